@@ -0,0 +1,1393 @@
+/*
+     File: assembler.c 
+ Abstract: Page assembler for sample CUPS printer driver.
+  Version: 4.0 
+  
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple 
+ Inc. ("Apple") in consideration of your agreement to the following 
+ terms, and your use, installation, modification or redistribution of 
+ this Apple software constitutes acceptance of these terms.  If you do 
+ not agree with these terms, please do not use, install, modify or 
+ redistribute this Apple software. 
+  
+ In consideration of your agreement to abide by the following terms, and 
+ subject to these terms, Apple grants you a personal, non-exclusive 
+ license, under Apple's copyrights in this original Apple software (the 
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple 
+ Software, with or without modifications, in source and/or binary forms; 
+ provided that if you redistribute the Apple Software in its entirety and 
+ without modifications, you must retain this notice and the following 
+ text and disclaimers in all such redistributions of the Apple Software. 
+ Neither the name, trademarks, service marks or logos of Apple Inc. may 
+ be used to endorse or promote products derived from the Apple Software 
+ without specific prior written permission from Apple.  Except as 
+ expressly stated in this notice, no other rights or licenses, express or 
+ implied, are granted by Apple herein, including but not limited to any 
+ patent rights that may be infringed by your derivative works or by other 
+ works in which the Apple Software may be incorporated. 
+  
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE 
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION 
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS 
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND 
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS. 
+  
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL 
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, 
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED 
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), 
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE 
+ POSSIBILITY OF SUCH DAMAGE. 
+  
+ Copyright (C) 2011 Apple Inc. All Rights Reserved. 
+  
+ */  
+
+/*
+ * Include necessary headers...
+ */
+
+#include <ApplicationServices/ApplicationServices.h>
+#include <CoreFoundation/CoreFoundation.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "sample.h"
+#include "assembler.h"
+#include "codec.h"
+#include "counters.h"
+#include "ink.h"
+#include "metrics.h"
+#include "trace.h"
+
+
+/*
+ * Constants...
+ */
+
+#define STAGE_DECODE	0		/* Counters for decode_lines() */
+#define STAGE_INK	1		/* Counters for update_ink_levels() */
+#define STAGE_MAX	2		/* Number of counted stages */
+
+
+/*
+ * Local types...
+ */
+
+typedef struct
+{
+  CGRect	box;			/* Box for page size */
+  unsigned	width,			/* Width of page image */
+		height,			/* Height of page image */
+		depth;			/* Depth of page image */
+  int		resolution;		/* Resolution of page image */
+  unsigned char	*data;			/* Page image or NULL */
+  size_t	length;			/* Bytes of data, less than the image if encoded */
+  int		ink[4];			/* CMYK "ink" used by the page */
+} stored_page_t;
+
+struct assembler_s
+{
+  char		printer[256],		/* Printer name */
+		basename[1024];		/* Base filename */
+  int		metrics;		/* Record page metrics? */
+  assembler_status_cb_t status_cb;	/* Status callback */
+  void		*status_data;		/* Status callback data */
+  int		document,		/* Current document number */
+		pages;			/* Number of pages drawn */
+  unsigned	copies;			/* Number of copies */
+  int		collate;		/* Collate copies? */
+  stored_page_t	*stored;		/* Pages kept for collated copies */
+  int		num_stored,		/* Number of pages kept */
+		alloc_stored;		/* Allocated pages */
+  CGContextRef	context;		/* PDF context */
+  uint64_t	page_start;		/* Start time of page */
+  CGRect	page_box;		/* Box for page size */
+  unsigned	raster_width,		/* Width of page image */
+		raster_height,		/* Height of page image */
+		raster_depth,		/* Depth of page image - 1 (grayscale), 3 (RGB), or 4 (CMYK) */
+		raster_bits,		/* Bits per sample sent - 1, 2, or 8 */
+		raster_size;		/* Total size of page image */
+  int		resolution;		/* Computed resolution */
+  unsigned char	*raster_data,		/* Page buffer */
+		*raster_ptr,		/* Pointer into page buffer */
+		*raster_end,		/* Pointer to end of page buffer */
+		*seed_line;		/* Previous line for delta-row data */
+  size_t	line_bytes,		/* Number of bytes per line */
+		data_bytes;		/* Number of bytes per line sent */
+  int		cmyk[4],		/* CMYK "ink" levels */
+		page_cmyk[4];		/* CMYK "ink" levels at start of page */
+};
+
+
+/*
+ * Local globals...
+ */
+
+static counter_stage_t	stages[STAGE_MAX] =
+{					/* Counters for each raster kernel */
+  COUNTER_STAGE("decode"),
+  COUNTER_STAGE("ink")
+};
+
+
+/*
+ * Local functions...
+ */
+
+static CGImageRef create_image(unsigned char *data, unsigned width,
+		             unsigned height, unsigned depth);
+static unsigned	decode_lines(int codec, const unsigned char *src,
+		             size_t srcsize, unsigned lines, int prefix,
+			     unsigned char *seed, size_t data_bytes,
+			     unsigned bits, size_t line_bytes,
+			     unsigned char *ptr, unsigned char *end);
+static void	expand_line(unsigned char *dst, const unsigned char *src,
+		            size_t samples, unsigned bits);
+static void	free_data(void *info, const void *data, size_t size);
+static int	out_of_ink(assembler_t *a, const int ink[4]);
+static void	print_copies(assembler_t *a);
+static void	put_halftoned(assembler_t *a, const unsigned char *line,
+		              size_t bytes);
+static int	sink_begin_document(void *data, const char *author,
+		                    const char *title);
+static int	sink_begin_page(void *data, unsigned x, unsigned y,
+		                unsigned width, unsigned height);
+static int	sink_begin_raster(void *data, unsigned width,
+		                  unsigned height, unsigned depth);
+static int	sink_end_document(void *data);
+static int	sink_end_page(void *data);
+static int	sink_get_levels(void *data);
+static int	sink_maintain(void *data, protocol_command_t command,
+		              const char *colors);
+static int	sink_put_encoded(void *data, int y, unsigned count,
+		                 int codec, const unsigned char *buffer,
+				 size_t bytes);
+static int	sink_put_lines(void *data, int y, unsigned count,
+		               const unsigned char * const *lines,
+			       size_t bytes);
+static int	sink_put_span(void *data, unsigned x,
+		              const unsigned char *buffer, size_t bytes);
+static int	sink_set_copies(void *data, unsigned copies, int collate);
+static int	sink_set_halftone(void *data, unsigned bits);
+static int	sink_skip_lines(void *data, unsigned count);
+static int	store_page(assembler_t *a, const int ink[4]);
+static void	use_ink(assembler_t *a, unsigned char *data, unsigned width,
+		        unsigned height, unsigned depth, int resolution,
+		        const int ink[4]);
+static void	update_ink_levels(int cmyk[4], unsigned char *line, int bytes,
+		                  int depth, int resolution);
+
+
+/*
+ * 'AssemblerCreate()' - Create a page assembler for a job.
+ */
+
+assembler_t *				/* O - Page assembler or NULL on error */
+AssemblerCreate(const char *printer,	/* I - Printer name */
+                const char *job,	/* I - Job ID */
+		const char *title,	/* I - Job title */
+		int        metrics)	/* I - Record page metrics? */
+{
+  assembler_t	*a;			/* Page assembler */
+  char		*baseptr,		/* Pointer into base filename */
+		dirname[1024];		/* Directory for files */
+
+
+  if ((a = calloc(1, sizeof(assembler_t))) == NULL)
+    return (NULL);
+
+  snprintf(a->printer, sizeof(a->printer), "%s", printer ? printer : "");
+  a->metrics    = metrics;
+  a->resolution = 100;
+  a->copies     = 1;
+
+ /*
+  * Prepare base output filename using job ID and title...
+  */
+
+  snprintf(a->basename, sizeof(a->basename), "%s - %s", job, title);
+  for (baseptr = a->basename; *baseptr; baseptr ++)
+    if ((!(*baseptr & 0x80) && *baseptr < ' ') || *baseptr == '/' ||
+        *baseptr == 0x7f)
+      *baseptr = '_';
+
+ /*
+  * Prepare a directory to hold the files...
+  */
+
+  snprintf(dirname, sizeof(dirname), "/Library/Caches/%s", a->printer);
+  mkdir(dirname, 0755);
+  chmod(dirname, 0755);
+
+  InkLoad(a->cmyk);
+
+  return (a);
+}
+
+
+/*
+ * 'AssemblerDelete()' - Finish the last document and free a page assembler.
+ */
+
+void
+AssemblerDelete(assembler_t *a)		/* I - Page assembler */
+{
+  if (!a)
+    return;
+
+  print_copies(a);
+
+  if (a->context)
+  {
+    CGPDFContextClose(a->context);
+    CGContextRelease(a->context);
+  }
+
+  InkSave(a->cmyk);
+
+  CountersReport(stages, STAGE_MAX, 0);
+
+  free(a->raster_data);
+  free(a->seed_line);
+  free(a);
+}
+
+
+/*
+ * 'AssemblerSink()' - Make a sink that sends commands to a page assembler.
+ */
+
+void
+AssemblerSink(assembler_t     *a,	/* I - Page assembler */
+              protocol_sink_t *sink)	/* O - Sink */
+{
+  sink->data           = a;
+  sink->begin_document = sink_begin_document;
+  sink->set_copies     = sink_set_copies;
+  sink->begin_page     = sink_begin_page;
+  sink->begin_raster   = sink_begin_raster;
+  sink->set_halftone   = sink_set_halftone;
+  sink->put_lines      = sink_put_lines;
+  sink->put_encoded    = sink_put_encoded;
+  sink->put_span       = sink_put_span;
+  sink->skip_lines     = sink_skip_lines;
+  sink->get_levels     = sink_get_levels;
+  sink->maintain       = sink_maintain;
+  sink->end_page       = sink_end_page;
+  sink->end_document   = sink_end_document;
+}
+
+
+/*
+ * 'AssemblerStatus()' - Set the callback for status (ink levels).
+ *
+ * sampletopdf sends the status over the back-channel; the fused filter
+ * reads it directly.
+ */
+
+void
+AssemblerStatus(
+    assembler_t           *a,		/* I - Page assembler */
+    assembler_status_cb_t cb,		/* I - Status callback */
+    void                  *data)	/* I - Callback data */
+{
+  a->status_cb   = cb;
+  a->status_data = data;
+}
+
+
+/*
+ * 'create_image()' - Make an image from a page buffer.
+ *
+ * The image owns the page buffer, which is freed when CG is done with it.
+ */
+
+static CGImageRef			/* O - Page image */
+create_image(unsigned char *data,	/* I - Page buffer */
+             unsigned      width,	/* I - Width in pixels */
+	     unsigned      height,	/* I - Height in lines */
+	     unsigned      depth)	/* I - Samples per pixel */
+{
+  CFStringRef colorSpaceName = NULL;
+  const CGFloat *decode = NULL;
+  static const CGFloat inverted[8] = { 1, 0, 1, 0, 1, 0, 1, 0 };
+					/* Flip CMYK samples, which are 255 for no ink */
+
+  if (depth == 1)
+  {
+    // kCGColorSpaceGenericGrayGamma2_2 doesn't exist in all versions of Mac OS X
+    if (&kCGColorSpaceGenericGrayGamma2_2 != NULL)
+      colorSpaceName = kCGColorSpaceGenericGrayGamma2_2;
+    else
+      colorSpaceName = kCGColorSpaceGenericGray;
+  }
+  else if (depth == 4)
+  {
+    colorSpaceName = kCGColorSpaceGenericCMYK;
+    decode         = inverted;
+  }
+  else
+  {
+    // kCGColorSpaceSRGB doesn't exist in all versions of Mac OS X
+    if (&kCGColorSpaceSRGB != NULL)
+      colorSpaceName = kCGColorSpaceSRGB;
+    else
+      colorSpaceName = kCGColorSpaceGenericRGB;
+  }
+
+  CGColorSpaceRef colorspace = CGColorSpaceCreateWithName(colorSpaceName);
+  CGDataProviderRef provider = CGDataProviderCreateWithData(NULL, data, width * height * depth, free_data);
+  CGImageRef image = CGImageCreate(width, height, 8, depth * 8, width * depth, colorspace, kCGImageAlphaNone, provider, decode, false, kCGRenderingIntentDefault);
+
+  CGDataProviderRelease(provider);
+  CGColorSpaceRelease(colorspace);
+
+  return (image);
+}
+
+
+/*
+ * 'decode_lines()' - Decode lines of compressed raster data.
+ *
+ * Each line is decoded into the seed line, which then holds the previous
+ * line for any delta-row data that follows, and copied to the page buffer,
+ * expanding halftoned data to 8 bits.  Lines past the end of the page buffer
+ * are decoded but not stored.
+ */
+
+static unsigned				/* O - Number of lines decoded */
+decode_lines(int                 codec,	/* I  - Raster data encoding */
+             const unsigned char *src,	/* I  - Encoded data */
+	     size_t              srcsize,
+					/* I  - Bytes of encoded data */
+	     unsigned            lines,	/* I  - Number of lines */
+	     int                 prefix,/* I  - Is each line preceded by its length? */
+	     unsigned char       *seed,	/* IO - Seed line */
+	     size_t              data_bytes,
+					/* I  - Bytes per decoded line */
+	     unsigned            bits,	/* I  - Bits per sample */
+	     size_t              line_bytes,
+					/* I  - Bytes per line in page buffer */
+	     unsigned char       *ptr,	/* I  - Pointer into page buffer */
+	     unsigned char       *end)	/* I  - Pointer to end of page buffer */
+{
+  unsigned	i;			/* Looping var */
+  size_t	length;			/* Length of encoded line */
+  ssize_t	bytes;			/* Length of decoded line */
+  counter_sample_t sample;		/* Counter sample */
+  TRACE_SCOPE("decode");
+
+
+  CountersBegin(&sample);
+
+  for (i = 0; i < lines; i ++, ptr += line_bytes)
+  {
+    if (!prefix)
+      length = srcsize;
+    else if (srcsize < 4)
+      break;
+    else
+    {
+      length  = ((size_t)src[0] << 24) | ((size_t)src[1] << 16) |
+                ((size_t)src[2] << 8) | src[3];
+      src     += 4;
+      srcsize -= 4;
+    }
+
+    if (length > srcsize)
+      break;
+
+    if (codec == CODEC_DELTA)
+      bytes = DeltaRowDecode(seed, data_bytes, src, length);
+    else if (codec == CODEC_PACKBITS)
+      bytes = PackBitsDecode(seed, data_bytes, src, length);
+    else
+      bytes = -1;
+
+    if (bytes != (ssize_t)data_bytes)
+      break;
+
+    if ((ptr + line_bytes) <= end)
+    {
+      if (bits < 8)
+        expand_line(ptr, seed, line_bytes, bits);
+      else
+        memcpy(ptr, seed, line_bytes);
+    }
+
+    src     += length;
+    srcsize -= length;
+  }
+
+  CountersEnd(stages + STAGE_DECODE, &sample);
+
+  return (i);
+}
+
+
+/*
+ * 'expand_line()' - Expand a line of halftoned data to 8 bits per sample.
+ */
+
+static void
+expand_line(unsigned char       *dst,	/* O - 8-bit samples */
+            const unsigned char *src,	/* I - Packed samples */
+	    size_t              samples,/* I - Number of samples */
+	    unsigned            bits)	/* I - Bits per sample (1 or 2) */
+{
+  static unsigned char	table[2][256][8];
+					/* Samples for each packed byte */
+  static int		table_ready = 0;/* Has the table been filled in? */
+  unsigned		i, j,		/* Looping vars */
+			per_byte = 8 / bits;
+					/* Samples per packed byte */
+
+
+  if (!table_ready)
+  {
+    for (i = 0; i < 256; i ++)
+      for (j = 0; j < 8; j ++)
+      {
+        table[0][i][j] = (i & (0x80 >> j)) ? 255 : 0;
+        table[1][i][j] = (unsigned char)(((i >> (6 - 2 * (j & 3))) & 3) * 85);
+      }
+
+    table_ready = 1;
+  }
+
+  for (; samples >= per_byte; samples -= per_byte, dst += per_byte)
+    memcpy(dst, table[bits - 1][*src++], per_byte);
+
+  if (samples > 0)
+    memcpy(dst, table[bits - 1][*src], samples);
+}
+
+
+/*
+ * 'free_data()' - Free bitmap data when CG is done using it.
+ */
+
+static void
+free_data(void       *info,		/* I - Context pointer (unused) */
+          const void *data,		/* I - Pointer to data */
+	  size_t     size)		/* I - Size of data buffer (unused) */
+{
+  (void)info;
+  (void)size;
+
+  free((void *)data);
+}
+
+
+/*
+ * 'out_of_ink()' - See if a color runs out during another copy of a page.
+ */
+
+static int				/* O - 1 if a color runs out, 0 otherwise */
+out_of_ink(assembler_t *a,		/* I - Page assembler */
+           const int   ink[4])		/* I - Ink used by page */
+{
+  int	i;				/* Looping var */
+
+
+  for (i = 0; i < 4; i ++)
+    if (a->cmyk[i] <= ink[i])
+      return (1);
+
+  return (0);
+}
+
+
+/*
+ * 'print_copies()' - Print the extra copies of a collated document.
+ *
+ * Each kept page is decoded into a new page buffer for each copy, and the
+ * ink it used is used again, removing any colors that run out.  The kept
+ * pages are then freed.
+ */
+
+static void
+print_copies(assembler_t *a)		/* I - Page assembler */
+{
+  stored_page_t	*page;			/* Current page */
+  unsigned char	*buffer;		/* Page buffer */
+  size_t	size;			/* Size of page buffer */
+  CGImageRef	image;			/* Page image */
+  unsigned	copy;			/* Current copy */
+  int		i;			/* Looping var */
+
+
+  if (!a->num_stored)
+    return;
+
+  if (a->context && a->copies > 1)
+  {
+    TRACE_SCOPE("copies");
+
+    fprintf(stderr, "DEBUG: Printing %u more copies of %d pages...\n",
+            a->copies - 1, a->num_stored);
+
+    for (copy = 1; copy < a->copies; copy ++)
+    {
+      for (i = a->num_stored, page = a->stored; i > 0; i --, page ++)
+      {
+        CGContextBeginPage(a->context, &page->box);
+
+        size = (size_t)page->width * page->height * page->depth;
+
+        if (page->data && (buffer = malloc(size)) != NULL)
+        {
+          if (page->length == size)
+	    memcpy(buffer, page->data, size);
+	  else if (PackBitsDecode(buffer, size, page->data, page->length) != (ssize_t)size)
+	  {
+	    fputs("DEBUG: Bad kept page.\n", stderr);
+	    free(buffer);
+	    buffer = NULL;
+	  }
+
+          use_ink(a, buffer, page->width, page->height, page->depth,
+                  page->resolution, page->ink);
+
+	  if (buffer && (image = create_image(buffer, page->width, page->height, page->depth)) != NULL)
+	  {
+	    CGContextDrawImage(a->context, page->box, image);
+	    CGImageRelease(image);
+	  }
+        }
+
+        else
+          use_ink(a, NULL, 0, 0, 0, 0, page->ink);
+
+        CGPDFContextEndPage(a->context);
+      }
+    }
+  }
+
+  for (i = a->num_stored, page = a->stored; i > 0; i --, page ++)
+    free(page->data);
+
+  free(a->stored);
+
+  a->stored       = NULL;
+  a->num_stored   = 0;
+  a->alloc_stored = 0;
+}
+
+
+/*
+ * 'put_halftoned()' - Put a line of halftoned data on the page.
+ *
+ * The line is copied to the seed line and then expanded to 8 bits in the
+ * page.
+ */
+
+static void
+put_halftoned(assembler_t         *a,	/* I - Page assembler */
+              const unsigned char *line,/* I - Packed samples */
+	      size_t              bytes)/* I - Bytes in line */
+{
+  if (bytes > a->data_bytes)
+    bytes = a->data_bytes;
+
+  memcpy(a->seed_line, line, bytes);
+
+  if ((a->raster_ptr + a->line_bytes) <= a->raster_end)
+  {
+    expand_line(a->raster_ptr, a->seed_line, a->line_bytes, a->raster_bits);
+    update_ink_levels(a->cmyk, a->raster_ptr, a->line_bytes, a->raster_depth,
+                      a->resolution);
+    a->raster_ptr += a->line_bytes;
+  }
+}
+
+
+/*
+ * 'sink_begin_document()' - Start a new PDF file.
+ */
+
+static int				/* O - Always 1 */
+sink_begin_document(
+    void       *data,			/* I - Page assembler */
+    const char *author,			/* I - Author (unused) */
+    const char *title)			/* I - Title (unused) */
+{
+  assembler_t	*a = (assembler_t *)data;
+					/* Page assembler */
+  char		filename[1024];		/* Actual filename */
+  CFStringRef	cf_filename;		/* CoreFoundation filename */
+  CFURLRef	cf_fileurl;		/* CoreFoundation file URL */
+
+
+  (void)author;
+  (void)title;
+
+  print_copies(a);
+
+  if (a->context)
+  {
+    CGContextRelease(a->context);
+    a->context = NULL;
+  }
+
+  a->copies  = 1;
+  a->collate = 0;
+
+  a->document ++;
+  if (snprintf(filename, sizeof(filename), "/Library/Caches/%s/%s%d.pdf", a->printer, a->basename, a->document) >= (int)sizeof(filename))
+  {
+    fputs("DEBUG: Document filename is too long.\n", stderr);
+    cf_filename = NULL;
+  }
+  else
+    cf_filename = CFStringCreateWithCString(kCFAllocatorDefault, filename, kCFStringEncodingUTF8);
+
+  if (cf_filename)
+  {
+    cf_fileurl = CFURLCreateWithFileSystemPath(kCFAllocatorDefault, cf_filename, kCFURLPOSIXPathStyle, false);
+
+    if (cf_fileurl)
+    {
+      a->context = CGPDFContextCreateWithURL(cf_fileurl, NULL, NULL);
+      CFRelease(cf_fileurl);
+    }
+
+    CFRelease(cf_filename);
+
+    chmod(filename, 0644);
+    fprintf(stderr, "DEBUG: Writing \"%s\"...\n", filename);
+  }
+
+  return (1);
+}
+
+
+/*
+ * 'sink_begin_page()' - Start a page.
+ */
+
+static int				/* O - Always 1 */
+sink_begin_page(void     *data,		/* I - Page assembler */
+                unsigned x,		/* I - Left margin in points */
+		unsigned y,		/* I - Bottom margin in points */
+		unsigned width,		/* I - Page width in points */
+		unsigned height)	/* I - Page length in points */
+{
+  assembler_t	*a = (assembler_t *)data;
+					/* Page assembler */
+
+
+  if (!a->context)
+    return (1);
+
+  a->page_box.origin.x    = x;
+  a->page_box.origin.y    = y;
+  a->page_box.size.width  = width;
+  a->page_box.size.height = height;
+
+  fprintf(stderr, "DEBUG: Starting page - [%g %g %g %g]...\n",
+	  a->page_box.origin.x, a->page_box.origin.y,
+	  a->page_box.size.width, a->page_box.size.height);
+  CGContextBeginPage(a->context, &a->page_box);
+
+  a->page_start = MetricsNow();
+
+  memcpy(a->page_cmyk, a->cmyk, sizeof(a->page_cmyk));
+
+  return (1);
+}
+
+
+/*
+ * 'sink_begin_raster()' - Allocate the page image.
+ */
+
+static int				/* O - Always 1 */
+sink_begin_raster(void     *data,	/* I - Page assembler */
+                  unsigned width,	/* I - Width in pixels */
+		  unsigned height,	/* I - Height in lines */
+		  unsigned depth)	/* I - Samples per pixel */
+{
+  assembler_t	*a = (assembler_t *)data;
+					/* Page assembler */
+
+
+  if (a->raster_data || a->page_box.size.width <= 0.0 ||
+      a->page_box.size.height <= 0.0)
+    return (1);
+
+  if ((depth != 1 && depth != 3 && depth != 4) ||
+      width == 0 || width > 3600 || height == 0 || height > 5400)
+    return (1);
+
+ /*
+  * Allocate memory for up to 12x18" page at 300 DPI.
+  */
+
+  a->raster_width  = width;
+  a->raster_height = height;
+  a->raster_depth  = depth;
+  a->raster_size   = width * height * depth;
+  a->raster_data   = malloc(a->raster_size);
+  a->raster_ptr    = a->raster_data;
+  a->raster_end    = a->raster_data + a->raster_size;
+  a->line_bytes    = width * depth;
+  a->data_bytes    = a->line_bytes;
+  a->raster_bits   = 8;
+  a->resolution    = (int)(width * 72.0 / a->page_box.size.width);
+
+  if (!a->raster_data)
+    return (1);
+
+ /*
+  * Clear the page and the seed line for delta-row data to white...
+  */
+
+  memset(a->raster_data, 255, a->raster_size);
+
+  free(a->seed_line);
+
+  if ((a->seed_line = malloc(a->line_bytes)) != NULL)
+    memset(a->seed_line, 255, a->line_bytes);
+  else
+  {
+    free(a->raster_data);
+    a->raster_data = NULL;
+    return (1);
+  }
+
+  return (1);
+}
+
+
+/*
+ * 'sink_end_document()' - Print any collated copies and finish a PDF file.
+ */
+
+static int				/* O - Always 1 */
+sink_end_document(void *data)		/* I - Page assembler */
+{
+  assembler_t	*a = (assembler_t *)data;
+					/* Page assembler */
+
+
+  print_copies(a);
+
+  if (a->context)
+  {
+    CGContextRelease(a->context);
+    a->context = NULL;
+  }
+
+  return (1);
+}
+
+
+/*
+ * 'sink_end_page()' - Draw the page image and finish the page.
+ *
+ * Uncollated copies are drawn from the same image right after the page,
+ * until a color runs out and the rest are drawn without it.  For collated
+ * copies the page is kept until the end of the document.  If the page can't
+ * be kept, the rest of the document is printed uncollated.
+ */
+
+static int				/* O - Always 1 */
+sink_end_page(void *data)		/* I - Page assembler */
+{
+  assembler_t	*a = (assembler_t *)data;
+					/* Page assembler */
+  CGImageRef	image = NULL;		/* Page image */
+  unsigned char	*pixels = a->raster_data,
+					/* Pixels in page image */
+		*buffer;		/* Pixels in copy */
+  int		ink[4],			/* Ink used by page */
+		collate,		/* Keep page for collated copies? */
+		i;			/* Looping var */
+  unsigned	copy;			/* Current copy */
+  TRACE_SCOPE("draw");
+
+
+  if (!a->context)
+    return (1);
+
+  for (i = 0; i < 4; i ++)
+    ink[i] = a->page_cmyk[i] - a->cmyk[i];
+
+  collate = a->copies > 1 && a->collate;
+
+  if (collate && !store_page(a, ink))
+  {
+    fprintf(stderr, "WARNING: Unable to keep page %d for collated copies, "
+                    "printing the rest of the document uncollated.\n",
+            a->pages + 1);
+
+    collate = a->collate = 0;
+  }
+
+  if (a->raster_data)
+  {
+    image = create_image(a->raster_data, a->raster_width, a->raster_height,
+                         a->raster_depth);
+
+    CGContextDrawImage(a->context, a->page_box, image);
+
+    fputs("DEBUG: Drawing image on page...\n", stderr);
+
+   /*
+    * The image owns the page buffer now, so start the next page with a new
+    * one...
+    */
+
+    a->raster_data = NULL;
+
+    if (a->metrics)
+      MetricsAdd(METRIC_LINES, a->raster_height);
+  }
+
+  fputs("DEBUG: Ending page...\n", stderr);
+
+  CGPDFContextEndPage(a->context);
+
+  for (copy = 1; !collate && copy < a->copies; copy ++)
+  {
+    if (image && out_of_ink(a, ink) &&
+        (buffer = malloc(a->raster_size)) != NULL)
+    {
+     /*
+      * Draw this copy and the ones after it from a new image without the
+      * colors that run out...
+      */
+
+      memcpy(buffer, pixels, a->raster_size);
+      use_ink(a, buffer, a->raster_width, a->raster_height, a->raster_depth,
+              a->resolution, ink);
+
+      CGImageRelease(image);
+      image = create_image(buffer, a->raster_width, a->raster_height,
+                           a->raster_depth);
+      pixels = buffer;
+    }
+    else
+      use_ink(a, NULL, 0, 0, 0, 0, ink);
+
+    CGContextBeginPage(a->context, &a->page_box);
+
+    if (image)
+      CGContextDrawImage(a->context, a->page_box, image);
+
+    CGPDFContextEndPage(a->context);
+  }
+
+  if (image)
+    CGImageRelease(image);
+
+ /*
+  * The fused filter records the page itself, so only the stages that are
+  * ours alone are added then...
+  */
+
+  if (a->metrics)
+  {
+    MetricsAdd(METRIC_PAGES, 1);
+    MetricsTime(METRIC_TIME_PAGE, MetricsNow() - a->page_start);
+  }
+
+  MetricsTime(METRIC_TIME_DECODE, stages[STAGE_DECODE].page.nsecs);
+  MetricsTime(METRIC_TIME_INK, stages[STAGE_INK].page.nsecs);
+
+  CountersReport(stages, STAGE_MAX, ++ a->pages);
+
+  return (1);
+}
+
+
+/*
+ * 'sink_get_levels()' - Report the ink levels.
+ */
+
+static int				/* O - Always 1 */
+sink_get_levels(void *data)		/* I - Page assembler */
+{
+  assembler_t	*a = (assembler_t *)data;
+					/* Page assembler */
+  char		levels[255];		/* Ink levels */
+
+
+  snprintf(levels, sizeof(levels), "IL%d,%d,%d,%d\n", a->cmyk[0] / 10000, a->cmyk[1] / 10000, a->cmyk[2] / 10000, a->cmyk[3] / 10000);
+
+  if (a->status_cb)
+    (a->status_cb)(a->status_data, levels);
+
+  return (1);
+}
+
+
+/*
+ * 'sink_maintain()' - "Change" ink or clean the print head.
+ */
+
+static int				/* O - Always 1 */
+sink_maintain(
+    void               *data,		/* I - Page assembler */
+    protocol_command_t command,		/* I - PROTOCOL_CHANGEINK or PROTOCOL_CLEAN */
+    const char         *colors)		/* I - Colors (unused) */
+{
+  assembler_t	*a = (assembler_t *)data;
+					/* Page assembler */
+
+
+  (void)colors;
+
+  if (command == PROTOCOL_CHANGEINK)
+    a->cmyk[0] = a->cmyk[1] = a->cmyk[2] = a->cmyk[3] = INK_FULL;
+
+  return (1);
+}
+
+
+/*
+ * 'sink_put_encoded()' - Put compressed lines on the page.
+ *
+ * A line (y < 0) is decoded into the seed line and then copied to the page.
+ * A band has each line preceded by its length.
+ */
+
+static int				/* O - Always 1 */
+sink_put_encoded(
+    void                *data,		/* I - Page assembler */
+    int                 y,		/* I - First line or -1 for the next line */
+    unsigned            count,		/* I - Number of lines */
+    int                 codec,		/* I - Encoding */
+    const unsigned char *buffer,	/* I - Encoded data */
+    size_t              bytes)		/* I - Bytes of encoded data */
+{
+  assembler_t	*a = (assembler_t *)data;
+					/* Page assembler */
+  unsigned	decoded,		/* Number of lines decoded */
+		i;			/* Looping var */
+
+
+  if (!a->raster_data)
+    return (1);
+
+  if (y < 0)
+  {
+    if (bytes > 2 * a->line_bytes + 16)
+      bytes = 2 * a->line_bytes + 16;
+
+    if (decode_lines(codec, buffer, bytes, 1, 0, a->seed_line, a->data_bytes,
+                     a->raster_bits, a->line_bytes, a->raster_ptr,
+		     a->raster_end) != 1)
+    {
+      fprintf(stderr, "DEBUG: Bad %s line.\n", CodecName((codec_t)codec));
+      return (1);
+    }
+
+    if ((a->raster_ptr + a->line_bytes) <= a->raster_end)
+    {
+      update_ink_levels(a->cmyk, a->raster_ptr, a->line_bytes, a->raster_depth, a->resolution);
+      a->raster_ptr += a->line_bytes;
+    }
+
+    return (1);
+  }
+
+  if ((unsigned)y < a->raster_height)
+    a->raster_ptr = a->raster_data + y * a->line_bytes;
+  else
+    a->raster_ptr = a->raster_end;
+
+  if (count > a->raster_height)
+    count = a->raster_height;
+
+  if (bytes > count * (2 * a->line_bytes + 20))
+    bytes = count * (2 * a->line_bytes + 20);
+
+  decoded = decode_lines(codec, buffer, bytes, count, 1, a->seed_line,
+                         a->data_bytes, a->raster_bits, a->line_bytes,
+			 a->raster_ptr, a->raster_end);
+
+  if (decoded < count)
+    fprintf(stderr, "DEBUG: Bad %s data in band at line %u.\n",
+            CodecName((codec_t)codec), y + decoded);
+
+  for (i = decoded; i > 0 && (a->raster_ptr + a->line_bytes) <= a->raster_end; i --, a->raster_ptr += a->line_bytes)
+    update_ink_levels(a->cmyk, a->raster_ptr, a->line_bytes, a->raster_depth, a->resolution);
+
+  return (1);
+}
+
+
+/*
+ * 'sink_put_lines()' - Put uncompressed lines on the page.
+ *
+ * The lines are copied straight from the caller's buffers into the page
+ * buffer, so a filter in the same process hands its lines over without
+ * another copy.  Anything that doesn't fit is discarded.
+ */
+
+static int				/* O - Always 1 */
+sink_put_lines(
+    void                      *data,	/* I - Page assembler */
+    int                       y,	/* I - First line or -1 for the next line */
+    unsigned                  count,	/* I - Number of lines */
+    const unsigned char * const *lines,	/* I - Lines */
+    size_t                    bytes)	/* I - Bytes per line */
+{
+  assembler_t	*a = (assembler_t *)data;
+					/* Page assembler */
+  unsigned	i;			/* Looping var */
+  unsigned char	*start;			/* Start of lines in page buffer */
+  size_t	length;			/* Bytes to copy */
+
+
+  if (!a->raster_data)
+    return (1);
+
+  if (y >= 0)
+  {
+    if ((unsigned)y < a->raster_height)
+      a->raster_ptr = a->raster_data + y * a->line_bytes;
+    else
+      a->raster_ptr = a->raster_end;
+  }
+
+  if (a->raster_bits < 8)
+  {
+   /*
+    * Halftoned lines, which are expanded one at a time...
+    */
+
+    for (i = 0; i < count; i ++)
+      put_halftoned(a, lines[i], bytes);
+
+    return (1);
+  }
+
+  for (i = 0, start = a->raster_ptr; i < count; i ++)
+  {
+    if ((length = bytes) > (size_t)(a->raster_end - a->raster_ptr))
+      length = a->raster_end - a->raster_ptr;
+
+    memcpy(a->raster_ptr, lines[i], length);
+    a->raster_ptr += length;
+  }
+
+  length        = a->raster_ptr - start;
+  a->raster_ptr = start;
+
+ /*
+  * Keep a copy of the last line for any delta-row data that follows...
+  */
+
+  if (length >= a->line_bytes)
+    memcpy(a->seed_line, start + (length / a->line_bytes - 1) * a->line_bytes, a->line_bytes);
+
+ /*
+  * Update ink usage counters.  Normally you'd get this information
+  * from the printer itself, but since we are simulating the printer
+  * we also have to simulate the ink usage counters and the affect on
+  * the printed output.
+  */
+
+  for (; length >= a->line_bytes; length -= a->line_bytes, a->raster_ptr += a->line_bytes)
+    update_ink_levels(a->cmyk, a->raster_ptr, a->line_bytes, a->raster_depth, a->resolution);
+
+  if (length > 0)
+  {
+    update_ink_levels(a->cmyk, a->raster_ptr, length, a->raster_depth, a->resolution);
+    a->raster_ptr += length;
+  }
+
+  return (1);
+}
+
+
+/*
+ * 'sink_put_span()' - Put the non-white pixels of a line on the page.
+ */
+
+static int				/* O - Always 1 */
+sink_put_span(
+    void                *data,		/* I - Page assembler */
+    unsigned            x,		/* I - First pixel */
+    const unsigned char *buffer,	/* I - Pixels */
+    size_t              bytes)		/* I - Bytes of pixels */
+{
+  assembler_t	*a = (assembler_t *)data;
+					/* Page assembler */
+  unsigned char	*span_ptr,		/* Pointer to span in page buffer */
+		*span_end;		/* Pointer to end of line */
+
+
+  if (!a->raster_data)
+    return (1);
+
+  if (a->raster_bits < 8)
+  {
+   /*
+    * Halftoned spans start on a byte boundary in the packed line...
+    */
+
+    span_ptr = a->seed_line + a->data_bytes;
+
+    if (x < a->raster_width)
+      span_ptr = a->seed_line + (size_t)x * a->raster_depth * a->raster_bits / 8;
+
+    if (bytes > (size_t)(a->seed_line + a->data_bytes - span_ptr))
+      bytes = a->seed_line + a->data_bytes - span_ptr;
+
+    memset(a->seed_line, 255, a->data_bytes);
+    memcpy(span_ptr, buffer, bytes);
+
+    if ((a->raster_ptr + a->line_bytes) <= a->raster_end)
+    {
+      expand_line(a->raster_ptr, a->seed_line, a->line_bytes, a->raster_bits);
+      update_ink_levels(a->cmyk, a->raster_ptr, a->line_bytes, a->raster_depth, a->resolution);
+      a->raster_ptr += a->line_bytes;
+    }
+
+    return (1);
+  }
+
+  if ((span_end = a->raster_ptr + a->line_bytes) > a->raster_end)
+    span_end = a->raster_end;
+
+  if (x < a->raster_width)
+    span_ptr = a->raster_ptr + x * a->raster_depth;
+  else
+    span_ptr = span_end;
+
+  if (span_ptr > span_end)
+    span_ptr = span_end;
+
+  if (bytes > (size_t)(span_end - span_ptr))
+    bytes = span_end - span_ptr;
+
+  memcpy(span_ptr, buffer, bytes);
+
+  memset(a->seed_line, 255, a->line_bytes);
+  memcpy(a->seed_line + (span_ptr - a->raster_ptr), span_ptr, bytes);
+
+ /*
+  * White pixels use no ink, so only the span needs to be counted...
+  */
+
+  update_ink_levels(a->cmyk, span_ptr, bytes, a->raster_depth, a->resolution);
+
+  a->raster_ptr = span_end;
+
+  return (1);
+}
+
+
+/*
+ * 'sink_set_copies()' - Set the number of copies of each page.
+ *
+ * Any collated copies of the pages before are printed first.
+ */
+
+static int				/* O - Always 1 */
+sink_set_copies(void     *data,		/* I - Page assembler */
+                unsigned copies,	/* I - Number of copies */
+		int      collate)	/* I - Collate copies? */
+{
+  assembler_t	*a = (assembler_t *)data;
+					/* Page assembler */
+
+
+  print_copies(a);
+
+  a->copies  = copies > 0 ? copies : 1;
+  a->collate = collate;
+
+  fprintf(stderr, "DEBUG: Printing %u %s copies...\n", a->copies,
+          collate ? "collated" : "uncollated");
+
+  return (1);
+}
+
+
+/*
+ * 'sink_set_halftone()' - Set the bits per sample for halftoned data.
+ *
+ * Halftoned raster data has 1 or 2 bits per sample, packed most significant
+ * bits first.
+ */
+
+static int				/* O - Always 1 */
+sink_set_halftone(void     *data,	/* I - Page assembler */
+                  unsigned bits)	/* I - Bits per sample */
+{
+  assembler_t	*a = (assembler_t *)data;
+					/* Page assembler */
+
+
+  if (!a->raster_data || (bits != 1 && bits != 2))
+    return (1);
+
+  a->raster_bits = bits;
+  a->data_bytes  = (a->line_bytes * bits + 7) / 8;
+
+  memset(a->seed_line, 255, a->data_bytes);
+
+  return (1);
+}
+
+
+/*
+ * 'sink_skip_lines()' - Skip white lines, which are already white in the
+ *                       page buffer.
+ */
+
+static int				/* O - Always 1 */
+sink_skip_lines(void     *data,		/* I - Page assembler */
+                unsigned count)		/* I - Number of lines */
+{
+  assembler_t	*a = (assembler_t *)data;
+					/* Page assembler */
+
+
+  if (!a->raster_data)
+    return (1);
+
+  if (count < (size_t)(a->raster_end - a->raster_ptr) / a->line_bytes)
+    a->raster_ptr += count * a->line_bytes;
+  else
+    a->raster_ptr = a->raster_end;
+
+  memset(a->seed_line, 255, a->line_bytes);
+
+  return (1);
+}
+
+
+/*
+ * 'store_page()' - Keep the current page for collated copies.
+ *
+ * The page image is kept encoded with PackBits, which shrinks the mostly
+ * white pages of a typical document to a small fraction of their size.
+ * Images that PackBits can't make smaller, like photos, are kept as is.
+ */
+
+static int				/* O - 1 on success, 0 on failure */
+store_page(assembler_t *a,		/* I - Page assembler */
+           const int   ink[4])		/* I - Ink used by page */
+{
+  stored_page_t	*page;			/* Kept page */
+  ssize_t	length;			/* Length of encoded page */
+  unsigned char	*temp;			/* Shrunk encoding buffer */
+  TRACE_SCOPE("keep page");
+
+
+  if (a->num_stored >= a->alloc_stored)
+  {
+    if ((page = realloc(a->stored, (size_t)(a->alloc_stored + 16) * sizeof(stored_page_t))) == NULL)
+      return (0);
+
+    a->stored       = page;
+    a->alloc_stored += 16;
+  }
+
+  page = a->stored + a->num_stored;
+
+  memset(page, 0, sizeof(stored_page_t));
+  memcpy(page->ink, ink, sizeof(page->ink));
+
+  page->box = a->page_box;
+
+  if (a->raster_data)
+  {
+    if ((page->data = malloc(a->raster_size)) == NULL)
+      return (0);
+
+    if ((length = PackBitsEncode(page->data, a->raster_size - 1, a->raster_data, a->raster_size)) < 0)
+    {
+      memcpy(page->data, a->raster_data, a->raster_size);
+      length = a->raster_size;
+    }
+    else if ((temp = realloc(page->data, (size_t)length)) != NULL)
+      page->data = temp;
+
+    page->length = (size_t)length;
+    page->width  = a->raster_width;
+    page->height = a->raster_height;
+    page->depth  = a->raster_depth;
+    page->resolution = a->resolution;
+
+    fprintf(stderr, "DEBUG: Kept page as %u of %u bytes.\n",
+            (unsigned)page->length, a->raster_size);
+  }
+
+  a->num_stored ++;
+
+  return (1);
+}
+
+
+/*
+ * 'use_ink()' - Use the ink for another copy of a page.
+ *
+ * When a color runs out, the copy's pixels are run through the ink levels a
+ * line at a time like the page was, so the color is removed from the rest
+ * of the copy.  Otherwise the ink the page used is taken off the levels,
+ * which never go below 0.
+ */
+
+static void
+use_ink(assembler_t   *a,		/* I  - Page assembler */
+        unsigned char *data,		/* IO - Pixels in copy or NULL */
+        unsigned      width,		/* I  - Width in pixels */
+        unsigned      height,		/* I  - Height in lines */
+        unsigned      depth,		/* I  - Samples per pixel */
+        int           resolution,	/* I  - Resolution of copy */
+        const int     ink[4])		/* I  - Ink used by page */
+{
+  unsigned	y;			/* Current line */
+  int		i;			/* Looping var */
+
+
+  if (data && out_of_ink(a, ink))
+  {
+    for (y = 0; y < height; y ++, data += (size_t)width * depth)
+      update_ink_levels(a->cmyk, data, (int)(width * depth), (int)depth,
+                        resolution);
+    return;
+  }
+
+  for (i = 0; i < 4; i ++)
+  {
+    a->cmyk[i] -= ink[i];
+
+    if (a->cmyk[i] < 0)
+      a->cmyk[i] = 0;
+  }
+}
+
+
+/*
+ * 'update_ink_levels()' - Update the virtual CMYK ink levels based on a line
+ *                         from the page.
+ */
+
+static void
+update_ink_levels(
+    int           cmyk[4],		/* IO - CMYK levels */
+    unsigned char *line,		/* IO - Pixels on the current line */
+    int           bytes,		/* I  - Number of bytes */
+    int           depth,		/* I  - Bytes per pixel */
+    int           resolution)		/* I  - Output resolution */
+{
+  counter_sample_t sample;		/* Counter sample */
+  TRACE_SCOPE("ink");
+
+
+  CountersBegin(&sample);
+  InkUpdate(cmyk, line, bytes, depth, resolution);
+  CountersEnd(stages + STAGE_INK, &sample);
+}
@@ -0,0 +1,85 @@
+/*
+     File: assembler.h 
+ Abstract: Page assembler definitions for sample CUPS printer driver.
+  Version: 4.0 
+  
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple 
+ Inc. ("Apple") in consideration of your agreement to the following 
+ terms, and your use, installation, modification or redistribution of 
+ this Apple software constitutes acceptance of these terms.  If you do 
+ not agree with these terms, please do not use, install, modify or 
+ redistribute this Apple software. 
+  
+ In consideration of your agreement to abide by the following terms, and 
+ subject to these terms, Apple grants you a personal, non-exclusive 
+ license, under Apple's copyrights in this original Apple software (the 
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple 
+ Software, with or without modifications, in source and/or binary forms; 
+ provided that if you redistribute the Apple Software in its entirety and 
+ without modifications, you must retain this notice and the following 
+ text and disclaimers in all such redistributions of the Apple Software. 
+ Neither the name, trademarks, service marks or logos of Apple Inc. may 
+ be used to endorse or promote products derived from the Apple Software 
+ without specific prior written permission from Apple.  Except as 
+ expressly stated in this notice, no other rights or licenses, express or 
+ implied, are granted by Apple herein, including but not limited to any 
+ patent rights that may be infringed by your derivative works or by other 
+ works in which the Apple Software may be incorporated. 
+  
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE 
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION 
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS 
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND 
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS. 
+  
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL 
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, 
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED 
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), 
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE 
+ POSSIBILITY OF SUCH DAMAGE. 
+  
+ Copyright (C) 2011 Apple Inc. All Rights Reserved. 
+  
+ */  
+
+#ifndef _SAMPLE_ASSEMBLER_H_
+#  define _SAMPLE_ASSEMBLER_H_
+
+/*
+ * Include necessary headers...
+ */
+
+#  include "protocol.h"
+
+
+/*
+ * Page assembler...
+ *
+ * The page assembler is the sample printer itself: it takes commands through
+ * a sink, builds each page image, keeps the virtual ink levels, and writes
+ * each document to "/Library/Caches/<printer>/<job> - <title><n>.pdf".
+ * sampletopdf feeds it from the protocol stream, and the fused
+ * rastertosamplepdf filter calls it directly.  Like the printer, it ignores
+ * commands that don't fit the current page, so its sink never fails.
+ */
+
+typedef struct assembler_s assembler_t;
+typedef void (*assembler_status_cb_t)(void *data, const char *status);
+					/* Status (back-channel) callback */
+
+
+/*
+ * Prototypes...
+ */
+
+extern assembler_t	*AssemblerCreate(const char *printer, const char *job,
+			                 const char *title, int metrics);
+extern void		AssemblerDelete(assembler_t *a);
+extern void		AssemblerSink(assembler_t *a, protocol_sink_t *sink);
+extern void		AssemblerStatus(assembler_t *a, assembler_status_cb_t cb,
+			                void *data);
+
+#endif /* !_SAMPLE_ASSEMBLER_H_ */
@@ -0,0 +1,397 @@
+/*
+     File: codec.c 
+ Abstract: Raster data encodings for sample CUPS printer driver.
+  Version: 4.0 
+  
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple 
+ Inc. ("Apple") in consideration of your agreement to the following 
+ terms, and your use, installation, modification or redistribution of 
+ this Apple software constitutes acceptance of these terms.  If you do 
+ not agree with these terms, please do not use, install, modify or 
+ redistribute this Apple software. 
+  
+ In consideration of your agreement to abide by the following terms, and 
+ subject to these terms, Apple grants you a personal, non-exclusive 
+ license, under Apple's copyrights in this original Apple software (the 
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple 
+ Software, with or without modifications, in source and/or binary forms; 
+ provided that if you redistribute the Apple Software in its entirety and 
+ without modifications, you must retain this notice and the following 
+ text and disclaimers in all such redistributions of the Apple Software. 
+ Neither the name, trademarks, service marks or logos of Apple Inc. may 
+ be used to endorse or promote products derived from the Apple Software 
+ without specific prior written permission from Apple.  Except as 
+ expressly stated in this notice, no other rights or licenses, express or 
+ implied, are granted by Apple herein, including but not limited to any 
+ patent rights that may be infringed by your derivative works or by other 
+ works in which the Apple Software may be incorporated. 
+  
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE 
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION 
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS 
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND 
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS. 
+  
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL 
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, 
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED 
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), 
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE 
+ POSSIBILITY OF SUCH DAMAGE. 
+  
+ Copyright (C) 2011 Apple Inc. All Rights Reserved. 
+  
+ */  
+
+#include "codec.h"			/* Codec definitions */
+#include <stdint.h>
+#include <string.h>
+
+
+/*
+ * Local globals...
+ */
+
+static const char * const codec_names[] =
+{					/* Encoding names */
+  "raw",
+  "packbits",
+  "delta"
+};
+
+
+/*
+ * 'CodecName()' - Return the name of an encoding.
+ */
+
+const char *				/* O - Encoding name */
+CodecName(codec_t codec)		/* I - Encoding */
+{
+  if (codec < CODEC_RAW || codec > CODEC_DELTA)
+    return ("unknown");
+
+  return (codec_names[codec]);
+}
+
+
+/*
+ * 'CodecValue()' - Return the encoding with the given name.
+ */
+
+int					/* O - Encoding or -1 if unknown */
+CodecValue(const char *name)		/* I - Encoding name */
+{
+  int	i;				/* Looping var */
+
+
+  for (i = CODEC_RAW; i <= CODEC_DELTA; i ++)
+    if (!strcmp(name, codec_names[i]))
+      return (i);
+
+  return (-1);
+}
+
+
+/*
+ * 'DeltaRowDecode()' - Apply a delta-row encoded line to the seed line.
+ *
+ * On entry the destination buffer holds the seed line; the changed bytes are
+ * replaced in place.
+ */
+
+ssize_t					/* O - Bytes in line or -1 on error */
+DeltaRowDecode(unsigned char       *dst,/* IO - Seed line/decoded line */
+               size_t              dstsize,
+					/* I  - Bytes in line */
+               const unsigned char *src,/* I  - Encoded data */
+	       size_t              srcsize)
+					/* I  - Bytes of encoded data */
+{
+  const unsigned char	*srcend;	/* End of encoded data */
+  size_t		pos,		/* Current position in line */
+			offset,		/* Offset to next change */
+			count;		/* Number of changed bytes */
+  unsigned		extra;		/* Extra offset byte */
+
+
+  for (srcend = src + srcsize, pos = 0; src < srcend;)
+  {
+   /*
+    * Each command byte holds the number of replacement bytes minus 1 in the
+    * upper 3 bits and the offset from the end of the previous replacement in
+    * the lower 5 bits.  An offset of 31 continues in the following bytes
+    * until one of them is less than 255...
+    */
+
+    count  = (size_t)(*src >> 5) + 1;
+    offset = *src++ & 31;
+
+    if (offset == 31)
+    {
+      do
+      {
+        if (src >= srcend)
+	  return (-1);
+
+        extra  = *src++;
+	offset += extra;
+      }
+      while (extra == 255);
+    }
+
+    pos += offset;
+
+    if (pos > dstsize || count > (dstsize - pos) ||
+        count > (size_t)(srcend - src))
+      return (-1);
+
+    memcpy(dst + pos, src, count);
+
+    src += count;
+    pos += count;
+  }
+
+  return ((ssize_t)dstsize);
+}
+
+
+/*
+ * 'DeltaRowEncode()' - Encode the differences between a line and the seed
+ *                      line.
+ *
+ * Identical lines encode to 0 bytes.  Lines whose encoding does not fit in the
+ * destination buffer return -1 so the caller can use another encoding.
+ */
+
+ssize_t					/* O - Encoded bytes or -1 if too large */
+DeltaRowEncode(unsigned char       *dst,/* I - Destination buffer */
+               size_t              dstsize,
+					/* I - Size of destination buffer */
+	       const unsigned char *src,/* I - Line to encode */
+	       const unsigned char *seed,
+					/* I - Previous line */
+	       size_t              bytes)
+					/* I - Bytes in line */
+{
+  unsigned char	*dstptr,		/* Current position in output */
+		*dstend;		/* End of output */
+  size_t	i,			/* Current position in line */
+		start,			/* Start of changed bytes */
+		pos,			/* End of previous replacement */
+		offset,			/* Offset to changed bytes */
+		count;			/* Number of changed bytes */
+  uint64_t	a, b;			/* Words to compare */
+
+
+  for (dstptr = dst, dstend = dst + dstsize, i = 0, pos = 0; i < bytes;)
+  {
+   /*
+    * Skip unchanged bytes, a word at a time where possible...
+    */
+
+    while ((i + 8) <= bytes)
+    {
+      memcpy(&a, src + i, 8);
+      memcpy(&b, seed + i, 8);
+
+      if (a != b)
+        break;
+
+      i += 8;
+    }
+
+    while (i < bytes && src[i] == seed[i])
+      i ++;
+
+    if (i >= bytes)
+      break;
+
+   /*
+    * Collect up to 8 changed bytes...
+    */
+
+    for (start = i; i < bytes && (i - start) < 8 && src[i] != seed[i]; i ++);
+
+    count  = i - start;
+    offset = start - pos;
+    pos    = i;
+
+   /*
+    * Write the command byte, any extra offset bytes, and the new data...
+    */
+
+    if ((size_t)(dstend - dstptr) < (count + 2 + offset / 255))
+      return (-1);
+
+    if (offset < 31)
+      *dstptr++ = (unsigned char)(((count - 1) << 5) | offset);
+    else
+    {
+      *dstptr++ = (unsigned char)(((count - 1) << 5) | 31);
+
+      for (offset -= 31; offset >= 255; offset -= 255)
+        *dstptr++ = 255;
+
+      *dstptr++ = (unsigned char)offset;
+    }
+
+    memcpy(dstptr, src + start, count);
+    dstptr += count;
+  }
+
+  return (dstptr - dst);
+}
+
+
+/*
+ * 'PackBitsDecode()' - Decode PackBits data.
+ */
+
+ssize_t					/* O - Decoded bytes or -1 on error */
+PackBitsDecode(unsigned char       *dst,/* I - Destination buffer */
+               size_t              dstsize,
+					/* I - Size of destination buffer */
+               const unsigned char *src,/* I - Encoded data */
+	       size_t              srcsize)
+					/* I - Bytes of encoded data */
+{
+  unsigned char		*dstptr,	/* Current position in output */
+			*dstend;	/* End of output */
+  const unsigned char	*srcend;	/* End of encoded data */
+  size_t		count;		/* Length of run */
+
+
+  for (dstptr = dst, dstend = dst + dstsize, srcend = src + srcsize;
+       src < srcend;)
+  {
+    if (*src < 128)
+    {
+     /*
+      * 0 to 127 is followed by 1 to 128 literal bytes...
+      */
+
+      count = (size_t)*src++ + 1;
+
+      if (count > (size_t)(srcend - src) || count > (size_t)(dstend - dstptr))
+        return (-1);
+
+      memcpy(dstptr, src, count);
+      src += count;
+    }
+    else if (*src > 128)
+    {
+     /*
+      * 129 to 255 repeats the next byte 128 to 2 times...
+      */
+
+      count = 257 - (size_t)*src++;
+
+      if (src >= srcend || count > (size_t)(dstend - dstptr))
+        return (-1);
+
+      memset(dstptr, *src++, count);
+    }
+    else
+    {
+     /*
+      * 128 is a no-op...
+      */
+
+      src ++;
+      continue;
+    }
+
+    dstptr += count;
+  }
+
+  return (dstptr - dst);
+}
+
+
+/*
+ * 'PackBitsEncode()' - Encode data using PackBits.
+ *
+ * Runs of 3 or more bytes are encoded as repeats and everything else as
+ * literals.  Data whose encoding does not fit in the destination buffer
+ * returns -1 so the caller can use another encoding.
+ */
+
+ssize_t					/* O - Encoded bytes or -1 if too large */
+PackBitsEncode(unsigned char       *dst,/* I - Destination buffer */
+               size_t              dstsize,
+					/* I - Size of destination buffer */
+	       const unsigned char *src,/* I - Data to encode */
+	       size_t              bytes)
+					/* I - Bytes of data */
+{
+  unsigned char		*dstptr,	/* Current position in output */
+			*dstend;	/* End of output */
+  const unsigned char	*srcend,	/* End of input */
+			*start,		/* Start of run or literal */
+			*limit;		/* End of longest possible run */
+  size_t		count;		/* Length of run or literal */
+  uint64_t		pattern,	/* Run byte repeated in a word */
+			word;		/* Word to compare */
+
+
+  for (dstptr = dst, dstend = dst + dstsize, srcend = src + bytes;
+       src < srcend;)
+  {
+   /*
+    * Measure the run at the current position, a word at a time where
+    * possible...
+    */
+
+    start   = src ++;
+    limit   = (srcend - start) > 128 ? start + 128 : srcend;
+    pattern = *start * UINT64_C(0x0101010101010101);
+
+    while ((limit - src) >= 8)
+    {
+      memcpy(&word, src, 8);
+
+      if (word != pattern)
+        break;
+
+      src += 8;
+    }
+
+    while (src < limit && *src == *start)
+      src ++;
+
+    if ((count = (size_t)(src - start)) >= 3)
+    {
+     /*
+      * Repeated bytes...
+      */
+
+      if ((dstend - dstptr) < 2)
+        return (-1);
+
+      *dstptr++ = (unsigned char)(257 - count);
+      *dstptr++ = *start;
+      continue;
+    }
+
+   /*
+    * Literal bytes, up to the next run of 3 or more...
+    */
+
+    for (src = start; src < srcend && (src - start) < 128; src ++)
+      if ((srcend - src) >= 3 && src[0] == src[1] && src[1] == src[2])
+        break;
+
+    count = (size_t)(src - start);
+
+    if ((size_t)(dstend - dstptr) < (count + 1))
+      return (-1);
+
+    *dstptr++ = (unsigned char)(count - 1);
+    memcpy(dstptr, start, count);
+    dstptr += count;
+  }
+
+  return (dstptr - dst);
+}
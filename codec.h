@@ -0,0 +1,98 @@
+/*
+     File: codec.h 
+ Abstract: Raster data encoding definitions for sample CUPS printer driver.
+  Version: 4.0 
+  
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple 
+ Inc. ("Apple") in consideration of your agreement to the following 
+ terms, and your use, installation, modification or redistribution of 
+ this Apple software constitutes acceptance of these terms.  If you do 
+ not agree with these terms, please do not use, install, modify or 
+ redistribute this Apple software. 
+  
+ In consideration of your agreement to abide by the following terms, and 
+ subject to these terms, Apple grants you a personal, non-exclusive 
+ license, under Apple's copyrights in this original Apple software (the 
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple 
+ Software, with or without modifications, in source and/or binary forms; 
+ provided that if you redistribute the Apple Software in its entirety and 
+ without modifications, you must retain this notice and the following 
+ text and disclaimers in all such redistributions of the Apple Software. 
+ Neither the name, trademarks, service marks or logos of Apple Inc. may 
+ be used to endorse or promote products derived from the Apple Software 
+ without specific prior written permission from Apple.  Except as 
+ expressly stated in this notice, no other rights or licenses, express or 
+ implied, are granted by Apple herein, including but not limited to any 
+ patent rights that may be infringed by your derivative works or by other 
+ works in which the Apple Software may be incorporated. 
+  
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE 
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION 
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS 
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND 
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS. 
+  
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL 
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, 
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED 
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), 
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE 
+ POSSIBILITY OF SUCH DAMAGE. 
+  
+ Copyright (C) 2011 Apple Inc. All Rights Reserved. 
+  
+ */  
+
+#ifndef _SAMPLE_CODEC_H_
+#  define _SAMPLE_CODEC_H_
+
+/*
+ * Include necessary headers...
+ */
+
+#  include <stddef.h>
+#  include <sys/types.h>
+
+
+/*
+ * Raster data encodings...
+ *
+ * LINE and BAND commands may name an encoding after their byte count.  No
+ * encoding means "raw".  In a compressed BAND each line is preceded by its
+ * encoded length as a 4-byte big-endian number.
+ *
+ * "packbits" is the TIFF/Macintosh PackBits run-length encoding.
+ *
+ * "delta" is the PCL mode 3 delta-row encoding, which only sends the bytes
+ * that differ from the previous line (the "seed" line).  The seed line is
+ * white at the start of each page and is always the previous line on the
+ * page, regardless of how that line was sent.
+ */
+
+typedef enum
+{
+  CODEC_RAW,				/* Uncompressed */
+  CODEC_PACKBITS,			/* PackBits run-length encoding */
+  CODEC_DELTA				/* PCL mode 3 delta-row encoding */
+} codec_t;
+
+
+/*
+ * Prototypes...
+ */
+
+extern const char	*CodecName(codec_t codec);
+extern int		CodecValue(const char *name);
+extern ssize_t		DeltaRowDecode(unsigned char *dst, size_t dstsize,
+			               const unsigned char *src, size_t srcsize);
+extern ssize_t		DeltaRowEncode(unsigned char *dst, size_t dstsize,
+			               const unsigned char *src,
+				       const unsigned char *seed, size_t bytes);
+extern ssize_t		PackBitsDecode(unsigned char *dst, size_t dstsize,
+			               const unsigned char *src, size_t srcsize);
+extern ssize_t		PackBitsEncode(unsigned char *dst, size_t dstsize,
+			               const unsigned char *src, size_t bytes);
+
+#endif /* !_SAMPLE_CODEC_H_ */
@@ -0,0 +1,965 @@
+/*
+     File: color.c 
+ Abstract: Color separation engine for sample CUPS printer driver.
+  Version: 4.0 
+  
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple 
+ Inc. ("Apple") in consideration of your agreement to the following 
+ terms, and your use, installation, modification or redistribution of 
+ this Apple software constitutes acceptance of these terms.  If you do 
+ not agree with these terms, please do not use, install, modify or 
+ redistribute this Apple software. 
+  
+ In consideration of your agreement to abide by the following terms, and 
+ subject to these terms, Apple grants you a personal, non-exclusive 
+ license, under Apple's copyrights in this original Apple software (the 
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple 
+ Software, with or without modifications, in source and/or binary forms; 
+ provided that if you redistribute the Apple Software in its entirety and 
+ without modifications, you must retain this notice and the following 
+ text and disclaimers in all such redistributions of the Apple Software. 
+ Neither the name, trademarks, service marks or logos of Apple Inc. may 
+ be used to endorse or promote products derived from the Apple Software 
+ without specific prior written permission from Apple.  Except as 
+ expressly stated in this notice, no other rights or licenses, express or 
+ implied, are granted by Apple herein, including but not limited to any 
+ patent rights that may be infringed by your derivative works or by other 
+ works in which the Apple Software may be incorporated. 
+  
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE 
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION 
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS 
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND 
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS. 
+  
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL 
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, 
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED 
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), 
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE 
+ POSSIBILITY OF SUCH DAMAGE. 
+  
+ Copyright (C) 2011 Apple Inc. All Rights Reserved. 
+  
+ */  
+
+#include "color.h"			/* Color separation definitions */
+#include "sample.h"			/* Logging */
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+/*
+ * Media type parameters...
+ *
+ * Dot gain makes printed ink spread, so mid-tones come out darker than
+ * asked for.  The tone curve raises ink amounts to the power "gain" to make
+ * up for it, with the full gain at 300 DPI and less at lower resolutions
+ * where dots overlap less.  "limit" is the most ink, as a sum of the CMYK
+ * fractions, the paper can take without bleeding.
+ */
+
+typedef struct
+{
+  const char	*name;			/* Media type name, as used in the PPD */
+  double	gain,			/* Dot gain exponent at 300 DPI */
+		limit;			/* Total ink limit */
+} color_paper_t;
+
+
+/*
+ * Profile data...
+ *
+ * Only matrix/TRC RGB profiles are supported, which is what the system's
+ * generic and sRGB profiles are.  The tone curves are sampled at the grid
+ * points.
+ */
+
+typedef struct
+{
+  double	matrix[3][3],		/* RGB to XYZ matrix */
+		curves[3][COLOR_GRID];	/* Linear values at grid points */
+} color_profile_t;
+
+
+/*
+ * Tetrahedra...
+ *
+ * Indexed by (fr >= fg) | (fg >= fb) << 1 | (fr >= fb) << 2; entries 3 and
+ * 4 can't happen.
+ */
+
+typedef struct
+{
+  unsigned char		first,		/* Axis with largest fraction */
+			second,		/* Axis with middle fraction */
+			third;		/* Axis with smallest fraction */
+  unsigned		d1,		/* Offset to second corner */
+			d2;		/* Offset to third corner */
+} color_tetra_t;
+
+
+/*
+ * Cache file header...
+ *
+ * The header is followed by COLOR_NODES CMYK nodes of 4 bytes each.
+ */
+
+typedef struct
+{
+  char		magic[4];		/* "SLUT" */
+  unsigned	version,		/* COLOR_VERSION */
+		grid;			/* COLOR_GRID */
+  uint64_t	hash;			/* Hash of profile, media, and resolution */
+} color_cache_t;
+
+
+/*
+ * Local globals...
+ */
+
+static const color_paper_t color_papers[] =
+{					/* Media types */
+  { "Plain",  1.40, 2.4 },
+  { "Matte",  1.20, 2.8 },
+  { "Glossy", 1.10, 3.2 }
+};
+
+#define DR (COLOR_GRID * COLOR_GRID)
+#define DG COLOR_GRID
+#define DB 1
+
+static const color_tetra_t color_tetrahedra[8] =
+{					/* Tetrahedra by fraction order */
+  { 2, 1, 0, DB, DB + DG },		/* B > G > R */
+  { 2, 0, 1, DB, DB + DR },		/* B > R >= G */
+  { 1, 2, 0, DG, DG + DB },		/* G >= B > R */
+  { 0, 1, 2, DR, DR + DG },		/* (unused) */
+  { 0, 1, 2, DR, DR + DG },		/* (unused) */
+  { 0, 2, 1, DR, DR + DB },		/* R >= B > G */
+  { 1, 0, 2, DG, DG + DR },		/* G > R >= B */
+  { 0, 1, 2, DR, DR + DG }		/* R >= G >= B */
+};
+
+#undef DR
+#undef DG
+#undef DB
+
+static const double	color_srgb[3][3] =
+{					/* sRGB primaries, D50 */
+  { 0.4361, 0.3851, 0.1431 },
+  { 0.2225, 0.7169, 0.0606 },
+  { 0.0139, 0.0971, 0.7141 }
+};
+
+
+/*
+ * Local functions...
+ */
+
+static void	build_table(color_t *color, const color_profile_t *profile);
+static void	default_profile(color_profile_t *profile);
+static uint64_t	hash_data(uint64_t hash, const void *data, size_t length);
+static int	load_cache(color_t *color, const char *filename);
+static unsigned	node_value(double ink);
+static double	parametric_curve(unsigned type, const double *params,
+		                 double x);
+static unsigned char *read_profile(const char *filename, size_t *length);
+static int	read_curve(const unsigned char *data, size_t length,
+		           uint32_t offset, double *curve);
+static uint32_t	read_u32(const unsigned char *data);
+static int	parse_profile(color_profile_t *profile,
+		              const unsigned char *data, size_t length);
+static void	save_cache(color_t *color, const char *filename);
+
+
+/*
+ * 'ColorDelete()' - Free color separation data.
+ */
+
+void
+ColorDelete(color_t *color)		/* I - Color separation data */
+{
+  free(color);
+}
+
+
+/*
+ * 'ColorLine()' - Separate a line of RGB pixels into CMYK.
+ *
+ * 16-bit samples are used directly, so the fraction between grid points
+ * keeps the bits the 8-bit conversion would have thrown away.  Runs of the
+ * same color - mostly white - reuse the previous pixel.
+ */
+
+void
+ColorLine(color_t             *color,	/* I - Color separation data */
+          unsigned char       *dst,	/* O - CMYK pixels */
+          const unsigned char *src,	/* I - RGB pixels */
+          unsigned            width,	/* I - Width in pixels */
+	  unsigned            bits)	/* I - Bits per sample (8 or 16) */
+{
+  const uint64_t	*nodes = color->nodes;
+					/* Grid nodes */
+  const uint64_t	*n0;		/* First corner of tetrahedron */
+  unsigned		r, g, b,	/* Current sample values */
+			pr = ~0U,	/* Previous sample values */
+			pg = 0,
+			pb = 0,
+			fr, fg, fb,	/* Fractions between grid points */
+			f[3];		/* Fractions by axis */
+  const color_tetra_t	*t;		/* Tetrahedron */
+  uint64_t		sum = 0;	/* Weighted sum of corners */
+  const unsigned short	*src16 = (const unsigned short *)src;
+					/* 16-bit samples */
+
+
+  for (; width > 0; width --, dst += 4)
+  {
+    if (bits == 16)
+    {
+      r = src16[0];
+      g = src16[1];
+      b = src16[2];
+      src16 += 3;
+    }
+    else
+    {
+      r = src[0];
+      g = src[1];
+      b = src[2];
+      src += 3;
+    }
+
+    if (r != pr || g != pg || b != pb)
+    {
+      pr = r;
+      pg = g;
+      pb = b;
+
+      if (bits == 16)
+      {
+       /*
+        * Map 0-65535 to 0-65536 and then to grid units with an 8-bit
+	* fraction...
+	*/
+
+        unsigned index;			/* Grid index */
+
+        r = (r + (r >> 15)) * (COLOR_GRID - 1);
+        g = (g + (g >> 15)) * (COLOR_GRID - 1);
+        b = (b + (b >> 15)) * (COLOR_GRID - 1);
+
+        n0 = nodes;
+
+        if ((index = r >> 16) >= COLOR_GRID - 1)
+	{
+	  index = COLOR_GRID - 2;
+	  fr    = 256;
+	}
+	else
+	  fr = (r >> 8) & 255;
+	n0 += index * COLOR_GRID * COLOR_GRID;
+
+        if ((index = g >> 16) >= COLOR_GRID - 1)
+	{
+	  index = COLOR_GRID - 2;
+	  fg    = 256;
+	}
+	else
+	  fg = (g >> 8) & 255;
+	n0 += index * COLOR_GRID;
+
+        if ((index = b >> 16) >= COLOR_GRID - 1)
+	{
+	  index = COLOR_GRID - 2;
+	  fb    = 256;
+	}
+	else
+	  fb = (b >> 8) & 255;
+	n0 += index;
+      }
+      else
+      {
+        n0 = nodes + color->offsets[0][r] + color->offsets[1][g] + color->offsets[2][b];
+	fr = color->fractions[r];
+	fg = color->fractions[g];
+	fb = color->fractions[b];
+      }
+
+     /*
+      * Pick the tetrahedron containing the pixel by ordering the fractions.
+      * It runs from the first corner to the far corner of the grid cell,
+      * stepping along the axis with the largest fraction first.  Looking
+      * the order up avoids branches that photos mispredict...
+      */
+
+      f[0] = fr;
+      f[1] = fg;
+      f[2] = fb;
+
+      t = color_tetrahedra + ((fr >= fg) | ((fg >= fb) << 1) | ((fr >= fb) << 2));
+
+      sum = n0[0] * (256 - f[t->first]) +
+            n0[t->d1] * (f[t->first] - f[t->second]) +
+	    n0[t->d2] * (f[t->second] - f[t->third]) +
+	    n0[COLOR_GRID * COLOR_GRID + COLOR_GRID + 1] * f[t->third] +
+            0x0080008000800080ULL;
+    }
+
+    dst[0] = (unsigned char)(sum >> 8);
+    dst[1] = (unsigned char)(sum >> 24);
+    dst[2] = (unsigned char)(sum >> 40);
+    dst[3] = (unsigned char)(sum >> 56);
+  }
+}
+
+
+/*
+ * 'ColorMedia()' - Return the media type for a MediaType name.
+ */
+
+int					/* O - Media type or -1 if unknown */
+ColorMedia(const char *name)		/* I - MediaType name */
+{
+  int	i;				/* Looping var */
+
+
+  for (i = 0; i < (int)(sizeof(color_papers) / sizeof(color_papers[0])); i ++)
+    if (!strcmp(name, color_papers[i].name))
+      return (i);
+
+  return (-1);
+}
+
+
+/*
+ * 'ColorNew()' - Create color separation data.
+ *
+ * The table comes from the cache when there is one for the same profile,
+ * media, and resolution; otherwise it is built and saved for the next job.
+ */
+
+color_t *				/* O - Color separation data or NULL */
+ColorNew(const char    *profile,	/* I - ICC profile filename or NULL */
+         color_media_t media,		/* I - Media type */
+	 unsigned      resolution)	/* I - Resolution in DPI */
+{
+  color_t		*color;		/* Color separation data */
+  unsigned char		*data = NULL;	/* Profile data */
+  size_t		length = 0;	/* Length of profile data */
+  color_profile_t	parsed;		/* Parsed profile */
+  unsigned		i,		/* Looping var */
+			x,		/* Position in grid units * 256 */
+			index;		/* Grid index */
+  const char		*cachedir;	/* Cache directory */
+  char			filename[1024];	/* Cache filename */
+  static const unsigned	version = COLOR_VERSION,
+			grid = COLOR_GRID;
+
+
+  if ((color = calloc(1, sizeof(color_t))) == NULL)
+    return (NULL);
+
+  color->media      = media;
+  color->resolution = resolution;
+
+ /*
+  * Build the lookup tables for 8-bit samples...
+  */
+
+  for (i = 0; i < 256; i ++)
+  {
+    x = (i * (COLOR_GRID - 1) * 256 + 127) / 255;
+
+    if ((index = x >> 8) >= COLOR_GRID - 1)
+    {
+      index                = COLOR_GRID - 2;
+      color->fractions[i]  = 256;
+    }
+    else
+      color->fractions[i] = x & 255;
+
+    color->offsets[0][i] = index * COLOR_GRID * COLOR_GRID;
+    color->offsets[1][i] = index * COLOR_GRID;
+    color->offsets[2][i] = index;
+  }
+
+ /*
+  * Hash everything that goes into the table...
+  */
+
+  if (profile && (data = read_profile(profile, &length)) == NULL)
+    LogDebug("Unable to read color profile \"%s\": %s", profile, strerror(errno));
+
+  color->hash = hash_data(14695981039346656037ULL, &version, sizeof(version));
+  color->hash = hash_data(color->hash, &grid, sizeof(grid));
+  color->hash = hash_data(color->hash, &media, sizeof(media));
+  color->hash = hash_data(color->hash, &resolution, sizeof(resolution));
+  if (data)
+    color->hash = hash_data(color->hash, data, length);
+
+ /*
+  * Use the cached table or build a new one...
+  */
+
+  if ((cachedir = getenv("CUPS_CACHEDIR")) == NULL &&
+      (cachedir = getenv("TMPDIR")) == NULL)
+    cachedir = "/tmp";
+
+  snprintf(filename, sizeof(filename), "%s/sample-%016llx.lut", cachedir,
+           (unsigned long long)color->hash);
+
+  if (load_cache(color, filename))
+  {
+    LogDebug("Using cached color table \"%s\".", filename);
+  }
+  else
+  {
+    if (!data || !parse_profile(&parsed, data, length))
+    {
+      if (data)
+        LogDebug("Unsupported color profile \"%s\", using sRGB.", profile);
+
+      default_profile(&parsed);
+    }
+
+    build_table(color, &parsed);
+    save_cache(color, filename);
+  }
+
+  free(data);
+
+  return (color);
+}
+
+
+/*
+ * 'build_table()' - Build the grid nodes.
+ *
+ * Each grid point goes from the profile's RGB through XYZ to the printer's
+ * RGB, which uses the sRGB primaries and tone curve.  Black generation
+ * then uses the same formula as the printer:
+ *
+ *         (1 - max(R,G,B))^3
+ *     K = ------------------
+ *         (1 - min(R,G,B))^2
+ *
+ *     C = 1 - R - K
+ *     M = 1 - G - K
+ *     Y = 1 - B - K
+ *
+ * followed by the media's tone curve and ink limit.  The ink limit takes
+ * from C, M, and Y and leaves K alone, so dark colors keep their density.
+ */
+
+static void
+build_table(color_t               *color,/* I - Color separation data */
+            const color_profile_t *profile)
+					/* I - Source profile */
+{
+  const color_paper_t	*paper = color_papers + color->media;
+					/* Media parameters */
+  double		inverse[3][3],	/* XYZ to printer RGB matrix */
+			det,		/* Determinant of sRGB matrix */
+			gain,		/* Dot gain exponent */
+			rgb[3],		/* Linear RGB */
+			xyz[3],		/* XYZ */
+			device[3],	/* Printer RGB */
+			cmyk[4],	/* Ink amounts */
+			rgbmin, rgbmax,	/* Minimum and maximum of printer RGB */
+			total;		/* Total ink */
+  unsigned		r, g, b,	/* Grid indices */
+			i;		/* Looping var */
+  uint64_t		*node = color->nodes;
+					/* Current node */
+  const double		(*m)[3] = color_srgb;
+					/* sRGB matrix */
+
+
+ /*
+  * Invert the printer's RGB to XYZ matrix...
+  */
+
+  det = m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1]) -
+        m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0]) +
+        m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+
+  inverse[0][0] = (m[1][1] * m[2][2] - m[1][2] * m[2][1]) / det;
+  inverse[0][1] = (m[0][2] * m[2][1] - m[0][1] * m[2][2]) / det;
+  inverse[0][2] = (m[0][1] * m[1][2] - m[0][2] * m[1][1]) / det;
+  inverse[1][0] = (m[1][2] * m[2][0] - m[1][0] * m[2][2]) / det;
+  inverse[1][1] = (m[0][0] * m[2][2] - m[0][2] * m[2][0]) / det;
+  inverse[1][2] = (m[0][2] * m[1][0] - m[0][0] * m[1][2]) / det;
+  inverse[2][0] = (m[1][0] * m[2][1] - m[1][1] * m[2][0]) / det;
+  inverse[2][1] = (m[0][1] * m[2][0] - m[0][0] * m[2][1]) / det;
+  inverse[2][2] = (m[0][0] * m[1][1] - m[0][1] * m[1][0]) / det;
+
+  gain = 1.0 + (paper->gain - 1.0) *
+               (color->resolution < 300 ? color->resolution : 300) / 300.0;
+
+  for (r = 0; r < COLOR_GRID; r ++)
+    for (g = 0; g < COLOR_GRID; g ++)
+      for (b = 0; b < COLOR_GRID; b ++, node ++)
+      {
+       /*
+        * Profile RGB to printer RGB...
+	*/
+
+        rgb[0] = profile->curves[0][r];
+        rgb[1] = profile->curves[1][g];
+        rgb[2] = profile->curves[2][b];
+
+        for (i = 0; i < 3; i ++)
+	  xyz[i] = profile->matrix[i][0] * rgb[0] +
+	           profile->matrix[i][1] * rgb[1] +
+		   profile->matrix[i][2] * rgb[2];
+
+        for (i = 0; i < 3; i ++)
+	{
+	  device[i] = inverse[i][0] * xyz[0] + inverse[i][1] * xyz[1] +
+	              inverse[i][2] * xyz[2];
+
+	  if (device[i] <= 0.0)
+	    device[i] = 0.0;
+	  else if (device[i] >= 1.0)
+	    device[i] = 1.0;
+	  else if (device[i] <= 0.0031308)
+	    device[i] *= 12.92;
+	  else
+	    device[i] = 1.055 * pow(device[i], 1.0 / 2.4) - 0.055;
+	}
+
+       /*
+        * Black generation...
+	*/
+
+        rgbmin = rgbmax = device[0];
+	for (i = 1; i < 3; i ++)
+	{
+	  if (device[i] < rgbmin)
+	    rgbmin = device[i];
+	  if (device[i] > rgbmax)
+	    rgbmax = device[i];
+	}
+
+        if (rgbmin < 1.0)
+	  cmyk[3] = (1.0 - rgbmax) * (1.0 - rgbmax) * (1.0 - rgbmax) /
+	            ((1.0 - rgbmin) * (1.0 - rgbmin));
+	else
+	  cmyk[3] = 0.0;
+
+        for (i = 0; i < 3; i ++)
+	  if ((cmyk[i] = 1.0 - device[i] - cmyk[3]) < 0.0)
+	    cmyk[i] = 0.0;
+
+       /*
+        * Tone curve and ink limit...
+	*/
+
+        for (i = 0; i < 4; i ++)
+	  cmyk[i] = pow(cmyk[i], gain);
+
+        total = cmyk[0] + cmyk[1] + cmyk[2];
+	if (total + cmyk[3] > paper->limit && total > 0.0)
+	  for (i = 0; i < 3; i ++)
+	    cmyk[i] *= (paper->limit - cmyk[3]) / total;
+
+        for (i = 0, *node = 0; i < 4; i ++)
+	  *node |= (uint64_t)node_value(cmyk[i]) << (16 * i);
+      }
+
+  LogDebug("Built %ux%ux%u color table for %s paper at %u DPI.",
+           COLOR_GRID, COLOR_GRID, COLOR_GRID, paper->name,
+	   color->resolution);
+}
+
+
+/*
+ * 'default_profile()' - Use the sRGB profile.
+ */
+
+static void
+default_profile(
+    color_profile_t *profile)		/* O - Profile */
+{
+  unsigned	i;			/* Looping var */
+  static const double params[5] =	/* sRGB tone curve */
+  {
+    2.4, 1.0 / 1.055, 0.055 / 1.055, 1.0 / 12.92, 0.04045
+  };
+
+
+  memcpy(profile->matrix, color_srgb, sizeof(profile->matrix));
+
+  for (i = 0; i < COLOR_GRID; i ++)
+    profile->curves[0][i] = profile->curves[1][i] = profile->curves[2][i] =
+        parametric_curve(3, params, (double)i / (COLOR_GRID - 1));
+}
+
+
+/*
+ * 'hash_data()' - Add data to a 64-bit FNV-1a hash.
+ */
+
+static uint64_t				/* O - New hash */
+hash_data(uint64_t   hash,		/* I - Current hash */
+          const void *data,		/* I - Data */
+	  size_t     length)		/* I - Length of data */
+{
+  const unsigned char	*ptr = (const unsigned char *)data;
+					/* Pointer into data */
+
+
+  while (length > 0)
+  {
+    hash = (hash ^ *ptr++) * 1099511628211ULL;
+    length --;
+  }
+
+  return (hash);
+}
+
+
+/*
+ * 'load_cache()' - Load the grid nodes from a cache file.
+ */
+
+static int				/* O - 1 on success, 0 on failure */
+load_cache(color_t    *color,		/* I - Color separation data */
+           const char *filename)	/* I - Cache filename */
+{
+  int			fd;		/* Cache file */
+  color_cache_t		header;		/* Cache file header */
+  unsigned char		buffer[COLOR_NODES * 4],
+					/* CMYK nodes */
+			*ptr;		/* Pointer into nodes */
+  unsigned		i;		/* Looping var */
+  ssize_t		bytes;		/* Bytes read */
+
+
+  if ((fd = open(filename, O_RDONLY)) < 0)
+    return (0);
+
+  bytes = read(fd, &header, sizeof(header));
+  if (bytes == sizeof(header))
+    bytes = read(fd, buffer, sizeof(buffer));
+  else
+    bytes = -1;
+
+  close(fd);
+
+  if (bytes != sizeof(buffer) || memcmp(header.magic, "SLUT", 4) ||
+      header.version != COLOR_VERSION || header.grid != COLOR_GRID ||
+      header.hash != color->hash)
+  {
+    LogDebug("Ignoring bad color table cache \"%s\".", filename);
+    return (0);
+  }
+
+  for (i = 0, ptr = buffer; i < COLOR_NODES; i ++, ptr += 4)
+    color->nodes[i] = (uint64_t)ptr[0] | ((uint64_t)ptr[1] << 16) |
+                      ((uint64_t)ptr[2] << 32) | ((uint64_t)ptr[3] << 48);
+
+  return (1);
+}
+
+
+/*
+ * 'node_value()' - Convert an ink amount to a sample value.
+ */
+
+static unsigned				/* O - Sample value, 255 for no ink */
+node_value(double ink)			/* I - Ink amount, 0.0 to 1.0 */
+{
+  if (ink <= 0.0)
+    return (255);
+  else if (ink >= 1.0)
+    return (0);
+  else
+    return (255 - (unsigned)(ink * 255.0 + 0.5));
+}
+
+
+/*
+ * 'parametric_curve()' - Evaluate an ICC parametric curve.
+ */
+
+static double				/* O - Linear value */
+parametric_curve(unsigned     type,	/* I - Function type (0 to 4) */
+                 const double *p,	/* I - Parameters g, a, b, c, d, e, f */
+                 double       x)	/* I - Encoded value */
+{
+  switch (type)
+  {
+    case 0 :
+        return (pow(x, p[0]));
+
+    case 1 :
+        return (x >= -p[2] / p[1] ? pow(p[1] * x + p[2], p[0]) : 0.0);
+
+    case 2 :
+        return (x >= -p[2] / p[1] ? pow(p[1] * x + p[2], p[0]) + p[3] : p[3]);
+
+    case 3 :
+        return (x >= p[4] ? pow(p[1] * x + p[2], p[0]) : p[3] * x);
+
+    default :
+        return (x >= p[4] ? pow(p[1] * x + p[2], p[0]) + p[5] : p[3] * x + p[6]);
+  }
+}
+
+
+/*
+ * 'parse_profile()' - Get the matrix and tone curves from an ICC profile.
+ */
+
+static int				/* O - 1 on success, 0 if not supported */
+parse_profile(
+    color_profile_t     *profile,	/* O - Profile */
+    const unsigned char *data,		/* I - Profile data */
+    size_t              length)		/* I - Length of profile data */
+{
+  uint32_t		count,		/* Number of tags */
+			sig,		/* Tag signature */
+			offset;		/* Tag offset */
+  const unsigned char	*tag;		/* Current tag */
+  unsigned		found = 0,	/* Tags found */
+			i, j;		/* Looping vars */
+  static const char	*names[6] = { "rXYZ", "gXYZ", "bXYZ", "rTRC", "gTRC", "bTRC" };
+
+
+  if (length < 132 || memcmp(data + 16, "RGB ", 4) || memcmp(data + 36, "acsp", 4))
+    return (0);
+
+  if ((count = read_u32(data + 128)) > (length - 132) / 12)
+    return (0);
+
+  for (i = 0, tag = data + 132; i < count; i ++, tag += 12)
+  {
+    sig    = read_u32(tag);
+    offset = read_u32(tag + 4);
+
+    for (j = 0; j < 6; j ++)
+      if (sig == read_u32((const unsigned char *)names[j]))
+        break;
+
+    if (j == 6)
+      continue;
+
+    if (j < 3)
+    {
+     /*
+      * XYZType - the primary's XYZ is a column of the matrix...
+      */
+
+      if (offset > length - 20 || memcmp(data + offset, "XYZ ", 4))
+        return (0);
+
+      profile->matrix[0][j] = (int32_t)read_u32(data + offset + 8) / 65536.0;
+      profile->matrix[1][j] = (int32_t)read_u32(data + offset + 12) / 65536.0;
+      profile->matrix[2][j] = (int32_t)read_u32(data + offset + 16) / 65536.0;
+    }
+    else if (!read_curve(data, length, offset, profile->curves[j - 3]))
+      return (0);
+
+    found |= 1 << j;
+  }
+
+  return (found == 63);
+}
+
+
+/*
+ * 'read_curve()' - Sample a curveType or parametricCurveType tag.
+ */
+
+static int				/* O - 1 on success, 0 on error */
+read_curve(const unsigned char *data,	/* I - Profile data */
+           size_t              length,	/* I - Length of profile data */
+	   uint32_t            offset,	/* I - Offset of tag */
+	   double              *curve)	/* O - Linear values at grid points */
+{
+  const unsigned char	*tag = data + offset;
+					/* Tag data */
+  uint32_t		count;		/* Number of curve entries */
+  unsigned		i,		/* Looping var */
+			type;		/* Parametric function type */
+  double		x,		/* Encoded value */
+			pos,		/* Position in table */
+			params[7];	/* Parametric function parameters */
+  static const unsigned	num_params[5] = { 1, 3, 4, 5, 7 };
+
+
+  if (offset > length - 12)
+    return (0);
+
+  if (!memcmp(tag, "curv", 4))
+  {
+    count = read_u32(tag + 8);
+
+    if (count > (length - offset - 12) / 2)
+      return (0);
+
+    for (i = 0; i < COLOR_GRID; i ++)
+    {
+      x = (double)i / (COLOR_GRID - 1);
+
+      if (count == 0)
+        curve[i] = x;
+      else if (count == 1)
+        curve[i] = pow(x, ((tag[12] << 8) | tag[13]) / 256.0);
+      else
+      {
+        unsigned	index;		/* Table index */
+
+        pos   = x * (count - 1);
+	index = (unsigned)pos;
+
+        if (index >= count - 1)
+	  curve[i] = ((tag[12 + 2 * count - 2] << 8) | tag[12 + 2 * count - 1]) / 65535.0;
+	else
+	  curve[i] = (((tag[12 + 2 * index] << 8) | tag[13 + 2 * index]) * (1.0 - pos + index) +
+	              ((tag[14 + 2 * index] << 8) | tag[15 + 2 * index]) * (pos - index)) / 65535.0;
+      }
+    }
+  }
+  else if (!memcmp(tag, "para", 4))
+  {
+    if ((type = (tag[8] << 8) | tag[9]) > 4 ||
+        offset + 12 + 4 * num_params[type] > length)
+      return (0);
+
+    for (i = 0; i < num_params[type]; i ++)
+      params[i] = (int32_t)read_u32(tag + 12 + 4 * i) / 65536.0;
+
+    for (i = 0; i < COLOR_GRID; i ++)
+      curve[i] = parametric_curve(type, params, (double)i / (COLOR_GRID - 1));
+  }
+  else
+    return (0);
+
+  return (1);
+}
+
+
+/*
+ * 'read_profile()' - Read an ICC profile into memory.
+ */
+
+static unsigned char *			/* O - Profile data or NULL */
+read_profile(const char *filename,	/* I - Profile filename */
+             size_t     *length)	/* O - Length of profile data */
+{
+  int		fd;			/* Profile file */
+  struct stat	info;			/* File information */
+  unsigned char	*data;			/* Profile data */
+  ssize_t	bytes;			/* Bytes read */
+
+
+  if ((fd = open(filename, O_RDONLY)) < 0)
+    return (NULL);
+
+  if (fstat(fd, &info) || info.st_size < 132 || info.st_size > 16 * 1024 * 1024 ||
+      (data = malloc((size_t)info.st_size)) == NULL)
+  {
+    close(fd);
+    errno = EINVAL;
+    return (NULL);
+  }
+
+  bytes = read(fd, data, (size_t)info.st_size);
+  close(fd);
+
+  if (bytes != info.st_size)
+  {
+    free(data);
+    errno = EIO;
+    return (NULL);
+  }
+
+  *length = (size_t)bytes;
+
+  return (data);
+}
+
+
+/*
+ * 'read_u32()' - Read a big-endian 32-bit value.
+ */
+
+static uint32_t				/* O - Value */
+read_u32(const unsigned char *data)	/* I - Data */
+{
+  return (((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) |
+          ((uint32_t)data[2] << 8) | data[3]);
+}
+
+
+/*
+ * 'save_cache()' - Save the grid nodes to a cache file.
+ *
+ * The file is written under a temporary name and renamed, so that jobs on
+ * other queues never see a partial table.
+ */
+
+static void
+save_cache(color_t    *color,		/* I - Color separation data */
+           const char *filename)	/* I - Cache filename */
+{
+  int			fd;		/* Cache file */
+  char			tempfile[1024];	/* Temporary filename */
+  color_cache_t		header;		/* Cache file header */
+  unsigned char		buffer[COLOR_NODES * 4],
+					/* CMYK nodes */
+			*ptr;		/* Pointer into nodes */
+  unsigned		i;		/* Looping var */
+
+
+  snprintf(tempfile, sizeof(tempfile), "%s.XXXXXX", filename);
+
+  if ((fd = mkstemp(tempfile)) < 0)
+  {
+    LogDebug("Unable to create color table cache \"%s\": %s", tempfile,
+             strerror(errno));
+    return;
+  }
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, "SLUT", 4);
+  header.version = COLOR_VERSION;
+  header.grid    = COLOR_GRID;
+  header.hash    = color->hash;
+
+  for (i = 0, ptr = buffer; i < COLOR_NODES; i ++, ptr += 4)
+  {
+    ptr[0] = (unsigned char)color->nodes[i];
+    ptr[1] = (unsigned char)(color->nodes[i] >> 16);
+    ptr[2] = (unsigned char)(color->nodes[i] >> 32);
+    ptr[3] = (unsigned char)(color->nodes[i] >> 48);
+  }
+
+  if (write(fd, &header, sizeof(header)) != sizeof(header) ||
+      write(fd, buffer, sizeof(buffer)) != sizeof(buffer) ||
+      fchmod(fd, 0644))
+  {
+    LogDebug("Unable to save color table cache \"%s\": %s", filename,
+             strerror(errno));
+    close(fd);
+    unlink(tempfile);
+  }
+  else if (close(fd) || rename(tempfile, filename))
+  {
+    LogDebug("Unable to save color table cache \"%s\": %s", filename,
+             strerror(errno));
+    unlink(tempfile);
+  }
+}
@@ -0,0 +1,121 @@
+/*
+     File: color.h 
+ Abstract: Color separation definitions for sample CUPS printer driver.
+  Version: 4.0 
+  
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple 
+ Inc. ("Apple") in consideration of your agreement to the following 
+ terms, and your use, installation, modification or redistribution of 
+ this Apple software constitutes acceptance of these terms.  If you do 
+ not agree with these terms, please do not use, install, modify or 
+ redistribute this Apple software. 
+  
+ In consideration of your agreement to abide by the following terms, and 
+ subject to these terms, Apple grants you a personal, non-exclusive 
+ license, under Apple's copyrights in this original Apple software (the 
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple 
+ Software, with or without modifications, in source and/or binary forms; 
+ provided that if you redistribute the Apple Software in its entirety and 
+ without modifications, you must retain this notice and the following 
+ text and disclaimers in all such redistributions of the Apple Software. 
+ Neither the name, trademarks, service marks or logos of Apple Inc. may 
+ be used to endorse or promote products derived from the Apple Software 
+ without specific prior written permission from Apple.  Except as 
+ expressly stated in this notice, no other rights or licenses, express or 
+ implied, are granted by Apple herein, including but not limited to any 
+ patent rights that may be infringed by your derivative works or by other 
+ works in which the Apple Software may be incorporated. 
+  
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE 
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION 
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS 
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND 
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS. 
+  
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL 
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, 
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED 
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), 
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE 
+ POSSIBILITY OF SUCH DAMAGE. 
+  
+ Copyright (C) 2011 Apple Inc. All Rights Reserved. 
+  
+ */  
+
+#ifndef _SAMPLE_COLOR_H_
+#  define _SAMPLE_COLOR_H_
+
+/*
+ * Include necessary headers...
+ */
+
+#  include <stddef.h>
+#  include <stdint.h>
+
+
+/*
+ * Color separation constants...
+ */
+
+#  define COLOR_GRID	17		/* Grid points per RGB axis */
+#  define COLOR_NODES	(COLOR_GRID * COLOR_GRID * COLOR_GRID)
+#  define COLOR_VERSION	1		/* Bump when the separation changes */
+
+
+/*
+ * Media types...
+ */
+
+typedef enum
+{
+  COLOR_PLAIN,				/* Plain paper */
+  COLOR_MATTE,				/* Matte photo paper */
+  COLOR_GLOSSY				/* Glossy photo paper */
+} color_media_t;
+
+
+/*
+ * Color separation data...
+ *
+ * RGB pixels are separated into CMYK with a 3D lookup table and tetrahedral
+ * interpolation.  The table is built from the source ICC profile, the
+ * black generation formula used by the printer, a dot gain curve for the
+ * media, and a total ink limit, and is cached on disk by a hash of all of
+ * them.
+ *
+ * Separated pixels are 4 bytes in CMYK order with 255 for no ink, so that
+ * white is still all 0xff bytes like the grayscale and RGB formats.
+ *
+ * Each grid node holds its 4 samples in the 16-bit lanes of a 64-bit word.
+ * Interpolation weights always add up to 256, so a whole pixel is
+ * interpolated with 4 integer multiplies and no lane can overflow.
+ */
+
+typedef struct
+{
+  color_media_t		media;		/* Media type */
+  unsigned		resolution;	/* Resolution in DPI */
+  uint64_t		hash;		/* Hash of profile, media, and resolution */
+  uint64_t		nodes[COLOR_NODES];
+					/* Grid nodes */
+  unsigned		offsets[3][256];/* Node offset for each 8-bit sample */
+  unsigned short	fractions[256];	/* Fraction (0 to 256) for each 8-bit sample */
+} color_t;
+
+
+/*
+ * Prototypes...
+ */
+
+extern void		ColorDelete(color_t *color);
+extern void		ColorLine(color_t *color, unsigned char *dst,
+			          const unsigned char *src, unsigned width,
+				  unsigned bits);
+extern int		ColorMedia(const char *name);
+extern color_t		*ColorNew(const char *profile, color_media_t media,
+			          unsigned resolution);
+
+#endif /* !_SAMPLE_COLOR_H_ */
@@ -46,6 +46,8 @@
  */  
 
 #include "sample.h"			/* Common sample driver header */
+#include "metrics.h"			/* Shared job metrics definitions */
+#include "protocol.h"			/* Sample printer protocol definitions */
 #include <cups/cups.h>			/* CUPS API headers */
 
 /*
@@ -78,6 +80,8 @@ main(int  argc,				/* I - Number of command-line args */
   if ((ppd = Initialize(argc, argv, &job)) == NULL)
     return (1);
 
+  MetricsStart(METRICS_COMMAND);
+
  /*
   * Open the command file as needed...
   */
@@ -86,7 +90,7 @@ main(int  argc,				/* I - Number of command-line args */
   {
     if ((fp = cupsFileOpen(argv[6], "r")) == NULL)
     {
-      LogMessage("ERROR", CFCopyLocalizedString(CFSTR("Unable to open command file: %s"), NULL), strerror(errno));
+      LogMessage("ERROR", "Unable to open command file: %s", strerror(errno));
       return (1);
     }
   }
@@ -149,9 +153,11 @@ main(int  argc,				/* I - Number of command-line args */
       GetStatus(ppd, 5.0);
     }
     else
-      LogMessage("ERROR", CFCopyLocalizedString(CFSTR("Unknown printer command \"%s\"!"), NULL), line);
+      LogMessage("ERROR", "Unknown printer command \"%s\"!", line);
   }
 
+  MetricsFinish();
+
   return (0);
 }
 
@@ -163,32 +169,14 @@ main(int  argc,				/* I - Number of command-line args */
 static void
 print_self_test_page(const char *user)	/* I - User that requested page */
 {
-  int		y,			/* Current line */
-		color,			/* Current color */
-		pass;			/* Current pass */
-  unsigned char	data[360 * 3],		/* Data for line */
-  		*dataptr;		/* Pointer into line */
-  unsigned char	colors[4][3] =		/* Colors for each "ink" */
-		{
-		  { 0, 0, 0 },		/* Black */
-		  { 0, 255, 255 },	/* Cyan */
-		  { 255, 0, 255 },	/* Magenta */
-		  { 255, 255, 0 }	/* Yellow */
-		};
+  int		y;			/* Current line */
+  unsigned char	data[PROTOCOL_SELFTEST_WIDTH * 3];
+					/* Data for line */
 
 
  /*
-  * The self-test page prints a common head test pattern for each color like
-  * this:
-  *
-  * |----            |
-  * |    ----        |
-  * |        ----    |
-  * |            ----|
-  * |----            |
-  * |    ----        |
-  * |        ----    |
-  * |            ----|
+  * The self-test page prints the head test pattern built by
+  * ProtocolSelfTestLine() for each color...
   */
 
   puts("DOCUMENT");
@@ -198,36 +186,9 @@ print_self_test_page(const char *user)	/* I - User that requested page */
   puts("PAGE 0 0 360 72");		/* 5x1" test page */
   puts("RASTER 360 72 3");		/* 72dpi color image */
 
-  for (y = 0; y < 72; y ++)
+  for (y = 0; y < PROTOCOL_SELFTEST_HEIGHT; y ++)
   {
-   /*
-    * Clear the line...
-    */
-
-    memset(data, 255, sizeof(data));
-
-   /*
-    * Add each color...
-    */
-
-    for (color = 0, pass = y & 7; color < 4; color ++)
-    {
-      dataptr = data + color * 96 * 3;
-
-      memcpy(dataptr + 0 * 3, colors[color], 3);
-      memcpy(dataptr + 71 * 3, colors[color], 3);
-
-      dataptr += pass * 9 * 3;
-      memcpy(dataptr + 0 * 3, colors[color], 3);
-      memcpy(dataptr + 1 * 3, colors[color], 3);
-      memcpy(dataptr + 2 * 3, colors[color], 3);
-      memcpy(dataptr + 3 * 3, colors[color], 3);
-      memcpy(dataptr + 4 * 3, colors[color], 3);
-      memcpy(dataptr + 5 * 3, colors[color], 3);
-      memcpy(dataptr + 6 * 3, colors[color], 3);
-      memcpy(dataptr + 7 * 3, colors[color], 3);
-      memcpy(dataptr + 8 * 3, colors[color], 3);
-    }
+    ProtocolSelfTestLine(data, y);
 
    /*
     * Write the line...
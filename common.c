@@ -47,6 +47,99 @@
 
 #include <stdarg.h>
 #include "sample.h"			/* Common sample driver header */
+#include "metrics.h"			/* Shared job metrics definitions */
+#include "trace.h"			/* Stage timing definitions */
+#include <ctype.h>
+#include <locale.h>
+#include <pthread.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#ifdef __APPLE__
+#  include <mach-o/dyld.h>		/* _NSGetExecutablePath() */
+#endif /* __APPLE__ */
+
+
+/*
+ * Resources directory of the installed bundle, used when the program's own
+ * path can't be found...
+ */
+
+#ifndef SAMPLE_RESOURCES
+#  define SAMPLE_RESOURCES "/Library/Printers/Acme/SampleRaster.bundle/Contents/Resources"
+#endif /* !SAMPLE_RESOURCES */
+
+
+/*
+ * Message catalog data...
+ *
+ * The Localizable.strings file for the current language is loaded once into
+ * a single buffer, and the key/value pairs are sorted by key so a message can
+ * be looked up with bsearch().
+ */
+
+typedef struct
+{
+  const char	*key,			/* English message */
+		*value;			/* Localized message */
+} message_t;
+
+
+/*
+ * Local globals...
+ *
+ * The status monitor thread blocks on the back-channel and reports status
+ * as it arrives, so the raster loop doesn't need to poll for it.  The mutex
+ * and condition variable let StopStatus() and WaitStatus() wait for replies.
+ */
+
+static pthread_t	status_thread;	/* Status monitor thread */
+static int		status_started = 0,
+					/* Was the thread started? */
+			status_pipe[2] = { -1, -1 },
+					/* Pipe to stop the thread */
+			status_done = 0;/* Did the back-channel close? */
+static unsigned		status_replies = 0,
+					/* Number of replies read */
+			status_levels = 0;
+					/* Number of ink level lines read */
+static pthread_mutex_t	status_mutex = PTHREAD_MUTEX_INITIALIZER;
+					/* Mutex for reply count */
+static pthread_cond_t	status_cond = PTHREAD_COND_INITIALIZER;
+					/* Signaled for each reply */
+
+
+static char		*catalog_data = NULL;
+					/* Strings from message catalog */
+static message_t	*catalog = NULL;/* Messages sorted by key */
+static size_t		catalog_count = 0;
+					/* Number of messages */
+static int		log_debug = 1;	/* Write DEBUG messages? */
+
+
+/*
+ * Local functions...
+ */
+
+static int	compare_messages(const void *a, const void *b);
+static int	format_args(const char *format, int *args, int max);
+static void	get_deadline(double timeout, struct timespec *deadline);
+static int	load_catalog(const char *resources, const char *language);
+static void	load_log_level(void);
+static const char *localize(const char *message);
+static char	*parse_string(char **ptr);
+static void	report_lines(char *lines);
+static void	*status_monitor(void *data);
+static void	write_message(const char *prefix, const char *format,
+		              va_list ap);
+static void	write_status(const char *prefix, const char *format, ...)
+#ifdef __GNUC__
+		__attribute__((format(printf, 2, 3)))
+#endif /* __GNUC__ */
+		;
+
 
 /*
  * 'GetStatus()' - Read back-channel for status information.
@@ -56,12 +149,10 @@ int					/* O - 1 on success, 0 on failure */
 GetStatus(ppd_file_t *ppd,		/* I - PPD file for printer */
           double     timeout)		/* I - Timeout in seconds */
 {
-  char		buffer[1025],		/* Buffer for back-channel data */
-		*start,			/* Start of line */
-		*end;			/* End of line */
+  char		buffer[1025];		/* Buffer for back-channel data */
   ssize_t	bytes;			/* Number of bytes read */
-  static int	last_levels[4] = { -1, -1, -1, -1 };
-					/* Previous levels seen */
+  uint64_t	start = MetricsNow();	/* Start of round-trip */
+  TRACE_SCOPE("status");
 
 
   if (timeout > 0.0)
@@ -87,12 +178,144 @@ GetStatus(ppd_file_t *ppd,		/* I - PPD file for printer */
     return (timeout == 0.0 ? 1 : 0);
   }
 
+  if (timeout > 0.0)
+  {
+    MetricsAdd(METRIC_ROUND_TRIPS, 1);
+    MetricsTime(METRIC_TIME_STATUS, MetricsNow() - start);
+  }
+
  /*
-  * Nul-terminate the buffer.
+  * Nul-terminate the buffer and parse it.
   */
 
   buffer[bytes] = '\0';
 
+  return (ParseStatus(buffer));
+}
+
+
+/*
+ * 'Initialize()' - Open the PPD file and parse options.
+ */
+
+ppd_file_t *				/* O - PPD file for printer */
+Initialize(int        argc,		/* I - Number of command-line args */
+           char       *argv[],		/* I - Command-line arguments */
+           job_data_t *job)		/* O - Job data */
+{
+  ppd_file_t	*ppd;			/* PPD file for printer */
+
+
+ /*
+  * Validate the command-line arguments...
+  */
+
+  if (argc < 6 || argc > 7)
+  {
+    fprintf(stderr, "Usage: %s job user title copies options [filename]\n",
+            argv[0]);
+    return (NULL);
+  }
+
+ /*
+  * Localize...
+  */
+
+  SetLocale(argv[0]);
+
+ /*
+  * Parse the options on the command-line...
+  */
+
+  job->job_id      = atoi(argv[1]);
+  job->user        = argv[2];
+  job->title       = argv[3];
+  job->num_options = cupsParseOptions(argv[5], 0, &(job->options));
+
+ /*
+  * Open the PPD file...
+  */
+
+  if ((ppd = ppdOpenFile(getenv("PPD"))) != NULL)
+  {
+   /*
+    * Mark the options for the job...
+    */
+
+    ppdMarkDefaults(ppd);
+    cupsMarkOptions(ppd, job->num_options, job->options);
+  }
+  else
+    LogMessage("ERROR", "Unable to open PPD file: %s", strerror(errno));
+
+ /*
+  * Return the PPD to the caller...
+  */
+
+  return (ppd);
+}
+
+
+/*
+ * 'LogDebug()' - Write a debugging message.
+ *
+ * Nothing is formatted unless the scheduler is logging debug messages.
+ */
+
+void
+LogDebug(const char *format,		/* I - printf-style format string */
+         ...)				/* I - Additional arguments as needed */
+{
+  va_list	ap;			/* Pointer to additional arguments */
+
+
+  if (!log_debug)
+    return;
+
+  TRACE_SCOPE("log");
+
+  va_start(ap, format);
+  write_message("DEBUG", format, ap);
+  va_end(ap);
+}
+
+
+/*
+ * 'LogMessage()' - Write a localized message.
+ */
+
+void
+LogMessage(const char *prefix,		/* I - Prefix ("INFO", "ERROR", etc.) */
+           const char *message,		/* I - English message and format string */
+	   ...)				/* I - Additional arguments as needed */
+{
+  va_list	ap;			/* Pointer to additional arguments */
+
+
+  if (!log_debug && !strcmp(prefix, "DEBUG"))
+    return;
+
+  TRACE_SCOPE("log");
+
+  va_start(ap, message);
+  write_message(prefix, localize(message), ap);
+  va_end(ap);
+}
+
+
+/*
+ * 'ParseStatus()' - Parse back-channel data and report it to the scheduler.
+ */
+
+int					/* O - 1 on success, 0 on failure */
+ParseStatus(char *buffer)		/* I - Nul-terminated back-channel data */
+{
+  char		*start,			/* Start of line */
+		*end;			/* End of line */
+  static int	last_levels[4] = { -1, -1, -1, -1 };
+					/* Previous levels seen */
+
+
  /*
   * Parse the back-channel data.  For our imaginary sample device, it will
   * return one of the following strings on a line by itself:
@@ -149,32 +372,32 @@ GetStatus(ppd_file_t *ppd,		/* I - PPD file for printer */
       * Write an ATTR: message to stderr...
       */
 
-      fprintf(stderr,
-              "ATTR: marker-colors=#00ffff,#ff00ff,#ffff00,#000000 "
-	      "marker-levels=%d,%d,%d,%d "
-	      "marker-names=Cyan,Magenta,Yellow,Black "
-	      "marker-types=ink,ink,ink,ink\n",
-	      levels[0], levels[1], levels[2], levels[3]);
+      write_status("ATTR",
+                   "marker-colors=#00ffff,#ff00ff,#ffff00,#000000 "
+		   "marker-levels=%d,%d,%d,%d "
+		   "marker-names=Cyan,Magenta,Yellow,Black "
+		   "marker-types=ink,ink,ink,ink",
+		   levels[0], levels[1], levels[2], levels[3]);
 
       if (levels[0] < 5 && last_levels[0] >= 5)
-        fputs("STATE: +com.sample-cyan-error\n", stderr);
+        write_status("STATE", "+com.sample-cyan-error");
       else if (levels[0] >= 5 && last_levels[0] < 5)
-        fputs("STATE: -com.sample-cyan-error\n", stderr);
+        write_status("STATE", "-com.sample-cyan-error");
 
       if (levels[1] < 5 && last_levels[1] >= 5)
-        fputs("STATE: +com.sample-magenta-error\n", stderr);
+        write_status("STATE", "+com.sample-magenta-error");
       else if (levels[1] >= 5 && last_levels[1] < 5)
-        fputs("STATE: -com.sample-magenta-error\n", stderr);
+        write_status("STATE", "-com.sample-magenta-error");
 
       if (levels[2] < 5 && last_levels[2] >= 5)
-        fputs("STATE: +com.sample-yellow-error\n", stderr);
+        write_status("STATE", "+com.sample-yellow-error");
       else if (levels[2] >= 5 && last_levels[2] < 5)
-        fputs("STATE: -com.sample-yellow-error\n", stderr);
+        write_status("STATE", "-com.sample-yellow-error");
 
       if (levels[3] < 5 && last_levels[3] >= 5)
-        fputs("STATE: +com.sample-black-error\n", stderr);
+        write_status("STATE", "+com.sample-black-error");
       else if (levels[3] >= 5 && last_levels[3] < 5)
-        fputs("STATE: -com.sample-black-error\n", stderr);
+        write_status("STATE", "-com.sample-black-error");
 
       last_levels[0] = levels[0];
       last_levels[1] = levels[1];
@@ -187,8 +410,8 @@ GetStatus(ppd_file_t *ppd,		/* I - PPD file for printer */
       * Write out-of-paper STATE: messages to stderr...
       */
 
-      fputs("STATE: -media-low-report\n", stderr);
-      fputs("STATE: +media-empty-warning\n", stderr);
+      write_status("STATE", "-media-low-report");
+      write_status("STATE", "+media-empty-warning");
     }
     else if (!strcmp(start, "LP"))
     {
@@ -196,8 +419,8 @@ GetStatus(ppd_file_t *ppd,		/* I - PPD file for printer */
       * Write low-paper STATE: messages to stderr...
       */
 
-      fputs("STATE: -media-empty-warning\n", stderr);
-      fputs("STATE: +media-low-report\n", stderr);
+      write_status("STATE", "-media-empty-warning");
+      write_status("STATE", "+media-low-report");
     }
     else if (!strcmp(start, "OK"))
     {
@@ -205,12 +428,12 @@ GetStatus(ppd_file_t *ppd,		/* I - PPD file for printer */
       * Write no-error STATE: messages to stderr...
       */
 
-      fputs("STATE: -media-empty-warning\n", stderr);
-      fputs("STATE: -media-low-report\n", stderr);
+      write_status("STATE", "-media-empty-warning");
+      write_status("STATE", "-media-low-report");
     }
     else
     {
-      fprintf(stderr, "DEBUG: Unknown status \"%s\"!\n", start);
+      LogDebug("Unknown status \"%s\"!", start);
       return (0);
     }
   }
@@ -223,141 +446,868 @@ GetStatus(ppd_file_t *ppd,		/* I - PPD file for printer */
 }
 
 
+
 /*
- * 'Initialize()' - Open the PPD file and parse options.
+ * 'SetLocale()' - Load the message catalog and debug logging setting.
+ *
+ * The Localizable.strings files are in the Resources directory of the bundle
+ * containing the program.  cupsd passes the queue name as argv[0], so the
+ * program is found from the executable path the kernel reports, then from
+ * argv[0] if it is a path, and otherwise the installed bundle is used.
  */
 
-ppd_file_t *				/* O - PPD file for printer */
-Initialize(int        argc,		/* I - Number of command-line args */
-           char       *argv[],		/* I - Command-line arguments */
-           job_data_t *job)		/* O - Job data */
+void
+SetLocale(const char *program)		/* I - argv[0] */
 {
-  ppd_file_t	*ppd;			/* PPD file for printer */
+  const char	*language;		/* APPLE_LANGUAGE environment variable */
+  char		code[3],		/* Language code */
+		resources[1024],	/* Resources directory */
+		*ptr;			/* Pointer into resources directory */
+  int		i;			/* Looping var */
+#ifdef __APPLE__
+  uint32_t	pathsize = sizeof(resources);
+					/* Size of executable path */
+#else
+  ssize_t	pathlen;		/* Length of executable path */
+#endif /* __APPLE__ */
+  static const char * const names[][2] =
+  {					/* Older language directory names */
+    { "de", "German" },
+    { "en", "English" },
+    { "fr", "French" },
+    { "ja", "Japanese" }
+  };
 
 
  /*
-  * Validate the command-line arguments...
+  * Use the user's locale for any formatting done by the C library...
   */
 
-  if (argc < 6 || argc > 7)
-  {
-    fprintf(stderr, "Usage: %s job user title copies options [filename]\n",
-            argv[0]);
-    return (NULL);
-  }
+  setlocale(LC_MESSAGES, "");
 
  /*
-  * Localize...
+  * See whether the scheduler is logging debug messages...
   */
 
-  SetLocale();
+  load_log_level();
 
  /*
-  * Parse the options on the command-line...
+  * Find the Resources directory...
   */
 
-  job->job_id      = atoi(argv[1]);
-  job->user        = argv[2];
-  job->title       = argv[3];
-  job->num_options = cupsParseOptions(argv[5], 0, &(job->options));
+  if (catalog)
+    return;
+
+#ifdef __APPLE__
+  if (_NSGetExecutablePath(resources, &pathsize))
+    resources[0] = '\0';
+#else
+  if ((pathlen = readlink("/proc/self/exe", resources,
+                          sizeof(resources) - 1)) < 0)
+    pathlen = 0;
+
+  resources[pathlen] = '\0';
+#endif /* __APPLE__ */
+
+  if (!resources[0] && program && strchr(program, '/'))
+    snprintf(resources, sizeof(resources), "%s", program);
+
+  if ((ptr = strrchr(resources, '/')) != NULL)
+    snprintf(ptr, sizeof(resources) - (size_t)(ptr - resources),
+             "/../Resources");
+  else
+    snprintf(resources, sizeof(resources), "%s", SAMPLE_RESOURCES);
 
  /*
-  * Open the PPD file...
+  * Then load the catalog for the current language, which can be in a
+  * directory named for the language code or the older English name of the
+  * language, falling back on English...
   */
 
-  if ((ppd = ppdOpenFile(getenv("PPD"))) != NULL)
+  if ((language = getenv("APPLE_LANGUAGE")) == NULL)
+    language = getenv("LANG");
+
+  if (!language || !isalpha(language[0] & 255) || !isalpha(language[1] & 255))
+    language = "en";
+
+  code[0] = (char)tolower(language[0] & 255);
+  code[1] = (char)tolower(language[1] & 255);
+  code[2] = '\0';
+
+  if (load_catalog(resources, code))
+    return;
+
+  for (i = 0; i < (int)(sizeof(names) / sizeof(names[0])); i ++)
+    if (!strcmp(code, names[i][0]) && load_catalog(resources, names[i][1]))
+      return;
+
+  load_catalog(resources, "English");
+}
+
+
+/*
+ * 'StartStatus()' - Start a thread that reports status from the device.
+ */
+
+int					/* O - 1 on success, 0 on failure */
+StartStatus(void)
+{
+  if (status_started)
+    return (1);
+
+  if (pipe(status_pipe))
+    return (0);
+
+  status_done    = 0;
+  status_replies = 0;
+  status_levels  = 0;
+
+  if (pthread_create(&status_thread, NULL, status_monitor, NULL))
   {
+    close(status_pipe[0]);
+    close(status_pipe[1]);
+    status_pipe[0] = status_pipe[1] = -1;
+    return (0);
+  }
+
+  status_started = 1;
+
+  return (1);
+}
+
+
+/*
+ * 'StopStatus()' - Ask the device for its status, wait for a reply, and stop
+ *                  the status monitor thread.
+ *
+ * Without a monitor thread this is the same as GetStatus().
+ */
+
+void
+StopStatus(double timeout)		/* I - Time to wait for a reply in seconds */
+{
+  unsigned		replies;	/* Replies before the request */
+  uint64_t		start;		/* Start of round-trip */
+  struct timespec	deadline;	/* Time to give up */
+
+
+  if (!status_started)
+  {
+    GetStatus(NULL, timeout);
+    return;
+  }
+
+  if (timeout > 0.0)
+  {
+    TRACE_SCOPE("status wait");
+
    /*
-    * Mark the options for the job...
+    * Send a "get levels" command to the printer and wait for the reply...
     */
 
-    ppdMarkDefaults(ppd);
-    cupsMarkOptions(ppd, job->num_options, job->options);
+    get_deadline(timeout, &deadline);
+
+    pthread_mutex_lock(&status_mutex);
+
+    replies = status_replies;
+    start   = MetricsNow();
+
+    puts("LEVELS");
+    fflush(stdout);
+
+    while (status_replies == replies && !status_done)
+      if (pthread_cond_timedwait(&status_cond, &status_mutex, &deadline))
+        break;
+
+    if (status_replies != replies)
+    {
+      MetricsAdd(METRIC_ROUND_TRIPS, 1);
+      MetricsTime(METRIC_TIME_STATUS, MetricsNow() - start);
+    }
+
+    pthread_mutex_unlock(&status_mutex);
   }
-  else
-    LogMessage("ERROR", CFCopyLocalizedString(CFSTR("Unable to open PPD file: %s"), NULL), strerror(errno));
 
  /*
-  * Return the PPD to the caller...
+  * Wake up the thread and wait for it to finish...
   */
 
-  return (ppd);
+  write(status_pipe[1], "", 1);
+  pthread_join(status_thread, NULL);
+
+  close(status_pipe[0]);
+  close(status_pipe[1]);
+  status_pipe[0] = status_pipe[1] = -1;
+  status_started = 0;
 }
 
 
 /*
- * 'LogMessage()' - Write a localized message.
+ * 'WaitStatus()' - Wait for the device to answer LEVELS commands.
+ *
+ * The device answers each LEVELS command with one line of ink levels, in
+ * order, so once it has answered every LEVELS command sent so far it has
+ * also finished every command sent before them.
  */
 
-void
-LogMessage(const char  *prefix,		/* I - Prefix ("INFO", "ERROR", etc.) */
-           CFStringRef format,		/* I - Format string */
-	   ...)				/* I - Additional arguments as needed */
+int					/* O - 1 if answered, 0 on timeout or if the device went away */
+WaitStatus(unsigned requests,		/* I - Number of LEVELS commands sent */
+           double   timeout)		/* I - Time to wait in seconds */
 {
-  CFStringRef	formatted;		/* Formatted string */
-  va_list	ap;			/* Pointer to additional arguments */
-  char		buffer[2048];		/* Output buffer */
+  int			status;		/* Return status */
+  struct timespec	deadline;	/* Time to give up */
 
 
- /*
-  * Format the message...
-  */
+  if (!status_started)
+    return (0);
+
+  TRACE_SCOPE("status wait");
+
+  get_deadline(timeout, &deadline);
+
+  pthread_mutex_lock(&status_mutex);
+
+  while (status_levels < requests && !status_done)
+    if (pthread_cond_timedwait(&status_cond, &status_mutex, &deadline))
+      break;
+
+  status = status_levels >= requests;
+
+  pthread_mutex_unlock(&status_mutex);
+
+  return (status);
+}
+
+
+/*
+ * 'compare_messages()' - Compare the keys of two messages.
+ */
+
+static int				/* O - Result of comparison */
+compare_messages(const void *a,		/* I - First message */
+                 const void *b)		/* I - Second message */
+{
+  return (strcmp(((const message_t *)a)->key, ((const message_t *)b)->key));
+}
+
+
+/*
+ * 'format_args()' - Get the argument types used by a format string.
+ *
+ * Each argument is recorded as its conversion character plus any length
+ * modifiers, by position, so that a localized format can be checked against
+ * the English one before it is ever used.
+ */
+
+static int				/* O - Number of arguments or -1 on error */
+format_args(const char *format,		/* I - printf-style format string */
+            int        *args,		/* O - Argument types */
+	    int        max)		/* I - Size of argument array */
+{
+  int		count = 0,		/* Number of arguments */
+		seq = 0,		/* Next sequential argument */
+		pos,			/* Argument position */
+		type;			/* Argument type */
+  const char	*ptr;			/* Pointer into position */
 
-  va_start(ap, format);
 
-  if ((formatted = CFStringCreateWithFormatAndArguments(kCFAllocatorDefault, NULL, format, ap)) != NULL)
+  memset(args, 0, (size_t)max * sizeof(int));
+
+  while ((format = strchr(format, '%')) != NULL)
   {
-    if (CFStringGetCString(formatted, buffer, sizeof(buffer), kCFStringEncodingUTF8))
-      fprintf(stderr, "%s: %s\n", prefix, buffer);
-  
-    CFRelease(formatted);
+    if (*++format == '%')
+    {
+      format ++;
+      continue;
+    }
+
+    for (pos = 0, ptr = format; isdigit(*ptr & 255); ptr ++)
+      pos = pos * 10 + *ptr - '0';
+
+    if (*ptr == '$' && pos > 0)
+      format = ptr + 1;
+    else
+      pos = ++ seq;
+
+    while (*format && strchr("-+ #0'", *format))
+      format ++;
+
+    while (isdigit(*format & 255) || *format == '.')
+      format ++;
+
+    for (type = 0; *format && strchr("hlLqjzt", *format); format ++)
+      type = type * 128 + *format;
+
+    if (!*format || *format == '*' || pos > max)
+      return (-1);
+
+    args[pos - 1] = type * 128 + *format++;
+
+    if (pos > count)
+      count = pos;
   }
 
-  va_end(ap);
+  return (count);
+}
+
+
+/*
+ * 'get_deadline()' - Get the time to stop waiting for the device.
+ */
+
+static void
+get_deadline(double          timeout,	/* I - Time to wait in seconds */
+             struct timespec *deadline)	/* O - Time to give up */
+{
+  struct timeval	curtime;	/* Current time */
+
+
+  gettimeofday(&curtime, NULL);
+
+  deadline->tv_sec  = curtime.tv_sec + (time_t)timeout;
+  deadline->tv_nsec = curtime.tv_usec * 1000 + (long)((timeout - (time_t)timeout) * 1000000000.0);
+
+  if (deadline->tv_nsec >= 1000000000)
+  {
+    deadline->tv_sec ++;
+    deadline->tv_nsec -= 1000000000;
+  }
+}
+
+
+/*
+ * 'load_catalog()' - Load a Localizable.strings file.
+ *
+ * The file can be UTF-8 or UTF-16 with a byte order mark.  Localized strings
+ * whose format doesn't match the English message are ignored.
+ */
+
+static int				/* O - 1 on success, 0 on failure */
+load_catalog(const char *resources,	/* I - Resources directory */
+             const char *language)	/* I - Language directory name */
+{
+  char			filename[1024];	/* Catalog filename */
+  int			fd;		/* File descriptor */
+  struct stat		info;		/* File information */
+  unsigned char		*data,		/* File data */
+			*utf8;		/* UTF-8 data */
+  char			*ptr,		/* Pointer into data */
+			*key,		/* Key string */
+			*value;		/* Value string */
+  size_t		i,		/* Looping var */
+			alloc = 0;	/* Allocated messages */
+  unsigned		ch,		/* UTF-16 character */
+			ch2;		/* Second half of surrogate pair */
+  int			big,		/* Big-endian UTF-16? */
+			kargs[16],	/* English argument types */
+			vargs[16],	/* Localized argument types */
+			kcount,		/* Number of English arguments */
+			vcount,		/* Number of localized arguments */
+			j;		/* Looping var */
+  message_t		*temp;		/* New message array */
+
+
+  if (snprintf(filename, sizeof(filename), "%s/%s.lproj/Localizable.strings",
+               resources, language) >= (int)sizeof(filename) ||
+      (fd = open(filename, O_RDONLY)) < 0)
+    return (0);
+
+  if (fstat(fd, &info) || info.st_size < 2 ||
+      (data = malloc((size_t)info.st_size + 1)) == NULL)
+  {
+    close(fd);
+    return (0);
+  }
+
+  if (read(fd, data, (size_t)info.st_size) != (ssize_t)info.st_size)
+  {
+    close(fd);
+    free(data);
+    return (0);
+  }
+
+  close(fd);
+
+  data[info.st_size] = '\0';
+
+  if ((data[0] == 0xff && data[1] == 0xfe) || (data[0] == 0xfe && data[1] == 0xff))
+  {
+   /*
+    * Convert UTF-16 to UTF-8, which takes at most 3 bytes for every 2...
+    */
+
+    if ((utf8 = malloc((size_t)info.st_size / 2 * 3 + 1)) == NULL)
+    {
+      free(data);
+      return (0);
+    }
+
+    big = data[0] == 0xfe;
+
+    for (i = 2, ptr = (char *)utf8; (i + 1) < (size_t)info.st_size; i += 2)
+    {
+      ch = big ? (unsigned)((data[i] << 8) | data[i + 1]) : (unsigned)((data[i + 1] << 8) | data[i]);
+
+      if (ch >= 0xd800 && ch < 0xdc00 && (i + 3) < (size_t)info.st_size)
+      {
+        ch2 = big ? (unsigned)((data[i + 2] << 8) | data[i + 3]) : (unsigned)((data[i + 3] << 8) | data[i + 2]);
+
+        if (ch2 >= 0xdc00 && ch2 < 0xe000)
+	{
+	  ch = 0x10000 + ((ch - 0xd800) << 10) + (ch2 - 0xdc00);
+	  i += 2;
+	}
+      }
+
+      if (ch < 0x80)
+        *ptr++ = (char)ch;
+      else if (ch < 0x800)
+      {
+        *ptr++ = (char)(0xc0 | (ch >> 6));
+        *ptr++ = (char)(0x80 | (ch & 0x3f));
+      }
+      else if (ch < 0x10000)
+      {
+        *ptr++ = (char)(0xe0 | (ch >> 12));
+        *ptr++ = (char)(0x80 | ((ch >> 6) & 0x3f));
+        *ptr++ = (char)(0x80 | (ch & 0x3f));
+      }
+      else
+      {
+        *ptr++ = (char)(0xf0 | (ch >> 18));
+        *ptr++ = (char)(0x80 | ((ch >> 12) & 0x3f));
+        *ptr++ = (char)(0x80 | ((ch >> 6) & 0x3f));
+        *ptr++ = (char)(0x80 | (ch & 0x3f));
+      }
+    }
+
+    *ptr = '\0';
+
+    free(data);
+    data = utf8;
+  }
+
+  ptr = (char *)data;
+
+  if (!strncmp(ptr, "\357\273\277", 3))
+    ptr += 3;				/* Skip UTF-8 byte order mark */
 
  /*
-  * Since we call this function with a copy of the localized string, release it
-  * here so we don't leak memory for every LogMessage call...
+  * Read "key" = "value"; pairs, unescaping the strings in place...
   */
 
-  CFRelease(format);
+  while ((key = parse_string(&ptr)) != NULL)
+  {
+    while (isspace(*ptr & 255))
+      ptr ++;
+
+    if (*ptr++ != '=' || (value = parse_string(&ptr)) == NULL)
+      break;
+
+    while (isspace(*ptr & 255))
+      ptr ++;
+
+    if (*ptr == ';')
+      ptr ++;
+
+    if ((kcount = format_args(key, kargs, 16)) < 0 ||
+        (vcount = format_args(value, vargs, 16)) < 0 || vcount > kcount)
+      continue;
+
+    for (j = 0; j < vcount; j ++)
+      if (vargs[j] && vargs[j] != kargs[j])
+        break;
+
+    if (j < vcount)
+      continue;
+
+    if (catalog_count >= alloc)
+    {
+      alloc += 64;
+
+      if ((temp = realloc(catalog, alloc * sizeof(message_t))) == NULL)
+        break;
+
+      catalog = temp;
+    }
+
+    catalog[catalog_count].key   = key;
+    catalog[catalog_count].value = value;
+    catalog_count ++;
+  }
+
+  if (catalog_count == 0)
+  {
+    free(data);
+    free(catalog);
+    catalog = NULL;
+    return (0);
+  }
+
+  catalog_data = (char *)data;
+
+  qsort(catalog, catalog_count, sizeof(message_t), compare_messages);
+
+  return (1);
 }
 
 
 /*
- * 'SetLocale()' - Initialize bundle and POSIX localization.
+ * 'load_log_level()' - See whether the scheduler logs debug messages.
+ *
+ * The scheduler throws DEBUG messages away unless its LogLevel is "debug" or
+ * "debug2", in which case there's no need to format them at all.
  */
 
-void
-SetLocale(void)
+static void
+load_log_level(void)
+{
+  const char	*serverroot;		/* CUPS_SERVERROOT environment variable */
+  char		filename[1024],		/* cupsd.conf filename */
+		line[1024],		/* Line from file */
+		*ptr;			/* Pointer into line */
+  FILE		*fp;			/* cupsd.conf file */
+
+
+  if ((serverroot = getenv("CUPS_SERVERROOT")) == NULL)
+    serverroot = "/etc/cups";
+
+  if (snprintf(filename, sizeof(filename), "%s/cupsd.conf",
+               serverroot) >= (int)sizeof(filename) ||
+      (fp = fopen(filename, "r")) == NULL)
+    return;				/* Keep writing debug messages */
+
+  log_debug = 0;			/* Default LogLevel is "warn" */
+
+  while (fgets(line, sizeof(line), fp))
+  {
+    for (ptr = line; isspace(*ptr & 255); ptr ++);
+
+    if (!strncasecmp(ptr, "LogLevel", 8) && isspace(ptr[8] & 255))
+    {
+      for (ptr += 8; isspace(*ptr & 255); ptr ++);
+
+      log_debug = !strncasecmp(ptr, "debug", 5);
+    }
+  }
+
+  fclose(fp);
+}
+
+
+/*
+ * 'localize()' - Look up the localized version of a message.
+ */
+
+static const char *			/* O - Localized message */
+localize(const char *message)		/* I - English message */
 {
-  const char	*apple_language;	/* APPLE_LANGUAGE environment variable */
-  CFStringRef	language;		/* Language string */
-  CFArrayRef	languageArray;		/* Language array */
+  message_t	key,			/* Search key */
+		*match;			/* Matching message */
+
+
+  if (!catalog_count)
+    return (message);
+
+  key.key = message;
+
+  if ((match = bsearch(&key, catalog, catalog_count, sizeof(message_t), compare_messages)) != NULL)
+    return (match->value);
+
+  return (message);
+}
+
+
+/*
+ * 'parse_string()' - Parse a quoted string in a strings file.
+ *
+ * Comments and whitespace before the string are skipped.  The unescaped
+ * string is written over the original, which is never shorter.
+ */
+
+static char *				/* O - String or NULL if none */
+parse_string(char **ptr)		/* IO - Pointer into data */
+{
+  char		*src = *ptr,		/* Source */
+		*dst,			/* Destination */
+		*start;			/* Start of string */
+  unsigned	ch;			/* Unicode character */
+  int		i;			/* Looping var */
 
 
  /*
-  * Turn off buffering of stderr...
+  * Skip whitespace and comments...
   */
 
-  setbuf(stderr, NULL);
+  for (;;)
+  {
+    while (isspace(*src & 255))
+      src ++;
+
+    if (!strncmp(src, "/*", 2))
+    {
+      if ((src = strstr(src + 2, "*/")) == NULL)
+        return (NULL);
+
+      src += 2;
+    }
+    else if (!strncmp(src, "//", 2))
+    {
+      if ((src = strchr(src, '\n')) == NULL)
+        return (NULL);
+    }
+    else
+      break;
+  }
+
+  if (*src != '\"')
+    return (NULL);
 
  /*
-  * Setup the Core Foundation language environment for localized messages.
+  * Copy the string, handling the usual escapes...
   */
 
-  if ((apple_language = getenv("APPLE_LANGUAGE")) == NULL)
-    apple_language = getenv("LANG");
+  for (start = dst = ++ src; *src && *src != '\"'; src ++)
+  {
+    if (*src != '\\' || !src[1])
+    {
+      *dst++ = *src;
+      continue;
+    }
+
+    switch (*++src)
+    {
+      case 'n' :
+          *dst++ = '\n';
+	  break;
+      case 'r' :
+          *dst++ = '\r';
+	  break;
+      case 't' :
+          *dst++ = '\t';
+	  break;
+      case 'U' :
+      case 'u' :
+          for (i = 0, ch = 0; i < 4 && isxdigit(src[1] & 255); i ++, src ++)
+	    ch = ch * 16 + (unsigned)(isdigit(src[1] & 255) ? src[1] - '0' : tolower(src[1] & 255) - 'a' + 10);
+
+          if (ch < 0x80)
+	    *dst++ = (char)ch;
+	  else if (ch < 0x800)
+	  {
+	    *dst++ = (char)(0xc0 | (ch >> 6));
+	    *dst++ = (char)(0x80 | (ch & 0x3f));
+	  }
+	  else
+	  {
+	    *dst++ = (char)(0xe0 | (ch >> 12));
+	    *dst++ = (char)(0x80 | ((ch >> 6) & 0x3f));
+	    *dst++ = (char)(0x80 | (ch & 0x3f));
+	  }
+	  break;
+      default :
+          *dst++ = *src;
+	  break;
+    }
+  }
+
+  if (*src != '\"')
+    return (NULL);
+
+  *dst = '\0';
+  *ptr = src + 1;
+
+  return (start);
+}
+
+
+/*
+ * 'report_lines()' - Report complete lines of back-channel data.
+ *
+ * The ink level lines are counted for WaitStatus() before ParseStatus()
+ * splits the lines apart.
+ */
+
+static void
+report_lines(char *lines)		/* I - Nul-terminated lines */
+{
+  char		*ptr;			/* Pointer into lines */
+  unsigned	levels;			/* Ink level lines */
+
+
+  for (levels = 0, ptr = lines; ptr; ptr = strchr(ptr, '\n'))
+  {
+    if (*ptr == '\n')
+      ptr ++;
+
+    if (!strncmp(ptr, "IL", 2))
+      levels ++;
+  }
+
+  ParseStatus(lines);
+
+  pthread_mutex_lock(&status_mutex);
+  status_replies ++;
+  status_levels += levels;
+  pthread_cond_broadcast(&status_cond);
+  pthread_mutex_unlock(&status_mutex);
+}
+
+
+/*
+ * 'status_monitor()' - Read and report back-channel data until stopped.
+ */
+
+static void *				/* O - Thread exit status (unused) */
+status_monitor(void *data)		/* I - Thread data (unused) */
+{
+  struct pollfd	fds[2];			/* Back-channel and stop pipe */
+  char		buffer[2049],		/* Buffer for back-channel data */
+		*end,			/* End of complete lines */
+		saved;			/* Character after complete lines */
+  size_t	used = 0;		/* Bytes in buffer */
+  ssize_t	bytes;			/* Number of bytes read */
+
 
-  if (apple_language)
+  (void)data;
+
+  TRACE_THREAD("status");
+
+  fds[0].fd     = CUPS_BC_FD;
+  fds[0].events = POLLIN;
+  fds[1].fd     = status_pipe[0];
+  fds[1].events = POLLIN;
+
+  for (;;)
   {
-    language      = CFStringCreateWithCString(kCFAllocatorDefault, apple_language, kCFStringEncodingUTF8);
-    languageArray = CFArrayCreate(kCFAllocatorDefault, (const void **)&language, 1, &kCFTypeArrayCallBacks);
+    if (poll(fds, 2, -1) < 0)
+    {
+      if (errno == EINTR)
+        continue;
+
+      break;
+    }
 
-    CFPreferencesSetValue(CFSTR("AppleLanguages"), languageArray, kCFPreferencesCurrentApplication, kCFPreferencesAnyUser, kCFPreferencesAnyHost);
-    setlocale(LC_MESSAGES, "");
+    if (fds[1].revents || (fds[0].revents & POLLNVAL))
+      break;
+    else if (!fds[0].revents)
+      continue;
 
-    CFRelease(language);
-    CFRelease(languageArray);
+   /*
+    * Read whatever the backend sent, stopping when the back-channel is
+    * closed...
+    */
+
+    TRACE_SCOPE("status");
+
+    if ((bytes = cupsBackChannelRead(buffer + used, sizeof(buffer) - 1 - used,
+                                     0.0)) <= 0)
+      break;
+
+    used         += (size_t)bytes;
+    buffer[used] = '\0';
+
+   /*
+    * Then report the complete lines and keep any partial line for the next
+    * read, so a reply split between two reads is seen once.  A line too
+    * long for the buffer is reported as is...
+    */
+
+    if ((end = strrchr(buffer, '\n')) != NULL)
+      end ++;
+    else if (used < (sizeof(buffer) - 1))
+      continue;
+    else
+      end = buffer + used;
+
+    saved = *end;
+    *end  = '\0';
+
+    report_lines(buffer);
+
+    *end  = saved;
+    used -= (size_t)(end - buffer);
+
+    memmove(buffer, end, used + 1);
   }
+
+ /*
+  * A last line without a newline is complete once the back-channel closes...
+  */
+
+  if (used > 0)
+    report_lines(buffer);
+
+  pthread_mutex_lock(&status_mutex);
+  status_done = 1;
+  pthread_cond_broadcast(&status_cond);
+  pthread_mutex_unlock(&status_mutex);
+
+  return (NULL);
+}
+
+
+/*
+ * 'write_message()' - Format a message and write it to stderr.
+ *
+ * The message is formatted on the stack and written with a single write()
+ * so that messages from different threads are never mixed together.
+ */
+
+static void
+write_message(const char *prefix,	/* I - Prefix ("INFO", "ERROR", etc.) */
+              const char *format,	/* I - printf-style format string */
+	      va_list    ap)		/* I - Pointer to additional arguments */
+{
+  char		buffer[2048];		/* Output buffer */
+  int		bytes,			/* Length of prefix */
+		length;			/* Length of message */
+  ssize_t	written;		/* Bytes written */
+  const char	*ptr;			/* Pointer into buffer */
+
+
+  if ((bytes = snprintf(buffer, sizeof(buffer) - 1, "%s: ", prefix)) < 0)
+    return;
+  else if (bytes >= (int)sizeof(buffer) - 1)
+    bytes = sizeof(buffer) - 2;
+
+  if ((length = vsnprintf(buffer + bytes, sizeof(buffer) - 1 - (size_t)bytes, format, ap)) < 0)
+    return;
+  else if (length >= (int)sizeof(buffer) - 1 - bytes)
+    length = (int)sizeof(buffer) - 2 - bytes;
+
+  bytes += length;
+  buffer[bytes++] = '\n';
+
+  for (ptr = buffer; bytes > 0; ptr += written, bytes -= (int)written)
+  {
+    if ((written = write(2, ptr, (size_t)bytes)) < 0)
+    {
+      if (errno == EINTR)
+      {
+        written = 0;
+	continue;
+      }
+
+      break;
+    }
+  }
+}
+
+
+/*
+ * 'write_status()' - Write an ATTR: or STATE: message to stderr.
+ */
+
+static void
+write_status(const char *prefix,	/* I - Prefix ("ATTR" or "STATE") */
+             const char *format,	/* I - printf-style format string */
+	     ...)			/* I - Additional arguments as needed */
+{
+  va_list	ap;			/* Pointer to additional arguments */
+
+
+  va_start(ap, format);
+  write_message(prefix, format, ap);
+  va_end(ap);
 }
@@ -0,0 +1,495 @@
+/*
+     File: counters.c 
+ Abstract: Hardware performance counters for sample CUPS printer driver.
+  Version: 4.0 
+  
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple 
+ Inc. ("Apple") in consideration of your agreement to the following 
+ terms, and your use, installation, modification or redistribution of 
+ this Apple software constitutes acceptance of these terms.  If you do 
+ not agree with these terms, please do not use, install, modify or 
+ redistribute this Apple software. 
+  
+ In consideration of your agreement to abide by the following terms, and 
+ subject to these terms, Apple grants you a personal, non-exclusive 
+ license, under Apple's copyrights in this original Apple software (the 
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple 
+ Software, with or without modifications, in source and/or binary forms; 
+ provided that if you redistribute the Apple Software in its entirety and 
+ without modifications, you must retain this notice and the following 
+ text and disclaimers in all such redistributions of the Apple Software. 
+ Neither the name, trademarks, service marks or logos of Apple Inc. may 
+ be used to endorse or promote products derived from the Apple Software 
+ without specific prior written permission from Apple.  Except as 
+ expressly stated in this notice, no other rights or licenses, express or 
+ implied, are granted by Apple herein, including but not limited to any 
+ patent rights that may be infringed by your derivative works or by other 
+ works in which the Apple Software may be incorporated. 
+  
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE 
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION 
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS 
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND 
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS. 
+  
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL 
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, 
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED 
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), 
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE 
+ POSSIBILITY OF SUCH DAMAGE. 
+  
+ Copyright (C) 2011 Apple Inc. All Rights Reserved. 
+  
+ */  
+
+#include "counters.h"			/* Hardware counter definitions */
+#include "sample.h"			/* Logging */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#ifdef __linux__
+#  include <linux/perf_event.h>
+#  include <sys/ioctl.h>
+#  include <sys/syscall.h>
+#  define HAVE_PERF_EVENTS 1
+#endif /* __linux__ */
+
+
+/*
+ * Counter group for one thread...
+ *
+ * The group is read with PERF_FORMAT_GROUP, which returns the number of
+ * counters followed by their values in the order they were opened.
+ */
+
+typedef struct
+{
+  int			leader,		/* Group leader or -1 for timing only */
+			num_counters,	/* Number of counters in group */
+			fds[COUNTER_MAX];
+					/* Counter file descriptors */
+  counter_t		counters[COUNTER_MAX];
+					/* Counters in read order */
+} counter_group_t;
+
+
+/*
+ * Globals...
+ */
+
+int			Counting = 0;	/* Are counters on? */
+
+
+/*
+ * Local globals...
+ */
+
+static const char * const counter_names[COUNTER_MAX] =
+{					/* Counter names for reports */
+  "cycles",
+  "instructions",
+  "cache_misses",
+  "branch_misses"
+};
+static pthread_key_t	counter_key;	/* Counter group for each thread */
+static unsigned		counter_mask = 0;
+					/* Counters available on main thread */
+static int		counter_report = 0;
+					/* Report counters? */
+static FILE		*counter_fp = NULL;
+					/* JSON summary file or NULL */
+static char		counter_program[256] = "",
+					/* Program name */
+			counter_job[256] = "";
+					/* Job ID */
+
+
+/*
+ * Local functions...
+ */
+
+static void		close_group(void *data);
+static unsigned long long get_nsecs(void);
+static counter_group_t	*get_group(void);
+static int		read_group(counter_group_t *group,
+			           unsigned long long *values);
+static void		report_totals(const char *name, int page,
+			              counter_totals_t *totals);
+
+
+/*
+ * 'CountersBegin()' - Start a sample around a kernel call.
+ */
+
+void
+CountersBegin(counter_sample_t *sample)	/* O - Sample */
+{
+  counter_group_t	*group;		/* Counters for this thread */
+
+
+  if ((sample->active = Counting) == 0)
+    return;
+
+  group = counter_report ? get_group() : NULL;
+
+  if (!group || !read_group(group, sample->values))
+    memset(sample->values, 0, sizeof(sample->values));
+
+  sample->nsecs = get_nsecs();
+}
+
+
+/*
+ * 'CountersEnd()' - Finish a sample and add it to a stage.
+ */
+
+void
+CountersEnd(counter_stage_t  *stage,	/* I - Stage */
+            counter_sample_t *sample)	/* I - Sample from CountersBegin() */
+{
+  unsigned long long	nsecs,		/* End time */
+			values[COUNTER_MAX];
+					/* Ending counter values */
+  counter_group_t	*group;		/* Counters for this thread */
+  int			i;		/* Looping var */
+
+
+  if (!sample->active)
+    return;
+
+  nsecs = get_nsecs();
+  group = counter_report ? get_group() : NULL;
+
+  if (!group || !read_group(group, values))
+    memcpy(values, sample->values, sizeof(values));
+
+  pthread_mutex_lock(&stage->mutex);
+
+  stage->page.calls ++;
+  stage->page.nsecs += nsecs - sample->nsecs;
+
+  for (i = 0; i < COUNTER_MAX; i ++)
+    stage->page.values[i] += values[i] - sample->values[i];
+
+  pthread_mutex_unlock(&stage->mutex);
+}
+
+
+/*
+ * 'CountersReport()' - Report and reset stage totals.
+ *
+ * "page" is the page number, or 0 to report the totals for the job.  Page
+ * totals are added to the job totals when they are reported.
+ */
+
+void
+CountersReport(counter_stage_t *stages,	/* I - Stages */
+               int             num_stages,
+					/* I - Number of stages */
+	       int             page)	/* I - Page number or 0 for job */
+{
+  int	i, j;				/* Looping vars */
+
+
+  if (!Counting)
+    return;
+
+  for (i = 0; i < num_stages; i ++)
+  {
+    pthread_mutex_lock(&stages[i].mutex);
+
+    if (page > 0)
+    {
+      stages[i].job.calls += stages[i].page.calls;
+      stages[i].job.nsecs += stages[i].page.nsecs;
+
+      for (j = 0; j < COUNTER_MAX; j ++)
+        stages[i].job.values[j] += stages[i].page.values[j];
+
+      if (counter_report)
+        report_totals(stages[i].name, page, &stages[i].page);
+
+      memset(&stages[i].page, 0, sizeof(counter_totals_t));
+    }
+    else if (counter_report)
+      report_totals(stages[i].name, 0, &stages[i].job);
+
+    pthread_mutex_unlock(&stages[i].mutex);
+  }
+
+  if (counter_fp)
+    fflush(counter_fp);
+}
+
+
+/*
+ * 'CountersStart()' - Turn counters on if SAMPLE_COUNTERS is set.
+ *
+ * When "timing" is non-zero the stages are timed even without
+ * SAMPLE_COUNTERS, but nothing is reported.
+ */
+
+int					/* O - 1 if counting, 0 otherwise */
+CountersStart(const char *program,	/* I - Program name */
+              const char *job,		/* I - Job ID */
+	      int        timing)	/* I - Time stages without counters? */
+{
+  const char		*value;		/* SAMPLE_COUNTERS value */
+  counter_group_t	*group;		/* Counters for main thread */
+  char			names[256];	/* Names of available counters */
+  int			i;		/* Looping var */
+
+
+  if (Counting)
+    return (1);
+
+  if ((value = getenv("SAMPLE_COUNTERS")) == NULL)
+  {
+    Counting = timing != 0;
+    return (Counting);
+  }
+
+  if (pthread_key_create(&counter_key, close_group))
+    return (0);
+
+  snprintf(counter_program, sizeof(counter_program), "%s", program);
+  snprintf(counter_job, sizeof(counter_job), "%s", job);
+
+  if (value[0] == '/' && (counter_fp = fopen(value, "a")) == NULL)
+    LogDebug("Unable to open counter summary \"%s\": %s", value,
+             strerror(errno));
+
+  Counting       = 1;
+  counter_report = 1;
+
+ /*
+  * Open the main thread's counters now to see what's available...
+  */
+
+  if ((group = get_group()) != NULL)
+    for (i = 0; i < group->num_counters; i ++)
+      counter_mask |= 1 << group->counters[i];
+
+  for (i = 0, names[0] = '\0'; i < COUNTER_MAX; i ++)
+    if (counter_mask & (1 << i))
+    {
+      if (names[0])
+        strncat(names, ", ", sizeof(names) - strlen(names) - 1);
+      strncat(names, counter_names[i], sizeof(names) - strlen(names) - 1);
+    }
+
+  if (names[0])
+    LogDebug("Counting %s.", names);
+  else
+    LogDebug("Hardware counters not available, timing only.");
+
+  return (1);
+}
+
+
+/*
+ * 'close_group()' - Close a thread's counters when it exits.
+ */
+
+static void
+close_group(void *data)			/* I - Counter group */
+{
+  counter_group_t	*group = (counter_group_t *)data;
+					/* Counter group */
+  int			i;		/* Looping var */
+
+
+  for (i = 0; i < group->num_counters; i ++)
+    close(group->fds[i]);
+
+  free(group);
+}
+
+
+/*
+ * 'get_nsecs()' - Get a monotonic time in nanoseconds.
+ */
+
+static unsigned long long		/* O - Time in nanoseconds */
+get_nsecs(void)
+{
+#ifdef CLOCK_MONOTONIC
+  struct timespec	curtime;	/* Current time */
+
+
+  clock_gettime(CLOCK_MONOTONIC, &curtime);
+
+  return ((unsigned long long)curtime.tv_sec * 1000000000 + curtime.tv_nsec);
+
+#else
+  struct timeval	curtime;	/* Current time */
+
+
+  gettimeofday(&curtime, NULL);
+
+  return ((unsigned long long)curtime.tv_sec * 1000000000 + curtime.tv_usec * 1000);
+#endif /* CLOCK_MONOTONIC */
+}
+
+
+/*
+ * 'get_group()' - Get the counters for the current thread, opening them the
+ *                 first time.
+ */
+
+static counter_group_t *		/* O - Counter group or NULL */
+get_group(void)
+{
+  counter_group_t	*group;		/* Counter group */
+#ifdef HAVE_PERF_EVENTS
+  struct perf_event_attr attr;		/* Counter attributes */
+  int			i,		/* Looping var */
+			fd;		/* Counter file descriptor */
+  static const unsigned long long configs[COUNTER_MAX] =
+  {					/* perf_event_open configs */
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES,
+    PERF_COUNT_HW_BRANCH_MISSES
+  };
+#endif /* HAVE_PERF_EVENTS */
+
+
+  if ((group = pthread_getspecific(counter_key)) != NULL)
+    return (group);
+
+  if ((group = calloc(1, sizeof(counter_group_t))) == NULL)
+    return (NULL);
+
+  group->leader = -1;
+
+#ifdef HAVE_PERF_EVENTS
+ /*
+  * Open each counter, skipping the ones this system doesn't have.  Only
+  * user-space events are counted so that a perf_event_paranoid setting of 2
+  * still works...
+  */
+
+  for (i = 0; i < COUNTER_MAX; i ++)
+  {
+    memset(&attr, 0, sizeof(attr));
+
+    attr.size           = sizeof(attr);
+    attr.type           = PERF_TYPE_HARDWARE;
+    attr.config         = configs[i];
+    attr.disabled       = group->leader < 0;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv     = 1;
+    attr.read_format    = PERF_FORMAT_GROUP;
+
+    if ((fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, group->leader, 0)) < 0)
+      continue;
+
+    if (group->leader < 0)
+      group->leader = fd;
+
+    group->fds[group->num_counters]        = fd;
+    group->counters[group->num_counters ++] = (counter_t)i;
+  }
+
+  if (group->leader >= 0)
+    ioctl(group->leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif /* HAVE_PERF_EVENTS */
+
+  pthread_setspecific(counter_key, group);
+
+  return (group);
+}
+
+
+/*
+ * 'read_group()' - Read the current counter values.
+ */
+
+static int				/* O - 1 on success, 0 on failure */
+read_group(counter_group_t    *group,	/* I - Counter group */
+           unsigned long long *values)	/* O - Counter values */
+{
+  unsigned long long	buffer[COUNTER_MAX + 1];
+					/* Number of counters and values */
+  int			i;		/* Looping var */
+
+
+  if (group->leader < 0 ||
+      read(group->leader, buffer, sizeof(buffer)) < (ssize_t)((group->num_counters + 1) * sizeof(buffer[0])))
+    return (0);
+
+  memset(values, 0, COUNTER_MAX * sizeof(values[0]));
+
+  for (i = 0; i < group->num_counters; i ++)
+    values[group->counters[i]] = buffer[i + 1];
+
+  return (1);
+}
+
+
+/*
+ * 'report_totals()' - Log one stage's totals and write its JSON summary.
+ */
+
+static void
+report_totals(const char       *name,	/* I - Stage name */
+              int              page,	/* I - Page number or 0 for job */
+              counter_totals_t *totals)	/* I - Totals */
+{
+  char		label[64],		/* "Page N" or "Job" */
+		text[512],		/* Counter text */
+		json[1024],		/* JSON summary */
+		*ptr;			/* Pointer into text */
+  int		i;			/* Looping var */
+
+
+  if (page > 0)
+    snprintf(label, sizeof(label), "Page %d", page);
+  else
+    snprintf(label, sizeof(label), "Job");
+
+  snprintf(json, sizeof(json),
+           "{\"program\":\"%s\",\"pid\":%d,\"job\":\"%s\",\"page\":%d,"
+	   "\"stage\":\"%s\",\"calls\":%llu,\"nsecs\":%llu",
+	   counter_program, (int)getpid(), counter_job, page, name,
+	   totals->calls, totals->nsecs);
+
+  for (i = 0, ptr = text, text[0] = '\0'; i < COUNTER_MAX; i ++)
+  {
+    if (!(counter_mask & (1 << i)))
+      continue;
+
+    snprintf(ptr, sizeof(text) - (size_t)(ptr - text), ", %llu %s",
+             totals->values[i], counter_names[i]);
+    ptr += strlen(ptr);
+
+    snprintf(json + strlen(json), sizeof(json) - strlen(json), ",\"%s\":%llu",
+             counter_names[i], totals->values[i]);
+  }
+
+  if ((counter_mask & (1 << COUNTER_CYCLES)) &&
+      (counter_mask & (1 << COUNTER_INSTRUCTIONS)) &&
+      totals->values[COUNTER_CYCLES] > 0)
+    snprintf(ptr, sizeof(text) - (size_t)(ptr - text), ", %.2f IPC",
+             (double)totals->values[COUNTER_INSTRUCTIONS] /
+	         (double)totals->values[COUNTER_CYCLES]);
+
+  strncat(json, "}", sizeof(json) - strlen(json) - 1);
+
+  LogDebug("%s %s: %llu calls, %.3f ms%s", label, name, totals->calls,
+           totals->nsecs * 0.000001, text);
+
+  if (counter_fp)
+    fprintf(counter_fp, "%s\n", json);
+  else
+    LogDebug("COUNTERS %s", json);
+}
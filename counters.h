@@ -0,0 +1,134 @@
+/*
+     File: counters.h 
+ Abstract: Hardware performance counter definitions for sample CUPS printer driver.
+  Version: 4.0 
+  
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple 
+ Inc. ("Apple") in consideration of your agreement to the following 
+ terms, and your use, installation, modification or redistribution of 
+ this Apple software constitutes acceptance of these terms.  If you do 
+ not agree with these terms, please do not use, install, modify or 
+ redistribute this Apple software. 
+  
+ In consideration of your agreement to abide by the following terms, and 
+ subject to these terms, Apple grants you a personal, non-exclusive 
+ license, under Apple's copyrights in this original Apple software (the 
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple 
+ Software, with or without modifications, in source and/or binary forms; 
+ provided that if you redistribute the Apple Software in its entirety and 
+ without modifications, you must retain this notice and the following 
+ text and disclaimers in all such redistributions of the Apple Software. 
+ Neither the name, trademarks, service marks or logos of Apple Inc. may 
+ be used to endorse or promote products derived from the Apple Software 
+ without specific prior written permission from Apple.  Except as 
+ expressly stated in this notice, no other rights or licenses, express or 
+ implied, are granted by Apple herein, including but not limited to any 
+ patent rights that may be infringed by your derivative works or by other 
+ works in which the Apple Software may be incorporated. 
+  
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE 
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION 
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS 
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND 
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS. 
+  
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL 
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, 
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED 
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), 
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE 
+ POSSIBILITY OF SUCH DAMAGE. 
+  
+ Copyright (C) 2011 Apple Inc. All Rights Reserved. 
+  
+ */  
+
+#ifndef _SAMPLE_COUNTERS_H_
+#  define _SAMPLE_COUNTERS_H_
+
+/*
+ * Include necessary headers...
+ */
+
+#  include <pthread.h>
+
+
+/*
+ * Hardware counters...
+ */
+
+typedef enum
+{
+  COUNTER_CYCLES,			/* CPU cycles */
+  COUNTER_INSTRUCTIONS,			/* Instructions retired */
+  COUNTER_CACHE_MISSES,			/* Last-level cache misses */
+  COUNTER_BRANCH_MISSES,		/* Mispredicted branches */
+  COUNTER_MAX
+} counter_t;
+
+
+/*
+ * Counter data...
+ *
+ * Setting SAMPLE_COUNTERS turns on counting around the raster kernels.  On
+ * Linux each thread opens a perf_event_open group for the counters above;
+ * counters the system doesn't have (containers and virtual machines often
+ * have none) are left out, and everywhere else only the time is measured.
+ *
+ * A stage is one kind of kernel call.  Totals are kept for the current page
+ * and for the job.  CountersReport() logs them as DEBUG lines and writes one
+ * JSON object per stage either to the file named by SAMPLE_COUNTERS, when
+ * it is an absolute path, or as "DEBUG: COUNTERS {...}" lines.  The stages
+ * can also be timed without SAMPLE_COUNTERS for the shared job metrics, in
+ * which case nothing is reported.
+ */
+
+typedef struct
+{
+  unsigned long long	calls,		/* Number of calls */
+			nsecs,		/* Time in nanoseconds */
+			values[COUNTER_MAX];
+					/* Counter values */
+} counter_totals_t;
+
+typedef struct
+{
+  const char		*name;		/* Stage name */
+  pthread_mutex_t	mutex;		/* Lock for totals */
+  counter_totals_t	page,		/* Totals for the current page */
+			job;		/* Totals for the job */
+} counter_stage_t;
+
+typedef struct
+{
+  int			active;		/* Is this sample being taken? */
+  unsigned long long	nsecs,		/* Start time in nanoseconds */
+			values[COUNTER_MAX];
+					/* Starting counter values */
+} counter_sample_t;
+
+#  define COUNTER_STAGE(name)	{ name, PTHREAD_MUTEX_INITIALIZER, { 0 }, { 0 } }
+
+
+/*
+ * Globals...
+ */
+
+extern int		Counting;	/* Are counters on? */
+
+
+/*
+ * Prototypes...
+ */
+
+extern void		CountersBegin(counter_sample_t *sample);
+extern void		CountersEnd(counter_stage_t *stage,
+			            counter_sample_t *sample);
+extern void		CountersReport(counter_stage_t *stages, int num_stages,
+			               int page);
+extern int		CountersStart(const char *program, const char *job,
+			              int timing);
+
+#endif /* !_SAMPLE_COUNTERS_H_ */
@@ -0,0 +1,825 @@
+/*
+     File: halftone.c 
+ Abstract: Halftoning for sample CUPS printer driver.
+  Version: 4.0 
+  
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple 
+ Inc. ("Apple") in consideration of your agreement to the following 
+ terms, and your use, installation, modification or redistribution of 
+ this Apple software constitutes acceptance of these terms.  If you do 
+ not agree with these terms, please do not use, install, modify or 
+ redistribute this Apple software. 
+  
+ In consideration of your agreement to abide by the following terms, and 
+ subject to these terms, Apple grants you a personal, non-exclusive 
+ license, under Apple's copyrights in this original Apple software (the 
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple 
+ Software, with or without modifications, in source and/or binary forms; 
+ provided that if you redistribute the Apple Software in its entirety and 
+ without modifications, you must retain this notice and the following 
+ text and disclaimers in all such redistributions of the Apple Software. 
+ Neither the name, trademarks, service marks or logos of Apple Inc. may 
+ be used to endorse or promote products derived from the Apple Software 
+ without specific prior written permission from Apple.  Except as 
+ expressly stated in this notice, no other rights or licenses, express or 
+ implied, are granted by Apple herein, including but not limited to any 
+ patent rights that may be infringed by your derivative works or by other 
+ works in which the Apple Software may be incorporated. 
+  
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE 
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION 
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS 
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND 
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS. 
+  
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL 
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, 
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED 
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), 
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE 
+ POSSIBILITY OF SUCH DAMAGE. 
+  
+ Copyright (C) 2011 Apple Inc. All Rights Reserved. 
+  
+ */  
+
+#include "halftone.h"			/* Halftoning definitions */
+#include "kernels.h"			/* CPU feature detection */
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#  include <emmintrin.h>
+#endif /* __SSE2__ */
+#if defined(__i386__) || defined(__x86_64__)
+#  if defined(__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)
+#    include <immintrin.h>
+#    define HAVE_AVX2_KERNELS 1
+#  endif /* __clang__ || __GNUC__ >= 4.9 */
+#endif /* __i386__ || __x86_64__ */
+
+
+/*
+ * Threshold matrices...
+ *
+ * Matrix values are 0 to 255.  For a sample value v, a threshold t (the
+ * matrix value scaled to 0 to 254), and L ink levels above white/black (1 or
+ * 3), the ink level is:
+ *
+ *     (v * L + t) / 255
+ *
+ * so white (255) and solid (0) samples are never dithered.
+ */
+
+#define BAYER_SIZE	16		/* Size of ordered dither matrix */
+#define BLUENOISE_SIZE	64		/* Size of blue-noise matrix */
+#define BLUENOISE_SIGMA	1.5		/* Void-and-cluster filter width */
+#define BLUENOISE_RADIUS 8		/* Filter radius, beyond which it is ~0 */
+
+
+/*
+ * Memory ordering for the carried error row...
+ */
+
+#if defined(__ATOMIC_ACQUIRE)
+#  define halftone_load(p)	__atomic_load_n(p, __ATOMIC_ACQUIRE)
+#  define halftone_store(p,v)	__atomic_store_n(p, v, __ATOMIC_RELEASE)
+#else
+#  define halftone_load(p)	halftone_load_sync(p)
+#  define halftone_store(p,v)	(__sync_synchronize(), *(volatile unsigned *)(p) = (v))
+
+static inline unsigned
+halftone_load_sync(unsigned *p)
+{
+  unsigned v = *(volatile unsigned *)p;
+
+  __sync_synchronize();
+
+  return (v);
+}
+#endif /* __ATOMIC_ACQUIRE */
+
+
+/*
+ * Local globals...
+ */
+
+static const char * const halftone_names[] =
+{					/* Mode names, as used in the PPD */
+  "None",
+  "Ordered",
+  "BlueNoise",
+  "ErrorDiffusion"
+};
+
+static unsigned char	bitrev[256];	/* Bit-reversed bytes */
+
+
+/*
+ * Local functions...
+ */
+
+static const unsigned char *bayer_matrix(void);
+static const unsigned char *bluenoise_matrix(void);
+static void	bluenoise_update(float *energy, const float *kernel,
+		                 unsigned point, float sign);
+static void	diffuse_line(halftone_t *ht, unsigned char *dst,
+		             const unsigned char *src, unsigned y);
+static void	dither1_scalar(unsigned char *dst, const unsigned char *src,
+		               const unsigned char *thr, size_t count);
+#if defined(__SSE2__)
+static void	dither1_sse2(unsigned char *dst, const unsigned char *src,
+		             const unsigned char *thr, size_t count);
+#endif /* __SSE2__ */
+#ifdef HAVE_AVX2_KERNELS
+static void	dither1_avx2(unsigned char *dst, const unsigned char *src,
+		             const unsigned char *thr, size_t count)
+			     __attribute__((target("avx2")));
+#endif /* HAVE_AVX2_KERNELS */
+static void	dither2(unsigned char *dst, const unsigned char *src,
+		        const unsigned char *thr, size_t count);
+
+
+/*
+ * 'HalftoneDelete()' - Free the memory used for halftoning.
+ */
+
+void
+HalftoneDelete(halftone_t *ht)		/* I - Halftoning data */
+{
+  if (!ht)
+    return;
+
+  free(ht->thresholds);
+  free(ht->errors[0]);
+  free(ht->errors[1]);
+  free(ht);
+}
+
+
+/*
+ * 'HalftoneLines()' - Halftone lines of 8-bit data.
+ *
+ * Lines are packed into the destination buffer one after another, "bytes"
+ * apart.
+ */
+
+void
+HalftoneLines(
+    halftone_t          *ht,		/* I - Halftoning data */
+    unsigned char       *dst,		/* O - Packed lines */
+    const unsigned char **lines,	/* I - 8-bit lines */
+    unsigned            y,		/* I - First line */
+    unsigned            count)		/* I - Number of lines */
+{
+  unsigned		i;		/* Looping var */
+  const unsigned char	*thr;		/* Threshold row */
+  unsigned		features = GetCPUFeatures();
+					/* Supported CPU features */
+
+
+  if (ht->mode == HALFTONE_DIFFUSION)
+  {
+    for (i = 0; i < count; i ++, dst += ht->bytes)
+      diffuse_line(ht, dst, lines[i], y + i);
+
+    halftone_store(&ht->next_y, y + count);
+    return;
+  }
+
+  for (i = 0; i < count; i ++, dst += ht->bytes)
+  {
+    thr = ht->thresholds + ((y + i) % ht->size) * ht->samples;
+
+    if (ht->bits == 2)
+      dither2(dst, lines[i], thr, ht->samples);
+#ifdef HAVE_AVX2_KERNELS
+    else if (features & KERNEL_AVX2)
+      dither1_avx2(dst, lines[i], thr, ht->samples);
+#endif /* HAVE_AVX2_KERNELS */
+#if defined(__SSE2__)
+    else if (features & KERNEL_SSE2)
+      dither1_sse2(dst, lines[i], thr, ht->samples);
+#endif /* __SSE2__ */
+    else
+      dither1_scalar(dst, lines[i], thr, ht->samples);
+  }
+
+  (void)features;
+}
+
+
+/*
+ * 'HalftoneName()' - Return the name of a halftoning mode.
+ */
+
+const char *				/* O - Mode name */
+HalftoneName(halftone_mode_t mode)	/* I - Halftoning mode */
+{
+  if (mode < HALFTONE_NONE || mode > HALFTONE_DIFFUSION)
+    return ("unknown");
+
+  return (halftone_names[mode]);
+}
+
+
+/*
+ * 'HalftoneNew()' - Prepare to halftone a page.
+ */
+
+halftone_t *				/* O - Halftoning data or NULL on error */
+HalftoneNew(halftone_mode_t mode,	/* I - Halftoning mode */
+            unsigned        bits,	/* I - Bits per sample (1 or 2) */
+	    unsigned        width,	/* I - Width in pixels */
+	    unsigned        colors)	/* I - Samples per pixel */
+{
+  halftone_t		*ht;		/* Halftoning data */
+  const unsigned char	*matrix;	/* Threshold matrix */
+  unsigned char		*thr;		/* Current threshold */
+  unsigned		i, x, y,	/* Looping vars */
+			t;		/* Threshold value */
+
+
+  if (mode == HALFTONE_NONE || (bits != 1 && bits != 2) || width == 0 ||
+      colors == 0 || colors > 4)
+    return (NULL);
+
+  if ((ht = calloc(1, sizeof(halftone_t))) == NULL)
+    return (NULL);
+
+  ht->mode    = mode;
+  ht->bits    = bits;
+  ht->width   = width;
+  ht->colors  = colors;
+  ht->samples = (size_t)width * colors;
+  ht->bytes   = (ht->samples * bits + 7) / 8;
+
+  if (!bitrev[128])
+  {
+    for (i = 0; i < 256; i ++)
+    {
+      for (x = 0, t = 0; x < 8; x ++)
+        if (i & (1 << x))
+	  t |= 0x80 >> x;
+
+      bitrev[i] = (unsigned char)t;
+    }
+  }
+
+  if (mode == HALFTONE_DIFFUSION)
+  {
+   /*
+    * Error rows have an extra pixel on each side so the filter doesn't need
+    * to check for the ends of the line...
+    */
+
+    if ((ht->errors[0] = calloc(ht->samples + 2 * colors, sizeof(int))) == NULL ||
+        (ht->errors[1] = calloc(ht->samples + 2 * colors, sizeof(int))) == NULL)
+    {
+      HalftoneDelete(ht);
+      return (NULL);
+    }
+
+    return (ht);
+  }
+
+ /*
+  * Expand the threshold matrix into one row of thresholds per matrix row, so
+  * dithering a line is a straight compare of two arrays...
+  */
+
+  if (mode == HALFTONE_BLUENOISE)
+  {
+    matrix   = bluenoise_matrix();
+    ht->size = BLUENOISE_SIZE;
+  }
+  else
+  {
+    matrix   = bayer_matrix();
+    ht->size = BAYER_SIZE;
+  }
+
+  if (!matrix || (ht->thresholds = malloc(ht->size * ht->samples)) == NULL)
+  {
+    HalftoneDelete(ht);
+    return (NULL);
+  }
+
+  for (y = 0, thr = ht->thresholds; y < ht->size; y ++)
+  {
+    for (x = 0; x < width; x ++)
+    {
+      t = matrix[y * ht->size + x % ht->size] * 255 / 256;
+
+      if (bits == 1)
+        t = 254 - t;			/* Ink if v > 254 - t */
+
+      for (i = 0; i < colors; i ++)
+        *thr++ = (unsigned char)t;
+    }
+  }
+
+  return (ht);
+}
+
+
+/*
+ * 'HalftoneReady()' - See whether lines starting at "y" can be halftoned.
+ *
+ * This is always true for threshold modes.  For error diffusion it is true
+ * once every line above "y" has been halftoned.
+ */
+
+int					/* O - 1 if ready, 0 otherwise */
+HalftoneReady(halftone_t *ht,		/* I - Halftoning data */
+              unsigned   y)		/* I - First line */
+{
+  return (ht->mode != HALFTONE_DIFFUSION || halftone_load(&ht->next_y) == y);
+}
+
+
+/*
+ * 'HalftoneValue()' - Return the halftoning mode with the given name.
+ */
+
+int					/* O - Mode or -1 if unknown */
+HalftoneValue(const char *name)		/* I - Mode name */
+{
+  int	i;				/* Looping var */
+
+
+  for (i = HALFTONE_NONE; i <= HALFTONE_DIFFUSION; i ++)
+    if (!strcmp(name, halftone_names[i]))
+      return (i);
+
+  return (-1);
+}
+
+
+/*
+ * 'bayer_matrix()' - Return the ordered dither matrix.
+ *
+ * Each level of the recursive Bayer matrix comes from one bit of the X and
+ * Y coordinates, with the finest level in the most significant bits.
+ */
+
+static const unsigned char *		/* O - 16x16 matrix */
+bayer_matrix(void)
+{
+  static unsigned char	matrix[BAYER_SIZE * BAYER_SIZE];
+					/* Matrix */
+  static int		ready = 0;	/* Matrix initialized? */
+  unsigned		x, y, i, v;	/* Looping vars */
+
+
+  if (!ready)
+  {
+    for (y = 0; y < BAYER_SIZE; y ++)
+      for (x = 0; x < BAYER_SIZE; x ++)
+      {
+        for (i = 0, v = 0; i < 4; i ++)
+	  v = (v << 2) | ((((x ^ y) >> i) & 1) << 1) | ((y >> i) & 1);
+
+        matrix[y * BAYER_SIZE + x] = (unsigned char)v;
+      }
+
+    ready = 1;
+  }
+
+  return (matrix);
+}
+
+
+/*
+ * 'bluenoise_matrix()' - Return the blue-noise threshold matrix.
+ *
+ * The matrix is made once with Ulichney's void-and-cluster method: a random
+ * pattern is relaxed by moving points from the tightest cluster to the
+ * largest void, then every position is ranked by removing clusters from the
+ * pattern and filling voids until the matrix is full.  Cluster and void sizes
+ * come from a Gaussian filter that wraps around the matrix edges so the
+ * matrix tiles seamlessly.
+ */
+
+static const unsigned char *		/* O - 64x64 matrix or NULL on error */
+bluenoise_matrix(void)
+{
+  static unsigned char	*matrix = NULL;	/* Matrix */
+  const unsigned	size = BLUENOISE_SIZE,
+			count = BLUENOISE_SIZE * BLUENOISE_SIZE;
+  float			*kernel,	/* Gaussian filter */
+			*energy,	/* Filtered pattern */
+			*initial;	/* Energy of initial pattern */
+  unsigned char		*pattern,	/* Current binary pattern */
+			*start;		/* Initial binary pattern */
+  unsigned short	*rank;		/* Rank of each position */
+  unsigned		i, x, y,	/* Looping vars */
+			dx, dy,		/* Wrapped distances */
+			ones,		/* Number of points in pattern */
+			cluster,	/* Tightest cluster */
+			hole,		/* Largest void */
+			seed = 1;	/* Random number seed */
+
+
+  if (matrix)
+    return (matrix);
+
+  kernel  = malloc(count * sizeof(float));
+  energy  = calloc(count, sizeof(float));
+  initial = malloc(count * sizeof(float));
+  pattern = calloc(count, 1);
+  start   = malloc(count);
+  rank    = malloc(count * sizeof(unsigned short));
+  matrix  = malloc(count);
+
+  if (!kernel || !energy || !initial || !pattern || !start || !rank || !matrix)
+  {
+    free(matrix);
+    matrix = NULL;
+    goto cleanup;
+  }
+
+  for (y = 0; y < size; y ++)
+    for (x = 0; x < size; x ++)
+    {
+      dx = x < size / 2 ? x : size - x;
+      dy = y < size / 2 ? y : size - y;
+
+      kernel[y * size + x] = (float)exp(-(double)(dx * dx + dy * dy) /
+                                        (2.0 * BLUENOISE_SIGMA * BLUENOISE_SIGMA));
+    }
+
+ /*
+  * Start with about 10% of the positions set at random...
+  */
+
+  for (ones = 0; ones < count / 10;)
+  {
+    seed = seed * 1103515245 + 12345;
+    i    = (seed >> 8) % count;
+
+    if (!pattern[i])
+    {
+      pattern[i] = 1;
+      bluenoise_update(energy, kernel, i, 1.0f);
+      ones ++;
+    }
+  }
+
+ /*
+  * Relax the pattern until the tightest cluster is also the largest void...
+  */
+
+  for (;;)
+  {
+    for (i = 0, cluster = 0; i < count; i ++)
+      if (pattern[i] && (!pattern[cluster] || energy[i] > energy[cluster]))
+        cluster = i;
+
+    pattern[cluster] = 0;
+    bluenoise_update(energy, kernel, cluster, -1.0f);
+
+    for (i = 0, hole = cluster; i < count; i ++)
+      if (!pattern[i] && energy[i] < energy[hole])
+        hole = i;
+
+    pattern[hole] = 1;
+    bluenoise_update(energy, kernel, hole, 1.0f);
+
+    if (hole == cluster)
+      break;
+  }
+
+  memcpy(start, pattern, count);
+  memcpy(initial, energy, count * sizeof(float));
+
+ /*
+  * Rank the initial points by removing the tightest cluster each time...
+  */
+
+  for (i = ones; i > 0; i --)
+  {
+    for (x = 0, cluster = count; x < count; x ++)
+      if (pattern[x] && (cluster == count || energy[x] > energy[cluster]))
+        cluster = x;
+
+    rank[cluster]    = (unsigned short)(i - 1);
+    pattern[cluster] = 0;
+    bluenoise_update(energy, kernel, cluster, -1.0f);
+  }
+
+ /*
+  * Then rank the remaining positions by filling the largest void each
+  * time...
+  */
+
+  memcpy(pattern, start, count);
+  memcpy(energy, initial, count * sizeof(float));
+
+  for (i = ones; i < count; i ++)
+  {
+    for (x = 0, hole = count; x < count; x ++)
+      if (!pattern[x] && (hole == count || energy[x] < energy[hole]))
+        hole = x;
+
+    rank[hole]    = (unsigned short)i;
+    pattern[hole] = 1;
+    bluenoise_update(energy, kernel, hole, 1.0f);
+  }
+
+  for (i = 0; i < count; i ++)
+    matrix[i] = (unsigned char)(rank[i] * 256 / count);
+
+  cleanup:
+
+  free(kernel);
+  free(energy);
+  free(initial);
+  free(pattern);
+  free(start);
+  free(rank);
+
+  return (matrix);
+}
+
+
+/*
+ * 'bluenoise_update()' - Add or remove a point from the filtered pattern.
+ */
+
+static void
+bluenoise_update(float       *energy,	/* I - Filtered pattern */
+                 const float *kernel,	/* I - Gaussian filter */
+		 unsigned    point,	/* I - Position of point */
+		 float       sign)	/* I - 1 to add, -1 to remove */
+{
+  const unsigned	mask = BLUENOISE_SIZE - 1;
+  unsigned		px = point % BLUENOISE_SIZE,
+			py = point / BLUENOISE_SIZE;
+  int			dx, dy;		/* Offsets from point */
+  float			*row;		/* Energy row */
+  const float		*krow;		/* Filter row */
+
+
+  for (dy = -BLUENOISE_RADIUS; dy <= BLUENOISE_RADIUS; dy ++)
+  {
+    row  = energy + ((py + dy) & mask) * BLUENOISE_SIZE;
+    krow = kernel + (dy & mask) * BLUENOISE_SIZE;
+
+    for (dx = -BLUENOISE_RADIUS; dx <= BLUENOISE_RADIUS; dx ++)
+      row[(px + dx) & mask] += sign * krow[dx & mask];
+  }
+}
+
+
+/*
+ * 'diffuse_line()' - Halftone a line with serpentine Floyd-Steinberg error
+ *                    diffusion.
+ *
+ * Even lines go left to right and odd lines right to left, so the direction
+ * depends only on the line number and the output is the same however the
+ * page is split into bands.  Errors are kept in 16ths.
+ */
+
+static void
+diffuse_line(halftone_t          *ht,	/* I - Halftoning data */
+             unsigned char       *dst,	/* O - Packed line */
+             const unsigned char *src,	/* I - 8-bit line */
+	     unsigned            y)	/* I - Line number */
+{
+  unsigned	colors = ht->colors,	/* Samples per pixel */
+		levels = (1 << ht->bits) - 1,
+					/* Ink levels above 0 */
+		n;			/* Looping var */
+  int		c,			/* Current color */
+		*cur = ht->errors[y & 1] + colors,
+					/* Errors for this line */
+		*next = ht->errors[(y + 1) & 1] + colors,
+					/* Errors for the next line */
+		i,			/* Sample index */
+		step,			/* Offset to next pixel */
+		carry[4] = { 0, 0, 0, 0 },
+					/* Error for next pixel */
+		v,			/* Sample plus error */
+		err;			/* Quantization error */
+  unsigned	q;			/* Ink level */
+  size_t	used;			/* Bits used in last byte */
+  unsigned char	quant[256],		/* Ink level for each value */
+		value[256];		/* Value printed for each value */
+
+
+  for (v = 0; v < 256; v ++)
+  {
+    quant[v] = (unsigned char)((v * (int)levels + 127) / 255);
+    value[v] = (unsigned char)(quant[v] * 255 / levels);
+  }
+
+  memset(next - colors, 0, (ht->samples + 2 * colors) * sizeof(int));
+  memset(dst, 0, ht->bytes);
+
+  if (y & 1)
+  {
+    i    = (int)(ht->samples - colors);
+    step = -(int)colors;
+  }
+  else
+  {
+    i    = 0;
+    step = (int)colors;
+  }
+
+  for (n = 0; n < ht->width; n ++, i += step)
+  {
+    for (c = 0; c < (int)colors; c ++)
+    {
+      v = src[i + c] + ((cur[i + c] + carry[c] + 8) >> 4);
+
+      if (v < 0)
+        v = 0;
+      else if (v > 255)
+        v = 255;
+
+      q   = quant[v];
+      err = v - value[v];
+
+      carry[c]            = 7 * err;
+      next[i + c - step] += 3 * err;
+      next[i + c]        += 5 * err;
+      next[i + c + step] += err;
+
+      if (ht->bits == 1)
+        dst[(i + c) >> 3] |= (unsigned char)(q << (7 - ((i + c) & 7)));
+      else
+        dst[(i + c) >> 2] |= (unsigned char)(q << (6 - (((i + c) & 3) << 1)));
+    }
+  }
+
+  if ((used = (ht->samples * ht->bits) & 7) != 0)
+    dst[ht->bytes - 1] |= 0xff >> used;
+}
+
+
+/*
+ * 'dither1_scalar()' - Dither samples to 1 bit with a threshold row.
+ */
+
+static void
+dither1_scalar(unsigned char       *dst,/* O - Packed samples */
+               const unsigned char *src,/* I - 8-bit samples */
+	       const unsigned char *thr,/* I - Thresholds */
+	       size_t              count)
+					/* I - Number of samples */
+{
+  unsigned	byte,			/* Current byte */
+		bit;			/* Current bit */
+
+
+  for (byte = 0, bit = 0x80; count > 0; count --, src ++, thr ++)
+  {
+    if (*src > *thr)
+      byte |= bit;
+
+    if ((bit >>= 1) == 0)
+    {
+      *dst++ = (unsigned char)byte;
+      byte   = 0;
+      bit    = 0x80;
+    }
+  }
+
+  if (bit != 0x80)
+    *dst = (unsigned char)(byte | (2 * bit - 1));
+}
+
+
+#if defined(__SSE2__)
+/*
+ * 'dither1_sse2()' - Dither samples to 1 bit, 16 at a time using SSE2.
+ */
+
+static void
+dither1_sse2(unsigned char       *dst,	/* O - Packed samples */
+             const unsigned char *src,	/* I - 8-bit samples */
+	     const unsigned char *thr,	/* I - Thresholds */
+	     size_t              count)	/* I - Number of samples */
+{
+  const __m128i	zero = _mm_setzero_si128();
+  unsigned	mask;			/* Samples with ink */
+
+
+  for (; count >= 16; count -= 16, src += 16, thr += 16, dst += 2)
+  {
+   /*
+    * v > t is the same as saturate(v - t) != 0...
+    */
+
+    mask = ~(unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_subs_epu8(_mm_loadu_si128((const __m128i *)src), _mm_loadu_si128((const __m128i *)thr)), zero));
+
+    dst[0] = bitrev[mask & 255];
+    dst[1] = bitrev[(mask >> 8) & 255];
+  }
+
+  dither1_scalar(dst, src, thr, count);
+}
+#endif /* __SSE2__ */
+
+
+#ifdef HAVE_AVX2_KERNELS
+/*
+ * 'dither1_avx2()' - Dither samples to 1 bit, 32 at a time using AVX2.
+ */
+
+static void
+dither1_avx2(unsigned char       *dst,	/* O - Packed samples */
+             const unsigned char *src,	/* I - 8-bit samples */
+	     const unsigned char *thr,	/* I - Thresholds */
+	     size_t              count)	/* I - Number of samples */
+{
+  const __m256i	zero = _mm256_setzero_si256();
+  unsigned	mask;			/* Samples with ink */
+
+
+  for (; count >= 32; count -= 32, src += 32, thr += 32, dst += 4)
+  {
+    mask = ~(unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_subs_epu8(_mm256_loadu_si256((const __m256i *)src), _mm256_loadu_si256((const __m256i *)thr)), zero));
+
+    dst[0] = bitrev[mask & 255];
+    dst[1] = bitrev[(mask >> 8) & 255];
+    dst[2] = bitrev[(mask >> 16) & 255];
+    dst[3] = bitrev[mask >> 24];
+  }
+
+  dither1_scalar(dst, src, thr, count);
+}
+#endif /* HAVE_AVX2_KERNELS */
+
+
+/*
+ * 'dither2()' - Dither samples to 2 bits with a threshold row.
+ *
+ * The divide by 255 is done as (x + 1 + (x >> 8)) >> 8, which is exact for
+ * all 16-bit values.
+ */
+
+#define DITHER2(v,t)	((3 * (v) + (t) + 1 + ((3 * (v) + (t)) >> 8)) >> 8)
+
+static void
+dither2(unsigned char       *dst,	/* O - Packed samples */
+        const unsigned char *src,	/* I - 8-bit samples */
+	const unsigned char *thr,	/* I - Thresholds */
+	size_t              count)	/* I - Number of samples */
+{
+  unsigned	byte,			/* Current byte */
+		shift;			/* Shift for current sample */
+#if defined(__SSE2__)
+  const __m128i	zero = _mm_setzero_si128(),
+		one = _mm_set1_epi16(1),
+		mask0 = _mm_set1_epi32(0xc0),
+		mask1 = _mm_set1_epi32(0x30),
+		mask2 = _mm_set1_epi32(0x0c),
+		mask3 = _mm_set1_epi32(0x03);
+  __m128i	v, t, lo, hi, w;	/* Samples and levels */
+
+
+ /*
+  * Compute 16 levels in 16-bit lanes, then combine each group of 4 levels
+  * in a 32-bit lane into one byte...
+  */
+
+  for (; count >= 16; count -= 16, src += 16, thr += 16, dst += 4)
+  {
+    v  = _mm_loadu_si128((const __m128i *)src);
+    t  = _mm_loadu_si128((const __m128i *)thr);
+    lo = _mm_unpacklo_epi8(v, zero);
+    hi = _mm_unpackhi_epi8(v, zero);
+    lo = _mm_add_epi16(_mm_add_epi16(lo, _mm_slli_epi16(lo, 1)), _mm_unpacklo_epi8(t, zero));
+    hi = _mm_add_epi16(_mm_add_epi16(hi, _mm_slli_epi16(hi, 1)), _mm_unpackhi_epi8(t, zero));
+    lo = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(lo, one), _mm_srli_epi16(lo, 8)), 8);
+    hi = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(hi, one), _mm_srli_epi16(hi, 8)), 8);
+    w  = _mm_packus_epi16(lo, hi);
+    w  = _mm_or_si128(_mm_or_si128(_mm_and_si128(_mm_slli_epi32(w, 6), mask0),
+                                   _mm_and_si128(_mm_srli_epi32(w, 4), mask1)),
+                      _mm_or_si128(_mm_and_si128(_mm_srli_epi32(w, 14), mask2),
+                                   _mm_and_si128(_mm_srli_epi32(w, 24), mask3)));
+    w  = _mm_packus_epi16(_mm_packs_epi32(w, w), zero);
+
+    byte = (unsigned)_mm_cvtsi128_si32(w);
+    memcpy(dst, &byte, 4);
+  }
+#endif /* __SSE2__ */
+
+  for (; count >= 4; count -= 4, src += 4, thr += 4)
+    *dst++ = (unsigned char)((DITHER2(src[0], thr[0]) << 6) |
+                             (DITHER2(src[1], thr[1]) << 4) |
+                             (DITHER2(src[2], thr[2]) << 2) |
+			     DITHER2(src[3], thr[3]));
+
+  for (byte = 0, shift = 6; count > 0; count --, src ++, thr ++, shift -= 2)
+    byte |= DITHER2(*src, *thr) << shift;
+
+  if (shift != 6)
+    *dst = (unsigned char)(byte | ((1 << (shift + 2)) - 1));
+}
@@ -0,0 +1,114 @@
+/*
+     File: halftone.h 
+ Abstract: Halftoning definitions for sample CUPS printer driver.
+  Version: 4.0 
+  
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple 
+ Inc. ("Apple") in consideration of your agreement to the following 
+ terms, and your use, installation, modification or redistribution of 
+ this Apple software constitutes acceptance of these terms.  If you do 
+ not agree with these terms, please do not use, install, modify or 
+ redistribute this Apple software. 
+  
+ In consideration of your agreement to abide by the following terms, and 
+ subject to these terms, Apple grants you a personal, non-exclusive 
+ license, under Apple's copyrights in this original Apple software (the 
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple 
+ Software, with or without modifications, in source and/or binary forms; 
+ provided that if you redistribute the Apple Software in its entirety and 
+ without modifications, you must retain this notice and the following 
+ text and disclaimers in all such redistributions of the Apple Software. 
+ Neither the name, trademarks, service marks or logos of Apple Inc. may 
+ be used to endorse or promote products derived from the Apple Software 
+ without specific prior written permission from Apple.  Except as 
+ expressly stated in this notice, no other rights or licenses, express or 
+ implied, are granted by Apple herein, including but not limited to any 
+ patent rights that may be infringed by your derivative works or by other 
+ works in which the Apple Software may be incorporated. 
+  
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE 
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION 
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS 
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND 
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS. 
+  
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL 
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, 
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED 
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), 
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE 
+ POSSIBILITY OF SUCH DAMAGE. 
+  
+ Copyright (C) 2011 Apple Inc. All Rights Reserved. 
+  
+ */  
+
+#ifndef _SAMPLE_HALFTONE_H_
+#  define _SAMPLE_HALFTONE_H_
+
+/*
+ * Include necessary headers...
+ */
+
+#  include <stddef.h>
+
+
+/*
+ * Halftoning modes...
+ */
+
+typedef enum
+{
+  HALFTONE_NONE,			/* Send 8-bit data */
+  HALFTONE_ORDERED,			/* 16x16 Bayer ordered dither */
+  HALFTONE_BLUENOISE,			/* 64x64 blue-noise threshold matrix */
+  HALFTONE_DIFFUSION			/* Serpentine Floyd-Steinberg */
+} halftone_mode_t;
+
+
+/*
+ * Halftoning data...
+ *
+ * Each 8-bit sample becomes a 1-bit or 2-bit ink level.  Samples are packed
+ * most significant bits first, in the same chunked order as the 8-bit data,
+ * and any unused bits at the end of a line are set so that white lines are
+ * all 0xff bytes.
+ *
+ * Threshold modes can halftone any line at any time.  Error diffusion
+ * carries an error row from one line to the next, so lines must be
+ * halftoned in page order; HalftoneReady() tells a conversion thread when
+ * the previous band is done.
+ */
+
+typedef struct
+{
+  halftone_mode_t	mode;		/* Halftoning mode */
+  unsigned		bits,		/* Bits per sample (1 or 2) */
+			width,		/* Width in pixels */
+			colors;		/* Samples per pixel */
+  size_t		samples,	/* Samples per line */
+			bytes;		/* Bytes per packed line */
+  unsigned		size;		/* Threshold matrix size */
+  unsigned char		*thresholds;	/* Threshold rows, size * samples */
+  int			*errors[2];	/* Error rows for diffusion */
+  unsigned		next_y;		/* Next line to diffuse */
+} halftone_t;
+
+
+/*
+ * Prototypes...
+ */
+
+extern void		HalftoneDelete(halftone_t *ht);
+extern void		HalftoneLines(halftone_t *ht, unsigned char *dst,
+			              const unsigned char **lines, unsigned y,
+				      unsigned count);
+extern const char	*HalftoneName(halftone_mode_t mode);
+extern halftone_t	*HalftoneNew(halftone_mode_t mode, unsigned bits,
+			             unsigned width, unsigned colors);
+extern int		HalftoneReady(halftone_t *ht, unsigned y);
+extern int		HalftoneValue(const char *name);
+
+#endif /* !_SAMPLE_HALFTONE_H_ */
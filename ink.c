@@ -0,0 +1,311 @@
+/*
+     File: ink.c 
+ Abstract: Virtual ink levels for sample CUPS printer driver.
+  Version: 4.0 
+  
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple 
+ Inc. ("Apple") in consideration of your agreement to the following 
+ terms, and your use, installation, modification or redistribution of 
+ this Apple software constitutes acceptance of these terms.  If you do 
+ not agree with these terms, please do not use, install, modify or 
+ redistribute this Apple software. 
+  
+ In consideration of your agreement to abide by the following terms, and 
+ subject to these terms, Apple grants you a personal, non-exclusive 
+ license, under Apple's copyrights in this original Apple software (the 
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple 
+ Software, with or without modifications, in source and/or binary forms; 
+ provided that if you redistribute the Apple Software in its entirety and 
+ without modifications, you must retain this notice and the following 
+ text and disclaimers in all such redistributions of the Apple Software. 
+ Neither the name, trademarks, service marks or logos of Apple Inc. may 
+ be used to endorse or promote products derived from the Apple Software 
+ without specific prior written permission from Apple.  Except as 
+ expressly stated in this notice, no other rights or licenses, express or 
+ implied, are granted by Apple herein, including but not limited to any 
+ patent rights that may be infringed by your derivative works or by other 
+ works in which the Apple Software may be incorporated. 
+  
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE 
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION 
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS 
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND 
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS. 
+  
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL 
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, 
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED 
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), 
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE 
+ POSSIBILITY OF SUCH DAMAGE. 
+  
+ Copyright (C) 2011 Apple Inc. All Rights Reserved. 
+  
+ */  
+
+/*
+ * Include necessary headers...
+ */
+
+#include "ink.h"			/* Virtual ink level definitions */
+#include <cups/file.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+
+/*
+ * 'InkLoad()' - Load the CMYK ink levels from the cache file.
+ */
+
+void
+InkLoad(int cmyk[4])		/* O - CMYK levels */
+{
+  cups_file_t	*fp;			/* File to read from */
+  char		filename[1024],		/* Cache filename */
+		line[1024];		/* Line from file */
+
+
+  cmyk[0] = cmyk[1] = cmyk[2] = cmyk[3] = INK_FULL;
+
+  snprintf(filename, sizeof(filename), "/Library/Caches/%s.cmyk", getenv("PRINTER"));
+
+  if ((fp = cupsFileOpen(filename, "r")) != NULL)
+  {
+    if (cupsFileGets(fp, line, sizeof(line)))
+      sscanf(line, "%d%d%d%d", cmyk + 0, cmyk + 1, cmyk + 2, cmyk + 3);
+
+    cupsFileClose(fp);
+  }
+}
+
+
+/*
+ * 'InkSave()' - Save the CMYK ink levels to the cache file.
+ */
+
+void
+InkSave(int cmyk[4])		/* I - CMYK levels */
+{
+  cups_file_t	*fp;			/* File to write to */
+  char		filename[1024];		/* Cache filename */
+
+
+  snprintf(filename, sizeof(filename), "/Library/Caches/%s.cmyk", getenv("PRINTER"));
+
+  if ((fp = cupsFileOpen(filename, "w")) != NULL)
+  {
+    cupsFilePrintf(fp, "%d %d %d %d\n", cmyk[0], cmyk[1], cmyk[2], cmyk[3]);
+    cupsFileClose(fp);
+    chmod(filename, 0644);
+  }
+}
+
+
+/*
+ * 'InkUpdate()' - Update the virtual CMYK ink levels based on a line from the
+ *                 page.
+ */
+
+void
+InkUpdate(
+    int           cmyk[4],		/* IO - CMYK levels */
+    unsigned char *line,		/* IO - Pixels on the current line */
+    int           bytes,		/* I  - Number of bytes */
+    int           depth,		/* I  - Bytes per pixel */
+    int           resolution)		/* I  - Output resolution */
+{
+  int c = 0, m = 0, y = 0, k = 0;	/* Total CMYK on the line */
+
+
+  if (depth == 1)
+  {
+   /*
+    * Update black ink usage for grayscale output...
+    */
+
+    if (cmyk[3] <= 0)
+    {
+     /*
+      * Simulate out-of-ink condition by removing black...
+      */
+
+      memset(line, 255, bytes);
+    }
+    else
+    {
+     /*
+      * Otherwise count the amount of black ink used...
+      */
+
+      while (bytes > 0)
+      {
+	k += 255 - *line;
+
+	bytes --;
+	line ++;
+      }
+    }
+  }
+  else if (depth == 4)
+  {
+   /*
+    * Count CMYK ink usage for separated output, where 255 is no ink...
+    */
+
+    while (bytes > 0)
+    {
+      c += 255 - line[0];
+      m += 255 - line[1];
+      y += 255 - line[2];
+      k += 255 - line[3];
+
+     /*
+      * Simulate out-of-ink conditions by removing that ink...
+      */
+
+      if (cmyk[0] <= 0)
+        line[0] = 255;
+      if (cmyk[1] <= 0)
+        line[1] = 255;
+      if (cmyk[2] <= 0)
+        line[2] = 255;
+      if (cmyk[3] <= 0)
+        line[3] = 255;
+
+      bytes -= 4;
+      line += 4;
+    }
+  }
+  else if (cmyk[0] <= 0 && cmyk[1] <= 0 && cmyk[2] <= 0 && cmyk[3] <= 0)
+  {
+   /*
+    * Completely out of ink, blank the line to simulate that...
+    */
+
+    memset(line, 255, bytes);
+  }
+  else
+  {
+   /*
+    * Update CMYK ink usage for color output...
+    */
+
+    int kmin, kmax;
+
+    while (bytes > 0)
+    {
+     /*
+      * NOTE: Real printers need more complex code than this!
+      *
+      * The classic RGB to CMYK formula calculates K using the maximum
+      * RGB value, and then subtracts it from the C, M, and Y values:
+      *
+      *    K = 1 - max(R,G,B)
+      *    C = 1 - R - K
+      *    M = 1 - G - K
+      *    Y = 1 - B - K
+      *
+      * Colors tend to look "flat" with this simple formula, so instead we
+      * use a formula that calculates black based on both the minimum and
+      * maximum RGB values so that the amount of black depends not only on
+      * the darkness of the color but how colorful it is.  Less colorful
+      * colors use more black:
+      *
+      *         (1 - max(R,G,B))^3
+      *     K = ------------------
+      *         (1 - min(R,G,B))^2
+      *
+      *     C = 1 - R - K
+      *     M = 1 - G - K
+      *     Y = 1 - B - K
+      */
+
+      kmin = line[0] > line[1] ?
+		 (line[0] > line[2] ? line[0] : line[2]) :
+		 (line[1] > line[2] ? line[1] : line[2]);
+      kmax = line[0] < line[1] ?
+		 (line[0] < line[2] ? line[0] : line[2]) :
+		 (line[1] < line[2] ? line[1] : line[2]);
+      if (kmax > kmin)
+      {
+	kmin = 255 - kmin;
+	kmax = 255 - kmax;
+	kmin = 255 - kmin * kmin * kmin / (kmax * kmax);
+      }
+
+     /*
+      * Add the current CMYK values to our color counters for the line.
+      */
+
+      c += kmin - line[0];
+      m += kmin - line[1];
+      y += kmin - line[2];
+      k += 255 - kmin;
+
+      if (cmyk[0] <= 0)
+      {
+       /*
+	* Simulate out-of-cyan-ink condition by removing cyan...
+	*/
+
+	line[0] = kmin;
+      }
+
+      if (cmyk[1] <= 0)
+      {
+       /*
+	* Simulate out-of-magenta-ink condition by removing magenta...
+	*/
+
+	line[1] = kmin;
+      }
+
+      if (cmyk[2] <= 0)
+      {
+       /*
+	* Simulate out-of-yellow-ink condition by removing yellow...
+	*/
+
+	line[2] = kmin;
+      }
+
+      if (cmyk[3] <= 0)
+      {
+       /*
+	* Simulate out-of-black-ink condition by removing black...
+	*/
+
+	kmin = 255 - kmin;
+	line[0] += kmin;
+	line[1] += kmin;
+	line[2] += kmin;
+      }
+
+      bytes -= 3;
+      line += 3;
+    }
+  }
+
+ /*
+  * Subtract a portion of the CMYK colors used on this line from the
+  * ink counters, then limit to a minimum of 0 ink left.
+  */
+
+  cmyk[0] -= 50 * c / resolution / resolution;
+  cmyk[1] -= 50 * m / resolution / resolution;
+  cmyk[2] -= 50 * y / resolution / resolution;
+  cmyk[3] -= 50 * k / resolution / resolution;
+
+  if (cmyk[0] < 0)
+    cmyk[0] = 0;
+  if (cmyk[1] < 0)
+    cmyk[1] = 0;
+  if (cmyk[2] < 0)
+    cmyk[2] = 0;
+  if (cmyk[3] < 0)
+    cmyk[3] = 0;
+}
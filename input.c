@@ -0,0 +1,678 @@
+/*
+     File: input.c 
+ Abstract: Raster input for sample CUPS printer driver.
+  Version: 4.0 
+  
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple 
+ Inc. ("Apple") in consideration of your agreement to the following 
+ terms, and your use, installation, modification or redistribution of 
+ this Apple software constitutes acceptance of these terms.  If you do 
+ not agree with these terms, please do not use, install, modify or 
+ redistribute this Apple software. 
+  
+ In consideration of your agreement to abide by the following terms, and 
+ subject to these terms, Apple grants you a personal, non-exclusive 
+ license, under Apple's copyrights in this original Apple software (the 
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple 
+ Software, with or without modifications, in source and/or binary forms; 
+ provided that if you redistribute the Apple Software in its entirety and 
+ without modifications, you must retain this notice and the following 
+ text and disclaimers in all such redistributions of the Apple Software. 
+ Neither the name, trademarks, service marks or logos of Apple Inc. may 
+ be used to endorse or promote products derived from the Apple Software 
+ without specific prior written permission from Apple.  Except as 
+ expressly stated in this notice, no other rights or licenses, express or 
+ implied, are granted by Apple herein, including but not limited to any 
+ patent rights that may be infringed by your derivative works or by other 
+ works in which the Apple Software may be incorporated. 
+  
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE 
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION 
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS 
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND 
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS. 
+  
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL 
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, 
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED 
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), 
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE 
+ POSSIBILITY OF SUCH DAMAGE. 
+  
+ Copyright (C) 2011 Apple Inc. All Rights Reserved. 
+  
+ */  
+
+/*
+ * Include necessary headers...
+ */
+
+#include "sample.h"			/* Common driver definitions */
+#include "input.h"			/* Raster input definitions */
+#include <errno.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+/*
+ * Constants...
+ */
+
+#define INPUT_BUFSIZE	65536		/* Minimum size of read buffer */
+
+
+/*
+ * Local functions...
+ */
+
+static int	decode_line(input_t *in, unsigned char *line);
+static size_t	fill_buffer(input_t *in, size_t bytes);
+static int	map_file(input_t *in);
+static size_t	read_bytes(input_t *in, void *data, size_t bytes);
+static void	swap_samples(unsigned char *line, size_t bytes);
+
+
+/*
+ * 'InputCreate()' - Open a raster stream for reading.
+ *
+ * With INPUT_MAP a regular file is mapped instead of read.  With INPUT_CUPS
+ * the stream is read with libcups.
+ */
+
+input_t *				/* O - Raster input or NULL on error */
+InputCreate(int fd,			/* I - File descriptor */
+            int flags)			/* I - INPUT_MAP and/or INPUT_CUPS */
+{
+  input_t	*in;			/* Raster input */
+  uint32_t	sync;			/* Sync word */
+
+
+  if ((in = calloc(1, sizeof(input_t))) == NULL)
+    return (NULL);
+
+  in->fd = fd;
+
+  if (flags & INPUT_CUPS)
+  {
+    if ((in->ras = cupsRasterOpen(fd, CUPS_RASTER_READ)) == NULL)
+    {
+      free(in);
+      return (NULL);
+    }
+
+    return (in);
+  }
+
+  if (flags & INPUT_MAP)
+    map_file(in);
+
+ /*
+  * The sync word tells us the version and byte order of the stream; version
+  * 2 raster is run-length encoded...
+  */
+
+  if (read_bytes(in, &sync, sizeof(sync)) < sizeof(sync))
+  {
+    InputDelete(in);
+    return (NULL);
+  }
+
+  in->swapped    = sync == CUPS_RASTER_REVSYNCv1 ||
+                   sync == CUPS_RASTER_REVSYNCv2 ||
+		   sync == CUPS_RASTER_REVSYNC;
+  in->compressed = sync == CUPS_RASTER_SYNCv2 ||
+                   sync == CUPS_RASTER_REVSYNCv2;
+
+  if (!in->swapped && !in->compressed && sync != CUPS_RASTER_SYNCv1 &&
+      sync != CUPS_RASTER_SYNC)
+  {
+    InputDelete(in);
+    errno = EINVAL;
+    return (NULL);
+  }
+
+  return (in);
+}
+
+
+/*
+ * 'InputDelete()' - Close a raster stream.
+ */
+
+void
+InputDelete(input_t *in)		/* I - Raster input */
+{
+  if (!in)
+    return;
+
+  if (in->map)
+    munmap((void *)in->map, in->map_size);
+
+  if (in->ras)
+    cupsRasterClose(in->ras);
+
+  free(in->buffer);
+  free(in->line);
+  free(in);
+}
+
+
+/*
+ * 'InputReadHeader()' - Read the header for the next page.
+ *
+ * Any lines left on the current page are skipped.
+ */
+
+int					/* O - 1 on success, 0 at end of stream */
+InputReadHeader(
+    input_t             *in,		/* I - Raster input */
+    cups_page_header2_t *header)	/* O - Page header */
+{
+  unsigned		i,		/* Looping var */
+			*word;		/* Header word to swap */
+  const unsigned char	*data;		/* Skipped lines */
+  size_t		bytes;		/* Bytes of raster data on page */
+
+
+  if (in->ras)
+  {
+    if (!cupsRasterReadHeader2(in->ras, header))
+      return (0);
+
+    in->bytes = header->cupsBytesPerLine;
+    in->lines = header->cupsHeight;
+
+    return (1);
+  }
+
+  while (in->lines > 0)
+    if (!InputReadLines(in, in->line, 1, &data, NULL))
+      return (0);
+
+  in->repeat = 0;
+  in->last   = NULL;
+
+  if (read_bytes(in, header, sizeof(cups_page_header2_t)) <
+          sizeof(cups_page_header2_t))
+    return (0);
+
+  if (in->swapped)
+  {
+   /*
+    * Swap the 81 integer and real values from AdvanceDistance through
+    * cupsReal...
+    */
+
+    for (i = 81, word = (unsigned *)&header->AdvanceDistance; i > 0;
+         i --, word ++)
+      *word = (*word >> 24) | ((*word >> 8) & 0xff00) |
+              ((*word & 0xff00) << 8) | (*word << 24);
+  }
+
+ /*
+  * Check the header the same way libcups does...
+  */
+
+  if (header->cupsColorOrder == CUPS_ORDER_CHUNKED)
+    in->bpp = (header->cupsBitsPerPixel + 7) / 8;
+  else
+    in->bpp = (header->cupsBitsPerColor + 7) / 8;
+
+  if (in->bpp == 0)
+    in->bpp = 1;
+
+  if (header->cupsBitsPerPixel == 0 || header->cupsBitsPerPixel > 240 ||
+      header->cupsBitsPerColor == 0 || header->cupsBitsPerColor > 16 ||
+      header->cupsBytesPerLine == 0 || header->cupsBytesPerLine > 0x7fffffff ||
+      header->cupsHeight == 0 || (header->cupsBytesPerLine % in->bpp) != 0)
+    return (0);
+
+  switch (header->cupsColorSpace)
+  {
+    case CUPS_CSPACE_W :
+    case CUPS_CSPACE_RGB :
+    case CUPS_CSPACE_SW :
+    case CUPS_CSPACE_SRGB :
+    case CUPS_CSPACE_RGBW :
+    case CUPS_CSPACE_ADOBERGB :
+        in->clear = 0xff;
+	break;
+
+    default :
+        in->clear = 0x00;
+	break;
+  }
+
+  in->swap16 = in->swapped && (header->cupsBitsPerColor == 16 ||
+                               header->cupsBitsPerPixel == 12 ||
+			       header->cupsBitsPerPixel == 16);
+
+  free(in->line);
+
+  if ((in->line = malloc(header->cupsBytesPerLine)) == NULL)
+    return (0);
+
+  in->bytes = header->cupsBytesPerLine;
+  in->lines = header->cupsHeight;
+
+ /*
+  * Start reading an uncompressed page in before the first band asks for
+  * it...
+  */
+
+  if (in->map && !in->compressed)
+  {
+    bytes = (size_t)in->lines * in->bytes;
+
+    if (bytes > (size_t)(in->end - in->ptr))
+      bytes = (size_t)(in->end - in->ptr);
+
+    if (bytes > 0)
+    {
+      size_t	start = (size_t)(in->ptr - in->map) & ~(size_t)(getpagesize() - 1);
+					/* Page-aligned start of data */
+
+      madvise((void *)(in->map + start),
+              bytes + (size_t)(in->ptr - in->map) - start, MADV_WILLNEED);
+    }
+  }
+
+  return (1);
+}
+
+
+/*
+ * 'InputReadLines()' - Read lines of raster data.
+ *
+ * Uncompressed lines in a mapped file are returned in place, otherwise they
+ * are read or decoded into "buffer", which must hold "count" lines.  Either
+ * way "data" points to the first line and the lines follow one another.
+ *
+ * If "same" is not NULL, a line that the stream repeats from the line before
+ * it in "buffer" is not stored; "same" is set to 1 for that line and 0 for
+ * the others.  The first line is always stored.
+ */
+
+unsigned				/* O - Number of lines read */
+InputReadLines(
+    input_t             *in,		/* I - Raster input */
+    unsigned char       *buffer,	/* I - Buffer for lines */
+    unsigned            count,		/* I - Number of lines wanted */
+    const unsigned char **data,		/* O - Lines */
+    unsigned char       *same)		/* O - Repeated lines or NULL */
+{
+  unsigned		i;		/* Looping var */
+  unsigned char		*line;		/* Current line */
+
+
+  if (count > in->lines)
+    count = in->lines;
+
+  if (same)
+    memset(same, 0, count);
+
+  *data = buffer;
+
+  if (in->ras)
+  {
+    for (i = 0, line = buffer; i < count; i ++, line += in->bytes)
+      if (cupsRasterReadPixels(in->ras, line, (unsigned)in->bytes) == 0)
+        break;
+  }
+  else if (!in->compressed && in->map && !in->swap16)
+  {
+   /*
+    * Pass mapped lines in place...
+    */
+
+    if ((i = (unsigned)((size_t)(in->end - in->ptr) / in->bytes)) > count)
+      i = count;
+
+    *data   = in->ptr;
+    in->ptr += (size_t)i * in->bytes;
+  }
+  else if (!in->compressed)
+  {
+    i = (unsigned)(read_bytes(in, buffer, (size_t)count * in->bytes) /
+                   in->bytes);
+
+    if (in->swap16)
+      swap_samples(buffer, (size_t)i * in->bytes);
+  }
+  else
+  {
+   /*
+    * Decode each new line into the buffer; repeats of it are either flagged
+    * or copied...
+    */
+
+    for (i = 0, line = buffer; i < count; i ++, line += in->bytes)
+    {
+      if (in->repeat == 0)
+      {
+        if (!decode_line(in, line))
+	  break;
+
+        in->last = line;
+      }
+      else if (same && i > 0)
+        same[i] = 1;
+      else if (line != in->last)
+        memcpy(line, in->last, in->bytes);
+
+      in->repeat --;
+    }
+
+   /*
+    * Keep a copy of a line that repeats into the next call...
+    */
+
+    if (in->repeat > 0 && in->last != in->line)
+    {
+      memcpy(in->line, in->last, in->bytes);
+      in->last = in->line;
+    }
+  }
+
+  in->lines -= i;
+
+  return (i);
+}
+
+
+/*
+ * 'decode_line()' - Decode a run-length encoded line.
+ *
+ * Each line starts with a repeat count and is followed by runs of pixels:
+ * 0 to 127 repeats the next pixel 1 to 128 times, 129 to 255 copies 128 to 2
+ * literal pixels, and 128 clears the rest of the line to white.  Repeated
+ * pixels are filled with memset() or by doubling memcpy() calls.
+ */
+
+static int				/* O - 1 on success, 0 on error */
+decode_line(input_t       *in,		/* I - Raster input */
+            unsigned char *line)	/* I - Line buffer */
+{
+  const unsigned char	*ptr,		/* Pointer into encoded data */
+			*end;		/* End of encoded data */
+  unsigned char		*lineptr,	/* Pointer into line */
+			*lineend;	/* End of line */
+  size_t		bpp = in->bpp,	/* Bytes per pixel */
+			count,		/* Bytes in run */
+			filled;		/* Bytes of run filled so far */
+  unsigned		byte;		/* Control byte */
+
+
+ /*
+  * An encoded line is never more than twice its decoded size, so that much
+  * is enough to decode it without going back to the file...
+  */
+
+  fill_buffer(in, 2 * in->bytes + 1);
+
+  ptr     = in->ptr;
+  end     = in->end;
+  lineptr = line;
+  lineend = line + in->bytes;
+
+  if (ptr >= end)
+    return (0);
+
+  in->repeat = *ptr++ + 1;
+
+  while (lineptr < lineend)
+  {
+    if (ptr >= end)
+      goto truncated;
+
+    if ((byte = *ptr++) == 128)
+    {
+     /*
+      * Clear to end of line...
+      */
+
+      memset(lineptr, in->clear, (size_t)(lineend - lineptr));
+      lineptr = lineend;
+    }
+    else if (byte > 128)
+    {
+     /*
+      * Copy literal pixels...
+      */
+
+      if ((count = (257 - byte) * bpp) > (size_t)(lineend - lineptr))
+        count = (size_t)(lineend - lineptr);
+
+      if (count > (size_t)(end - ptr))
+        goto truncated;
+
+      memcpy(lineptr, ptr, count);
+      lineptr += count;
+      ptr     += count;
+    }
+    else
+    {
+     /*
+      * Repeat the next pixel...
+      */
+
+      if ((count = (byte + 1) * bpp) > (size_t)(lineend - lineptr))
+        count = (size_t)(lineend - lineptr);
+
+      if (count < bpp)
+        break;
+
+      if (bpp > (size_t)(end - ptr))
+        goto truncated;
+
+      if (bpp == 1 || !memcmp(ptr, ptr + 1, bpp - 1))
+        memset(lineptr, *ptr, count);
+      else
+      {
+        memcpy(lineptr, ptr, bpp);
+
+        for (filled = bpp; filled < count; filled *= 2)
+	  memcpy(lineptr + filled, lineptr,
+	         filled < count - filled ? filled : count - filled);
+      }
+
+      lineptr += count;
+      ptr     += bpp;
+    }
+  }
+
+  in->ptr = ptr;
+
+  if (in->swap16)
+    swap_samples(line, in->bytes);
+
+  return (1);
+
+ /*
+  * Lose the rest of the stream if a line is cut short...
+  */
+
+  truncated:
+
+  in->ptr    = in->end;
+  in->repeat = 0;
+
+  return (0);
+}
+
+
+/*
+ * 'fill_buffer()' - Read more of a stream into the read buffer.
+ *
+ * Unread bytes are kept and the buffer is grown if needed.  Mapped files
+ * are already "buffered".
+ */
+
+static size_t				/* O - Bytes available */
+fill_buffer(input_t *in,		/* I - Raster input */
+            size_t  bytes)		/* I - Bytes wanted */
+{
+  size_t	avail = (size_t)(in->end - in->ptr),
+					/* Bytes available */
+		size;			/* New buffer size */
+  unsigned char	*buffer;		/* New buffer */
+  ssize_t	rbytes;			/* Bytes read */
+
+
+  if (avail >= bytes || in->map || in->eof)
+    return (avail);
+
+  if (bytes > in->bufsize)
+  {
+    if ((size = 2 * bytes) < INPUT_BUFSIZE)
+      size = INPUT_BUFSIZE;
+
+    if ((buffer = malloc(size)) == NULL)
+      return (avail);
+
+    if (avail > 0)
+      memcpy(buffer, in->ptr, avail);
+
+    free(in->buffer);
+
+    in->buffer  = buffer;
+    in->bufsize = size;
+  }
+  else if (avail > 0)
+    memmove(in->buffer, in->ptr, avail);
+
+  in->ptr = in->buffer;
+  in->end = in->buffer + avail;
+
+  while (avail < bytes)
+  {
+    while ((rbytes = read(in->fd, in->buffer + avail,
+                          in->bufsize - avail)) < 0 &&
+	   (errno == EINTR || errno == EAGAIN));
+
+    if (rbytes <= 0)
+    {
+      in->eof = 1;
+      break;
+    }
+
+    avail   += (size_t)rbytes;
+    in->end += rbytes;
+  }
+
+  return (avail);
+}
+
+
+/*
+ * 'map_file()' - Map a raster file.
+ *
+ * Nothing is read from the file, so the caller can read it instead if this
+ * fails.
+ */
+
+static int				/* O - 1 if mapped, 0 otherwise */
+map_file(input_t *in)			/* I - Raster input */
+{
+  struct stat	fileinfo;		/* File information */
+  void		*map;			/* Mapped file */
+
+
+  if (fstat(in->fd, &fileinfo) || !S_ISREG(fileinfo.st_mode) ||
+      lseek(in->fd, 0, SEEK_CUR) != 0 ||
+      fileinfo.st_size < (off_t)(sizeof(uint32_t) + sizeof(cups_page_header2_t)) ||
+      (uint64_t)fileinfo.st_size > (uint64_t)SIZE_MAX)
+    return (0);
+
+  if ((map = mmap(NULL, (size_t)fileinfo.st_size, PROT_READ, MAP_SHARED,
+                  in->fd, 0)) == MAP_FAILED)
+    return (0);
+
+  madvise(map, (size_t)fileinfo.st_size, MADV_SEQUENTIAL);
+
+  in->map      = map;
+  in->map_size = (size_t)fileinfo.st_size;
+  in->ptr      = in->map;
+  in->end      = in->map + in->map_size;
+
+  LogDebug("Mapped %lu bytes of raster data.", (unsigned long)in->map_size);
+
+  return (1);
+}
+
+
+/*
+ * 'read_bytes()' - Read bytes from a stream.
+ *
+ * Large reads go straight to "data" once the read buffer has been copied.
+ */
+
+static size_t				/* O - Bytes read */
+read_bytes(input_t *in,			/* I - Raster input */
+           void    *data,		/* I - Buffer */
+           size_t  bytes)		/* I - Bytes to read */
+{
+  unsigned char	*dataptr = (unsigned char *)data;
+					/* Pointer into buffer */
+  size_t	avail,			/* Bytes available */
+		total = 0;		/* Bytes read */
+  ssize_t	rbytes;			/* Bytes read */
+
+
+  if (bytes <= INPUT_BUFSIZE / 2 || in->map ||
+      (avail = (size_t)(in->end - in->ptr)) >= bytes)
+  {
+    if ((avail = fill_buffer(in, bytes)) < bytes)
+      bytes = avail;
+
+    if (bytes > 0)
+      memcpy(dataptr, in->ptr, bytes);
+
+    in->ptr += bytes;
+
+    return (bytes);
+  }
+
+  if (avail > 0)
+  {
+    memcpy(dataptr, in->ptr, avail);
+    in->ptr = in->end;
+    total   = avail;
+  }
+
+  while (total < bytes && !in->eof)
+  {
+    while ((rbytes = read(in->fd, dataptr + total, bytes - total)) < 0 &&
+	   (errno == EINTR || errno == EAGAIN));
+
+    if (rbytes <= 0)
+      in->eof = 1;
+    else
+      total += (size_t)rbytes;
+  }
+
+  return (total);
+}
+
+
+/*
+ * 'swap_samples()' - Swap the bytes of 16-bit samples.
+ */
+
+static void
+swap_samples(unsigned char *line,	/* I - Samples */
+             size_t        bytes)	/* I - Bytes of samples */
+{
+  unsigned char	temp;			/* Swapped byte */
+
+
+  for (; bytes > 1; bytes -= 2, line += 2)
+  {
+    temp    = line[0];
+    line[0] = line[1];
+    line[1] = temp;
+  }
+}
@@ -0,0 +1,115 @@
+/*
+     File: input.h 
+ Abstract: Raster input definitions for sample CUPS printer driver.
+  Version: 4.0 
+  
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple 
+ Inc. ("Apple") in consideration of your agreement to the following 
+ terms, and your use, installation, modification or redistribution of 
+ this Apple software constitutes acceptance of these terms.  If you do 
+ not agree with these terms, please do not use, install, modify or 
+ redistribute this Apple software. 
+  
+ In consideration of your agreement to abide by the following terms, and 
+ subject to these terms, Apple grants you a personal, non-exclusive 
+ license, under Apple's copyrights in this original Apple software (the 
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple 
+ Software, with or without modifications, in source and/or binary forms; 
+ provided that if you redistribute the Apple Software in its entirety and 
+ without modifications, you must retain this notice and the following 
+ text and disclaimers in all such redistributions of the Apple Software. 
+ Neither the name, trademarks, service marks or logos of Apple Inc. may 
+ be used to endorse or promote products derived from the Apple Software 
+ without specific prior written permission from Apple.  Except as 
+ expressly stated in this notice, no other rights or licenses, express or 
+ implied, are granted by Apple herein, including but not limited to any 
+ patent rights that may be infringed by your derivative works or by other 
+ works in which the Apple Software may be incorporated. 
+  
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE 
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION 
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS 
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND 
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS. 
+  
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL 
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, 
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED 
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), 
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE 
+ POSSIBILITY OF SUCH DAMAGE. 
+  
+ Copyright (C) 2011 Apple Inc. All Rights Reserved. 
+  
+ */  
+
+#ifndef _SAMPLE_INPUT_H_
+#  define _SAMPLE_INPUT_H_
+
+/*
+ * Include necessary headers...
+ */
+
+#  include <cups/raster.h>
+#  include <stddef.h>
+
+
+/*
+ * Input flags...
+ */
+
+#  define INPUT_MAP	1		/* Map regular files */
+#  define INPUT_CUPS	2		/* Read with libcups */
+
+
+/*
+ * Raster input data...
+ *
+ * Raster streams are decoded here rather than by cupsRasterReadPixels(), so
+ * that runs can be expanded straight into the band buffers and repeated
+ * lines can be passed on without copying them.  Files are mapped into memory
+ * when possible, and uncompressed lines in our own byte order are then
+ * passed as pointers into the mapping.  Pipes are read into "buffer".
+ *
+ * With INPUT_CUPS the stream is read with libcups instead, which is useful
+ * for checking the decoder.
+ */
+
+typedef struct
+{
+  int			fd;		/* File descriptor */
+  cups_raster_t		*ras;		/* libcups raster stream or NULL */
+  const unsigned char	*map;		/* Mapped file or NULL */
+  size_t		map_size;	/* Size of mapped file */
+  unsigned char		*buffer;	/* Read buffer */
+  size_t		bufsize;	/* Size of read buffer */
+  const unsigned char	*ptr,		/* Next byte in mapping or buffer */
+			*end;		/* End of mapping or buffer */
+  int			eof,		/* End of file seen? */
+			compressed,	/* Run-length encoded raster? */
+			swapped;	/* Other byte order? */
+  int			swap16;		/* Swap 16-bit samples on this page? */
+  unsigned		bpp;		/* Bytes per pixel for runs */
+  unsigned char		clear;		/* Byte for "clear to end of line" */
+  unsigned char		*line;		/* Last decoded line */
+  const unsigned char	*last;		/* Last line given to the caller */
+  unsigned		repeat;		/* Times the last line repeats */
+  size_t		bytes;		/* Bytes per line on current page */
+  unsigned		lines;		/* Lines left on current page */
+} input_t;
+
+
+/*
+ * Prototypes...
+ */
+
+extern input_t	*InputCreate(int fd, int flags);
+extern void	InputDelete(input_t *in);
+extern int	InputReadHeader(input_t *in, cups_page_header2_t *header);
+extern unsigned	InputReadLines(input_t *in, unsigned char *buffer,
+		               unsigned count, const unsigned char **data,
+			       unsigned char *same);
+
+#endif /* !_SAMPLE_INPUT_H_ */
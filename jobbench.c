@@ -0,0 +1,828 @@
+/*
+     File: jobbench.c 
+ Abstract: End-to-end job benchmark for sample CUPS printer driver.
+  Version: 4.0 
+  
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple 
+ Inc. ("Apple") in consideration of your agreement to the following 
+ terms, and your use, installation, modification or redistribution of 
+ this Apple software constitutes acceptance of these terms.  If you do 
+ not agree with these terms, please do not use, install, modify or 
+ redistribute this Apple software. 
+  
+ In consideration of your agreement to abide by the following terms, and 
+ subject to these terms, Apple grants you a personal, non-exclusive 
+ license, under Apple's copyrights in this original Apple software (the 
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple 
+ Software, with or without modifications, in source and/or binary forms; 
+ provided that if you redistribute the Apple Software in its entirety and 
+ without modifications, you must retain this notice and the following 
+ text and disclaimers in all such redistributions of the Apple Software. 
+ Neither the name, trademarks, service marks or logos of Apple Inc. may 
+ be used to endorse or promote products derived from the Apple Software 
+ without specific prior written permission from Apple.  Except as 
+ expressly stated in this notice, no other rights or licenses, express or 
+ implied, are granted by Apple herein, including but not limited to any 
+ patent rights that may be infringed by your derivative works or by other 
+ works in which the Apple Software may be incorporated. 
+  
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE 
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION 
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS 
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND 
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS. 
+  
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL 
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, 
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED 
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), 
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE 
+ POSSIBILITY OF SUCH DAMAGE. 
+  
+ Copyright (C) 2011 Apple Inc. All Rights Reserved. 
+  
+ */  
+
+/*
+ * Include necessary headers...
+ */
+
+#include "metrics.h"			/* MetricsNow() */
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+
+/*
+ * Constants...
+ */
+
+#define MAX_DOCS	32		/* Maximum documents per job */
+#define MAX_JOBS	256		/* Maximum jobs */
+#define MAX_RUNS	100		/* Maximum runs per job */
+
+
+/*
+ * Local types...
+ */
+
+typedef struct
+{
+  char		name[256];		/* Job name */
+  int		num_docs;		/* Number of documents */
+  char		*docs[MAX_DOCS];	/* Document files, in order */
+} job_t;
+
+typedef struct
+{
+  int		status;			/* 0 if every process succeeded */
+  int		pages;			/* Pages finished by the backend */
+  double	latency,		/* Seconds from start to backend exit */
+		first_page;		/* Seconds from start to first page */
+  uint64_t	filter_rss,		/* Largest filter resident set */
+		backend_rss,		/* Backend resident set */
+		stream_bytes,		/* Bytes sent to the backend */
+		output_bytes;		/* Bytes written by the backend */
+} result_t;
+
+typedef struct
+{
+  int		fd;			/* Backend stderr */
+  uint64_t	start;			/* Start time of job */
+  FILE		*log;			/* Log file or NULL */
+  int		pages;			/* Pages finished */
+  uint64_t	first_page;		/* Time first page finished */
+} monitor_t;
+
+
+/*
+ * Local globals...
+ */
+
+static const char	*backend = NULL;/* Backend program */
+static const char	*bindir = ".";	/* Directory with programs */
+static job_t		jobs[MAX_JOBS];	/* Jobs to run */
+static int		num_jobs = 0;	/* Number of jobs */
+static const char	*printer = "jobbench";
+					/* Printer queue name */
+static int		verbose = 0;	/* Show program messages? */
+
+
+/*
+ * Local functions...
+ */
+
+static void	add_job(const char *path, const char *name);
+static void	clean_output(int remove_files, uint64_t *bytes);
+static int	compare_doubles(const void *a, const void *b);
+static int	compare_strings(const void *a, const void *b);
+static void	load_corpus(const char *path);
+static void	*monitor_backend(void *data);
+static uint64_t	peak_rss(struct rusage *usage);
+static uint64_t	relay(int infd, int outfd, int recfd);
+static int	run_job(job_t *job, int recfd, result_t *result);
+static pid_t	start_program(const char *program, const char *filename,
+		              int infd, int outfd, int bcfd, int errfd);
+static void	usage(void);
+
+
+/*
+ * 'main()' - Run print jobs through the filters and backend and time them.
+ *
+ * Usage:
+ *
+ *     jobbench [options] corpus ...
+ *
+ * Each corpus is a directory or a single file.  Files in a directory are
+ * one-document jobs and subdirectories are multi-document jobs whose files
+ * are printed in name order.  The extension of each file says how it is
+ * sent to the backend:
+ *
+ *     .ras    CUPS raster, filtered by rastertosample
+ *     .cmd    CUPS command file, filtered by commandtosample
+ *     .smp    Recorded sample printer stream, replayed as-is
+ *
+ * The back-channel is connected as under cupsd, so status replies are part
+ * of the job time.
+ */
+
+int					/* O - Exit status */
+main(int  argc,				/* I - Number of command-line args */
+     char *argv[])			/* I - Command-line arguments */
+{
+  int		i, j;			/* Looping vars */
+  int		runs = 3;		/* Runs per job */
+  const char	*recdir = NULL;		/* Directory to record streams in */
+  char		filename[1024],		/* Recorded stream filename */
+		*ext;			/* Extension in filename */
+  int		recfd;			/* Recorded stream */
+  result_t	result,			/* Result of current run */
+		worst;			/* Largest values of all runs */
+  double	latency[MAX_RUNS],	/* Latency of each run */
+		first_page[MAX_RUNS];	/* Time to first page of each run */
+  int		status = 0;		/* Exit status */
+
+
+  for (i = 1; i < argc; i ++)
+  {
+    if (!strcmp(argv[i], "-B") && i + 1 < argc)
+      backend = argv[++ i];
+    else if (!strcmp(argv[i], "-b") && i + 1 < argc)
+      bindir = argv[++ i];
+    else if (!strcmp(argv[i], "-n") && i + 1 < argc)
+    {
+      if ((runs = atoi(argv[++ i])) < 1 || runs > MAX_RUNS)
+        usage();
+    }
+    else if (!strcmp(argv[i], "-p") && i + 1 < argc)
+      printer = argv[++ i];
+    else if (!strcmp(argv[i], "-r") && i + 1 < argc)
+      recdir = argv[++ i];
+    else if (!strcmp(argv[i], "-v"))
+      verbose = 1;
+    else if (argv[i][0] == '-')
+      usage();
+    else
+      load_corpus(argv[i]);
+  }
+
+  if (num_jobs == 0)
+    usage();
+
+  if (strchr(printer, '/'))
+  {
+    fputs("jobbench: Bad printer name.\n", stderr);
+    return (1);
+  }
+
+  if (!backend)
+  {
+    static char	path[1024];		/* Default backend */
+
+    snprintf(path, sizeof(path), "%s/sampletopdf", bindir);
+    backend = path;
+  }
+
+  if (recdir && mkdir(recdir, 0755) && errno != EEXIST)
+  {
+    fprintf(stderr, "jobbench: Unable to create \"%s\": %s\n", recdir,
+            strerror(errno));
+    return (1);
+  }
+
+  signal(SIGPIPE, SIG_IGN);
+
+ /*
+  * Run each job, reporting the median times and largest sizes...
+  */
+
+  printf("%-24s %4s %5s %10s %10s %9s %9s %10s %10s\n", "job", "docs",
+         "pages", "latency", "1st page", "filt RSS", "back RSS", "stream",
+	 "output");
+
+  for (i = 0; i < num_jobs; i ++)
+  {
+    memset(&worst, 0, sizeof(worst));
+
+    for (j = 0; j < runs; j ++)
+    {
+      recfd = -1;
+
+      if (recdir && j == 0)
+      {
+        if (snprintf(filename, sizeof(filename), "%s/%s", recdir,
+	             jobs[i].name) >= (int)sizeof(filename) - 4)
+	{
+          fprintf(stderr, "jobbench: Recording filename for \"%s\" is too "
+	                  "long.\n", jobs[i].name);
+	}
+	else
+	{
+          if ((ext = strrchr(filename, '.')) != NULL && ext > strrchr(filename, '/'))
+	    *ext = '\0';
+
+          strncat(filename, ".smp", sizeof(filename) - strlen(filename) - 1);
+
+          if ((recfd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+            fprintf(stderr, "jobbench: Unable to create \"%s\": %s\n",
+	            filename, strerror(errno));
+        }
+      }
+
+      if (run_job(jobs + i, recfd, &result))
+        worst.status = 1;
+
+      if (recfd >= 0)
+        close(recfd);
+
+      latency[j]    = result.latency;
+      first_page[j] = result.first_page;
+
+      if (result.pages > worst.pages)
+        worst.pages = result.pages;
+      if (result.filter_rss > worst.filter_rss)
+        worst.filter_rss = result.filter_rss;
+      if (result.backend_rss > worst.backend_rss)
+        worst.backend_rss = result.backend_rss;
+      if (result.stream_bytes > worst.stream_bytes)
+        worst.stream_bytes = result.stream_bytes;
+      if (result.output_bytes > worst.output_bytes)
+        worst.output_bytes = result.output_bytes;
+    }
+
+    qsort(latency, runs, sizeof(double), compare_doubles);
+    qsort(first_page, runs, sizeof(double), compare_doubles);
+
+    printf("%-24s %4d %5d %8.1fms %8.1fms %7.1fMB %7.1fMB %8.1fKB %8.1fKB%s\n",
+           jobs[i].name, jobs[i].num_docs, worst.pages,
+	   1000.0 * latency[runs / 2], 1000.0 * first_page[runs / 2],
+	   worst.filter_rss / 1048576.0, worst.backend_rss / 1048576.0,
+	   worst.stream_bytes / 1024.0, worst.output_bytes / 1024.0,
+	   worst.status ? "  FAILED" : "");
+    fflush(stdout);
+
+    if (worst.status)
+      status = 1;
+  }
+
+  return (status);
+}
+
+
+/*
+ * 'add_job()' - Add a job from a file or directory.
+ */
+
+static void
+add_job(const char *path,		/* I - File or directory */
+        const char *name)		/* I - Job name */
+{
+  job_t		*job;			/* New job */
+  DIR		*dir;			/* Directory */
+  struct dirent	*dent;			/* Directory entry */
+  char		filename[1024];		/* Document filename */
+  struct stat	info;			/* File information */
+
+
+  if (num_jobs >= MAX_JOBS)
+  {
+    fprintf(stderr, "jobbench: Too many jobs, ignoring \"%s\".\n", path);
+    return;
+  }
+
+  job = jobs + num_jobs;
+
+  strncpy(job->name, name, sizeof(job->name) - 1);
+  job->num_docs = 0;
+
+  if (stat(path, &info))
+  {
+    fprintf(stderr, "jobbench: Unable to open \"%s\": %s\n", path,
+            strerror(errno));
+    return;
+  }
+
+  if (!S_ISDIR(info.st_mode))
+  {
+    job->docs[job->num_docs ++] = strdup(path);
+  }
+  else if ((dir = opendir(path)) != NULL)
+  {
+    while ((dent = readdir(dir)) != NULL && job->num_docs < MAX_DOCS)
+    {
+      if (dent->d_name[0] == '.')
+        continue;
+
+      snprintf(filename, sizeof(filename), "%s/%s", path, dent->d_name);
+
+      if (!stat(filename, &info) && S_ISREG(info.st_mode))
+        job->docs[job->num_docs ++] = strdup(filename);
+    }
+
+    closedir(dir);
+
+    qsort(job->docs, job->num_docs, sizeof(char *), compare_strings);
+  }
+
+  if (job->num_docs > 0)
+    num_jobs ++;
+}
+
+
+/*
+ * 'clean_output()' - Total and optionally remove the backend's output files.
+ *
+ * sampletopdf writes "/Library/Caches/<printer>/<job> - <title><n>.pdf" and
+ * keeps the ink levels in "/Library/Caches/<printer>.cmyk".  Both are
+ * removed before each run so every run starts the same way.
+ */
+
+static void
+clean_output(int      remove_files,	/* I - Remove the files? */
+             uint64_t *bytes)		/* O - Total size of files or NULL */
+{
+  char		dirname[1024],		/* Output directory */
+		filename[1024];		/* Output file */
+  DIR		*dir;			/* Directory */
+  struct dirent	*dent;			/* Directory entry */
+  struct stat	info;			/* File information */
+
+
+  if (bytes)
+    *bytes = 0;
+
+  snprintf(dirname, sizeof(dirname), "/Library/Caches/%s", printer);
+
+  if ((dir = opendir(dirname)) != NULL)
+  {
+    while ((dent = readdir(dir)) != NULL)
+    {
+      if (dent->d_name[0] == '.')
+        continue;
+
+      if (snprintf(filename, sizeof(filename), "%s/%s", dirname,
+                   dent->d_name) >= (int)sizeof(filename) ||
+          stat(filename, &info) || !S_ISREG(info.st_mode))
+        continue;
+
+      if (bytes)
+        *bytes += (uint64_t)info.st_size;
+
+      if (remove_files)
+        unlink(filename);
+    }
+
+    closedir(dir);
+  }
+
+  if (remove_files)
+  {
+    snprintf(filename, sizeof(filename), "/Library/Caches/%s.cmyk", printer);
+    unlink(filename);
+  }
+}
+
+
+/*
+ * 'compare_doubles()' - Compare two times.
+ */
+
+static int				/* O - Result of comparison */
+compare_doubles(const void *a,		/* I - First time */
+                const void *b)		/* I - Second time */
+{
+  double	da = *((const double *)a),
+		db = *((const double *)b);
+
+
+  return (da < db ? -1 : da > db);
+}
+
+
+/*
+ * 'compare_strings()' - Compare two filenames.
+ */
+
+static int				/* O - Result of comparison */
+compare_strings(const void *a,		/* I - First filename */
+                const void *b)		/* I - Second filename */
+{
+  return (strcmp(*((char * const *)a), *((char * const *)b)));
+}
+
+
+/*
+ * 'load_corpus()' - Add the jobs in a corpus directory or file.
+ */
+
+static void
+load_corpus(const char *path)		/* I - Directory or file */
+{
+  DIR		*dir;			/* Directory */
+  struct dirent	*dent;			/* Directory entry */
+  struct stat	info;			/* File information */
+  char		filename[1024];		/* Job filename */
+  const char	*name;			/* Job name */
+  char		*names[MAX_JOBS];	/* Entries in directory */
+  int		i,			/* Looping var */
+		count = 0;		/* Number of entries */
+
+
+  if (stat(path, &info))
+  {
+    fprintf(stderr, "jobbench: Unable to open \"%s\": %s\n", path,
+            strerror(errno));
+    return;
+  }
+
+  if (!S_ISDIR(info.st_mode))
+  {
+    if ((name = strrchr(path, '/')) != NULL)
+      name ++;
+    else
+      name = path;
+
+    add_job(path, name);
+    return;
+  }
+
+  if ((dir = opendir(path)) == NULL)
+  {
+    fprintf(stderr, "jobbench: Unable to open \"%s\": %s\n", path,
+            strerror(errno));
+    return;
+  }
+
+  while ((dent = readdir(dir)) != NULL && count < MAX_JOBS)
+    if (dent->d_name[0] != '.')
+      names[count ++] = strdup(dent->d_name);
+
+  closedir(dir);
+
+  qsort(names, count, sizeof(char *), compare_strings);
+
+  for (i = 0; i < count; i ++)
+  {
+    snprintf(filename, sizeof(filename), "%s/%s", path, names[i]);
+    add_job(filename, names[i]);
+    free(names[i]);
+  }
+}
+
+
+/*
+ * 'monitor_backend()' - Watch the backend's messages for finished pages.
+ */
+
+static void *				/* O - Thread exit status (unused) */
+monitor_backend(void *data)		/* I - Monitor data */
+{
+  monitor_t	*monitor = (monitor_t *)data;
+					/* Monitor data */
+  FILE		*fp;			/* Backend stderr */
+  char		line[2048];		/* Line from backend */
+
+
+  if ((fp = fdopen(monitor->fd, "r")) == NULL)
+    return (NULL);
+
+  while (fgets(line, sizeof(line), fp))
+  {
+    if (!strncmp(line, "DEBUG: Ending page", 18))
+    {
+      if (monitor->pages == 0)
+        monitor->first_page = MetricsNow();
+
+      monitor->pages ++;
+    }
+
+    if (monitor->log)
+      fputs(line, monitor->log);
+  }
+
+  fclose(fp);
+
+  return (NULL);
+}
+
+
+/*
+ * 'peak_rss()' - Get the peak resident set in bytes.
+ */
+
+static uint64_t				/* O - Bytes */
+peak_rss(struct rusage *usage)		/* I - Resource usage */
+{
+#ifdef __APPLE__
+  return ((uint64_t)usage->ru_maxrss);
+#else
+  return ((uint64_t)usage->ru_maxrss * 1024);
+#endif /* __APPLE__ */
+}
+
+
+/*
+ * 'relay()' - Copy a document to the backend, recording it as needed.
+ */
+
+static uint64_t				/* O - Bytes copied */
+relay(int infd,				/* I - Document or filter output */
+      int outfd,			/* I - Backend input */
+      int recfd)			/* I - Recorded stream or -1 */
+{
+  char		buffer[65536];		/* Copy buffer */
+  ssize_t	bytes,			/* Bytes read */
+		written;		/* Bytes written */
+  uint64_t	total = 0;		/* Total bytes */
+  char		*ptr;			/* Pointer into buffer */
+
+
+  while ((bytes = read(infd, buffer, sizeof(buffer))) != 0)
+  {
+    if (bytes < 0)
+    {
+      if (errno == EINTR || errno == EAGAIN)
+        continue;
+
+      break;
+    }
+
+    total += (uint64_t)bytes;
+
+    if (recfd >= 0)
+      write(recfd, buffer, (size_t)bytes);
+
+    for (ptr = buffer; bytes > 0; bytes -= written, ptr += written)
+    {
+      if ((written = write(outfd, ptr, (size_t)bytes)) < 0)
+      {
+        if (errno == EINTR || errno == EAGAIN)
+	{
+	  written = 0;
+	  continue;
+	}
+
+	return (total);
+      }
+    }
+  }
+
+  return (total);
+}
+
+
+/*
+ * 'run_job()' - Run one job.
+ */
+
+static int				/* O - 0 on success, 1 on failure */
+run_job(job_t    *job,			/* I - Job */
+        int      recfd,			/* I - Recorded stream or -1 */
+	result_t *result)		/* O - Result */
+{
+  int		i;			/* Looping var */
+  int		data[2],		/* Pipe to backend */
+		backch[2],		/* Back-channel */
+		errpipe[2],		/* Backend messages */
+		output[2],		/* Filter output */
+		fd,			/* Replayed stream */
+		errfd,			/* Filter messages */
+		wstatus;		/* Exit status */
+  const char	*ext;			/* Document extension */
+  char		program[1024];		/* Filter */
+  pid_t		backend_pid,		/* Backend */
+		filter_pid;		/* Filter */
+  struct rusage	usage;			/* Resource usage */
+  monitor_t	monitor;		/* Backend monitor data */
+  pthread_t	monitor_thread;		/* Backend monitor thread */
+  uint64_t	end;			/* End of job */
+
+
+  memset(result, 0, sizeof(result_t));
+
+  clean_output(1, NULL);
+
+  errfd = open(verbose ? "/dev/stderr" : "/dev/null", O_WRONLY);
+
+  if (pipe(data) || pipe(backch) || pipe(errpipe))
+  {
+    perror("jobbench: Unable to create pipes");
+    exit(1);
+  }
+
+ /*
+  * Start the backend, which reads the job on stdin and sends back-channel
+  * data on fd 3...
+  */
+
+  memset(&monitor, 0, sizeof(monitor));
+  monitor.fd    = errpipe[0];
+  monitor.log   = verbose ? stderr : NULL;
+  monitor.start = MetricsNow();
+
+  if ((backend_pid = start_program(backend, NULL, data[0], errfd, backch[1],
+                                   errpipe[1])) < 0)
+    exit(1);
+
+  close(data[0]);
+  close(backch[1]);
+  close(errpipe[1]);
+
+  pthread_create(&monitor_thread, NULL, monitor_backend, &monitor);
+
+ /*
+  * Send each document, filtering as needed.  Filters read back-channel data
+  * on fd 3...
+  */
+
+  for (i = 0; i < job->num_docs; i ++)
+  {
+    if ((ext = strrchr(job->docs[i], '.')) != NULL && !strcmp(ext, ".smp"))
+    {
+      if ((fd = open(job->docs[i], O_RDONLY)) < 0)
+      {
+        fprintf(stderr, "jobbench: Unable to open \"%s\": %s\n", job->docs[i],
+	        strerror(errno));
+	result->status = 1;
+	continue;
+      }
+
+      result->stream_bytes += relay(fd, data[1], recfd);
+      close(fd);
+      continue;
+    }
+
+    if (ext && !strcmp(ext, ".cmd"))
+      snprintf(program, sizeof(program), "%s/commandtosample", bindir);
+    else
+      snprintf(program, sizeof(program), "%s/rastertosample", bindir);
+
+    if (pipe(output))
+    {
+      perror("jobbench: Unable to create pipes");
+      exit(1);
+    }
+
+    if ((filter_pid = start_program(program, job->docs[i], -1, output[1],
+                                    backch[0], errfd)) < 0)
+      exit(1);
+
+    close(output[1]);
+
+    result->stream_bytes += relay(output[0], data[1], recfd);
+    close(output[0]);
+
+    while (wait4(filter_pid, &wstatus, 0, &usage) < 0 && errno == EINTR);
+
+    if (!WIFEXITED(wstatus) || WEXITSTATUS(wstatus))
+    {
+      fprintf(stderr, "jobbench: %s failed on \"%s\".\n", program,
+              job->docs[i]);
+      result->status = 1;
+    }
+
+    if (peak_rss(&usage) > result->filter_rss)
+      result->filter_rss = peak_rss(&usage);
+  }
+
+ /*
+  * Wait for the backend to finish the job...
+  */
+
+  close(data[1]);
+
+  while (wait4(backend_pid, &wstatus, 0, &usage) < 0 && errno == EINTR);
+
+  end = MetricsNow();
+
+  pthread_join(monitor_thread, NULL);
+  close(backch[0]);
+  close(errfd);
+
+  if (!WIFEXITED(wstatus) || WEXITSTATUS(wstatus))
+  {
+    fprintf(stderr, "jobbench: %s failed on \"%s\".\n", backend, job->name);
+    result->status = 1;
+  }
+
+  result->pages       = monitor.pages;
+  result->latency     = (end - monitor.start) / 1000000000.0;
+  result->first_page  = monitor.pages ?
+                            (monitor.first_page - monitor.start) / 1000000000.0 :
+			    result->latency;
+  result->backend_rss = peak_rss(&usage);
+
+  clean_output(0, &result->output_bytes);
+
+  return (result->status);
+}
+
+
+/*
+ * 'start_program()' - Start a filter or backend the way cupsd does.
+ */
+
+static pid_t				/* O - Process ID or -1 on error */
+start_program(const char *program,	/* I - Program to run */
+              const char *filename,	/* I - File to print or NULL */
+              int        infd,		/* I - Standard input or -1 */
+	      int        outfd,		/* I - Standard output */
+	      int        bcfd,		/* I - Back-channel */
+	      int        errfd)		/* I - Standard error */
+{
+  pid_t		pid;			/* Process ID */
+  char		ppd[PATH_MAX];		/* PPD file */
+  int		fd;			/* Looping var */
+
+
+  if ((pid = fork()) < 0)
+  {
+    perror("jobbench: Unable to fork");
+    return (-1);
+  }
+  else if (pid > 0)
+    return (pid);
+
+ /*
+  * Child comes here...
+  */
+
+  if (infd < 0)
+    infd = open("/dev/null", O_RDONLY);
+
+  dup2(infd, 0);
+  dup2(outfd, 1);
+  dup2(errfd, 2);
+  dup2(bcfd, 3);
+
+  for (fd = 4; fd < 1024; fd ++)
+    close(fd);
+
+  setenv("PRINTER", printer, 1);
+
+  if (!getenv("PPD") && realpath("sample.ppd", ppd))
+    setenv("PPD", ppd, 1);
+
+  if (filename)
+    execl(program, program, "1", "jobbench", "jobbench", "1", "", filename,
+          (char *)NULL);
+  else
+    execl(program, program, "1", "jobbench", "jobbench", "1", "",
+          (char *)NULL);
+
+  fprintf(stderr, "jobbench: Unable to run \"%s\": %s\n", program,
+          strerror(errno));
+  _exit(1);
+}
+
+
+/*
+ * 'usage()' - Show program usage and exit.
+ */
+
+static void
+usage(void)
+{
+  fputs("Usage: jobbench [options] corpus ...\n", stderr);
+  fputs("Options:\n", stderr);
+  fputs("  -B backend        Backend to use (default sampletopdf in bindir)\n", stderr);
+  fputs("  -b bindir         Directory with the filters (default .)\n", stderr);
+  fputs("  -n runs           Runs per job (default 3)\n", stderr);
+  fputs("  -p printer        Printer queue name (default jobbench)\n", stderr);
+  fputs("  -r directory      Record the stream sent for each job\n", stderr);
+  fputs("  -v                Show filter and backend messages\n", stderr);
+
+  exit(1);
+}
@@ -0,0 +1,720 @@
+/*
+     File: kernels.c 
+ Abstract: Raster processing kernels for sample CUPS printer driver.
+  Version: 4.0 
+  
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple 
+ Inc. ("Apple") in consideration of your agreement to the following 
+ terms, and your use, installation, modification or redistribution of 
+ this Apple software constitutes acceptance of these terms.  If you do 
+ not agree with these terms, please do not use, install, modify or 
+ redistribute this Apple software. 
+  
+ In consideration of your agreement to abide by the following terms, and 
+ subject to these terms, Apple grants you a personal, non-exclusive 
+ license, under Apple's copyrights in this original Apple software (the 
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple 
+ Software, with or without modifications, in source and/or binary forms; 
+ provided that if you redistribute the Apple Software in its entirety and 
+ without modifications, you must retain this notice and the following 
+ text and disclaimers in all such redistributions of the Apple Software. 
+ Neither the name, trademarks, service marks or logos of Apple Inc. may 
+ be used to endorse or promote products derived from the Apple Software 
+ without specific prior written permission from Apple.  Except as 
+ expressly stated in this notice, no other rights or licenses, express or 
+ implied, are granted by Apple herein, including but not limited to any 
+ patent rights that may be infringed by your derivative works or by other 
+ works in which the Apple Software may be incorporated. 
+  
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE 
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION 
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS 
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND 
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS. 
+  
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL 
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, 
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED 
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), 
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE 
+ POSSIBILITY OF SUCH DAMAGE. 
+  
+ Copyright (C) 2011 Apple Inc. All Rights Reserved. 
+  
+ */  
+
+#include "sample.h"			/* Common sample driver header */
+#include "kernels.h"			/* Raster kernel definitions */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#  include <emmintrin.h>
+#endif /* __SSE2__ */
+#if defined(__i386__) || defined(__x86_64__)
+#  if defined(__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)
+#    include <immintrin.h>
+#    define HAVE_AVX2_KERNELS 1
+#  endif /* __clang__ || __GNUC__ >= 4.9 */
+#endif /* __i386__ || __x86_64__ */
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#  include <arm_neon.h>
+#  define HAVE_NEON_KERNELS 1
+#endif /* __ARM_NEON || __ARM_NEON__ */
+
+
+/*
+ * The kernels convert 16-bit data to 8-bits, which is then sent as-is or
+ * dithered by the halftoning code in halftone.c.  This formula:
+ *
+ *     (pixel + 129) / 257
+ *
+ * rounds the 16-bit pixel to the nearest 8-bit value ("+ 129") and converts
+ * from 16-bits to 8-bits (65535 / 255 = 257).
+ *
+ * The vector kernels replace the divide with a 16x16 high multiply that
+ * produces the same result for all 65536 inputs:
+ *
+ *     (((pixel * 65281) >> 16) + 129) >> 8
+ *
+ * The intermediate value never exceeds 65409, so everything stays in
+ * unsigned 16-bit lanes.
+ */
+
+#define CONVERT16_MUL	65281		/* 2^24 / 257, rounded up */
+#define CONVERT16_ADD	129		/* Rounding bias */
+
+
+/*
+ * Local functions...
+ */
+
+static const unsigned char *copy8(unsigned char *dst, const unsigned char *src,
+			          unsigned width);
+static void	convert16_scalar(unsigned char *dst, const unsigned short *src,
+		                 size_t count);
+#if defined(__SSE2__)
+static void	convert16_sse2(unsigned char *dst, const unsigned short *src,
+		               size_t count);
+#endif /* __SSE2__ */
+#ifdef HAVE_AVX2_KERNELS
+static void	convert16_avx2(unsigned char *dst, const unsigned short *src,
+		               size_t count) __attribute__((target("avx2")));
+#endif /* HAVE_AVX2_KERNELS */
+#ifdef HAVE_NEON_KERNELS
+static void	convert16_neon(unsigned char *dst, const unsigned short *src,
+		               size_t count);
+#endif /* HAVE_NEON_KERNELS */
+static const unsigned char *rskip_white_scalar(const unsigned char *start,
+				               const unsigned char *end);
+static const unsigned char *skip_white_scalar(const unsigned char *ptr,
+				              const unsigned char *end);
+#if defined(__SSE2__)
+static const unsigned char *rskip_white_sse2(const unsigned char *start,
+				             const unsigned char *end);
+static const unsigned char *skip_white_sse2(const unsigned char *ptr,
+				            const unsigned char *end);
+#endif /* __SSE2__ */
+#ifdef HAVE_AVX2_KERNELS
+static const unsigned char *rskip_white_avx2(const unsigned char *start,
+				             const unsigned char *end)
+				             __attribute__((target("avx2")));
+static const unsigned char *skip_white_avx2(const unsigned char *ptr,
+				            const unsigned char *end)
+				            __attribute__((target("avx2")));
+#endif /* HAVE_AVX2_KERNELS */
+#ifdef HAVE_NEON_KERNELS
+static const unsigned char *rskip_white_neon(const unsigned char *start,
+				             const unsigned char *end);
+static const unsigned char *skip_white_neon(const unsigned char *ptr,
+				            const unsigned char *end);
+#endif /* HAVE_NEON_KERNELS */
+
+
+/*
+ * Format-specific kernels...
+ *
+ * CONVERT16_KERNEL() defines a 16-bit conversion kernel for one color space
+ * and instruction set, so the number of samples per pixel is a compile-time
+ * constant in each kernel.
+ */
+
+#define CONVERT16_KERNEL(space,colors,isa) \
+static const unsigned char * \
+convert16_ ## space ## _ ## isa(unsigned char       *dst, \
+                                const unsigned char *src, \
+                                unsigned            width) \
+{ \
+  convert16_ ## isa(dst, (const unsigned short *)src, (size_t)width * colors); \
+  return (dst); \
+}
+
+CONVERT16_KERNEL(w, 1, scalar)
+CONVERT16_KERNEL(rgb, 3, scalar)
+#if defined(__SSE2__)
+CONVERT16_KERNEL(w, 1, sse2)
+CONVERT16_KERNEL(rgb, 3, sse2)
+#endif /* __SSE2__ */
+#ifdef HAVE_AVX2_KERNELS
+CONVERT16_KERNEL(w, 1, avx2)
+CONVERT16_KERNEL(rgb, 3, avx2)
+#endif /* HAVE_AVX2_KERNELS */
+#ifdef HAVE_NEON_KERNELS
+CONVERT16_KERNEL(w, 1, neon)
+CONVERT16_KERNEL(rgb, 3, neon)
+#endif /* HAVE_NEON_KERNELS */
+
+
+/*
+ * Kernel registry, best kernel first for each format...
+ */
+
+static const kernel_t kernels[] =
+{
+#ifdef HAVE_AVX2_KERNELS
+  { "w16-avx2",     16, CUPS_CSPACE_W,   CUPS_ORDER_CHUNKED, KERNEL_AVX2, convert16_w_avx2 },
+  { "rgb16-avx2",   16, CUPS_CSPACE_RGB, CUPS_ORDER_CHUNKED, KERNEL_AVX2, convert16_rgb_avx2 },
+#endif /* HAVE_AVX2_KERNELS */
+#if defined(__SSE2__)
+  { "w16-sse2",     16, CUPS_CSPACE_W,   CUPS_ORDER_CHUNKED, KERNEL_SSE2, convert16_w_sse2 },
+  { "rgb16-sse2",   16, CUPS_CSPACE_RGB, CUPS_ORDER_CHUNKED, KERNEL_SSE2, convert16_rgb_sse2 },
+#endif /* __SSE2__ */
+#ifdef HAVE_NEON_KERNELS
+  { "w16-neon",     16, CUPS_CSPACE_W,   CUPS_ORDER_CHUNKED, KERNEL_NEON, convert16_w_neon },
+  { "rgb16-neon",   16, CUPS_CSPACE_RGB, CUPS_ORDER_CHUNKED, KERNEL_NEON, convert16_rgb_neon },
+#endif /* HAVE_NEON_KERNELS */
+  { "w16-scalar",   16, CUPS_CSPACE_W,   CUPS_ORDER_CHUNKED, 0,           convert16_w_scalar },
+  { "rgb16-scalar", 16, CUPS_CSPACE_RGB, CUPS_ORDER_CHUNKED, 0,           convert16_rgb_scalar },
+  { "w8-copy",       8, CUPS_CSPACE_W,   CUPS_ORDER_CHUNKED, 0,           copy8 },
+  { "rgb8-copy",     8, CUPS_CSPACE_RGB, CUPS_ORDER_CHUNKED, 0,           copy8 }
+};
+
+
+/*
+ * 'FindKernel()' - Find the conversion kernel for a page.
+ *
+ * The SAMPLE_KERNEL environment variable can name a specific kernel to use
+ * instead of the fastest one.  It is ignored if the named kernel does not
+ * support the page format or the current CPU.
+ */
+
+const kernel_t *			/* O - Kernel or NULL if none */
+FindKernel(cups_page_header2_t *header)	/* I - Page header */
+{
+  const kernel_t	*kernel,	/* Current kernel */
+			*best = NULL;	/* Fastest matching kernel */
+  unsigned		features = GetCPUFeatures();
+					/* Supported CPU features */
+  const char		*forced = getenv("SAMPLE_KERNEL");
+					/* Kernel to force */
+  size_t		i;		/* Looping var */
+
+
+  for (i = 0, kernel = kernels; i < sizeof(kernels) / sizeof(kernels[0]); i ++, kernel ++)
+  {
+    if (kernel->bits != header->cupsBitsPerColor ||
+        kernel->cspace != header->cupsColorSpace ||
+        kernel->order != header->cupsColorOrder ||
+        (kernel->features & features) != kernel->features)
+      continue;
+
+    if (forced && !strcmp(forced, kernel->name))
+      return (kernel);
+
+    if (!best)
+      best = kernel;
+  }
+
+  if (forced && best)
+    LogDebug("SAMPLE_KERNEL=%s not usable for this page, using %s.", forced,
+             best->name);
+
+  return (best);
+}
+
+
+/*
+ * 'GetKernel()' - Get a kernel by name.
+ *
+ * Unlike FindKernel(), this doesn't look at the page format, so callers can
+ * run every kernel the CPU supports.
+ */
+
+const kernel_t *			/* O - Kernel or NULL if not available */
+GetKernel(const char *name)		/* I - Kernel name */
+{
+  const kernel_t	*kernel;	/* Current kernel */
+  unsigned		features = GetCPUFeatures();
+					/* Supported CPU features */
+  size_t		i;		/* Looping var */
+
+
+  for (i = 0, kernel = kernels; i < sizeof(kernels) / sizeof(kernels[0]); i ++, kernel ++)
+    if (!strcmp(name, kernel->name))
+      return ((kernel->features & features) == kernel->features ? kernel : NULL);
+
+  return (NULL);
+}
+
+
+/*
+ * 'GetCPUFeatures()' - Get the CPU features available to kernels.
+ */
+
+unsigned				/* O - KERNEL_xxx bitflags */
+GetCPUFeatures(void)
+{
+  static int	features = -1;		/* Cached features */
+
+
+  if (features < 0)
+  {
+    features = 0;
+
+#if defined(__SSE2__)
+    features |= KERNEL_SSE2;
+#endif /* __SSE2__ */
+
+#ifdef HAVE_AVX2_KERNELS
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2"))
+      features |= KERNEL_AVX2;
+#endif /* HAVE_AVX2_KERNELS */
+
+#ifdef HAVE_NEON_KERNELS
+    features |= KERNEL_NEON;
+#endif /* HAVE_NEON_KERNELS */
+  }
+
+  return ((unsigned)features);
+}
+
+
+/*
+ * 'ScanLine()' - Find the part of a converted line that isn't white.
+ *
+ * Converted lines are 8-bit data where 255 is white in every color space.
+ * The returned span starts at the first non-white byte and ends after the
+ * last non-white byte.
+ */
+
+int					/* O - 1 if the line has ink, 0 if white */
+ScanLine(const unsigned char *line,	/* I - Converted line */
+         size_t              bytes,	/* I - Bytes in line */
+	 size_t              *first,	/* O - First non-white byte */
+	 size_t              *last)	/* O - Byte after last non-white byte */
+{
+  const unsigned char	*end = line + bytes,
+					/* End of line */
+			*start;		/* First non-white byte */
+  unsigned		features = GetCPUFeatures();
+					/* Supported CPU features */
+
+
+  *first = *last = 0;
+
+#ifdef HAVE_AVX2_KERNELS
+  if (features & KERNEL_AVX2)
+  {
+    if ((start = skip_white_avx2(line, end)) == end)
+      return (0);
+
+    *first = start - line;
+    *last  = rskip_white_avx2(start, end) - line;
+
+    return (1);
+  }
+#endif /* HAVE_AVX2_KERNELS */
+
+#if defined(__SSE2__)
+  if (features & KERNEL_SSE2)
+  {
+    if ((start = skip_white_sse2(line, end)) == end)
+      return (0);
+
+    *first = start - line;
+    *last  = rskip_white_sse2(start, end) - line;
+
+    return (1);
+  }
+#endif /* __SSE2__ */
+
+#ifdef HAVE_NEON_KERNELS
+  if (features & KERNEL_NEON)
+  {
+    if ((start = skip_white_neon(line, end)) == end)
+      return (0);
+
+    *first = start - line;
+    *last  = rskip_white_neon(start, end) - line;
+
+    return (1);
+  }
+#endif /* HAVE_NEON_KERNELS */
+
+  (void)features;
+
+  if ((start = skip_white_scalar(line, end)) == end)
+    return (0);
+
+  *first = start - line;
+  *last  = rskip_white_scalar(start, end) - line;
+
+  return (1);
+}
+
+
+/*
+ * 'copy8()' - Pass 8-bit data through unchanged.
+ */
+
+static const unsigned char *		/* O - Converted data */
+copy8(unsigned char       *dst,		/* I - Output buffer (unused) */
+      const unsigned char *src,		/* I - Raster data */
+      unsigned            width)	/* I - Width in pixels (unused) */
+{
+  (void)dst;
+  (void)width;
+
+  return (src);
+}
+
+
+/*
+ * 'convert16_scalar()' - Convert 16-bit samples using the reference formula.
+ */
+
+static void
+convert16_scalar(
+    unsigned char        *dst,		/* O - 8-bit samples */
+    const unsigned short *src,		/* I - 16-bit samples */
+    size_t               count)		/* I - Number of samples */
+{
+  while (count > 0)
+  {
+    *dst++ = (*src++ + 129) / 257;
+    count --;
+  }
+}
+
+
+#if defined(__SSE2__)
+/*
+ * 'convert16_sse2()' - Convert 16-bit samples 16 at a time using SSE2.
+ */
+
+static void
+convert16_sse2(
+    unsigned char        *dst,		/* O - 8-bit samples */
+    const unsigned short *src,		/* I - 16-bit samples */
+    size_t               count)		/* I - Number of samples */
+{
+  const __m128i	mul = _mm_set1_epi16((short)CONVERT16_MUL),
+		add = _mm_set1_epi16(CONVERT16_ADD);
+  __m128i	lo, hi;			/* Samples */
+
+
+  for (; count >= 16; count -= 16, src += 16, dst += 16)
+  {
+    lo = _mm_loadu_si128((const __m128i *)src);
+    hi = _mm_loadu_si128((const __m128i *)(src + 8));
+
+    lo = _mm_srli_epi16(_mm_add_epi16(_mm_mulhi_epu16(lo, mul), add), 8);
+    hi = _mm_srli_epi16(_mm_add_epi16(_mm_mulhi_epu16(hi, mul), add), 8);
+
+    _mm_storeu_si128((__m128i *)dst, _mm_packus_epi16(lo, hi));
+  }
+
+  convert16_scalar(dst, src, count);
+}
+#endif /* __SSE2__ */
+
+
+#ifdef HAVE_AVX2_KERNELS
+/*
+ * 'convert16_avx2()' - Convert 16-bit samples 32 at a time using AVX2.
+ */
+
+static void
+convert16_avx2(
+    unsigned char        *dst,		/* O - 8-bit samples */
+    const unsigned short *src,		/* I - 16-bit samples */
+    size_t               count)		/* I - Number of samples */
+{
+  const __m256i	mul = _mm256_set1_epi16((short)CONVERT16_MUL),
+		add = _mm256_set1_epi16(CONVERT16_ADD);
+  __m256i	lo, hi;			/* Samples */
+
+
+  for (; count >= 32; count -= 32, src += 32, dst += 32)
+  {
+    lo = _mm256_loadu_si256((const __m256i *)src);
+    hi = _mm256_loadu_si256((const __m256i *)(src + 16));
+
+    lo = _mm256_srli_epi16(_mm256_add_epi16(_mm256_mulhi_epu16(lo, mul), add), 8);
+    hi = _mm256_srli_epi16(_mm256_add_epi16(_mm256_mulhi_epu16(hi, mul), add), 8);
+
+   /*
+    * _mm256_packus_epi16 packs within each 128-bit lane, so put the 64-bit
+    * quarters back in order afterwards...
+    */
+
+    _mm256_storeu_si256((__m256i *)dst,
+                        _mm256_permute4x64_epi64(_mm256_packus_epi16(lo, hi),
+                                                 0xd8));
+  }
+
+  convert16_scalar(dst, src, count);
+}
+#endif /* HAVE_AVX2_KERNELS */
+
+
+#ifdef HAVE_NEON_KERNELS
+/*
+ * 'convert16_neon()' - Convert 16-bit samples 16 at a time using NEON.
+ */
+
+static void
+convert16_neon(
+    unsigned char        *dst,		/* O - 8-bit samples */
+    const unsigned short *src,		/* I - 16-bit samples */
+    size_t               count)		/* I - Number of samples */
+{
+  const uint16x4_t	mul = vdup_n_u16(CONVERT16_MUL);
+  const uint16x8_t	add = vdupq_n_u16(CONVERT16_ADD);
+  uint16x8_t		lo, hi;		/* Samples */
+
+
+  for (; count >= 16; count -= 16, src += 16, dst += 16)
+  {
+    lo = vld1q_u16(src);
+    hi = vld1q_u16(src + 8);
+
+    lo = vcombine_u16(vshrn_n_u32(vmull_u16(vget_low_u16(lo), mul), 16),
+                      vshrn_n_u32(vmull_u16(vget_high_u16(lo), mul), 16));
+    hi = vcombine_u16(vshrn_n_u32(vmull_u16(vget_low_u16(hi), mul), 16),
+                      vshrn_n_u32(vmull_u16(vget_high_u16(hi), mul), 16));
+
+    vst1q_u8(dst, vcombine_u8(vshrn_n_u16(vaddq_u16(lo, add), 8),
+                              vshrn_n_u16(vaddq_u16(hi, add), 8)));
+  }
+
+  convert16_scalar(dst, src, count);
+}
+#endif /* HAVE_NEON_KERNELS */
+
+
+/*
+ * 'rskip_white_scalar()' - Find the end of the non-white data, a word at a
+ *                          time.
+ */
+
+static const unsigned char *		/* O - Byte after last non-white byte */
+rskip_white_scalar(
+    const unsigned char *start,		/* I - Start of data */
+    const unsigned char *end)		/* I - End of data */
+{
+  uint64_t	word;			/* Word to compare */
+
+
+  for (; (end - start) >= 8; end -= 8)
+  {
+    memcpy(&word, end - 8, 8);
+
+    if (word != UINT64_MAX)
+      break;
+  }
+
+  while (end > start && end[-1] == 255)
+    end --;
+
+  return (end);
+}
+
+
+/*
+ * 'skip_white_scalar()' - Skip white data, a word at a time.
+ */
+
+static const unsigned char *		/* O - First non-white byte or end */
+skip_white_scalar(
+    const unsigned char *ptr,		/* I - Start of data */
+    const unsigned char *end)		/* I - End of data */
+{
+  uint64_t	word;			/* Word to compare */
+
+
+  for (; (end - ptr) >= 8; ptr += 8)
+  {
+    memcpy(&word, ptr, 8);
+
+    if (word != UINT64_MAX)
+      break;
+  }
+
+  while (ptr < end && *ptr == 255)
+    ptr ++;
+
+  return (ptr);
+}
+
+
+#if defined(__SSE2__)
+/*
+ * 'rskip_white_sse2()' - Find the end of the non-white data, 16 bytes at a
+ *                        time using SSE2.
+ */
+
+static const unsigned char *		/* O - Byte after last non-white byte */
+rskip_white_sse2(
+    const unsigned char *start,		/* I - Start of data */
+    const unsigned char *end)		/* I - End of data */
+{
+  const __m128i	white = _mm_set1_epi8(-1);
+  unsigned	mask;			/* Non-white bytes */
+
+
+  for (; (end - start) >= 16; end -= 16)
+  {
+    mask = ~(unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(end - 16)), white)) & 0xffff;
+
+    if (mask)
+      return (end - 16 + (32 - __builtin_clz(mask)));
+  }
+
+  return (rskip_white_scalar(start, end));
+}
+
+
+/*
+ * 'skip_white_sse2()' - Skip white data 16 bytes at a time using SSE2.
+ */
+
+static const unsigned char *		/* O - First non-white byte or end */
+skip_white_sse2(
+    const unsigned char *ptr,		/* I - Start of data */
+    const unsigned char *end)		/* I - End of data */
+{
+  const __m128i	white = _mm_set1_epi8(-1);
+  unsigned	mask;			/* Non-white bytes */
+
+
+  for (; (end - ptr) >= 16; ptr += 16)
+  {
+    mask = ~(unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)ptr), white)) & 0xffff;
+
+    if (mask)
+      return (ptr + __builtin_ctz(mask));
+  }
+
+  return (skip_white_scalar(ptr, end));
+}
+#endif /* __SSE2__ */
+
+
+#ifdef HAVE_AVX2_KERNELS
+/*
+ * 'rskip_white_avx2()' - Find the end of the non-white data, 32 bytes at a
+ *                        time using AVX2.
+ */
+
+static const unsigned char *		/* O - Byte after last non-white byte */
+rskip_white_avx2(
+    const unsigned char *start,		/* I - Start of data */
+    const unsigned char *end)		/* I - End of data */
+{
+  const __m256i	white = _mm256_set1_epi8(-1);
+  unsigned	mask;			/* Non-white bytes */
+
+
+  for (; (end - start) >= 32; end -= 32)
+  {
+    mask = ~(unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(end - 32)), white));
+
+    if (mask)
+      return (end - 32 + (32 - __builtin_clz(mask)));
+  }
+
+  return (rskip_white_scalar(start, end));
+}
+
+
+/*
+ * 'skip_white_avx2()' - Skip white data 32 bytes at a time using AVX2.
+ */
+
+static const unsigned char *		/* O - First non-white byte or end */
+skip_white_avx2(
+    const unsigned char *ptr,		/* I - Start of data */
+    const unsigned char *end)		/* I - End of data */
+{
+  const __m256i	white = _mm256_set1_epi8(-1);
+  unsigned	mask;			/* Non-white bytes */
+
+
+  for (; (end - ptr) >= 32; ptr += 32)
+  {
+    mask = ~(unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)ptr), white));
+
+    if (mask)
+      return (ptr + __builtin_ctz(mask));
+  }
+
+  return (skip_white_scalar(ptr, end));
+}
+#endif /* HAVE_AVX2_KERNELS */
+
+
+#ifdef HAVE_NEON_KERNELS
+/*
+ * 'rskip_white_neon()' - Find the end of the non-white data, 16 bytes at a
+ *                        time using NEON.
+ */
+
+static const unsigned char *		/* O - Byte after last non-white byte */
+rskip_white_neon(
+    const unsigned char *start,		/* I - Start of data */
+    const unsigned char *end)		/* I - End of data */
+{
+  uint64x2_t	words;			/* Bytes as 64-bit words */
+
+
+  for (; (end - start) >= 16; end -= 16)
+  {
+    words = vreinterpretq_u64_u8(vld1q_u8(end - 16));
+
+    if ((vgetq_lane_u64(words, 0) & vgetq_lane_u64(words, 1)) != UINT64_MAX)
+      break;
+  }
+
+  return (rskip_white_scalar(start, end));
+}
+
+
+/*
+ * 'skip_white_neon()' - Skip white data 16 bytes at a time using NEON.
+ */
+
+static const unsigned char *		/* O - First non-white byte or end */
+skip_white_neon(
+    const unsigned char *ptr,		/* I - Start of data */
+    const unsigned char *end)		/* I - End of data */
+{
+  uint64x2_t	words;			/* Bytes as 64-bit words */
+
+
+  for (; (end - ptr) >= 16; ptr += 16)
+  {
+    words = vreinterpretq_u64_u8(vld1q_u8(ptr));
+
+    if ((vgetq_lane_u64(words, 0) & vgetq_lane_u64(words, 1)) != UINT64_MAX)
+      break;
+  }
+
+  return (skip_white_scalar(ptr, end));
+}
+#endif /* HAVE_NEON_KERNELS */
@@ -0,0 +1,102 @@
+/*
+     File: kernels.h 
+ Abstract: Raster processing kernel definitions for sample CUPS printer driver.
+  Version: 4.0 
+  
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple 
+ Inc. ("Apple") in consideration of your agreement to the following 
+ terms, and your use, installation, modification or redistribution of 
+ this Apple software constitutes acceptance of these terms.  If you do 
+ not agree with these terms, please do not use, install, modify or 
+ redistribute this Apple software. 
+  
+ In consideration of your agreement to abide by the following terms, and 
+ subject to these terms, Apple grants you a personal, non-exclusive 
+ license, under Apple's copyrights in this original Apple software (the 
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple 
+ Software, with or without modifications, in source and/or binary forms; 
+ provided that if you redistribute the Apple Software in its entirety and 
+ without modifications, you must retain this notice and the following 
+ text and disclaimers in all such redistributions of the Apple Software. 
+ Neither the name, trademarks, service marks or logos of Apple Inc. may 
+ be used to endorse or promote products derived from the Apple Software 
+ without specific prior written permission from Apple.  Except as 
+ expressly stated in this notice, no other rights or licenses, express or 
+ implied, are granted by Apple herein, including but not limited to any 
+ patent rights that may be infringed by your derivative works or by other 
+ works in which the Apple Software may be incorporated. 
+  
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE 
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION 
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS 
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND 
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS. 
+  
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL 
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, 
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED 
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), 
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE 
+ POSSIBILITY OF SUCH DAMAGE. 
+  
+ Copyright (C) 2011 Apple Inc. All Rights Reserved. 
+  
+ */  
+
+#ifndef _SAMPLE_KERNELS_H_
+#  define _SAMPLE_KERNELS_H_
+
+/*
+ * Include necessary headers...
+ */
+
+#  include <stddef.h>
+#  include <cups/raster.h>
+
+
+/*
+ * CPU features used by kernels...
+ */
+
+#  define KERNEL_SSE2	0x01		/* SSE2 instructions */
+#  define KERNEL_AVX2	0x02		/* AVX2 instructions */
+#  define KERNEL_NEON	0x04		/* NEON instructions */
+
+
+/*
+ * Kernel types...
+ *
+ * A conversion kernel turns one line of raster data in the page format into
+ * the 8-bit chunked data sent to the printer.  It returns a pointer to the
+ * converted data, which is either the output buffer or, for pass-through
+ * kernels, the input line itself.
+ */
+
+typedef const unsigned char *(*kernel_convert_t)(unsigned char *dst,
+                                                 const unsigned char *src,
+                                                 unsigned width);
+
+typedef struct
+{
+  const char		*name;		/* Kernel name */
+  unsigned		bits;		/* cupsBitsPerColor */
+  cups_cspace_t		cspace;		/* cupsColorSpace */
+  cups_order_t		order;		/* cupsColorOrder */
+  unsigned		features;	/* Required KERNEL_xxx features */
+  kernel_convert_t	convert;	/* Conversion function */
+} kernel_t;
+
+
+/*
+ * Prototypes...
+ */
+
+extern const kernel_t	*FindKernel(cups_page_header2_t *header);
+extern unsigned		GetCPUFeatures(void);
+extern const kernel_t	*GetKernel(const char *name);
+extern int		ScanLine(const unsigned char *line, size_t bytes,
+			         size_t *first, size_t *last);
+
+#endif /* !_SAMPLE_KERNELS_H_ */
@@ -0,0 +1,384 @@
+/*
+     File: metrics.c 
+ Abstract: Shared job metrics for sample CUPS printer driver.
+  Version: 4.0 
+  
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple 
+ Inc. ("Apple") in consideration of your agreement to the following 
+ terms, and your use, installation, modification or redistribution of 
+ this Apple software constitutes acceptance of these terms.  If you do 
+ not agree with these terms, please do not use, install, modify or 
+ redistribute this Apple software. 
+  
+ In consideration of your agreement to abide by the following terms, and 
+ subject to these terms, Apple grants you a personal, non-exclusive 
+ license, under Apple's copyrights in this original Apple software (the 
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple 
+ Software, with or without modifications, in source and/or binary forms; 
+ provided that if you redistribute the Apple Software in its entirety and 
+ without modifications, you must retain this notice and the following 
+ text and disclaimers in all such redistributions of the Apple Software. 
+ Neither the name, trademarks, service marks or logos of Apple Inc. may 
+ be used to endorse or promote products derived from the Apple Software 
+ without specific prior written permission from Apple.  Except as 
+ expressly stated in this notice, no other rights or licenses, express or 
+ implied, are granted by Apple herein, including but not limited to any 
+ patent rights that may be infringed by your derivative works or by other 
+ works in which the Apple Software may be incorporated. 
+  
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE 
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION 
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS 
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND 
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS. 
+  
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL 
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, 
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED 
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), 
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE 
+ POSSIBILITY OF SUCH DAMAGE. 
+  
+ Copyright (C) 2011 Apple Inc. All Rights Reserved. 
+  
+ */  
+
+/*
+ * Include necessary headers...
+ */
+
+#include "metrics.h"			/* Shared job metrics definitions */
+#include "sample.h"			/* Logging */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+
+/*
+ * Globals...
+ */
+
+const char * const MetricNames[METRIC_MAX] =
+{					/* Counter names */
+  "jobs",
+  "pages",
+  "lines",
+  "bytes_in",
+  "bytes_out",
+  "raw_bytes",
+  "encoded_bytes",
+  "status_round_trips",
+  "page_cache_hits",
+  "page_cache_misses"
+};
+const char * const MetricTimeNames[METRIC_TIME_MAX] =
+{					/* Stage names */
+  "job",
+  "page",
+  "convert",
+  "halftone",
+  "output",
+  "decode",
+  "ink",
+  "status"
+};
+
+
+/*
+ * Local globals...
+ */
+
+static const char * const metrics_programs[] =
+{					/* Program names */
+  "rastertosample",
+  "commandtosample",
+  "sampletopdf"
+};
+static metrics_program_t metrics_program;
+					/* Current program */
+static int		metrics_started = 0;
+					/* Was MetricsStart() called? */
+static uint64_t		metrics_start;	/* Start time of job */
+static metrics_file_t	metrics_job;	/* Metrics for this job */
+
+
+/*
+ * Local functions...
+ */
+
+static int		create_file(const char *filename, const char *queue,
+			            const char *program);
+static metrics_file_t	*open_file(const char *filename, const char *queue,
+			           const char *program);
+
+
+/*
+ * 'MetricsAdd()' - Add to a counter.
+ */
+
+void
+MetricsAdd(metric_t metric,		/* I - Counter */
+           uint64_t value)		/* I - Value to add */
+{
+  __sync_fetch_and_add(metrics_job.counters + metric, value);
+}
+
+
+/*
+ * 'MetricsFinish()' - Add the metrics for this job to the shared file.
+ */
+
+void
+MetricsFinish(void)
+{
+  const char		*dir,		/* Metrics directory */
+			*queue,		/* Printer queue */
+			*program;	/* Program name */
+  char			filename[1024];	/* Metrics filename */
+  metrics_file_t	*file;		/* Shared metrics */
+  struct rusage		usage;		/* Resource usage */
+  uint64_t		rss,		/* Peak resident set */
+			peak;		/* Peak in file */
+  int			i, j;		/* Looping vars */
+
+
+  if (!metrics_started)
+    return;
+
+  metrics_started = 0;
+
+  MetricsTime(METRIC_TIME_JOB, MetricsNow() - metrics_start);
+
+  if ((queue = getenv("PRINTER")) == NULL || !*queue || strchr(queue, '/'))
+    return;
+
+  if ((dir = getenv("SAMPLE_METRICS")) == NULL)
+    dir = "/Library/Caches";
+
+  program = metrics_programs[metrics_program];
+
+  if (snprintf(filename, sizeof(filename), "%s/%s.%s.metrics", dir, queue,
+               program) >= (int)sizeof(filename) ||
+      (file = open_file(filename, queue, program)) == NULL)
+    return;
+
+ /*
+  * Add everything with atomic adds so that other jobs can do the same at
+  * the same time...
+  */
+
+  for (i = 0; i < METRIC_MAX; i ++)
+    if (metrics_job.counters[i])
+      __sync_fetch_and_add(file->counters + i, metrics_job.counters[i]);
+
+  for (i = 0; i < METRIC_TIME_MAX; i ++)
+  {
+    if (!metrics_job.times[i].count)
+      continue;
+
+    __sync_fetch_and_add(&file->times[i].count, metrics_job.times[i].count);
+    __sync_fetch_and_add(&file->times[i].nsecs, metrics_job.times[i].nsecs);
+
+    for (j = 0; j <= METRICS_BUCKETS; j ++)
+      if (metrics_job.times[i].buckets[j])
+        __sync_fetch_and_add(file->times[i].buckets + j,
+	                     metrics_job.times[i].buckets[j]);
+  }
+
+ /*
+  * The peak RSS is a maximum, so swap it in until no other job has a larger
+  * one.  Linux reports the size in kilobytes...
+  */
+
+  getrusage(RUSAGE_SELF, &usage);
+
+  rss = (uint64_t)usage.ru_maxrss;
+#ifndef __APPLE__
+  rss *= 1024;
+#endif /* !__APPLE__ */
+
+  while ((peak = file->peak_rss) < rss)
+    if (__sync_bool_compare_and_swap(&file->peak_rss, peak, rss))
+      break;
+
+  munmap(file, sizeof(metrics_file_t));
+
+  memset(&metrics_job, 0, sizeof(metrics_job));
+}
+
+
+/*
+ * 'MetricsNow()' - Get a monotonic time in nanoseconds.
+ */
+
+uint64_t				/* O - Time in nanoseconds */
+MetricsNow(void)
+{
+#ifdef CLOCK_MONOTONIC
+  struct timespec	curtime;	/* Current time */
+
+
+  clock_gettime(CLOCK_MONOTONIC, &curtime);
+
+  return ((uint64_t)curtime.tv_sec * 1000000000 + (uint64_t)curtime.tv_nsec);
+
+#else
+  struct timeval	curtime;	/* Current time */
+
+
+  gettimeofday(&curtime, NULL);
+
+  return ((uint64_t)curtime.tv_sec * 1000000000 + (uint64_t)curtime.tv_usec * 1000);
+#endif /* CLOCK_MONOTONIC */
+}
+
+
+/*
+ * 'MetricsStart()' - Start collecting metrics for a job.
+ */
+
+void
+MetricsStart(metrics_program_t program)	/* I - Program */
+{
+  metrics_program = program;
+  metrics_started = 1;
+  metrics_start   = MetricsNow();
+
+  MetricsAdd(METRIC_JOBS, 1);
+}
+
+
+/*
+ * 'MetricsTime()' - Add a time to a stage histogram.
+ */
+
+void
+MetricsTime(metric_time_t stage,	/* I - Stage */
+            uint64_t      nsecs)	/* I - Time in nanoseconds */
+{
+  metrics_histogram_t	*times = metrics_job.times + stage;
+					/* Histogram */
+  uint64_t		units = (nsecs + METRICS_BUCKET_NSECS - 1) /
+			        METRICS_BUCKET_NSECS;
+					/* Time in units of the first bucket */
+  int			bucket = 0;	/* Bucket for time */
+
+
+  while (bucket < METRICS_BUCKETS && ((uint64_t)1 << bucket) < units)
+    bucket ++;
+
+  __sync_fetch_and_add(&times->count, 1);
+  __sync_fetch_and_add(&times->nsecs, nsecs);
+  __sync_fetch_and_add(times->buckets + bucket, 1);
+}
+
+
+/*
+ * 'create_file()' - Create an empty metrics file.
+ *
+ * The file is written under a temporary name and then linked into place, so
+ * other processes never see a partial header.  If another process gets
+ * there first its file is used instead.
+ */
+
+static int				/* O - 1 on success, 0 on failure */
+create_file(const char *filename,	/* I - Metrics filename */
+            const char *queue,		/* I - Printer queue */
+	    const char *program)	/* I - Program name */
+{
+  int			fd;		/* Temporary file */
+  char			tempfile[1024];	/* Temporary filename */
+  metrics_file_t	header;		/* Empty metrics */
+
+
+  if (snprintf(tempfile, sizeof(tempfile), "%s.XXXXXX",
+               filename) >= (int)sizeof(tempfile) ||
+      (fd = mkstemp(tempfile)) < 0)
+    return (0);
+
+  memset(&header, 0, sizeof(header));
+  header.magic = METRICS_MAGIC;
+  header.size  = sizeof(metrics_file_t);
+  strncpy(header.queue, queue, sizeof(header.queue) - 1);
+  strncpy(header.program, program, sizeof(header.program) - 1);
+
+  if (write(fd, &header, sizeof(header)) != sizeof(header) ||
+      fchmod(fd, 0644) || close(fd))
+  {
+    close(fd);
+    unlink(tempfile);
+    return (0);
+  }
+
+  if (link(tempfile, filename) && errno != EEXIST)
+  {
+    unlink(tempfile);
+    return (0);
+  }
+
+  unlink(tempfile);
+
+  return (1);
+}
+
+
+/*
+ * 'open_file()' - Open and map a metrics file, creating it as needed.
+ */
+
+static metrics_file_t *			/* O - Shared metrics or NULL */
+open_file(const char *filename,		/* I - Metrics filename */
+          const char *queue,		/* I - Printer queue */
+	  const char *program)		/* I - Program name */
+{
+  int			fd;		/* Metrics file */
+  struct stat		info;		/* File information */
+  metrics_file_t	*file;		/* Shared metrics */
+
+
+  if ((fd = open(filename, O_RDWR)) < 0 && errno == ENOENT &&
+      create_file(filename, queue, program))
+    fd = open(filename, O_RDWR);
+
+  if (fd < 0)
+  {
+    LogDebug("Unable to open metrics file \"%s\": %s", filename,
+             strerror(errno));
+    return (NULL);
+  }
+
+  if (fstat(fd, &info) || info.st_size != sizeof(metrics_file_t))
+  {
+    LogDebug("Metrics file \"%s\" has the wrong size, ignoring.", filename);
+    close(fd);
+    return (NULL);
+  }
+
+  file = mmap(NULL, sizeof(metrics_file_t), PROT_READ | PROT_WRITE,
+              MAP_SHARED, fd, 0);
+  close(fd);
+
+  if (file == MAP_FAILED)
+  {
+    LogDebug("Unable to map metrics file \"%s\": %s", filename,
+             strerror(errno));
+    return (NULL);
+  }
+
+  if (file->magic != METRICS_MAGIC || file->size != sizeof(metrics_file_t))
+  {
+    LogDebug("Metrics file \"%s\" has the wrong format, ignoring.", filename);
+    munmap(file, sizeof(metrics_file_t));
+    return (NULL);
+  }
+
+  return (file);
+}
@@ -0,0 +1,174 @@
+/*
+     File: metrics.h 
+ Abstract: Shared job metrics definitions for sample CUPS printer driver.
+  Version: 4.0 
+  
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple 
+ Inc. ("Apple") in consideration of your agreement to the following 
+ terms, and your use, installation, modification or redistribution of 
+ this Apple software constitutes acceptance of these terms.  If you do 
+ not agree with these terms, please do not use, install, modify or 
+ redistribute this Apple software. 
+  
+ In consideration of your agreement to abide by the following terms, and 
+ subject to these terms, Apple grants you a personal, non-exclusive 
+ license, under Apple's copyrights in this original Apple software (the 
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple 
+ Software, with or without modifications, in source and/or binary forms; 
+ provided that if you redistribute the Apple Software in its entirety and 
+ without modifications, you must retain this notice and the following 
+ text and disclaimers in all such redistributions of the Apple Software. 
+ Neither the name, trademarks, service marks or logos of Apple Inc. may 
+ be used to endorse or promote products derived from the Apple Software 
+ without specific prior written permission from Apple.  Except as 
+ expressly stated in this notice, no other rights or licenses, express or 
+ implied, are granted by Apple herein, including but not limited to any 
+ patent rights that may be infringed by your derivative works or by other 
+ works in which the Apple Software may be incorporated. 
+  
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE 
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION 
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS 
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND 
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS. 
+  
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL 
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, 
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED 
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), 
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE 
+ POSSIBILITY OF SUCH DAMAGE. 
+  
+ Copyright (C) 2011 Apple Inc. All Rights Reserved. 
+  
+ */  
+
+#ifndef _SAMPLE_METRICS_H_
+#  define _SAMPLE_METRICS_H_
+
+/*
+ * Include necessary headers...
+ */
+
+#  include <stdint.h>
+
+
+/*
+ * Metrics file constants...
+ */
+
+#  define METRICS_MAGIC		0x534d5431	/* "SMT1" */
+#  define METRICS_BUCKETS	24		/* Histogram buckets */
+#  define METRICS_BUCKET_NSECS	100000		/* Upper bound of first bucket (100us) */
+
+
+/*
+ * Programs that keep metrics...
+ */
+
+typedef enum
+{
+  METRICS_FILTER,			/* rastertosample */
+  METRICS_COMMAND,			/* commandtosample */
+  METRICS_BACKEND			/* sampletopdf */
+} metrics_program_t;
+
+
+/*
+ * Counters...
+ */
+
+typedef enum
+{
+  METRIC_JOBS,				/* Jobs */
+  METRIC_PAGES,				/* Pages */
+  METRIC_LINES,				/* Raster lines */
+  METRIC_BYTES_IN,			/* Bytes read */
+  METRIC_BYTES_OUT,			/* Bytes written */
+  METRIC_RAW_BYTES,			/* Raster bytes before encoding */
+  METRIC_ENCODED_BYTES,			/* Raster bytes after encoding */
+  METRIC_ROUND_TRIPS,			/* Back-channel status round-trips */
+  METRIC_CACHE_HITS,			/* Pages repeated from the page cache */
+  METRIC_CACHE_MISSES,			/* Pages not in the page cache */
+  METRIC_MAX
+} metric_t;
+
+
+/*
+ * Timed stages...
+ */
+
+typedef enum
+{
+  METRIC_TIME_JOB,			/* Whole job */
+  METRIC_TIME_PAGE,			/* Whole page */
+  METRIC_TIME_CONVERT,			/* Converting a page */
+  METRIC_TIME_HALFTONE,			/* Halftoning a page */
+  METRIC_TIME_OUTPUT,			/* Encoding and writing a page */
+  METRIC_TIME_DECODE,			/* Decoding a page */
+  METRIC_TIME_INK,			/* Counting ink on a page */
+  METRIC_TIME_STATUS,			/* Back-channel status round-trip */
+  METRIC_TIME_MAX
+} metric_time_t;
+
+
+/*
+ * Metrics data...
+ *
+ * Every process adds its statistics for the job to a file shared by all
+ * jobs on the same queue, "<dir>/<printer>.<program>.metrics", where <dir>
+ * is SAMPLE_METRICS or /Library/Caches.  The file is mapped into memory
+ * and updated with atomic adds, so jobs running at the same time don't need
+ * a lock.  The samplemetrics command shows the files in the Prometheus
+ * text format.
+ *
+ * Times are kept as histograms whose bucket "i" counts the times of at most
+ * 2^i * 100us, with one more bucket for anything longer, so that percentiles
+ * can be computed from them.
+ */
+
+typedef struct
+{
+  uint64_t	count,			/* Number of times */
+		nsecs,			/* Total time in nanoseconds */
+		buckets[METRICS_BUCKETS + 1];
+					/* Times in each bucket */
+} metrics_histogram_t;
+
+typedef struct
+{
+  uint32_t		magic,		/* METRICS_MAGIC */
+			size;		/* Size of file */
+  char			queue[128],	/* Printer queue name */
+			program[64];	/* Program name */
+  uint64_t		counters[METRIC_MAX],
+					/* Counters */
+			peak_rss;	/* Largest resident set in bytes */
+  metrics_histogram_t	times[METRIC_TIME_MAX];
+					/* Stage times */
+} metrics_file_t;
+
+
+/*
+ * Globals...
+ */
+
+extern const char * const MetricNames[METRIC_MAX];
+					/* Counter names */
+extern const char * const MetricTimeNames[METRIC_TIME_MAX];
+					/* Stage names */
+
+
+/*
+ * Prototypes...
+ */
+
+extern void		MetricsAdd(metric_t metric, uint64_t value);
+extern void		MetricsFinish(void);
+extern uint64_t		MetricsNow(void);
+extern void		MetricsStart(metrics_program_t program);
+extern void		MetricsTime(metric_time_t stage, uint64_t nsecs);
+
+#endif /* !_SAMPLE_METRICS_H_ */
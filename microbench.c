@@ -0,0 +1,1887 @@
+/*
+     File: microbench.c 
+ Abstract: Microbenchmarks for sample CUPS printer driver.
+  Version: 4.0 
+  
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple 
+ Inc. ("Apple") in consideration of your agreement to the following 
+ terms, and your use, installation, modification or redistribution of 
+ this Apple software constitutes acceptance of these terms.  If you do 
+ not agree with these terms, please do not use, install, modify or 
+ redistribute this Apple software. 
+  
+ In consideration of your agreement to abide by the following terms, and 
+ subject to these terms, Apple grants you a personal, non-exclusive 
+ license, under Apple's copyrights in this original Apple software (the 
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple 
+ Software, with or without modifications, in source and/or binary forms; 
+ provided that if you redistribute the Apple Software in its entirety and 
+ without modifications, you must retain this notice and the following 
+ text and disclaimers in all such redistributions of the Apple Software. 
+ Neither the name, trademarks, service marks or logos of Apple Inc. may 
+ be used to endorse or promote products derived from the Apple Software 
+ without specific prior written permission from Apple.  Except as 
+ expressly stated in this notice, no other rights or licenses, express or 
+ implied, are granted by Apple herein, including but not limited to any 
+ patent rights that may be infringed by your derivative works or by other 
+ works in which the Apple Software may be incorporated. 
+  
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE 
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION 
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS 
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND 
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS. 
+  
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL 
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, 
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED 
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), 
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE 
+ POSSIBILITY OF SUCH DAMAGE. 
+  
+ Copyright (C) 2011 Apple Inc. All Rights Reserved. 
+  
+ */  
+
+/*
+ * Include necessary headers...
+ */
+
+#include "sample.h"			/* ParseStatus() */
+#include "ink.h"			/* Virtual ink level definitions */
+#include "input.h"			/* Raster input definitions */
+#include "kernels.h"			/* Raster conversion kernels */
+#include "metrics.h"			/* MetricsNow() */
+#include "protocol.h"			/* Sample printer protocol definitions */
+#include <cups/file.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+
+/*
+ * Constants...
+ */
+
+#define BENCH_WIDTH	2550		/* Line width, 8.5" at 300dpi */
+#define BENCH_REPEAT	5		/* Measurements per function, fastest wins */
+#define BENCH_LINES	8		/* Lines per BAND in protocol stream */
+#define BENCH_BAND	32		/* Lines per read from raster stream */
+#define BENCH_HEIGHT	3300		/* Page height, 11" at 300dpi */
+#define BENCH_SHIFTS	32		/* Sample offsets for 16-bit check, at least one vector */
+
+
+/*
+ * Local types...
+ */
+
+typedef void (*bench_func_t)(void *data);
+					/* Function being timed */
+
+typedef struct
+{
+  const char	*name;			/* Benchmark name */
+  void		(*run)(void);		/* Function to run benchmark */
+} bench_t;
+
+typedef struct
+{
+  const kernel_t	*kernel;	/* Kernel or NULL for reference */
+  unsigned char		*dst;		/* 8-bit samples */
+  const unsigned short	*src;		/* 16-bit samples */
+  unsigned		width,		/* Width in pixels */
+			samples;	/* Number of samples */
+} convert_data_t;
+
+typedef void (*ink_func_t)(int cmyk[4], unsigned char *line, int bytes,
+                           int depth, int resolution);
+					/* Ink level function */
+
+typedef struct
+{
+  ink_func_t		update;		/* Function to use */
+  const int		*levels;	/* Starting levels */
+  int			cmyk[4];	/* Current levels */
+  int			depth;		/* Bytes per pixel */
+  unsigned char		*line;		/* Line to update */
+  const unsigned char	*original;	/* Original line */
+  int			bytes;		/* Bytes in line */
+} ink_data_t;
+
+typedef struct
+{
+  int		(*parse)(char *buffer);	/* Function to use */
+  int		result;			/* Sum of results */
+} status_data_t;
+
+typedef struct
+{
+  void		(*build)(unsigned char *data, int y);
+					/* Function to use */
+  unsigned char	*lines;			/* Page of lines */
+} selftest_data_t;
+
+typedef struct
+{
+  protocol_command_t (*lookup)(const char *name);
+					/* Function to use */
+  const char	*filename;		/* Protocol stream */
+  unsigned char	*buffer;		/* Payload buffer */
+  size_t	size;			/* Size of payload buffer */
+  uint32_t	hash;			/* Hash of commands and payloads */
+} protocol_data_t;
+
+typedef struct
+{
+  int		flags;			/* Input flags */
+  const char	*filename;		/* Raster file */
+  unsigned char	*buffer,		/* Band buffer */
+		same[BENCH_BAND];	/* Repeated lines */
+  int		check;			/* Hash the lines? */
+  uint32_t	hash;			/* Hash of lines */
+} raster_data_t;
+
+
+/*
+ * Local functions...
+ */
+
+static void	bench_convert16(void);
+static void	bench_ink(void);
+static void	bench_protocol(void);
+static void	bench_raster(void);
+static void	bench_selftest(void);
+static void	bench_status(void);
+static int	check_raster(const char *filename, int flags);
+static int	compare_strings(const void *a, const void *b);
+static void	fill_random(unsigned char *data, size_t bytes, unsigned seed);
+static uint32_t	hash_bytes(uint32_t hash, const void *data, size_t bytes);
+static void	ref_convert16(unsigned char *dst, const unsigned short *src,
+		              unsigned count);
+static void	ref_ink_update(int cmyk[4], unsigned char *line, int bytes,
+		               int depth, int resolution);
+static protocol_command_t ref_protocol_command(const char *name);
+static int	ref_parse_status(char *buffer);
+static void	ref_selftest_line(unsigned char *data, int y);
+static void	report(const char *name, double bytes, double ref_nsecs,
+		       double new_nsecs, int same);
+static void	run_convert(void *data);
+static void	run_ink(void *data);
+static void	run_protocol(void *data);
+static void	run_raster(void *data);
+static void	run_selftest(void *data);
+static void	run_status(void *data);
+static double	time_func(bench_func_t func, void *data);
+static void	usage(void);
+static void	write_raster(const char *filename, cups_mode_t mode);
+
+
+/*
+ * Local globals...
+ */
+
+static const bench_t benches[] =
+{					/* Benchmarks */
+  { "convert16", bench_convert16 },
+  { "ink",       bench_ink },
+  { "status",    bench_status },
+  { "selftest",  bench_selftest },
+  { "protocol",  bench_protocol },
+  { "raster",    bench_raster }
+};
+static int		failures = 0;	/* Number of functions with different output */
+static const char	*raster_dir = NULL;
+					/* Raster streams to check decoder on */
+static uint64_t		min_nsecs = 50000000;
+					/* Minimum time per measurement */
+static const char * const status_bursts[] =
+{					/* Back-channel data, in order */
+  "IL100,90,80,70\nOK\n",
+  "IL100,90,80,70\n",
+  "IL4,90,3,70\nLP\n",
+  "OP\n",
+  "IL100,100,100,2\nOK\n",
+  "IL100,100,100,100\n",
+  "OK\nOK\nOK\nOK\n",
+  "IL99,98,97,96\nIL98,97,96,95\nIL97,96,95,94\nOK\n",
+  "XX\n"
+};
+
+
+/*
+ * 'main()' - Time the driver's hot functions and check their output.
+ *
+ * Usage:
+ *
+ *     microbench [-r directory] [-t msecs] [benchmark ...]
+ *
+ * Each function is run on the same synthetic data as a reference copy of its
+ * original scalar code.  The output must be identical, and the time for each
+ * is reported in nanoseconds per byte of input.  The raster decoder is also
+ * checked against libcups on the streams in the -r directory, which
+ * makecorpus writes to "corpus/raster".
+ */
+
+int					/* O - Exit status */
+main(int  argc,				/* I - Number of command-line args */
+     char *argv[])			/* I - Command-line arguments */
+{
+  int		i;			/* Looping var */
+  size_t	j;			/* Looping var */
+  int		count = 0;		/* Number of benchmarks named */
+  const char	*names[100];		/* Benchmarks to run */
+
+
+  for (i = 1; i < argc; i ++)
+  {
+    if (!strcmp(argv[i], "-r"))
+    {
+      i ++;
+
+      if (i >= argc)
+        usage();
+
+      raster_dir = argv[i];
+    }
+    else if (!strcmp(argv[i], "-t"))
+    {
+      i ++;
+
+      if (i >= argc || atoi(argv[i]) <= 0)
+        usage();
+
+      min_nsecs = (uint64_t)atoi(argv[i]) * 1000000;
+    }
+    else if (argv[i][0] == '-')
+      usage();
+    else if (count < (int)(sizeof(names) / sizeof(names[0])))
+    {
+      for (j = 0; j < sizeof(benches) / sizeof(benches[0]); j ++)
+        if (!strcmp(argv[i], benches[j].name))
+	  break;
+
+      if (j >= sizeof(benches) / sizeof(benches[0]))
+      {
+        fprintf(stderr, "microbench: Unknown benchmark \"%s\".\n", argv[i]);
+	usage();
+      }
+
+      names[count ++] = argv[i];
+    }
+  }
+
+  printf("%-22s %10s %10s %8s  %s\n", "function", "ref ns/B", "new ns/B",
+         "speedup", "output");
+
+  for (j = 0; j < sizeof(benches) / sizeof(benches[0]); j ++)
+  {
+    for (i = 0; i < count; i ++)
+      if (!strcmp(names[i], benches[j].name))
+        break;
+
+    if (count == 0 || i < count)
+      (benches[j].run)();
+  }
+
+  return (failures ? 1 : 0);
+}
+
+
+/*
+ * 'bench_convert16()' - Time the 16-bit to 8-bit conversion in OutputLine().
+ */
+
+static void
+bench_convert16(void)
+{
+  static const char * const names[] =
+  {					/* 16-bit kernels */
+    "w16-avx2",
+    "w16-sse2",
+    "w16-neon",
+    "w16-scalar",
+    "rgb16-avx2",
+    "rgb16-sse2",
+    "rgb16-neon",
+    "rgb16-scalar"
+  };
+  size_t		i;		/* Looping var */
+  unsigned		j,		/* Looping var */
+			colors,		/* Samples per pixel */
+			count,		/* Samples for check */
+			shift,		/* Offset of first sample */
+			samples;	/* Samples converted */
+  unsigned short	*check,		/* Every 16-bit value */
+			*line;		/* Line of 16-bit samples */
+  unsigned char		*ref,		/* Reference output */
+			*dst;		/* Kernel output */
+  const unsigned char	*converted;	/* Converted samples */
+  convert_data_t	data;		/* Benchmark data */
+  double		ref_nsecs,	/* Reference time */
+			new_nsecs;	/* Kernel time */
+  int			same;		/* Same output? */
+
+
+ /*
+  * The check buffer has every 16-bit value three times in a scrambled order,
+  * so that it is a whole number of W and RGB pixels.  Each kernel converts it
+  * starting at every sample offset up to the widest vector, so every value
+  * goes through every lane and each length of partial vector at the end of
+  * the line is covered...
+  */
+
+  count = 3 * 65536;
+  check = malloc(count * sizeof(unsigned short));
+  line  = malloc(3 * BENCH_WIDTH * sizeof(unsigned short));
+  ref   = malloc(count);
+  dst   = malloc(count);
+
+  if (!check || !line || !ref || !dst)
+  {
+    fputs("microbench: Out of memory.\n", stderr);
+    exit(1);
+  }
+
+  for (j = 0; j < count; j ++)
+    check[j] = (unsigned short)(j * 40503);
+
+  fill_random((unsigned char *)line, 3 * BENCH_WIDTH * sizeof(unsigned short),
+              1);
+
+  for (i = 0; i < sizeof(names) / sizeof(names[0]); i ++)
+  {
+    if ((data.kernel = GetKernel(names[i])) == NULL)
+      continue;
+
+    colors = data.kernel->cspace == CUPS_CSPACE_RGB ? 3 : 1;
+
+    for (shift = 0, same = 1; same && shift < BENCH_SHIFTS; shift ++)
+    {
+      samples   = (count - shift) / colors * colors;
+      converted = (data.kernel->convert)(dst,
+                                         (const unsigned char *)(check + shift),
+                                         samples / colors);
+
+      ref_convert16(ref, check + shift, samples);
+      same = !memcmp(converted, ref, samples);
+    }
+
+    data.dst     = dst;
+    data.src     = line;
+    data.width   = BENCH_WIDTH;
+    data.samples = BENCH_WIDTH * colors;
+    new_nsecs    = time_func(run_convert, &data);
+
+    data.kernel  = NULL;
+    ref_nsecs    = time_func(run_convert, &data);
+
+    report(names[i], data.samples * 2.0, ref_nsecs, new_nsecs, same);
+  }
+
+  free(check);
+  free(line);
+  free(ref);
+  free(dst);
+}
+
+
+/*
+ * 'bench_ink()' - Time the ink level updates in sampletopdf.
+ */
+
+static void
+bench_ink(void)
+{
+  static const int full[4]   = { INK_FULL, INK_FULL, INK_FULL, INK_FULL },
+		   noblack[4] = { INK_FULL, INK_FULL, INK_FULL, 0 },
+		   some[4]    = { 0, INK_FULL, INK_FULL, 0 },
+		   empty[4]   = { 0, 0, 0, 0 };
+  static const struct
+  {
+    const char	*name;			/* Name of case */
+    int		depth;			/* Bytes per pixel */
+    const int	*levels;		/* Starting ink levels */
+  }		cases[] =
+  {					/* Cases to run */
+    { "ink-w",          1, full },
+    { "ink-w-empty",    1, noblack },
+    { "ink-rgb",        3, full },
+    { "ink-rgb-some",   3, some },
+    { "ink-rgb-empty",  3, empty },
+    { "ink-cmyk",       4, full },
+    { "ink-cmyk-empty", 4, empty }
+  };
+  size_t	i;			/* Looping var */
+  unsigned char	*original,		/* Original line */
+		*line,			/* Line to update */
+		*ref_line;		/* Line from reference */
+  int		ref_cmyk[4];		/* Levels from reference */
+  ink_data_t	data;			/* Benchmark data */
+  double	ref_nsecs,		/* Reference time */
+		new_nsecs;		/* Current time */
+  int		same;			/* Same output? */
+
+
+  original = malloc(4 * BENCH_WIDTH);
+  line     = malloc(4 * BENCH_WIDTH);
+  ref_line = malloc(4 * BENCH_WIDTH);
+
+  if (!original || !line || !ref_line)
+  {
+    fputs("microbench: Out of memory.\n", stderr);
+    exit(1);
+  }
+
+ /*
+  * Use random colors with some white, since white pixels use no ink...
+  */
+
+  fill_random(original, 4 * BENCH_WIDTH, 2);
+  memset(original, 255, BENCH_WIDTH / 4);
+  memset(original + 2 * BENCH_WIDTH, 255, BENCH_WIDTH / 2);
+
+  for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i ++)
+  {
+    data.levels   = cases[i].levels;
+    data.depth    = cases[i].depth;
+    data.original = original;
+    data.bytes    = BENCH_WIDTH * cases[i].depth;
+
+    data.update = ref_ink_update;
+    data.line   = ref_line;
+    run_ink(&data);
+    memcpy(ref_cmyk, data.cmyk, sizeof(ref_cmyk));
+
+    data.update = InkUpdate;
+    data.line   = line;
+    run_ink(&data);
+
+    same = !memcmp(line, ref_line, data.bytes) &&
+           !memcmp(data.cmyk, ref_cmyk, sizeof(ref_cmyk));
+
+    new_nsecs = time_func(run_ink, &data);
+
+    data.update = ref_ink_update;
+    data.line   = ref_line;
+    ref_nsecs   = time_func(run_ink, &data);
+
+    report(cases[i].name, data.bytes, ref_nsecs, new_nsecs, same);
+  }
+
+  free(original);
+  free(line);
+  free(ref_line);
+}
+
+
+/*
+ * 'bench_protocol()' - Time the command loop in sampletopdf.
+ *
+ * A stream like the one rastertosample sends is written to a temporary file
+ * and read with cupsFileGetConf(), looking up each command and reading its
+ * raster data, which is what sampletopdf does before drawing anything.
+ */
+
+static void
+bench_protocol(void)
+{
+  int			fd;		/* Temporary file */
+  FILE			*fp;		/* Stream for temporary file */
+  const char		*tmpdir;	/* Temporary directory */
+  char			filename[1024];	/* Temporary filename */
+  unsigned char		*payload;	/* Raster data */
+  unsigned		page,		/* Current page */
+			y;		/* Current line */
+  long			bytes;		/* Size of stream */
+  protocol_data_t	data;		/* Benchmark data */
+  uint32_t		ref_hash;	/* Hash from reference */
+  double		ref_nsecs,	/* Reference time */
+			new_nsecs;	/* Current time */
+  int			same;		/* Same output? */
+
+
+  if ((tmpdir = getenv("TMPDIR")) == NULL)
+    tmpdir = "/tmp";
+
+  snprintf(filename, sizeof(filename), "%s/microbench.XXXXXX", tmpdir);
+
+  if ((fd = mkstemp(filename)) < 0 || (fp = fdopen(fd, "w")) == NULL)
+  {
+    fprintf(stderr, "microbench: Unable to create temporary file: %s\n",
+            strerror(errno));
+    exit(1);
+  }
+
+  data.size = 3 * BENCH_WIDTH * BENCH_LINES;
+
+  if ((payload = malloc(data.size)) == NULL ||
+      (data.buffer = malloc(data.size)) == NULL)
+  {
+    fputs("microbench: Out of memory.\n", stderr);
+    exit(1);
+  }
+
+  fill_random(payload, data.size, 3);
+
+ /*
+  * Write two letter-size 300dpi RGB pages with every kind of line...
+  */
+
+  fputs("DOCUMENT\nAUTHOR microbench\nTITLE Benchmark\n", fp);
+
+  for (page = 0; page < 2; page ++)
+  {
+    fputs("PAGE 0 0 612 792\nRASTER 2550 3300 3\n", fp);
+
+    for (y = 0; y < 3300; y += 32)
+    {
+      fprintf(fp, "LINE %d\n", 3 * BENCH_WIDTH);
+      fwrite(payload, 1, 3 * BENCH_WIDTH, fp);
+      fprintf(fp, "LINE %d packbits\n", 1024);
+      fwrite(payload + y, 1, 1024, fp);
+      fprintf(fp, "SPAN %d %d\n", 300 + y % 100, 1536);
+      fwrite(payload + 2 * y, 1, 1536, fp);
+      fprintf(fp, "BAND %u %d %d\n", y + 3, BENCH_LINES, 3 * BENCH_WIDTH * BENCH_LINES);
+      fwrite(payload, 1, 3 * BENCH_WIDTH * BENCH_LINES, fp);
+      fputs("SKIP 20\n", fp);
+
+      if ((y & 1023) == 0)
+        fputs("LEVELS\n", fp);
+    }
+
+    fputs("ENDPAGE\n", fp);
+  }
+
+  fputs("ENDDOCUMENT\n", fp);
+
+  bytes = ftell(fp);
+
+  if (fclose(fp))
+  {
+    fprintf(stderr, "microbench: Unable to write temporary file: %s\n",
+            strerror(errno));
+    unlink(filename);
+    exit(1);
+  }
+
+ /*
+  * Read it both ways...
+  */
+
+  data.filename = filename;
+  data.lookup   = ref_protocol_command;
+  run_protocol(&data);
+  ref_hash = data.hash;
+
+  data.lookup = ProtocolCommand;
+  run_protocol(&data);
+  same = data.hash == ref_hash;
+
+  new_nsecs   = time_func(run_protocol, &data);
+  data.lookup = ref_protocol_command;
+  ref_nsecs   = time_func(run_protocol, &data);
+
+  report("protocol-loop", bytes, ref_nsecs, new_nsecs, same);
+
+  unlink(filename);
+  free(payload);
+  free(data.buffer);
+}
+
+
+/*
+ * 'bench_raster()' - Time the raster decoder in rastertosample.
+ *
+ * Two letter-size 300dpi RGB pages of text, rules, and a photo are written
+ * by libcups, once run-length encoded and once uncompressed, and each file
+ * is read in bands with cupsRasterReadPixels() and with our own decoder.
+ * The run-length encoded file is read from the file descriptor by both, while
+ * the uncompressed file is mapped by ours, as rastertosample does for
+ * spooled files.  Times are per byte of decoded raster data.  The debug
+ * messages from mapping go to /dev/null.
+ *
+ * Then each stream in raster_dir is read both ways, mapped and unmapped, and
+ * every header and line must match what libcups reads, including where a
+ * stream that is cut short stops.
+ */
+
+static void
+bench_raster(void)
+{
+  static const struct
+  {
+    const char	*name;			/* Benchmark name */
+    cups_mode_t	mode;			/* How to write file */
+    int		flags;			/* How to read file */
+  }		streams[] =
+  {					/* Raster streams */
+    { "raster-rle", CUPS_RASTER_WRITE_COMPRESSED, 0 },
+    { "raster-v3",  CUPS_RASTER_WRITE,            INPUT_MAP }
+  };
+  size_t	i;			/* Looping var */
+  const char	*tmpdir;		/* Temporary directory */
+  char		filename[1024];		/* Temporary filename */
+  int		fd,			/* Temporary file */
+		saved,			/* Original stderr */
+		nullfd;			/* /dev/null */
+  raster_data_t	data;			/* Benchmark data */
+  uint32_t	ref_hash;		/* Hash from reference */
+  double	ref_nsecs,		/* Reference time */
+		new_nsecs;		/* Current time */
+  int		same;			/* Same output? */
+  DIR		*dir;			/* Conformance stream directory */
+  struct dirent	*dent;			/* Directory entry */
+  char		*names[1000];		/* Conformance streams */
+  size_t	count = 0;		/* Number of conformance streams */
+
+
+  if ((tmpdir = getenv("TMPDIR")) == NULL)
+    tmpdir = "/tmp";
+
+  if ((data.buffer = malloc(BENCH_BAND * 3 * BENCH_WIDTH)) == NULL)
+  {
+    fputs("microbench: Out of memory.\n", stderr);
+    exit(1);
+  }
+
+  for (i = 0; i < sizeof(streams) / sizeof(streams[0]); i ++)
+  {
+    snprintf(filename, sizeof(filename), "%s/microbench.XXXXXX", tmpdir);
+
+    if ((fd = mkstemp(filename)) < 0)
+    {
+      fprintf(stderr, "microbench: Unable to create temporary file: %s\n",
+	      strerror(errno));
+      exit(1);
+    }
+
+    close(fd);
+    write_raster(filename, streams[i].mode);
+
+   /*
+    * Check that every line is the same, then time both without hashing...
+    */
+
+    fflush(stderr);
+    saved = dup(2);
+
+    if ((nullfd = open("/dev/null", O_WRONLY)) >= 0)
+    {
+      dup2(nullfd, 2);
+      close(nullfd);
+    }
+
+    data.filename = filename;
+    data.check    = 1;
+    data.flags    = INPUT_CUPS;
+    run_raster(&data);
+    ref_hash = data.hash;
+
+    data.flags = streams[i].flags;
+    run_raster(&data);
+    same = data.hash == ref_hash;
+
+    data.check = 0;
+    new_nsecs  = time_func(run_raster, &data);
+    data.flags = INPUT_CUPS;
+    ref_nsecs  = time_func(run_raster, &data);
+
+    fflush(stderr);
+    dup2(saved, 2);
+    close(saved);
+
+    report(streams[i].name, 2.0 * 3 * BENCH_WIDTH * BENCH_HEIGHT, ref_nsecs,
+           new_nsecs, same);
+
+    unlink(filename);
+  }
+
+  free(data.buffer);
+
+  if (!raster_dir)
+    return;
+
+  if ((dir = opendir(raster_dir)) == NULL)
+  {
+    fprintf(stderr, "microbench: Unable to open \"%s\": %s\n", raster_dir,
+            strerror(errno));
+    exit(1);
+  }
+
+  while ((dent = readdir(dir)) != NULL && count < 1000)
+    if (dent->d_name[0] != '.')
+      names[count ++] = strdup(dent->d_name);
+
+  closedir(dir);
+
+  qsort(names, count, sizeof(char *), compare_strings);
+
+  for (i = 0; i < count; i ++)
+  {
+    snprintf(filename, sizeof(filename), "%s/%s", raster_dir, names[i]);
+
+    fflush(stderr);
+    saved = dup(2);
+
+    if ((nullfd = open("/dev/null", O_WRONLY)) >= 0)
+    {
+      dup2(nullfd, 2);
+      close(nullfd);
+    }
+
+    same = check_raster(filename, 0) && check_raster(filename, INPUT_MAP);
+
+    fflush(stderr);
+    dup2(saved, 2);
+    close(saved);
+
+    printf("%-22s %10s %10s %8s  %s\n", names[i], "-", "-", "-",
+	   same ? "same" : "DIFFERENT");
+    fflush(stdout);
+
+    if (!same)
+      failures ++;
+
+    free(names[i]);
+  }
+}
+
+
+/*
+ * 'bench_selftest()' - Time the line construction for the self-test page.
+ */
+
+static void
+bench_selftest(void)
+{
+  selftest_data_t	data;		/* Benchmark data */
+  unsigned char		*ref_lines;	/* Lines from reference */
+  size_t		bytes = PROTOCOL_SELFTEST_WIDTH * 3 *
+				PROTOCOL_SELFTEST_HEIGHT;
+					/* Bytes in page */
+  double		ref_nsecs,	/* Reference time */
+			new_nsecs;	/* Current time */
+  int			same;		/* Same output? */
+
+
+  data.lines = malloc(bytes);
+  ref_lines  = malloc(bytes);
+
+  if (!data.lines || !ref_lines)
+  {
+    fputs("microbench: Out of memory.\n", stderr);
+    exit(1);
+  }
+
+  data.build = ProtocolSelfTestLine;
+  run_selftest(&data);
+  memcpy(ref_lines, data.lines, bytes);
+
+  data.build = ref_selftest_line;
+  run_selftest(&data);
+  same = !memcmp(ref_lines, data.lines, bytes);
+
+  ref_nsecs  = time_func(run_selftest, &data);
+  data.build = ProtocolSelfTestLine;
+  new_nsecs  = time_func(run_selftest, &data);
+
+  report("selftest-line", bytes, ref_nsecs, new_nsecs, same);
+
+  free(data.lines);
+  free(ref_lines);
+}
+
+
+/*
+ * 'bench_status()' - Time the back-channel status parsing in GetStatus().
+ *
+ * ParseStatus() reports status on stderr, so the check compares what each
+ * version writes and the timing runs send it to /dev/null.
+ */
+
+static void
+bench_status(void)
+{
+  int		saved,			/* Original stderr */
+		nullfd,			/* /dev/null */
+		fd;			/* Output file */
+  size_t	i;			/* Looping var */
+  double	bytes = 0.0,		/* Bytes per run */
+		ref_nsecs,		/* Reference time */
+		new_nsecs;		/* Current time */
+  status_data_t	data;			/* Benchmark data */
+  int		ref_result;		/* Result of reference */
+  FILE		*fp;			/* Captured output */
+  const char	*tmpdir;		/* Temporary directory */
+  char		filename[2][1024],	/* Captured output files */
+		output[2][8192];	/* Captured output */
+  int		same;			/* Same output? */
+
+
+  for (i = 0; i < sizeof(status_bursts) / sizeof(status_bursts[0]); i ++)
+    bytes += strlen(status_bursts[i]);
+
+  if ((tmpdir = getenv("TMPDIR")) == NULL)
+    tmpdir = "/tmp";
+
+  fflush(stderr);
+  saved = dup(2);
+
+ /*
+  * Run each version twice through the bursts so the "levels changed" state
+  * is covered, capturing the output...
+  */
+
+  for (i = 0; i < 2; i ++)
+  {
+    snprintf(filename[i], sizeof(filename[i]), "%s/microbench.XXXXXX", tmpdir);
+
+    if ((fd = mkstemp(filename[i])) < 0)
+    {
+      fprintf(stderr, "microbench: Unable to create temporary file: %s\n",
+              strerror(errno));
+      exit(1);
+    }
+
+    dup2(fd, 2);
+    close(fd);
+
+    data.parse  = i ? ParseStatus : ref_parse_status;
+    data.result = 0;
+
+    run_status(&data);
+    run_status(&data);
+
+    if (i)
+      same = data.result == ref_result;
+    else
+      ref_result = data.result;
+
+    fflush(stderr);
+    dup2(saved, 2);
+  }
+
+  for (i = 0; i < 2; i ++)
+  {
+    memset(output[i], 0, sizeof(output[i]));
+
+    if ((fp = fopen(filename[i], "r")) != NULL)
+    {
+      fread(output[i], 1, sizeof(output[i]) - 1, fp);
+      fclose(fp);
+    }
+
+    unlink(filename[i]);
+  }
+
+  same = same && output[0][0] && !strcmp(output[0], output[1]);
+
+ /*
+  * Time them...
+  */
+
+  if ((nullfd = open("/dev/null", O_WRONLY)) >= 0)
+  {
+    dup2(nullfd, 2);
+    close(nullfd);
+  }
+
+  data.parse = ref_parse_status;
+  ref_nsecs  = time_func(run_status, &data);
+  data.parse = ParseStatus;
+  new_nsecs  = time_func(run_status, &data);
+
+  fflush(stderr);
+  dup2(saved, 2);
+  close(saved);
+
+  report("status-parse", bytes, ref_nsecs, new_nsecs, same);
+}
+
+
+/*
+ * 'check_raster()' - Compare our decoder with libcups on a raster stream.
+ *
+ * Lines flagged as repeats are compared from the line before.  Both readers
+ * must return the same headers, the same number of lines on each page, and
+ * the same pixels.  libcups goes on returning stale lines after a line that
+ * is cut short, so like rastertosample each page is only read up to the
+ * first short band.
+ */
+
+static int				/* O - 1 if the same, 0 otherwise */
+check_raster(const char *filename,	/* I - Raster file */
+             int        flags)		/* I - Input flags for our decoder */
+{
+  int			fd[2];		/* Raster file, for each reader */
+  input_t		*ref,		/* libcups input */
+			*in;		/* Our input */
+  cups_page_header2_t	ref_header,	/* Page header from libcups */
+			header;		/* Page header from ours */
+  unsigned char		*ref_buffer = NULL,
+					/* Lines from libcups */
+			*buffer = NULL,	/* Lines from ours */
+			same[BENCH_BAND];
+					/* Repeated lines */
+  const unsigned char	*ref_lines,	/* Lines in band from libcups */
+			*lines,		/* Lines in band from ours */
+			*line;		/* Current line from ours */
+  unsigned		i,		/* Looping var */
+			ref_count,	/* Lines read by libcups */
+			count;		/* Lines read by ours */
+  size_t		bytes;		/* Bytes per line */
+  int			ref_ok,		/* Header read by libcups? */
+			ok,		/* Header read by ours? */
+			result = 1;	/* Same output? */
+
+
+  if ((fd[0] = open(filename, O_RDONLY)) < 0)
+    return (0);
+
+  if ((fd[1] = open(filename, O_RDONLY)) < 0)
+  {
+    close(fd[0]);
+    return (0);
+  }
+
+  ref = InputCreate(fd[0], INPUT_CUPS);
+  in  = InputCreate(fd[1], flags);
+
+  if (!ref || !in)
+    result = !ref && !in;
+  else
+  {
+    do
+    {
+      ref_ok = InputReadHeader(ref, &ref_header);
+      ok     = InputReadHeader(in, &header);
+
+      if (ref_ok != ok ||
+          (ok && memcmp(&ref_header, &header, sizeof(header))))
+      {
+        result = 0;
+	break;
+      }
+
+      if (!ok)
+        break;
+
+      bytes = header.cupsBytesPerLine;
+
+      free(ref_buffer);
+      free(buffer);
+
+      ref_buffer = malloc(BENCH_BAND * bytes);
+      buffer     = malloc(BENCH_BAND * bytes);
+
+      if (!ref_buffer || !buffer)
+      {
+        fputs("microbench: Out of memory.\n", stderr);
+	exit(1);
+      }
+
+      do
+      {
+        ref_count = InputReadLines(ref, ref_buffer, BENCH_BAND, &ref_lines,
+	                           NULL);
+        count     = InputReadLines(in, buffer, BENCH_BAND, &lines, same);
+
+	if (count != ref_count)
+	  result = 0;
+
+	for (i = 0, line = lines; result && i < count; i ++)
+	{
+	  if (!same[i])
+	    line = lines + i * bytes;
+
+	  result = !memcmp(line, ref_lines + i * bytes, bytes);
+	}
+      }
+      while (result && count == BENCH_BAND);
+    }
+    while (result);
+  }
+
+  if (ref)
+    InputDelete(ref);
+
+  if (in)
+    InputDelete(in);
+
+  close(fd[0]);
+  close(fd[1]);
+
+  free(ref_buffer);
+  free(buffer);
+
+  return (result);
+}
+
+
+/*
+ * 'compare_strings()' - Compare two strings for qsort().
+ */
+
+static int				/* O - Result of comparison */
+compare_strings(const void *a,		/* I - First string */
+                const void *b)		/* I - Second string */
+{
+  return (strcmp(*(const char * const *)a, *(const char * const *)b));
+}
+
+
+/*
+ * 'fill_random()' - Fill a buffer with pseudo-random bytes.
+ */
+
+static void
+fill_random(unsigned char *data,	/* O - Buffer */
+            size_t        bytes,	/* I - Number of bytes */
+	    unsigned      seed)		/* I - Random seed */
+{
+  uint32_t	state = seed * 2654435761u + 1;
+					/* Random state */
+
+
+  while (bytes > 0)
+  {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+
+    *data++ = (unsigned char)(state >> 24);
+    bytes --;
+  }
+}
+
+
+/*
+ * 'hash_bytes()' - Add bytes to an FNV-1a hash.
+ */
+
+static uint32_t				/* O - New hash */
+hash_bytes(uint32_t   hash,		/* I - Current hash */
+           const void *data,		/* I - Bytes to add */
+	   size_t     bytes)		/* I - Number of bytes */
+{
+  const unsigned char	*ptr = (const unsigned char *)data;
+					/* Pointer into bytes */
+
+
+  while (bytes > 0)
+  {
+    hash = (hash ^ *ptr++) * 16777619;
+    bytes --;
+  }
+
+  return (hash);
+}
+
+
+/*
+ * 'ref_convert16()' - Reference 16-bit to 8-bit conversion from OutputLine().
+ */
+
+static void
+ref_convert16(
+    unsigned char        *dst,		/* O - 8-bit samples */
+    const unsigned short *src,		/* I - 16-bit samples */
+    unsigned             count)		/* I - Number of samples */
+{
+  for (; count > 0; count --, src ++)
+    *dst++ = (*src + 129) / 257;
+}
+
+
+/*
+ * 'ref_ink_update()' - Reference copy of InkUpdate().
+ */
+
+static void
+ref_ink_update(
+    int           cmyk[4],		/* IO - CMYK levels */
+    unsigned char *line,		/* IO - Pixels on the current line */
+    int           bytes,		/* I  - Number of bytes */
+    int           depth,		/* I  - Bytes per pixel */
+    int           resolution)		/* I  - Output resolution */
+{
+  int c = 0, m = 0, y = 0, k = 0;	/* Total CMYK on the line */
+
+
+  if (depth == 1)
+  {
+   /*
+    * Update black ink usage for grayscale output...
+    */
+
+    if (cmyk[3] <= 0)
+    {
+     /*
+      * Simulate out-of-ink condition by removing black...
+      */
+
+      memset(line, 255, bytes);
+    }
+    else
+    {
+     /*
+      * Otherwise count the amount of black ink used...
+      */
+
+      while (bytes > 0)
+      {
+	k += 255 - *line;
+
+	bytes --;
+	line ++;
+      }
+    }
+  }
+  else if (depth == 4)
+  {
+   /*
+    * Count CMYK ink usage for separated output, where 255 is no ink...
+    */
+
+    while (bytes > 0)
+    {
+      c += 255 - line[0];
+      m += 255 - line[1];
+      y += 255 - line[2];
+      k += 255 - line[3];
+
+     /*
+      * Simulate out-of-ink conditions by removing that ink...
+      */
+
+      if (cmyk[0] <= 0)
+        line[0] = 255;
+      if (cmyk[1] <= 0)
+        line[1] = 255;
+      if (cmyk[2] <= 0)
+        line[2] = 255;
+      if (cmyk[3] <= 0)
+        line[3] = 255;
+
+      bytes -= 4;
+      line += 4;
+    }
+  }
+  else if (cmyk[0] <= 0 && cmyk[1] <= 0 && cmyk[2] <= 0 && cmyk[3] <= 0)
+  {
+   /*
+    * Completely out of ink, blank the line to simulate that...
+    */
+
+    memset(line, 255, bytes);
+  }
+  else
+  {
+   /*
+    * Update CMYK ink usage for color output...
+    */
+
+    int kmin, kmax;
+
+    while (bytes > 0)
+    {
+     /*
+      * NOTE: Real printers need more complex code than this!
+      *
+      * The classic RGB to CMYK formula calculates K using the maximum
+      * RGB value, and then subtracts it from the C, M, and Y values:
+      *
+      *    K = 1 - max(R,G,B)
+      *    C = 1 - R - K
+      *    M = 1 - G - K
+      *    Y = 1 - B - K
+      *
+      * Colors tend to look "flat" with this simple formula, so instead we
+      * use a formula that calculates black based on both the minimum and
+      * maximum RGB values so that the amount of black depends not only on
+      * the darkness of the color but how colorful it is.  Less colorful
+      * colors use more black:
+      *
+      *         (1 - max(R,G,B))^3
+      *     K = ------------------
+      *         (1 - min(R,G,B))^2
+      *
+      *     C = 1 - R - K
+      *     M = 1 - G - K
+      *     Y = 1 - B - K
+      */
+
+      kmin = line[0] > line[1] ?
+		 (line[0] > line[2] ? line[0] : line[2]) :
+		 (line[1] > line[2] ? line[1] : line[2]);
+      kmax = line[0] < line[1] ?
+		 (line[0] < line[2] ? line[0] : line[2]) :
+		 (line[1] < line[2] ? line[1] : line[2]);
+      if (kmax > kmin)
+      {
+	kmin = 255 - kmin;
+	kmax = 255 - kmax;
+	kmin = 255 - kmin * kmin * kmin / (kmax * kmax);
+      }
+
+     /*
+      * Add the current CMYK values to our color counters for the line.
+      */
+
+      c += kmin - line[0];
+      m += kmin - line[1];
+      y += kmin - line[2];
+      k += 255 - kmin;
+
+      if (cmyk[0] <= 0)
+      {
+       /*
+	* Simulate out-of-cyan-ink condition by removing cyan...
+	*/
+
+	line[0] = kmin;
+      }
+
+      if (cmyk[1] <= 0)
+      {
+       /*
+	* Simulate out-of-magenta-ink condition by removing magenta...
+	*/
+
+	line[1] = kmin;
+      }
+
+      if (cmyk[2] <= 0)
+      {
+       /*
+	* Simulate out-of-yellow-ink condition by removing yellow...
+	*/
+
+	line[2] = kmin;
+      }
+
+      if (cmyk[3] <= 0)
+      {
+       /*
+	* Simulate out-of-black-ink condition by removing black...
+	*/
+
+	kmin = 255 - kmin;
+	line[0] += kmin;
+	line[1] += kmin;
+	line[2] += kmin;
+      }
+
+      bytes -= 3;
+      line += 3;
+    }
+  }
+
+ /*
+  * Subtract a portion of the CMYK colors used on this line from the
+  * ink counters, then limit to a minimum of 0 ink left.
+  */
+
+  cmyk[0] -= 50 * c / resolution / resolution;
+  cmyk[1] -= 50 * m / resolution / resolution;
+  cmyk[2] -= 50 * y / resolution / resolution;
+  cmyk[3] -= 50 * k / resolution / resolution;
+
+  if (cmyk[0] < 0)
+    cmyk[0] = 0;
+  if (cmyk[1] < 0)
+    cmyk[1] = 0;
+  if (cmyk[2] < 0)
+    cmyk[2] = 0;
+  if (cmyk[3] < 0)
+    cmyk[3] = 0;
+}
+
+
+/*
+ * 'ref_parse_status()' - Reference copy of ParseStatus().
+ */
+
+static int				/* O - 1 on success, 0 on failure */
+ref_parse_status(char *buffer)		/* I - Nul-terminated back-channel data */
+{
+  char		*start,			/* Start of line */
+		*end;			/* End of line */
+  static int	last_levels[4] = { -1, -1, -1, -1 };
+					/* Previous levels seen */
+
+
+ /*
+  * Parse the back-channel data.  For our imaginary sample device, it will
+  * return one of the following strings on a line by itself:
+  *
+  * ILnnn,nnn,nnn,nnn      (ink levels)
+  * OP                     (out of paper)
+  * LP                     (low paper)
+  * OK                     (no errors)
+  *
+  * Then we send ATTR: and STATE: messages to the scheduler.  See:
+  *
+  *     http://localhost:631/help/api-filter.html
+  */
+
+  for (start = buffer; *start; start = end)
+  {
+   /*
+    * Find the end of the current line...
+    */
+
+    if ((end = strchr(start, '\n')) != NULL)
+      *end++ = '\0';
+    else
+      end = start + strlen(start);
+
+   /*
+    * Parse this line...
+    */
+
+    if (!strncmp(start, "IL", 2))
+    {
+     /*
+      * Collect ink levels...
+      */
+
+      int	levels[4];		/* Ink levels */
+
+
+      if (sscanf(start, "IL%d,%d,%d,%d", levels + 0, levels + 1, levels + 2,
+                 levels + 3) != 4)
+        return (0);			/* Bad line */
+
+     /*
+      * Only report levels if they have changed...
+      */
+
+      if (levels[0] == last_levels[0] &&
+          levels[1] == last_levels[1] &&
+          levels[2] == last_levels[2] &&
+          levels[3] == last_levels[3])
+        continue;
+
+     /*
+      * Write an ATTR: message to stderr...
+      */
+
+      fprintf(stderr,
+              "ATTR: marker-colors=#00ffff,#ff00ff,#ffff00,#000000 "
+	      "marker-levels=%d,%d,%d,%d "
+	      "marker-names=Cyan,Magenta,Yellow,Black "
+	      "marker-types=ink,ink,ink,ink\n",
+	      levels[0], levels[1], levels[2], levels[3]);
+
+      if (levels[0] < 5 && last_levels[0] >= 5)
+        fputs("STATE: +com.sample-cyan-error\n", stderr);
+      else if (levels[0] >= 5 && last_levels[0] < 5)
+        fputs("STATE: -com.sample-cyan-error\n", stderr);
+
+      if (levels[1] < 5 && last_levels[1] >= 5)
+        fputs("STATE: +com.sample-magenta-error\n", stderr);
+      else if (levels[1] >= 5 && last_levels[1] < 5)
+        fputs("STATE: -com.sample-magenta-error\n", stderr);
+
+      if (levels[2] < 5 && last_levels[2] >= 5)
+        fputs("STATE: +com.sample-yellow-error\n", stderr);
+      else if (levels[2] >= 5 && last_levels[2] < 5)
+        fputs("STATE: -com.sample-yellow-error\n", stderr);
+
+      if (levels[3] < 5 && last_levels[3] >= 5)
+        fputs("STATE: +com.sample-black-error\n", stderr);
+      else if (levels[3] >= 5 && last_levels[3] < 5)
+        fputs("STATE: -com.sample-black-error\n", stderr);
+
+      last_levels[0] = levels[0];
+      last_levels[1] = levels[1];
+      last_levels[2] = levels[2];
+      last_levels[3] = levels[3];
+    }
+    else if (!strcmp(start, "OP"))
+    {
+     /*
+      * Write out-of-paper STATE: messages to stderr...
+      */
+
+      fputs("STATE: -media-low-report\n", stderr);
+      fputs("STATE: +media-empty-warning\n", stderr);
+    }
+    else if (!strcmp(start, "LP"))
+    {
+     /*
+      * Write low-paper STATE: messages to stderr...
+      */
+
+      fputs("STATE: -media-empty-warning\n", stderr);
+      fputs("STATE: +media-low-report\n", stderr);
+    }
+    else if (!strcmp(start, "OK"))
+    {
+     /*
+      * Write no-error STATE: messages to stderr...
+      */
+
+      fputs("STATE: -media-empty-warning\n", stderr);
+      fputs("STATE: -media-low-report\n", stderr);
+    }
+    else
+    {
+      LogDebug("Unknown status \"%s\"!", start);
+      return (0);
+    }
+  }
+
+ /*
+  * Return with no errors.
+  */
+
+  return (1);
+}
+
+
+/*
+ * 'ref_protocol_command()' - Reference copy of the command tests in
+ *                            sampletopdf, in their original order.
+ */
+
+static protocol_command_t		/* O - Command or PROTOCOL_UNKNOWN */
+ref_protocol_command(const char *name)	/* I - Command name */
+{
+  if (!strcmp(name, "DOCUMENT"))
+    return (PROTOCOL_DOCUMENT);
+  else if (!strcmp(name, "ENDDOCUMENT"))
+    return (PROTOCOL_ENDDOCUMENT);
+  else if (!strcmp(name, "PAGE"))
+    return (PROTOCOL_PAGE);
+  else if (!strcmp(name, "ENDPAGE"))
+    return (PROTOCOL_ENDPAGE);
+  else if (!strcmp(name, "RASTER"))
+    return (PROTOCOL_RASTER);
+  else if (!strcmp(name, "HALFTONE"))
+    return (PROTOCOL_HALFTONE);
+  else if (!strcmp(name, "LINE"))
+    return (PROTOCOL_LINE);
+  else if (!strcmp(name, "BAND"))
+    return (PROTOCOL_BAND);
+  else if (!strcmp(name, "SKIP"))
+    return (PROTOCOL_SKIP);
+  else if (!strcmp(name, "SPAN"))
+    return (PROTOCOL_SPAN);
+  else if (!strcmp(name, "LEVELS"))
+    return (PROTOCOL_LEVELS);
+  else if (!strcmp(name, "CHANGEINK"))
+    return (PROTOCOL_CHANGEINK);
+  else if (!strcmp(name, "AUTHOR"))
+    return (PROTOCOL_AUTHOR);
+  else if (!strcmp(name, "CLEAN"))
+    return (PROTOCOL_CLEAN);
+  else if (!strcmp(name, "TITLE"))
+    return (PROTOCOL_TITLE);
+  else
+    return (PROTOCOL_UNKNOWN);
+}
+
+
+/*
+ * 'ref_selftest_line()' - Reference copy of the line construction in
+ *                         print_self_test_page().
+ */
+
+static void
+ref_selftest_line(unsigned char *data,	/* O - Line */
+                  int           y)	/* I - Line on page */
+{
+  int		color,			/* Current color */
+		pass;			/* Current pass */
+  unsigned char	*dataptr;		/* Pointer into line */
+  unsigned char	colors[4][3] =		/* Colors for each "ink" */
+		{
+		  { 0, 0, 0 },		/* Black */
+		  { 0, 255, 255 },	/* Cyan */
+		  { 255, 0, 255 },	/* Magenta */
+		  { 255, 255, 0 }	/* Yellow */
+		};
+
+
+  memset(data, 255, 360 * 3);
+
+  for (color = 0, pass = y & 7; color < 4; color ++)
+  {
+    dataptr = data + color * 96 * 3;
+
+    memcpy(dataptr + 0 * 3, colors[color], 3);
+    memcpy(dataptr + 71 * 3, colors[color], 3);
+
+    dataptr += pass * 9 * 3;
+    memcpy(dataptr + 0 * 3, colors[color], 3);
+    memcpy(dataptr + 1 * 3, colors[color], 3);
+    memcpy(dataptr + 2 * 3, colors[color], 3);
+    memcpy(dataptr + 3 * 3, colors[color], 3);
+    memcpy(dataptr + 4 * 3, colors[color], 3);
+    memcpy(dataptr + 5 * 3, colors[color], 3);
+    memcpy(dataptr + 6 * 3, colors[color], 3);
+    memcpy(dataptr + 7 * 3, colors[color], 3);
+    memcpy(dataptr + 8 * 3, colors[color], 3);
+  }
+}
+
+
+/*
+ * 'report()' - Show the results for a function.
+ */
+
+static void
+report(const char *name,		/* I - Function name */
+       double     bytes,		/* I - Bytes of input per call */
+       double     ref_nsecs,		/* I - Reference time per call */
+       double     new_nsecs,		/* I - Current time per call */
+       int        same)			/* I - Same output? */
+{
+  printf("%-22s %10.4f %10.4f %7.2fx  %s\n", name, ref_nsecs / bytes,
+         new_nsecs / bytes, new_nsecs > 0.0 ? ref_nsecs / new_nsecs : 0.0,
+	 same ? "same" : "DIFFERENT");
+  fflush(stdout);
+
+  if (!same)
+    failures ++;
+}
+
+
+/*
+ * 'run_convert()' - Convert a line of 16-bit samples.
+ */
+
+static void
+run_convert(void *data)			/* I - Benchmark data */
+{
+  convert_data_t	*d = (convert_data_t *)data;
+					/* Benchmark data */
+
+
+  if (d->kernel)
+    (d->kernel->convert)(d->dst, (const unsigned char *)d->src, d->width);
+  else
+    ref_convert16(d->dst, d->src, d->samples);
+}
+
+
+/*
+ * 'run_ink()' - Update the ink levels for a line.
+ *
+ * The line and levels are reset first, since running out of ink changes
+ * both.
+ */
+
+static void
+run_ink(void *data)			/* I - Benchmark data */
+{
+  ink_data_t	*d = (ink_data_t *)data;/* Benchmark data */
+
+
+  memcpy(d->line, d->original, d->bytes);
+  memcpy(d->cmyk, d->levels, sizeof(d->cmyk));
+
+  (d->update)(d->cmyk, d->line, d->bytes, d->depth, 300);
+}
+
+
+/*
+ * 'run_protocol()' - Read a protocol stream.
+ */
+
+static void
+run_protocol(void *data)		/* I - Benchmark data */
+{
+  protocol_data_t	*d = (protocol_data_t *)data;
+					/* Benchmark data */
+  cups_file_t		*fp;		/* Protocol stream */
+  char			line[1024],	/* Line from file */
+			*value;		/* Value from line */
+  int			linenum = 0;	/* Current line number */
+  protocol_command_t	command;	/* Current command */
+  unsigned		x, y, lines;	/* Command values */
+  size_t		bytes;		/* Bytes of raster data */
+
+
+  d->hash = 2166136261u;
+
+  if ((fp = cupsFileOpen(d->filename, "r")) == NULL)
+    return;
+
+  while (cupsFileGetConf(fp, line, sizeof(line), &value, &linenum))
+  {
+    command = (d->lookup)(line);
+    bytes   = 0;
+
+    d->hash = hash_bytes(d->hash, &command, sizeof(command));
+
+    if (command == PROTOCOL_LINE && value)
+      sscanf(value, "%zu", &bytes);
+    else if (command == PROTOCOL_BAND && value)
+      sscanf(value, "%u%u%zu", &y, &lines, &bytes);
+    else if (command == PROTOCOL_SPAN && value)
+      sscanf(value, "%u%zu", &x, &bytes);
+    else if (value)
+      d->hash = hash_bytes(d->hash, value, strlen(value));
+
+    if (bytes > d->size)
+      bytes = d->size;
+
+    if (bytes > 0 && cupsFileRead(fp, (char *)d->buffer, bytes) > 0)
+      d->hash = hash_bytes(d->hash, d->buffer, 16);
+  }
+
+  cupsFileClose(fp);
+}
+
+
+/*
+ * 'run_raster()' - Read the pages of a raster file.
+ *
+ * Lines flagged as repeats are hashed from the line before, so the hash is
+ * the same whichever way the file is read.
+ */
+
+static void
+run_raster(void *data)			/* I - Benchmark data */
+{
+  raster_data_t		*d = (raster_data_t *)data;
+					/* Benchmark data */
+  int			fd;		/* Raster file */
+  input_t		*in;		/* Raster input */
+  cups_page_header2_t	header;		/* Page header */
+  const unsigned char	*lines,		/* Lines in band */
+			*line;		/* Current line */
+  unsigned		i,		/* Looping var */
+			count;		/* Lines read */
+
+
+  d->hash = 2166136261u;
+
+  if ((fd = open(d->filename, O_RDONLY)) < 0)
+    return;
+
+  if ((in = InputCreate(fd, d->flags)) != NULL)
+  {
+    while (InputReadHeader(in, &header))
+    {
+      while ((count = InputReadLines(in, d->buffer, BENCH_BAND, &lines,
+                                     d->same)) > 0)
+      {
+	if (!d->check)
+	{
+	  d->hash += count + lines[0];
+	  continue;
+	}
+
+	for (i = 0, line = lines; i < count; i ++)
+	{
+	  if (!d->same[i])
+	    line = lines + i * header.cupsBytesPerLine;
+
+	  d->hash = hash_bytes(d->hash, line, header.cupsBytesPerLine);
+	}
+      }
+    }
+
+    InputDelete(in);
+  }
+
+  close(fd);
+}
+
+
+/*
+ * 'run_selftest()' - Build the lines of the self-test page.
+ */
+
+static void
+run_selftest(void *data)		/* I - Benchmark data */
+{
+  selftest_data_t	*d = (selftest_data_t *)data;
+					/* Benchmark data */
+  int			y;		/* Current line */
+
+
+  for (y = 0; y < PROTOCOL_SELFTEST_HEIGHT; y ++)
+    (d->build)(d->lines + y * PROTOCOL_SELFTEST_WIDTH * 3, y);
+}
+
+
+/*
+ * 'run_status()' - Parse each burst of back-channel data.
+ */
+
+static void
+run_status(void *data)			/* I - Benchmark data */
+{
+  status_data_t	*d = (status_data_t *)data;
+					/* Benchmark data */
+  size_t	i;			/* Looping var */
+  char		buffer[1025];		/* Back-channel data */
+
+
+  for (i = 0; i < sizeof(status_bursts) / sizeof(status_bursts[0]); i ++)
+  {
+    strcpy(buffer, status_bursts[i]);
+    d->result += (d->parse)(buffer);
+  }
+}
+
+
+/*
+ * 'time_func()' - Time a function.
+ *
+ * The function is called until at least min_nsecs have passed, and the
+ * fastest of BENCH_REPEAT such measurements is used.
+ */
+
+static double				/* O - Nanoseconds per call */
+time_func(bench_func_t func,		/* I - Function to time */
+          void         *data)		/* I - Data for function */
+{
+  int		i;			/* Looping var */
+  uint64_t	calls,			/* Number of calls */
+		start,			/* Start time */
+		nsecs;			/* Elapsed time */
+  double	best = 0.0;		/* Fastest time per call */
+
+
+  (func)(data);
+
+  for (i = 0; i < BENCH_REPEAT; i ++)
+  {
+    calls = 0;
+    start = MetricsNow();
+
+    do
+    {
+      (func)(data);
+      calls ++;
+    }
+    while ((nsecs = MetricsNow() - start) < min_nsecs);
+
+    if (i == 0 || (double)nsecs / calls < best)
+      best = (double)nsecs / calls;
+  }
+
+  return (best);
+}
+
+
+/*
+ * 'usage()' - Show program usage and exit.
+ */
+
+static void
+usage(void)
+{
+  size_t	i;			/* Looping var */
+
+
+  fputs("Usage: microbench [-r directory] [-t msecs] [benchmark ...]\n",
+        stderr);
+  fputs("Benchmarks:", stderr);
+
+  for (i = 0; i < sizeof(benches) / sizeof(benches[0]); i ++)
+    fprintf(stderr, " %s", benches[i].name);
+
+  fputs("\n", stderr);
+
+  exit(1);
+}
+
+
+/*
+ * 'write_raster()' - Write the pages for the raster benchmark.
+ *
+ * Each page has text-like lines with short dark runs, blank lines between
+ * them, rules that repeat for several lines, and a band of noise.
+ */
+
+static void
+write_raster(const char  *filename,	/* I - File to write */
+             cups_mode_t mode)		/* I - CUPS_RASTER_WRITE or
+					       CUPS_RASTER_WRITE_COMPRESSED */
+{
+  int			fd;		/* Raster file */
+  cups_raster_t		*ras;		/* Raster stream */
+  cups_page_header2_t	header;		/* Page header */
+  unsigned char		*line,		/* Line of pixels */
+			*noise;		/* Random pixels */
+  unsigned		page,		/* Current page */
+			x,		/* Current column */
+			y;		/* Current line */
+  size_t		bytes = 3 * BENCH_WIDTH;
+					/* Bytes per line */
+
+
+  if ((fd = open(filename, O_WRONLY | O_TRUNC)) < 0 ||
+      (ras = cupsRasterOpen(fd, mode)) == NULL)
+  {
+    fprintf(stderr, "microbench: Unable to write raster file: %s\n",
+            strerror(errno));
+    exit(1);
+  }
+
+  if ((line = malloc(bytes)) == NULL || (noise = malloc(2 * bytes)) == NULL)
+  {
+    fputs("microbench: Out of memory.\n", stderr);
+    exit(1);
+  }
+
+  fill_random(noise, 2 * bytes, 4);
+
+  memset(&header, 0, sizeof(header));
+
+  header.HWResolution[0]  = 300;
+  header.HWResolution[1]  = 300;
+  header.PageSize[0]      = 612;
+  header.PageSize[1]      = 792;
+  header.NumCopies        = 1;
+  header.cupsWidth        = BENCH_WIDTH;
+  header.cupsHeight       = BENCH_HEIGHT;
+  header.cupsBitsPerColor = 8;
+  header.cupsBitsPerPixel = 24;
+  header.cupsBytesPerLine = (unsigned)bytes;
+  header.cupsColorOrder   = CUPS_ORDER_CHUNKED;
+  header.cupsColorSpace   = CUPS_CSPACE_RGB;
+  header.cupsNumColors    = 3;
+
+  for (page = 0; page < 2; page ++)
+  {
+    cupsRasterWriteHeader2(ras, &header);
+
+    for (y = 0; y < BENCH_HEIGHT; y ++)
+    {
+      memset(line, 255, bytes);
+
+      if (y >= 2000 && y < 2600)
+        memcpy(line, noise + (y * 7) % bytes, bytes);
+      else if ((y % 300) < 6)
+        memset(line + 300, 0, bytes - 600);
+      else if ((y % 50) < 30)
+      {
+        for (x = 150; x < BENCH_WIDTH - 150; x += 20 + noise[x + y] % 12)
+	  memset(line + 3 * x, noise[x] & 0x40, 3 * (2 + noise[x + 2 * y] % 6));
+      }
+
+      cupsRasterWritePixels(ras, line, (unsigned)bytes);
+    }
+  }
+
+  cupsRasterClose(ras);
+  close(fd);
+
+  free(line);
+  free(noise);
+}
@@ -0,0 +1,716 @@
+/*
+     File: output.c 
+ Abstract: Buffered output stream for sample CUPS printer driver.
+  Version: 4.0 
+  
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple 
+ Inc. ("Apple") in consideration of your agreement to the following 
+ terms, and your use, installation, modification or redistribution of 
+ this Apple software constitutes acceptance of these terms.  If you do 
+ not agree with these terms, please do not use, install, modify or 
+ redistribute this Apple software. 
+  
+ In consideration of your agreement to abide by the following terms, and 
+ subject to these terms, Apple grants you a personal, non-exclusive 
+ license, under Apple's copyrights in this original Apple software (the 
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple 
+ Software, with or without modifications, in source and/or binary forms; 
+ provided that if you redistribute the Apple Software in its entirety and 
+ without modifications, you must retain this notice and the following 
+ text and disclaimers in all such redistributions of the Apple Software. 
+ Neither the name, trademarks, service marks or logos of Apple Inc. may 
+ be used to endorse or promote products derived from the Apple Software 
+ without specific prior written permission from Apple.  Except as 
+ expressly stated in this notice, no other rights or licenses, express or 
+ implied, are granted by Apple herein, including but not limited to any 
+ patent rights that may be infringed by your derivative works or by other 
+ works in which the Apple Software may be incorporated. 
+  
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE 
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION 
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS 
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND 
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS. 
+  
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL 
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, 
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED 
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), 
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE 
+ POSSIBILITY OF SUCH DAMAGE. 
+  
+ Copyright (C) 2011 Apple Inc. All Rights Reserved. 
+  
+ */  
+
+#ifdef __linux__
+#  define _GNU_SOURCE			/* For splice() */
+#endif /* __linux__ */
+
+#include "output.h"			/* Output stream definitions */
+#include "codec.h"			/* Raster data encodings */
+#include "trace.h"			/* Stage timing definitions */
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+
+#ifdef __linux__
+#  include <fcntl.h>
+#  define HAVE_SPLICE 1
+#endif /* __linux__ */
+
+
+/*
+ * Local functions...
+ */
+
+static double	get_time(void);
+static int	stream_begin_document(void *data, const char *author,
+		                      const char *title);
+static int	stream_begin_page(void *data, unsigned x, unsigned y,
+		                  unsigned width, unsigned height);
+static int	stream_begin_raster(void *data, unsigned width,
+		                    unsigned height, unsigned depth);
+static int	stream_end_document(void *data);
+static int	stream_end_page(void *data);
+static int	stream_get_levels(void *data);
+static int	stream_maintain(void *data, protocol_command_t command,
+		                const char *colors);
+static int	stream_put_encoded(void *data, int y, unsigned count,
+		                   int codec, const unsigned char *buffer,
+				   size_t bytes);
+static int	stream_put_lines(void *data, int y, unsigned count,
+		                 const unsigned char * const *lines,
+				 size_t bytes);
+static int	stream_put_span(void *data, unsigned x,
+		                const unsigned char *buffer, size_t bytes);
+static int	stream_repeat_page(void *data, const char *key);
+static int	stream_set_copies(void *data, unsigned copies, int collate);
+static int	stream_set_halftone(void *data, unsigned bits);
+static int	stream_skip_lines(void *data, unsigned count);
+static int	write_all(output_t *out, struct iovec *iov, int iovcnt);
+static int	write_lines(output_t *out, const unsigned char *data,
+		            size_t bytes);
+
+
+/*
+ * 'OutputCreate()' - Create an output stream.
+ */
+
+output_t *				/* O - Output stream or NULL on error */
+OutputCreate(int    fd,			/* I - File descriptor */
+             size_t size,		/* I - Buffer size in bytes */
+             double interval)		/* I - Maximum time between flushes */
+{
+  output_t	*out;			/* Output stream */
+  void		*buffer;		/* Output buffer */
+
+
+  if ((out = calloc(1, sizeof(output_t))) == NULL)
+    return (NULL);
+
+  if (posix_memalign(&buffer, 4096, size))
+  {
+    free(out);
+    return (NULL);
+  }
+
+  out->fd         = fd;
+  out->source_fd  = -1;
+  out->buffer     = buffer;
+  out->size       = size;
+  out->interval   = interval;
+  out->last_flush = get_time();
+
+  return (out);
+}
+
+
+/*
+ * 'OutputDelete()' - Flush and free an output stream.
+ */
+
+void
+OutputDelete(output_t *out)		/* I - Output stream */
+{
+  if (!out)
+    return;
+
+  OutputFlush(out);
+
+  free(out->buffer);
+  free(out);
+}
+
+
+/*
+ * 'OutputFlush()' - Send any buffered data.
+ */
+
+int					/* O - 1 on success, 0 on failure */
+OutputFlush(output_t *out)		/* I - Output stream */
+{
+  struct iovec	iov;			/* Buffered data */
+
+
+  out->last_flush = get_time();
+
+  if (out->used == 0)
+    return (1);
+
+  iov.iov_base = out->buffer;
+  iov.iov_len  = out->used;
+  out->used    = 0;
+
+  return (write_all(out, &iov, 1));
+}
+
+
+/*
+ * 'OutputPrintf()' - Write a formatted command.
+ */
+
+int					/* O - 1 on success, 0 on failure */
+OutputPrintf(output_t   *out,		/* I - Output stream */
+             const char *format,	/* I - printf-style format string */
+	     ...)			/* I - Additional arguments as needed */
+{
+  va_list	ap;			/* Pointer to additional arguments */
+  char		buffer[1024];		/* Formatted command */
+  int		bytes;			/* Length of command */
+
+
+  va_start(ap, format);
+  bytes = vsnprintf(buffer, sizeof(buffer), format, ap);
+  va_end(ap);
+
+  if (bytes < 0)
+    return (0);
+  else if (bytes >= (int)sizeof(buffer))
+    bytes = sizeof(buffer) - 1;
+
+  return (OutputWrite(out, buffer, (size_t)bytes));
+}
+
+
+/*
+ * 'OutputPuts()' - Write a command followed by a newline.
+ */
+
+int					/* O - 1 on success, 0 on failure */
+OutputPuts(output_t   *out,		/* I - Output stream */
+           const char *s)		/* I - Command */
+{
+  return (OutputWrite(out, s, strlen(s)) && OutputWrite(out, "\n", 1));
+}
+
+
+/*
+ * 'OutputResetStats()' - Reset the byte and system call counters.
+ */
+
+void
+OutputResetStats(output_t *out)		/* I - Output stream */
+{
+  out->bytes   = 0;
+  out->writes  = 0;
+  out->spliced = 0;
+}
+
+
+/*
+ * 'OutputSetSource()' - Set the raster file that lines can be spliced from.
+ *
+ * "map" is a mapping of all of "fd", which must not change while the stream
+ * is open.  Lines inside the mapping are then spliced from the file when the
+ * output is a pipe, and copied as usual otherwise.
+ */
+
+int					/* O - 1 if lines can be spliced, 0 otherwise */
+OutputSetSource(output_t   *out,	/* I - Output stream */
+                int        fd,		/* I - Raster file */
+		const void *map,	/* I - Mapping of raster file */
+		size_t     size)	/* I - Size of mapping */
+{
+#ifdef HAVE_SPLICE
+  struct stat	fileinfo;		/* Output file information */
+
+
+  if (fstat(out->fd, &fileinfo) || !S_ISFIFO(fileinfo.st_mode))
+    return (0);
+
+  out->source_fd   = fd;
+  out->source      = (const unsigned char *)map;
+  out->source_size = size;
+
+  return (1);
+
+#else
+  (void)out;
+  (void)fd;
+  (void)map;
+  (void)size;
+
+  return (0);
+#endif /* HAVE_SPLICE */
+}
+
+
+/*
+ * 'OutputSink()' - Make a sink that writes commands to an output stream.
+ */
+
+void
+OutputSink(output_t        *out,	/* I - Output stream */
+           protocol_sink_t *sink)	/* O - Sink */
+{
+  sink->data           = out;
+  sink->begin_document = stream_begin_document;
+  sink->set_copies     = stream_set_copies;
+  sink->begin_page     = stream_begin_page;
+  sink->begin_raster   = stream_begin_raster;
+  sink->set_halftone   = stream_set_halftone;
+  sink->put_lines      = stream_put_lines;
+  sink->put_encoded    = stream_put_encoded;
+  sink->put_span       = stream_put_span;
+  sink->skip_lines     = stream_skip_lines;
+  sink->get_levels     = stream_get_levels;
+  sink->maintain       = stream_maintain;
+  sink->end_page       = stream_end_page;
+  sink->repeat_page    = stream_repeat_page;
+  sink->end_document   = stream_end_document;
+}
+
+
+/*
+ * 'OutputWrite() - Write data to an output stream.
+ *
+ * Data that fits is copied into the output buffer.  Otherwise the buffered
+ * data and the new data are sent together with a single writev() call.
+ */
+
+int					/* O - 1 on success, 0 on failure */
+OutputWrite(output_t   *out,		/* I - Output stream */
+            const void *data,		/* I - Data to write */
+	    size_t     bytes)		/* I - Number of bytes */
+{
+  struct iovec	iov[2];			/* Buffered and new data */
+
+
+  if ((out->used + bytes) > out->size)
+  {
+    iov[0].iov_base = out->buffer;
+    iov[0].iov_len  = out->used;
+    iov[1].iov_base = (void *)data;
+    iov[1].iov_len  = bytes;
+    out->used       = 0;
+    out->last_flush = get_time();
+
+    return (write_all(out, iov, 2));
+  }
+
+  memcpy(out->buffer + out->used, data, bytes);
+  out->used += bytes;
+
+  if (out->used == out->size || (get_time() - out->last_flush) >= out->interval)
+    return (OutputFlush(out));
+
+  return (1);
+}
+
+
+/*
+ * 'get_time()' - Get the current time in seconds.
+ */
+
+static double				/* O - Time in seconds */
+get_time(void)
+{
+  struct timeval	curtime;	/* Current time */
+
+
+  gettimeofday(&curtime, NULL);
+
+  return (curtime.tv_sec + 0.000001 * curtime.tv_usec);
+}
+
+
+/*
+ * 'stream_begin_document()' - Send DOCUMENT, AUTHOR, and TITLE.
+ */
+
+static int				/* O - 1 on success, 0 on failure */
+stream_begin_document(
+    void       *data,			/* I - Output stream */
+    const char *author,			/* I - Author */
+    const char *title)			/* I - Title */
+{
+  output_t	*out = (output_t *)data;/* Output stream */
+
+
+  return (OutputPuts(out, "DOCUMENT") &&
+          OutputPrintf(out, "AUTHOR %s\n", author) &&
+          OutputPrintf(out, "TITLE %s\n", title));
+}
+
+
+/*
+ * 'stream_begin_page()' - Send PAGE.
+ */
+
+static int				/* O - 1 on success, 0 on failure */
+stream_begin_page(void     *data,	/* I - Output stream */
+                  unsigned x,		/* I - Left margin in points */
+		  unsigned y,		/* I - Bottom margin in points */
+		  unsigned width,	/* I - Page width in points */
+		  unsigned height)	/* I - Page length in points */
+{
+  return (OutputPrintf((output_t *)data, "PAGE %u %u %u %u\n", x, y, width,
+                       height));
+}
+
+
+/*
+ * 'stream_begin_raster()' - Send RASTER.
+ */
+
+static int				/* O - 1 on success, 0 on failure */
+stream_begin_raster(void     *data,	/* I - Output stream */
+                    unsigned width,	/* I - Width in pixels */
+		    unsigned height,	/* I - Height in lines */
+		    unsigned depth)	/* I - Samples per pixel */
+{
+  return (OutputPrintf((output_t *)data, "RASTER %u %u %u\n", width, height,
+                       depth));
+}
+
+
+/*
+ * 'stream_end_document()' - Send ENDDOCUMENT.
+ */
+
+static int				/* O - 1 on success, 0 on failure */
+stream_end_document(void *data)		/* I - Output stream */
+{
+  return (OutputPuts((output_t *)data, "ENDDOCUMENT"));
+}
+
+
+/*
+ * 'stream_end_page()' - Send ENDPAGE.
+ */
+
+static int				/* O - 1 on success, 0 on failure */
+stream_end_page(void *data)		/* I - Output stream */
+{
+  return (OutputPuts((output_t *)data, "ENDPAGE"));
+}
+
+
+/*
+ * 'stream_get_levels()' - Send LEVELS.
+ *
+ * The reply comes back on the back-channel, so LEVELS is sent right away
+ * rather than waiting in the buffer until the next write after the flush
+ * interval.
+ */
+
+static int				/* O - 1 on success, 0 on failure */
+stream_get_levels(void *data)		/* I - Output stream */
+{
+  output_t	*out = (output_t *)data;/* Output stream */
+
+
+  return (OutputPuts(out, "LEVELS") && OutputFlush(out));
+}
+
+
+/*
+ * 'stream_maintain()' - Send CHANGEINK or CLEAN.
+ *
+ * Like LEVELS, these are sent right away.
+ */
+
+static int				/* O - 1 on success, 0 on failure */
+stream_maintain(
+    void               *data,		/* I - Output stream */
+    protocol_command_t command,		/* I - PROTOCOL_CHANGEINK or PROTOCOL_CLEAN */
+    const char         *colors)		/* I - Colors or NULL for all */
+{
+  output_t	*out = (output_t *)data;/* Output stream */
+  const char	*name = command == PROTOCOL_CHANGEINK ? "CHANGEINK" : "CLEAN";
+					/* Command name */
+  int		status;			/* Write status */
+
+
+  if (colors)
+    status = OutputPrintf(out, "%s %s\n", name, colors);
+  else
+    status = OutputPuts(out, name);
+
+  return (status && OutputFlush(out));
+}
+
+
+/*
+ * 'stream_put_encoded()' - Send encoded lines with LINE or BAND.
+ */
+
+static int				/* O - 1 on success, 0 on failure */
+stream_put_encoded(
+    void                *data,		/* I - Output stream */
+    int                 y,		/* I - First line or -1 for the next line */
+    unsigned            count,		/* I - Number of lines */
+    int                 codec,		/* I - Encoding */
+    const unsigned char *buffer,	/* I - Encoded data */
+    size_t              bytes)		/* I - Bytes of encoded data */
+{
+  output_t	*out = (output_t *)data;/* Output stream */
+
+
+  if (y < 0)
+    return (OutputPrintf(out, "LINE %u %s\n", (unsigned)bytes,
+                         CodecName((codec_t)codec)) &&
+            OutputWrite(out, buffer, bytes));
+
+  return (OutputPrintf(out, "BAND %d %u %u %s\n", y, count, (unsigned)bytes,
+                       CodecName((codec_t)codec)) &&
+          OutputWrite(out, buffer, bytes));
+}
+
+
+/*
+ * 'stream_put_lines()' - Send raw lines with LINE or BAND.
+ *
+ * The lines are written straight from the caller's buffers.  A band whose
+ * lines follow one another is written as a whole, so that lines passed
+ * through from the mapped raster file can be spliced together.
+ */
+
+static int				/* O - 1 on success, 0 on failure */
+stream_put_lines(
+    void                      *data,	/* I - Output stream */
+    int                       y,	/* I - First line or -1 for the next line */
+    unsigned                  count,	/* I - Number of lines */
+    const unsigned char * const *lines,	/* I - Lines */
+    size_t                    bytes)	/* I - Bytes per line */
+{
+  output_t	*out = (output_t *)data;/* Output stream */
+  unsigned	i;			/* Looping var */
+
+
+  if (y >= 0)
+  {
+    if (!OutputPrintf(out, "BAND %d %u %u\n", y, count,
+                      (unsigned)(count * bytes)))
+      return (0);
+
+    for (i = 1; i < count; i ++)
+      if (lines[i] != lines[0] + i * bytes)
+        break;
+
+    if (i == count)
+      return (write_lines(out, lines[0], count * bytes));
+  }
+
+  for (i = 0; i < count; i ++)
+  {
+    if (y < 0 && !OutputPrintf(out, "LINE %u\n", (unsigned)bytes))
+      return (0);
+
+    if (!write_lines(out, lines[i], bytes))
+      return (0);
+  }
+
+  return (1);
+}
+
+
+/*
+ * 'stream_put_span()' - Send SPAN.
+ */
+
+static int				/* O - 1 on success, 0 on failure */
+stream_put_span(
+    void                *data,		/* I - Output stream */
+    unsigned            x,		/* I - First pixel */
+    const unsigned char *buffer,	/* I - Pixels */
+    size_t              bytes)		/* I - Bytes of pixels */
+{
+  output_t	*out = (output_t *)data;/* Output stream */
+
+
+  return (OutputPrintf(out, "SPAN %u %u\n", x, (unsigned)bytes) &&
+          OutputWrite(out, buffer, bytes));
+}
+
+
+/*
+ * 'stream_repeat_page()' - Send REPEATPAGE.
+ */
+
+static int				/* O - 1 on success, 0 on failure */
+stream_repeat_page(void       *data,	/* I - Output stream */
+                   const char *key)	/* I - Key for cached page */
+{
+  return (OutputPrintf((output_t *)data, "REPEATPAGE %s\n", key));
+}
+
+
+/*
+ * 'stream_set_copies()' - Send COPIES.
+ */
+
+static int				/* O - 1 on success, 0 on failure */
+stream_set_copies(void     *data,	/* I - Output stream */
+                  unsigned copies,	/* I - Number of copies */
+		  int      collate)	/* I - Collate copies? */
+{
+  return (OutputPrintf((output_t *)data, "COPIES %u %d\n", copies,
+                       collate ? 1 : 0));
+}
+
+
+/*
+ * 'stream_set_halftone()' - Send HALFTONE.
+ */
+
+static int				/* O - 1 on success, 0 on failure */
+stream_set_halftone(void     *data,	/* I - Output stream */
+                    unsigned bits)	/* I - Bits per sample */
+{
+  return (OutputPrintf((output_t *)data, "HALFTONE %u\n", bits));
+}
+
+
+/*
+ * 'stream_skip_lines()' - Send SKIP.
+ */
+
+static int				/* O - 1 on success, 0 on failure */
+stream_skip_lines(void     *data,	/* I - Output stream */
+                  unsigned count)	/* I - Number of white lines */
+{
+  return (OutputPrintf((output_t *)data, "SKIP %u\n", count));
+}
+
+
+/*
+ * 'write_all()' - Write an I/O vector, retrying after short writes.
+ */
+
+static int				/* O - 1 on success, 0 on failure */
+write_all(output_t     *out,		/* I - Output stream */
+          struct iovec *iov,		/* I - I/O vector */
+	  int          iovcnt)		/* I - Number of vector elements */
+{
+  ssize_t	bytes;			/* Bytes written */
+  TRACE_SCOPE("write");
+
+
+  while (iovcnt > 0)
+  {
+    if (iov->iov_len == 0)
+    {
+      iov ++;
+      iovcnt --;
+      continue;
+    }
+
+    if ((bytes = writev(out->fd, iov, iovcnt)) < 0)
+    {
+      if (errno == EINTR)
+        continue;
+
+      return (0);
+    }
+
+    out->bytes += bytes;
+    out->writes ++;
+
+    while (iovcnt > 0 && (size_t)bytes >= iov->iov_len)
+    {
+      bytes -= iov->iov_len;
+      iov ++;
+      iovcnt --;
+    }
+
+    if (iovcnt > 0)
+    {
+      iov->iov_base = (char *)iov->iov_base + bytes;
+      iov->iov_len  -= bytes;
+    }
+  }
+
+  return (1);
+}
+
+
+/*
+ * 'write_lines()' - Write raster lines.
+ *
+ * Lines in the raster file set with OutputSetSource() are spliced from the
+ * file once the buffered commands have been written, when there are at least
+ * OUTPUT_SPLICE_MIN bytes of them.  If splice() fails the rest of the lines
+ * and everything after them are copied instead.
+ */
+
+static int				/* O - 1 on success, 0 on failure */
+write_lines(output_t            *out,	/* I - Output stream */
+            const unsigned char *data,	/* I - Lines */
+	    size_t              bytes)	/* I - Number of bytes */
+{
+#ifdef HAVE_SPLICE
+  loff_t	offset;			/* Offset in raster file */
+  ssize_t	spliced;		/* Bytes spliced */
+
+
+  if (out->source_fd < 0 || bytes < OUTPUT_SPLICE_MIN ||
+      data < out->source || data >= (out->source + out->source_size) ||
+      bytes > (size_t)(out->source + out->source_size - data))
+    return (OutputWrite(out, data, bytes));
+
+  if (!OutputFlush(out))
+    return (0);
+
+  offset = data - out->source;
+
+  while (bytes > 0)
+  {
+    TRACE_SCOPE("splice");
+
+    if ((spliced = splice(out->source_fd, &offset, out->fd, NULL, bytes,
+                          SPLICE_F_MOVE | SPLICE_F_MORE)) <= 0)
+    {
+      if (spliced < 0 && errno == EINTR)
+        continue;
+
+      out->source_fd = -1;
+      break;
+    }
+
+    out->bytes   += spliced;
+    out->spliced += spliced;
+    out->writes ++;
+
+    data  += spliced;
+    bytes -= (size_t)spliced;
+  }
+
+  if (bytes == 0)
+  {
+    out->last_flush = get_time();
+    return (1);
+  }
+#endif /* HAVE_SPLICE */
+
+  return (OutputWrite(out, data, bytes));
+}
@@ -0,0 +1,119 @@
+/*
+     File: output.h 
+ Abstract: Buffered output stream definitions for sample CUPS printer driver.
+  Version: 4.0 
+  
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple 
+ Inc. ("Apple") in consideration of your agreement to the following 
+ terms, and your use, installation, modification or redistribution of 
+ this Apple software constitutes acceptance of these terms.  If you do 
+ not agree with these terms, please do not use, install, modify or 
+ redistribute this Apple software. 
+  
+ In consideration of your agreement to abide by the following terms, and 
+ subject to these terms, Apple grants you a personal, non-exclusive 
+ license, under Apple's copyrights in this original Apple software (the 
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple 
+ Software, with or without modifications, in source and/or binary forms; 
+ provided that if you redistribute the Apple Software in its entirety and 
+ without modifications, you must retain this notice and the following 
+ text and disclaimers in all such redistributions of the Apple Software. 
+ Neither the name, trademarks, service marks or logos of Apple Inc. may 
+ be used to endorse or promote products derived from the Apple Software 
+ without specific prior written permission from Apple.  Except as 
+ expressly stated in this notice, no other rights or licenses, express or 
+ implied, are granted by Apple herein, including but not limited to any 
+ patent rights that may be infringed by your derivative works or by other 
+ works in which the Apple Software may be incorporated. 
+  
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE 
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION 
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS 
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND 
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS. 
+  
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL 
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, 
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED 
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), 
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE 
+ POSSIBILITY OF SUCH DAMAGE. 
+  
+ Copyright (C) 2011 Apple Inc. All Rights Reserved. 
+  
+ */  
+
+#ifndef _SAMPLE_OUTPUT_H_
+#  define _SAMPLE_OUTPUT_H_
+
+/*
+ * Include necessary headers...
+ */
+
+#  include "protocol.h"
+#  include <stddef.h>
+
+
+/*
+ * Default buffering policy...
+ */
+
+#  define OUTPUT_SIZE		262144	/* Buffer size in bytes */
+#  define OUTPUT_INTERVAL	0.1	/* Maximum time between flushes */
+#  define OUTPUT_SPLICE_MIN	16384	/* Smallest raster data worth splicing */
+
+
+/*
+ * Output stream data...
+ *
+ * Commands and raster data are collected in one page-aligned buffer and sent
+ * to the printer with writev(), either when the buffer fills up or when data
+ * has been waiting longer than the flush interval.  Commands the printer
+ * answers on the back-channel (LEVELS) or that the user is waiting on
+ * (CHANGEINK and CLEAN) are sent right away instead, since nothing more may
+ * be written for a while.
+ *
+ * On Linux, raster lines that are still in the mapped raster file are moved
+ * from the file to the printer pipe with splice() instead, once the commands
+ * before them have been written.  See OutputSetSource().
+ */
+
+typedef struct
+{
+  int		fd;			/* File descriptor */
+  unsigned char	*buffer;		/* Output buffer */
+  size_t	size,			/* Size of buffer */
+		used;			/* Bytes in buffer */
+  double	interval,		/* Maximum time between flushes */
+		last_flush;		/* Time of last flush */
+  int		source_fd;		/* Raster file to splice from or -1 */
+  const unsigned char *source;		/* Mapping of raster file */
+  size_t	source_size;		/* Size of mapping */
+  unsigned long	bytes,			/* Bytes written since last reset */
+		writes,			/* System calls since last reset */
+		spliced;		/* Bytes spliced since last reset */
+} output_t;
+
+
+/*
+ * Prototypes...
+ */
+
+extern output_t	*OutputCreate(int fd, size_t size, double interval);
+extern void	OutputDelete(output_t *out);
+extern int	OutputFlush(output_t *out);
+extern int	OutputPrintf(output_t *out, const char *format, ...)
+#  ifdef __GNUC__
+		__attribute__((format(printf, 2, 3)))
+#  endif /* __GNUC__ */
+		;
+extern int	OutputPuts(output_t *out, const char *s);
+extern void	OutputResetStats(output_t *out);
+extern int	OutputSetSource(output_t *out, int fd, const void *map,
+		                size_t size);
+extern void	OutputSink(output_t *out, protocol_sink_t *sink);
+extern int	OutputWrite(output_t *out, const void *data, size_t bytes);
+
+#endif /* !_SAMPLE_OUTPUT_H_ */
@@ -0,0 +1,800 @@
+/*
+     File: pagecache.c 
+ Abstract: Printer page cache for sample CUPS printer driver.
+  Version: 4.0 
+  
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple 
+ Inc. ("Apple") in consideration of your agreement to the following 
+ terms, and your use, installation, modification or redistribution of 
+ this Apple software constitutes acceptance of these terms.  If you do 
+ not agree with these terms, please do not use, install, modify or 
+ redistribute this Apple software. 
+  
+ In consideration of your agreement to abide by the following terms, and 
+ subject to these terms, Apple grants you a personal, non-exclusive 
+ license, under Apple's copyrights in this original Apple software (the 
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple 
+ Software, with or without modifications, in source and/or binary forms; 
+ provided that if you redistribute the Apple Software in its entirety and 
+ without modifications, you must retain this notice and the following 
+ text and disclaimers in all such redistributions of the Apple Software. 
+ Neither the name, trademarks, service marks or logos of Apple Inc. may 
+ be used to endorse or promote products derived from the Apple Software 
+ without specific prior written permission from Apple.  Except as 
+ expressly stated in this notice, no other rights or licenses, express or 
+ implied, are granted by Apple herein, including but not limited to any 
+ patent rights that may be infringed by your derivative works or by other 
+ works in which the Apple Software may be incorporated. 
+  
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE 
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION 
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS 
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND 
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS. 
+  
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL 
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, 
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED 
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), 
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE 
+ POSSIBILITY OF SUCH DAMAGE. 
+  
+ Copyright (C) 2011 Apple Inc. All Rights Reserved. 
+  
+ */  
+
+/*
+ * Include necessary headers...
+ */
+
+#include "sample.h"			/* Common driver definitions */
+#include "pagecache.h"			/* Page cache definitions */
+#include <ctype.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+
+/*
+ * Constants...
+ */
+
+#define TEMP_PREFIX	".page."	/* Prefix for temporary files */
+#define TEMP_AGE	3600		/* Seconds before temporary files are stale */
+
+#define PRIME1		UINT64_C(0x9e3779b185ebca87)
+#define PRIME2		UINT64_C(0xc2b2ae3d27d4eb4f)
+#define PRIME3		UINT64_C(0x165667b19e3779f9)
+#define PRIME4		UINT64_C(0x85ebca77c2b2ae63)
+#define PRIME5		UINT64_C(0x27d4eb2f165667c5)
+
+
+/*
+ * Local types...
+ */
+
+typedef struct
+{
+  char		key[PAGECACHE_KEY];	/* Key for page */
+  off_t		size;			/* Size of page */
+  time_t	mtime;			/* Time page was last used */
+} entry_t;
+
+
+/*
+ * Local functions...
+ */
+
+static int	compare_entries(const void *a, const void *b);
+static int	make_room(pagecache_t *pc, size_t bytes);
+static uint64_t	merge_lane(uint64_t hash, uint64_t lane);
+static int	pin_page(pagecache_t *pc, const char *key);
+static uint64_t	read64(const unsigned char *data);
+static int	remove_page(const char *filename);
+static uint64_t	round64(uint64_t lane, uint64_t input);
+static int	same_page(int fd, const void *data, size_t bytes);
+static int	store_page(pagecache_t *pc, const char *key);
+static int	valid_key(const char *key);
+
+
+/*
+ * 'PageCacheBegin()' - Start writing a page.
+ *
+ * The page's commands are written to the returned file, which is then given
+ * to PageCacheEnd().
+ */
+
+int					/* O - File for page or -1 on error */
+PageCacheBegin(pagecache_t *pc)		/* I - Page cache */
+{
+  PageCacheDone(pc);
+
+  if (snprintf(pc->temp, sizeof(pc->temp), "%s/" TEMP_PREFIX "XXXXXX",
+               pc->directory) >= (int)sizeof(pc->temp))
+  {
+    pc->temp[0] = '\0';
+    return (-1);
+  }
+
+  if ((pc->fd = mkstemp(pc->temp)) < 0)
+  {
+    LogDebug("Unable to create cached page: %s", strerror(errno));
+    pc->temp[0] = '\0';
+    return (-1);
+  }
+
+  fchmod(pc->fd, 0644);
+
+  return (pc->fd);
+}
+
+
+/*
+ * 'PageCacheCreate()' - Open the page cache for a printer.
+ */
+
+pagecache_t *				/* O - Page cache or NULL on error */
+PageCacheCreate(const char *printer,	/* I - Printer name */
+                size_t     limit)	/* I - Largest size of all cached pages */
+{
+  pagecache_t	*pc;			/* Page cache */
+  char		dirname[1024];		/* Printer directory */
+
+
+  if (!printer || !*printer || strchr(printer, '/') || limit == 0)
+    return (NULL);
+
+  if ((pc = calloc(1, sizeof(pagecache_t))) == NULL)
+    return (NULL);
+
+  pc->fd    = -1;
+  pc->limit = limit;
+
+ /*
+  * The cache lives with the printer's other files...
+  */
+
+  snprintf(dirname, sizeof(dirname), "/Library/Caches/%s", printer);
+  mkdir(dirname, 0755);
+
+  if (snprintf(pc->directory, sizeof(pc->directory), "%s/pages",
+               dirname) >= (int)sizeof(pc->directory))
+  {
+    free(pc);
+    return (NULL);
+  }
+
+  if (mkdir(pc->directory, 0755) && errno != EEXIST)
+  {
+    LogDebug("Unable to create page cache \"%s\": %s", pc->directory,
+             strerror(errno));
+    free(pc);
+    return (NULL);
+  }
+
+  return (pc);
+}
+
+
+/*
+ * 'PageCacheDelete()' - Close the page cache and unlock the pages in use.
+ */
+
+void
+PageCacheDelete(pagecache_t *pc)	/* I - Page cache */
+{
+  int	i;				/* Looping var */
+
+
+  if (!pc)
+    return;
+
+  PageCacheDone(pc);
+
+  for (i = 0; i < pc->num_pins; i ++)
+    close(pc->pins[i].fd);
+
+  free(pc);
+}
+
+
+/*
+ * 'PageCacheDone()' - Finish with the current page.
+ *
+ * The temporary file is removed; a page added to the cache keeps its other
+ * name.
+ */
+
+void
+PageCacheDone(pagecache_t *pc)		/* I - Page cache */
+{
+  if (pc->data)
+  {
+    munmap(pc->data, pc->bytes);
+    pc->data = NULL;
+  }
+
+  if (pc->fd >= 0)
+  {
+    close(pc->fd);
+    pc->fd = -1;
+  }
+
+  if (pc->temp[0])
+  {
+    unlink(pc->temp);
+    pc->temp[0] = '\0';
+  }
+
+  pc->bytes = 0;
+}
+
+
+/*
+ * 'PageCacheEnd()' - Hash a page and look it up in the cache.
+ *
+ * On a hit the printer already has the page and the caller sends
+ * "REPEATPAGE <key>".  Otherwise the caller sends the page in "data", which
+ * is added to the cache if it fits.  Either way "data" stays valid until
+ * PageCacheDone().
+ */
+
+int					/* O - 1 on hit, 0 on miss, -1 on error */
+PageCacheEnd(pagecache_t *pc,		/* I - Page cache */
+             char        *key,		/* O - Key for page */
+	     size_t      keysize)	/* I - Size of key buffer */
+{
+  struct stat	info;			/* Page file information */
+  void		*data;			/* Mapped page */
+
+
+  if (pc->fd < 0 || fstat(pc->fd, &info) || info.st_size == 0)
+    return (-1);
+
+  if ((data = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_SHARED, pc->fd,
+                   0)) == MAP_FAILED)
+    return (-1);
+
+  pc->data  = data;
+  pc->bytes = (size_t)info.st_size;
+
+  snprintf(key, keysize, "%016llx",
+           (unsigned long long)PageCacheHash(pc->data, pc->bytes));
+
+  if (pin_page(pc, key))
+  {
+    pc->hits ++;
+    pc->saved += pc->bytes;
+
+    return (1);
+  }
+
+  pc->misses ++;
+
+  store_page(pc, key);
+
+  return (0);
+}
+
+
+/*
+ * 'PageCacheHash()' - Compute the 64-bit hash of a page.
+ *
+ * This is XXH64 with a seed of 0, which hashes 32 bytes at a time in four
+ * independent lanes and runs at memory speed.  Words are read in little-
+ * endian order, so the filter and the printer must agree on it.
+ */
+
+uint64_t				/* O - Hash */
+PageCacheHash(const void *data,		/* I - Data */
+              size_t     bytes)		/* I - Bytes of data */
+{
+  const unsigned char	*ptr = (const unsigned char *)data,
+					/* Pointer into data */
+			*end = ptr + bytes;
+					/* End of data */
+  uint64_t		hash,		/* Hash */
+			lanes[4];	/* Lanes for large data */
+
+
+  if (bytes >= 32)
+  {
+    lanes[0] = PRIME1 + PRIME2;
+    lanes[1] = PRIME2;
+    lanes[2] = 0;
+    lanes[3] = -PRIME1;
+
+    for (; (end - ptr) >= 32; ptr += 32)
+    {
+      lanes[0] = round64(lanes[0], read64(ptr));
+      lanes[1] = round64(lanes[1], read64(ptr + 8));
+      lanes[2] = round64(lanes[2], read64(ptr + 16));
+      lanes[3] = round64(lanes[3], read64(ptr + 24));
+    }
+
+    hash = ((lanes[0] << 1) | (lanes[0] >> 63)) +
+           ((lanes[1] << 7) | (lanes[1] >> 57)) +
+           ((lanes[2] << 12) | (lanes[2] >> 52)) +
+           ((lanes[3] << 18) | (lanes[3] >> 46));
+
+    hash = merge_lane(hash, lanes[0]);
+    hash = merge_lane(hash, lanes[1]);
+    hash = merge_lane(hash, lanes[2]);
+    hash = merge_lane(hash, lanes[3]);
+  }
+  else
+    hash = PRIME5;
+
+  hash += (uint64_t)bytes;
+
+ /*
+  * Then the last 0 to 31 bytes...
+  */
+
+  for (; (end - ptr) >= 8; ptr += 8)
+  {
+    hash ^= round64(0, read64(ptr));
+    hash = ((hash << 27) | (hash >> 37)) * PRIME1 + PRIME4;
+  }
+
+  if ((end - ptr) >= 4)
+  {
+    hash ^= (uint64_t)(ptr[0] | (ptr[1] << 8) | (ptr[2] << 16) |
+                       ((uint32_t)ptr[3] << 24)) * PRIME1;
+    hash = ((hash << 23) | (hash >> 41)) * PRIME2 + PRIME3;
+    ptr  += 4;
+  }
+
+  for (; ptr < end; ptr ++)
+  {
+    hash ^= *ptr * PRIME5;
+    hash = ((hash << 11) | (hash >> 53)) * PRIME1;
+  }
+
+ /*
+  * Mix the bits so that every input bit affects every output bit...
+  */
+
+  hash ^= hash >> 33;
+  hash *= PRIME2;
+  hash ^= hash >> 29;
+  hash *= PRIME3;
+  hash ^= hash >> 32;
+
+  return (hash);
+}
+
+
+/*
+ * 'PageCacheKeep()' - Keep the pages in use after the job.
+ *
+ * The locks on the pages go away with the filter, so when the printer may
+ * not have read them yet they are marked as used PAGECACHE_KEEP seconds from
+ * now, which make_room() leaves alone until then.
+ */
+
+void
+PageCacheKeep(pagecache_t *pc)		/* I - Page cache */
+{
+  int		i;			/* Looping var */
+  struct timeval times[2];		/* Access and modification times */
+
+
+  gettimeofday(times, NULL);
+
+  times[0].tv_sec  += PAGECACHE_KEEP;
+  times[0].tv_usec = 0;
+  times[1]         = times[0];
+
+  for (i = 0; i < pc->num_pins; i ++)
+    futimes(pc->pins[i].fd, times);
+}
+
+
+/*
+ * 'PageCacheOpen()' - Open a cached page for the printer.
+ *
+ * The page is locked like a page the filter has repeated until the file is
+ * closed, and is only returned if its contents still have the key's hash.
+ */
+
+int					/* O - File descriptor or -1 on error */
+PageCacheOpen(const char *printer,	/* I - Printer name */
+              const char *key)		/* I - Key for page */
+{
+  char		filename[1024];		/* Cached page */
+  int		fd;			/* Cached page */
+  struct stat	info;			/* File information */
+  void		*data;			/* Mapped page */
+  uint64_t	hash;			/* Hash of page */
+
+
+  if (!printer || strchr(printer, '/') || !valid_key(key))
+  {
+    errno = EINVAL;
+    return (-1);
+  }
+
+  if (snprintf(filename, sizeof(filename), "/Library/Caches/%s/pages/%s",
+               printer, key) >= (int)sizeof(filename))
+  {
+    errno = ENAMETOOLONG;
+    return (-1);
+  }
+
+  if ((fd = open(filename, O_RDONLY)) < 0)
+    return (-1);
+
+  if (flock(fd, LOCK_SH) || fstat(fd, &info))
+  {
+    close(fd);
+    return (-1);
+  }
+
+  if (info.st_size == 0 ||
+      (data = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_SHARED, fd,
+                   0)) == MAP_FAILED)
+  {
+    close(fd);
+    errno = EIO;
+    return (-1);
+  }
+
+  hash = PageCacheHash(data, (size_t)info.st_size);
+
+  munmap(data, (size_t)info.st_size);
+
+  if (hash != strtoull(key, NULL, 16))
+  {
+    close(fd);
+    errno = EIO;
+    return (-1);
+  }
+
+  return (fd);
+}
+
+
+/*
+ * 'compare_entries()' - Compare the last use of two cached pages.
+ */
+
+static int				/* O - Result of comparison */
+compare_entries(const void *a,		/* I - First page */
+                const void *b)		/* I - Second page */
+{
+  time_t	atime = ((const entry_t *)a)->mtime,
+					/* First time */
+		btime = ((const entry_t *)b)->mtime;
+					/* Second time */
+
+
+  return (atime < btime ? -1 : atime > btime);
+}
+
+
+/*
+ * 'make_room()' - Remove the least recently used pages until a new page
+ *                 fits under the limit.
+ *
+ * The caller holds the cache lock.  Pages that another job has locked or
+ * kept with PageCacheKeep() are skipped, as are temporary files, except that
+ * temporary files left behind by a crashed filter are removed after an hour.
+ */
+
+static int				/* O - 1 if the page fits, 0 otherwise */
+make_room(pagecache_t *pc,		/* I - Page cache */
+          size_t      bytes)		/* I - Size of new page */
+{
+  DIR		*dir;			/* Cache directory */
+  struct dirent	*dent;			/* Directory entry */
+  struct stat	info;			/* File information */
+  char		filename[1024];		/* Cached page */
+  entry_t	*entries = NULL,	/* Cached pages */
+		*temp;			/* New array */
+  int		num_entries = 0,	/* Number of cached pages */
+		alloc_entries = 0,	/* Allocated cached pages */
+		i;			/* Looping var */
+  uint64_t	total = 0;		/* Total size of cached pages */
+  time_t	now = time(NULL),	/* Current time */
+		stale = now - TEMP_AGE;	/* Time when temporary files are stale */
+
+
+  if ((dir = opendir(pc->directory)) == NULL)
+    return (0);
+
+  while ((dent = readdir(dir)) != NULL)
+  {
+    if (snprintf(filename, sizeof(filename), "%s/%s", pc->directory,
+                 dent->d_name) >= (int)sizeof(filename))
+      continue;
+
+    if (!strncmp(dent->d_name, TEMP_PREFIX, sizeof(TEMP_PREFIX) - 1))
+    {
+      if (!stat(filename, &info) && info.st_mtime < stale)
+        unlink(filename);
+
+      continue;
+    }
+
+    if (!valid_key(dent->d_name) || stat(filename, &info))
+      continue;
+
+    if (num_entries >= alloc_entries)
+    {
+      if ((temp = realloc(entries, (size_t)(alloc_entries + 64) * sizeof(entry_t))) == NULL)
+        break;
+
+      entries       = temp;
+      alloc_entries += 64;
+    }
+
+    memcpy(entries[num_entries].key, dent->d_name, PAGECACHE_KEY);
+    entries[num_entries].size  = info.st_size;
+    entries[num_entries].mtime = info.st_mtime;
+    num_entries ++;
+
+    total += (uint64_t)info.st_size;
+  }
+
+  closedir(dir);
+
+  if ((total + bytes) > pc->limit && num_entries > 0)
+  {
+    qsort(entries, (size_t)num_entries, sizeof(entry_t), compare_entries);
+
+    for (i = 0; i < num_entries && (total + bytes) > pc->limit; i ++)
+    {
+      if (entries[i].mtime > now)
+        break;				/* Kept pages sort last */
+
+      if (snprintf(filename, sizeof(filename), "%s/%s", pc->directory,
+                   entries[i].key) >= (int)sizeof(filename))
+        continue;
+
+      if (remove_page(filename))
+      {
+        LogDebug("Removed cached page %s.", entries[i].key);
+	total -= (uint64_t)entries[i].size;
+      }
+    }
+  }
+
+  free(entries);
+
+  return ((total + bytes) <= pc->limit);
+}
+
+
+/*
+ * 'merge_lane()' - Merge a lane into the hash.
+ */
+
+static uint64_t				/* O - New hash */
+merge_lane(uint64_t hash,		/* I - Hash */
+           uint64_t lane)		/* I - Lane */
+{
+  hash ^= round64(0, lane);
+
+  return (hash * PRIME1 + PRIME4);
+}
+
+
+/*
+ * 'pin_page()' - Lock a cached page for the rest of the job.
+ *
+ * The page is also marked as used now.  A page that was removed or whose
+ * contents differ from the current page (a hash collision or a damaged
+ * file) can't be used.
+ */
+
+static int				/* O - 1 on success, 0 on failure */
+pin_page(pagecache_t *pc,		/* I - Page cache */
+         const char  *key)		/* I - Key for page */
+{
+  int		i,			/* Looping var */
+		fd;			/* Cached page */
+  char		filename[1024];		/* Cached page filename */
+  struct stat	info;			/* File information */
+
+
+  for (i = 0; i < pc->num_pins; i ++)
+    if (!strcmp(pc->pins[i].key, key))
+    {
+      if (!same_page(pc->pins[i].fd, pc->data, pc->bytes))
+        return (0);
+
+      futimes(pc->pins[i].fd, NULL);
+      return (1);
+    }
+
+  if (pc->num_pins >= PAGECACHE_PINS)
+    return (0);
+
+  if (snprintf(filename, sizeof(filename), "%s/%s", pc->directory,
+               key) >= (int)sizeof(filename) ||
+      (fd = open(filename, O_RDONLY)) < 0)
+    return (0);
+
+ /*
+  * A page that was removed before we got the lock has no links left...
+  */
+
+  if (flock(fd, LOCK_SH) || fstat(fd, &info) || info.st_nlink == 0 ||
+      !same_page(fd, pc->data, pc->bytes))
+  {
+    close(fd);
+    return (0);
+  }
+
+  futimes(fd, NULL);
+
+  pc->pins[pc->num_pins].fd = fd;
+  snprintf(pc->pins[pc->num_pins].key, sizeof(pc->pins[0].key), "%s", key);
+  pc->num_pins ++;
+
+  return (1);
+}
+
+
+/*
+ * 'read64()' - Read a little-endian 64-bit word.
+ */
+
+static uint64_t				/* O - Word */
+read64(const unsigned char *data)	/* I - Data */
+{
+  uint64_t	word;			/* Word */
+
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  memcpy(&word, data, 8);
+#else
+  word = (uint64_t)data[0] | ((uint64_t)data[1] << 8) |
+         ((uint64_t)data[2] << 16) | ((uint64_t)data[3] << 24) |
+         ((uint64_t)data[4] << 32) | ((uint64_t)data[5] << 40) |
+         ((uint64_t)data[6] << 48) | ((uint64_t)data[7] << 56);
+#endif /* __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__ */
+
+  return (word);
+}
+
+
+/*
+ * 'remove_page()' - Remove a cached page nobody has locked.
+ *
+ * The caller holds the cache lock.
+ */
+
+static int				/* O - 1 if removed, 0 otherwise */
+remove_page(const char *filename)	/* I - Cached page */
+{
+  int	fd,				/* Cached page */
+	status;				/* Return status */
+
+
+  if ((fd = open(filename, O_RDONLY)) < 0)
+    return (0);
+
+  status = !flock(fd, LOCK_EX | LOCK_NB) && !unlink(filename);
+
+  close(fd);
+
+  return (status);
+}
+
+
+/*
+ * 'round64()' - Add a word to a lane.
+ */
+
+static uint64_t				/* O - New lane */
+round64(uint64_t lane,			/* I - Lane */
+        uint64_t input)			/* I - Word */
+{
+  lane += input * PRIME2;
+  lane = (lane << 31) | (lane >> 33);
+
+  return (lane * PRIME1);
+}
+
+
+/*
+ * 'same_page()' - Compare a cached page with the current page.
+ */
+
+static int				/* O - 1 if the same, 0 otherwise */
+same_page(int        fd,		/* I - Cached page */
+          const void *data,		/* I - Current page */
+	  size_t     bytes)		/* I - Size of current page */
+{
+  struct stat	info;			/* File information */
+  void		*cached;		/* Mapped cached page */
+  int		same;			/* Same contents? */
+
+
+  if (fstat(fd, &info) || (size_t)info.st_size != bytes || bytes == 0)
+    return (0);
+
+  if ((cached = mmap(NULL, bytes, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED)
+    return (0);
+
+  same = !memcmp(cached, data, bytes);
+
+  munmap(cached, bytes);
+
+  return (same);
+}
+
+
+/*
+ * 'store_page()' - Add the current page to the cache.
+ *
+ * The temporary file gets a second name, the key, once there is room for
+ * it.  A page that is already there under that name didn't match the
+ * current page, so it is replaced unless another job has it locked.
+ */
+
+static int				/* O - 1 on success, 0 on failure */
+store_page(pagecache_t *pc,		/* I - Page cache */
+           const char  *key)		/* I - Key for page */
+{
+  char		filename[1024];		/* Cached page or lock file */
+  int		lockfd,			/* Lock file */
+		status = 0;		/* Return status */
+
+
+  if (pc->bytes > pc->limit || !pc->temp[0])
+    return (0);
+
+ /*
+  * Only one job at a time can add pages, so that the limit holds...
+  */
+
+  if (snprintf(filename, sizeof(filename), "%s/.lock",
+               pc->directory) >= (int)sizeof(filename) ||
+      (lockfd = open(filename, O_RDWR | O_CREAT, 0644)) < 0)
+    return (0);
+
+  if (!flock(lockfd, LOCK_EX) && make_room(pc, pc->bytes) &&
+      snprintf(filename, sizeof(filename), "%s/%s", pc->directory,
+               key) < (int)sizeof(filename))
+  {
+    if (!link(pc->temp, filename))
+      status = 1;
+    else if (errno == EEXIST && remove_page(filename) &&
+             !link(pc->temp, filename))
+      status = 1;			/* Replaced a damaged copy */
+    else
+      LogDebug("Unable to add cached page %s: %s", key, strerror(errno));
+  }
+
+  close(lockfd);
+
+  return (status);
+}
+
+
+/*
+ * 'valid_key()' - Check that a key is 16 hex digits.
+ */
+
+static int				/* O - 1 if valid, 0 otherwise */
+valid_key(const char *key)		/* I - Key */
+{
+  int	i;				/* Looping var */
+
+
+  for (i = 0; i < (PAGECACHE_KEY - 1); i ++)
+    if (!isxdigit(key[i] & 255))
+      return (0);
+
+  return (key[i] == '\0');
+}
@@ -0,0 +1,124 @@
+/*
+     File: pagecache.h 
+ Abstract: Printer page cache definitions for sample CUPS printer driver.
+  Version: 4.0 
+  
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple 
+ Inc. ("Apple") in consideration of your agreement to the following 
+ terms, and your use, installation, modification or redistribution of 
+ this Apple software constitutes acceptance of these terms.  If you do 
+ not agree with these terms, please do not use, install, modify or 
+ redistribute this Apple software. 
+  
+ In consideration of your agreement to abide by the following terms, and 
+ subject to these terms, Apple grants you a personal, non-exclusive 
+ license, under Apple's copyrights in this original Apple software (the 
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple 
+ Software, with or without modifications, in source and/or binary forms; 
+ provided that if you redistribute the Apple Software in its entirety and 
+ without modifications, you must retain this notice and the following 
+ text and disclaimers in all such redistributions of the Apple Software. 
+ Neither the name, trademarks, service marks or logos of Apple Inc. may 
+ be used to endorse or promote products derived from the Apple Software 
+ without specific prior written permission from Apple.  Except as 
+ expressly stated in this notice, no other rights or licenses, express or 
+ implied, are granted by Apple herein, including but not limited to any 
+ patent rights that may be infringed by your derivative works or by other 
+ works in which the Apple Software may be incorporated. 
+  
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE 
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION 
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS 
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND 
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS. 
+  
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL 
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, 
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED 
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), 
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE 
+ POSSIBILITY OF SUCH DAMAGE. 
+  
+ Copyright (C) 2011 Apple Inc. All Rights Reserved. 
+  
+ */  
+
+#ifndef _SAMPLE_PAGECACHE_H_
+#  define _SAMPLE_PAGECACHE_H_
+
+/*
+ * Include necessary headers...
+ */
+
+#  include <stddef.h>
+#  include <stdint.h>
+
+
+/*
+ * Page cache constants...
+ */
+
+#  define PAGECACHE_KEY		17	/* Size of a page key string */
+#  define PAGECACHE_PINS	256	/* Most cached pages in use by a job */
+#  define PAGECACHE_KEEP	3600	/* Seconds to keep pages the printer may not have read */
+
+
+/*
+ * Page cache data...
+ *
+ * The sample printer keeps the pages it has printed in
+ * "/Library/Caches/<printer>/pages", each named for the 64-bit hash of its
+ * commands and raster data.  The filter writes each page to a temporary
+ * file there first; when the printer already has a page with the same hash
+ * the filter sends "REPEATPAGE <key>" instead of the page, otherwise it
+ * sends the page and adds it to the cache.
+ *
+ * The total size of the cached pages is kept under a limit by removing the
+ * least recently used pages, with a lock file so that jobs running at the
+ * same time take turns.  Pages a job has repeated are locked with flock()
+ * until the printer has answered a LEVELS command sent after them, so
+ * nobody removes them before the printer has read them.  If the printer
+ * doesn't answer in time, the pages are marked as used an hour from now
+ * instead and aren't removed until then.  The printer locks each page while
+ * it reads it and checks that the page still has its hash.
+ */
+
+typedef struct
+{
+  int		fd;			/* Cached page */
+  char		key[PAGECACHE_KEY];	/* Key for page */
+} pagecache_pin_t;
+
+typedef struct
+{
+  char		directory[1024],	/* Cache directory */
+		temp[1024];		/* Temporary file for current page */
+  size_t	limit;			/* Largest size of all cached pages */
+  int		fd;			/* Temporary file or -1 */
+  unsigned char	*data;			/* Mapped page or NULL */
+  size_t	bytes;			/* Size of page */
+  pagecache_pin_t pins[PAGECACHE_PINS];	/* Cached pages in use */
+  int		num_pins;		/* Number of pages in use */
+  unsigned	hits,			/* Pages repeated from the cache */
+		misses;			/* Pages sent */
+  uint64_t	saved;			/* Bytes not sent */
+} pagecache_t;
+
+
+/*
+ * Prototypes...
+ */
+
+extern int		PageCacheBegin(pagecache_t *pc);
+extern pagecache_t	*PageCacheCreate(const char *printer, size_t limit);
+extern void		PageCacheDelete(pagecache_t *pc);
+extern void		PageCacheDone(pagecache_t *pc);
+extern int		PageCacheEnd(pagecache_t *pc, char *key,
+			             size_t keysize);
+extern uint64_t		PageCacheHash(const void *data, size_t bytes);
+extern void		PageCacheKeep(pagecache_t *pc);
+extern int		PageCacheOpen(const char *printer, const char *key);
+
+#endif /* !_SAMPLE_PAGECACHE_H_ */
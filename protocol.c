@@ -0,0 +1,579 @@
+/*
+     File: protocol.c 
+ Abstract: Sample printer protocol for sample CUPS printer driver.
+  Version: 4.0 
+  
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple 
+ Inc. ("Apple") in consideration of your agreement to the following 
+ terms, and your use, installation, modification or redistribution of 
+ this Apple software constitutes acceptance of these terms.  If you do 
+ not agree with these terms, please do not use, install, modify or 
+ redistribute this Apple software. 
+  
+ In consideration of your agreement to abide by the following terms, and 
+ subject to these terms, Apple grants you a personal, non-exclusive 
+ license, under Apple's copyrights in this original Apple software (the 
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple 
+ Software, with or without modifications, in source and/or binary forms; 
+ provided that if you redistribute the Apple Software in its entirety and 
+ without modifications, you must retain this notice and the following 
+ text and disclaimers in all such redistributions of the Apple Software. 
+ Neither the name, trademarks, service marks or logos of Apple Inc. may 
+ be used to endorse or promote products derived from the Apple Software 
+ without specific prior written permission from Apple.  Except as 
+ expressly stated in this notice, no other rights or licenses, express or 
+ implied, are granted by Apple herein, including but not limited to any 
+ patent rights that may be infringed by your derivative works or by other 
+ works in which the Apple Software may be incorporated. 
+  
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE 
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION 
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS 
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND 
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS. 
+  
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL 
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, 
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED 
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), 
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE 
+ POSSIBILITY OF SUCH DAMAGE. 
+  
+ Copyright (C) 2011 Apple Inc. All Rights Reserved. 
+  
+ */  
+
+/*
+ * Include necessary headers...
+ */
+
+#include "protocol.h"			/* Sample printer protocol definitions */
+#include "codec.h"			/* Raster data encodings */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+
+/*
+ * Constants...
+ */
+
+#define READ_SIZE	65536		/* Bytes to read at a time */
+#define READ_MAX	67108864	/* Largest raster data kept in memory */
+
+
+/*
+ * Local types...
+ */
+
+typedef struct
+{
+  const char		*name;		/* Command name */
+  protocol_command_t	command;	/* Command */
+} command_t;
+
+typedef struct
+{
+  int			fd;		/* File to read from */
+  unsigned char		*buffer;	/* Read buffer */
+  size_t		size,		/* Size of buffer */
+			pos,		/* Position of unread data */
+			len;		/* End of unread data */
+  uint64_t		total;		/* Total bytes read */
+} reader_t;
+
+
+/*
+ * Local globals...
+ */
+
+static const command_t commands[] =
+{					/* Commands, sorted by name */
+  { "AUTHOR",      PROTOCOL_AUTHOR },
+  { "BAND",        PROTOCOL_BAND },
+  { "CHANGEINK",   PROTOCOL_CHANGEINK },
+  { "CLEAN",       PROTOCOL_CLEAN },
+  { "COPIES",      PROTOCOL_COPIES },
+  { "DOCUMENT",    PROTOCOL_DOCUMENT },
+  { "ENDDOCUMENT", PROTOCOL_ENDDOCUMENT },
+  { "ENDPAGE",     PROTOCOL_ENDPAGE },
+  { "HALFTONE",    PROTOCOL_HALFTONE },
+  { "LEVELS",      PROTOCOL_LEVELS },
+  { "LINE",        PROTOCOL_LINE },
+  { "PAGE",        PROTOCOL_PAGE },
+  { "RASTER",      PROTOCOL_RASTER },
+  { "REPEATPAGE",  PROTOCOL_REPEATPAGE },
+  { "SKIP",        PROTOCOL_SKIP },
+  { "SPAN",        PROTOCOL_SPAN },
+  { "TITLE",       PROTOCOL_TITLE }
+};
+
+
+/*
+ * Local functions...
+ */
+
+static int	compare_commands(const void *a, const void *b);
+static const unsigned char *read_data(reader_t *r, size_t bytes);
+static int	read_line(reader_t *r, char *line, size_t linesize);
+
+
+/*
+ * 'ProtocolCommand()' - Look up a command name.
+ */
+
+protocol_command_t			/* O - Command or PROTOCOL_UNKNOWN */
+ProtocolCommand(const char *name)	/* I - Command name */
+{
+  command_t	key,			/* Search key */
+		*match;			/* Matching command */
+
+
+  key.name = name;
+
+  if ((match = bsearch(&key, commands, sizeof(commands) / sizeof(commands[0]),
+                       sizeof(commands[0]), compare_commands)) == NULL)
+    return (PROTOCOL_UNKNOWN);
+
+  return (match->command);
+}
+
+
+/*
+ * 'ProtocolRead()' - Read a stream of commands and send them to a sink.
+ *
+ * Lines and bands are passed to the sink straight from the read buffer.
+ * AUTHOR and TITLE are collected and passed with the DOCUMENT that they
+ * follow.
+ */
+
+uint64_t				/* O - Bytes read */
+ProtocolRead(int             fd,	/* I - File to read from */
+             protocol_sink_t *sink)	/* I - Sink for commands */
+{
+  reader_t		r;		/* Reader */
+  char			line[1024],	/* Command line */
+			*value,		/* Value after command */
+			author[256],	/* AUTHOR value */
+			title[256],	/* TITLE value */
+			encoding[32];	/* Raster data encoding */
+  int			document = 0;	/* DOCUMENT waiting to be sent? */
+  protocol_command_t	command;	/* Current command */
+  unsigned		x, y,		/* Position */
+			width, height,	/* Size */
+			count,		/* Number of lines */
+			i;		/* Looping var */
+  size_t		bytes;		/* Bytes of raster data */
+  int			codec;		/* Raster data encoding */
+  const unsigned char	*data,		/* Raster data */
+			**lines = NULL;	/* Lines in raw band */
+  unsigned		alloc_lines = 0;/* Allocated line pointers */
+
+
+  memset(&r, 0, sizeof(r));
+  r.fd = fd;
+
+  author[0] = title[0] = '\0';
+
+  while (read_line(&r, line, sizeof(line)))
+  {
+    if (!line[0] || line[0] == '#')
+      continue;
+
+    if ((value = strchr(line, ' ')) != NULL)
+    {
+      *value++ = '\0';
+
+      while (*value == ' ' || *value == '\t')
+        value ++;
+
+      if (!*value)
+        value = NULL;
+    }
+
+    command = ProtocolCommand(line);
+
+    if (document && command != PROTOCOL_AUTHOR && command != PROTOCOL_TITLE)
+    {
+      if (sink->begin_document)
+        (sink->begin_document)(sink->data, author, title);
+
+      document = 0;
+    }
+
+    switch (command)
+    {
+      case PROTOCOL_DOCUMENT :
+          document  = 1;
+	  author[0] = title[0] = '\0';
+          break;
+
+      case PROTOCOL_AUTHOR :
+          if (document && value)
+	    snprintf(author, sizeof(author), "%s", value);
+          break;
+
+      case PROTOCOL_TITLE :
+          if (document && value)
+	    snprintf(title, sizeof(title), "%s", value);
+          break;
+
+      case PROTOCOL_ENDDOCUMENT :
+          if (sink->end_document)
+	    (sink->end_document)(sink->data);
+          break;
+
+      case PROTOCOL_PAGE :
+          if (value && sscanf(value, "%u%u%u%u", &x, &y, &width, &height) == 4 &&
+	      sink->begin_page)
+	    (sink->begin_page)(sink->data, x, y, width, height);
+          break;
+
+      case PROTOCOL_RASTER :
+          if (value && sscanf(value, "%u%u%u", &width, &height, &count) == 3 &&
+	      sink->begin_raster)
+	    (sink->begin_raster)(sink->data, width, height, count);
+          break;
+
+      case PROTOCOL_COPIES :
+          x = 0;
+
+          if (value && sscanf(value, "%u%u", &count, &x) >= 1 &&
+	      sink->set_copies)
+	    (sink->set_copies)(sink->data, count, x != 0);
+          break;
+
+      case PROTOCOL_HALFTONE :
+          if (value && sink->set_halftone)
+	    (sink->set_halftone)(sink->data, (unsigned)strtoul(value, NULL, 10));
+          break;
+
+      case PROTOCOL_LINE :
+      case PROTOCOL_BAND :
+          encoding[0] = '\0';
+
+          if (!value)
+	    break;
+	  else if (command == PROTOCOL_LINE)
+	  {
+	    if (sscanf(value, "%zu%31s", &bytes, encoding) < 1)
+	      break;
+
+	    y     = 0;
+	    count = 1;
+	  }
+	  else if (sscanf(value, "%u%u%zu%31s", &y, &count, &bytes,
+	                  encoding) < 3)
+	    break;
+
+          if ((data = read_data(&r, bytes)) == NULL || count == 0)
+	    break;
+
+	  if (encoding[0] && (codec = CodecValue(encoding)) != CODEC_RAW)
+	  {
+	    if (sink->put_encoded)
+	      (sink->put_encoded)(sink->data,
+	                          command == PROTOCOL_LINE ? -1 : (int)y,
+				  count, codec, data, bytes);
+	    break;
+	  }
+
+	 /*
+	  * Point at each raw line in the read buffer...
+	  */
+
+          if (count > alloc_lines)
+	  {
+	    const unsigned char **temp;	/* New line pointers */
+
+	    if ((temp = realloc(lines, count * sizeof(unsigned char *))) == NULL)
+	      break;
+
+	    lines       = temp;
+	    alloc_lines = count;
+	  }
+
+	  for (i = 0; i < count; i ++)
+	    lines[i] = data + i * (bytes / count);
+
+	  if (sink->put_lines)
+	    (sink->put_lines)(sink->data, command == PROTOCOL_LINE ? -1 : (int)y,
+	                      count, lines, bytes / count);
+          break;
+
+      case PROTOCOL_SPAN :
+          if (!value || sscanf(value, "%u%zu", &x, &bytes) != 2)
+	    break;
+
+          if ((data = read_data(&r, bytes)) != NULL && sink->put_span)
+	    (sink->put_span)(sink->data, x, data, bytes);
+          break;
+
+      case PROTOCOL_SKIP :
+          if (value && sink->skip_lines)
+	    (sink->skip_lines)(sink->data, (unsigned)strtoul(value, NULL, 10));
+          break;
+
+      case PROTOCOL_ENDPAGE :
+          if (sink->end_page)
+	    (sink->end_page)(sink->data);
+          break;
+
+      case PROTOCOL_REPEATPAGE :
+          if (value && sink->repeat_page)
+	    (sink->repeat_page)(sink->data, value);
+          break;
+
+      case PROTOCOL_LEVELS :
+          if (sink->get_levels)
+	    (sink->get_levels)(sink->data);
+          break;
+
+      case PROTOCOL_CHANGEINK :
+      case PROTOCOL_CLEAN :
+          if (sink->maintain)
+	    (sink->maintain)(sink->data, command, value);
+          break;
+
+      default :
+          break;
+    }
+  }
+
+  if (document && sink->begin_document)
+    (sink->begin_document)(sink->data, author, title);
+
+  free(lines);
+  free(r.buffer);
+
+  return (r.total);
+}
+
+
+/*
+ * 'ProtocolSelfTestLine()' - Build a line of the self-test page.
+ *
+ * The self-test page prints a common head test pattern for each color like
+ * this:
+ *
+ * |----            |
+ * |    ----        |
+ * |        ----    |
+ * |            ----|
+ * |----            |
+ * |    ----        |
+ * |        ----    |
+ * |            ----|
+ */
+
+void
+ProtocolSelfTestLine(
+    unsigned char *data,		/* O - PROTOCOL_SELFTEST_WIDTH RGB pixels */
+    int           y)			/* I - Line on page */
+{
+  int		color,			/* Current color */
+		pass;			/* Current pass */
+  unsigned char	*dataptr;		/* Pointer into line */
+  static const unsigned char colors[4][3] =
+		{			/* Colors for each "ink" */
+		  { 0, 0, 0 },		/* Black */
+		  { 0, 255, 255 },	/* Cyan */
+		  { 255, 0, 255 },	/* Magenta */
+		  { 255, 255, 0 }	/* Yellow */
+		};
+
+
+ /*
+  * Clear the line...
+  */
+
+  memset(data, 255, PROTOCOL_SELFTEST_WIDTH * 3);
+
+ /*
+  * Add each color...
+  */
+
+  for (color = 0, pass = y & 7; color < 4; color ++)
+  {
+    dataptr = data + color * 96 * 3;
+
+    memcpy(dataptr + 0 * 3, colors[color], 3);
+    memcpy(dataptr + 71 * 3, colors[color], 3);
+
+    dataptr += pass * 9 * 3;
+    memcpy(dataptr + 0 * 3, colors[color], 3);
+    memcpy(dataptr + 1 * 3, colors[color], 3);
+    memcpy(dataptr + 2 * 3, colors[color], 3);
+    memcpy(dataptr + 3 * 3, colors[color], 3);
+    memcpy(dataptr + 4 * 3, colors[color], 3);
+    memcpy(dataptr + 5 * 3, colors[color], 3);
+    memcpy(dataptr + 6 * 3, colors[color], 3);
+    memcpy(dataptr + 7 * 3, colors[color], 3);
+    memcpy(dataptr + 8 * 3, colors[color], 3);
+  }
+}
+
+
+/*
+ * 'compare_commands()' - Compare two command names.
+ */
+
+static int				/* O - Result of comparison */
+compare_commands(const void *a,		/* I - First command */
+                 const void *b)		/* I - Second command */
+{
+  return (strcmp(((const command_t *)a)->name, ((const command_t *)b)->name));
+}
+
+
+/*
+ * 'read_data()' - Read raster data into the read buffer.
+ *
+ * The data is returned in one piece, growing the buffer as needed.  Data
+ * over READ_MAX bytes is skipped.
+ */
+
+static const unsigned char *		/* O - Data or NULL on error */
+read_data(reader_t *r,			/* I - Reader */
+          size_t   bytes)		/* I - Bytes to read */
+{
+  unsigned char	*temp;			/* New buffer */
+  size_t	size;			/* New buffer size */
+  ssize_t	rbytes;			/* Bytes read */
+  const unsigned char *data;		/* Data */
+
+
+  if (bytes > READ_MAX)
+  {
+   /*
+    * Too big, skip it...
+    */
+
+    while (bytes > 0)
+    {
+      if (r->pos >= r->len)
+      {
+        while ((rbytes = read(r->fd, r->buffer, r->size)) < 0 &&
+	       (errno == EINTR || errno == EAGAIN));
+
+        if (rbytes <= 0)
+	  break;
+
+        r->pos   = 0;
+	r->len   = (size_t)rbytes;
+	r->total += (uint64_t)rbytes;
+      }
+
+      size   = r->len - r->pos < bytes ? r->len - r->pos : bytes;
+      r->pos += size;
+      bytes  -= size;
+    }
+
+    return (NULL);
+  }
+
+  if ((r->len - r->pos) < bytes)
+  {
+   /*
+    * Move the unread data to the front of the buffer and make room for the
+    * rest...
+    */
+
+    if (bytes > r->size)
+    {
+      for (size = r->size; size < bytes; size *= 2);
+
+      if ((temp = realloc(r->buffer, size)) == NULL)
+        return (NULL);
+
+      r->buffer = temp;
+      r->size   = size;
+    }
+
+    memmove(r->buffer, r->buffer + r->pos, r->len - r->pos);
+    r->len -= r->pos;
+    r->pos = 0;
+
+    while (r->len < bytes)
+    {
+      while ((rbytes = read(r->fd, r->buffer + r->len, r->size - r->len)) < 0 &&
+             (errno == EINTR || errno == EAGAIN));
+
+      if (rbytes <= 0)
+        return (NULL);
+
+      r->len   += (size_t)rbytes;
+      r->total += (uint64_t)rbytes;
+    }
+  }
+
+  data   = r->buffer + r->pos;
+  r->pos += bytes;
+
+  return (data);
+}
+
+
+/*
+ * 'read_line()' - Read a command line.
+ */
+
+static int				/* O - 1 on success, 0 on end-of-file */
+read_line(reader_t *r,			/* I - Reader */
+          char     *line,		/* O - Line */
+	  size_t   linesize)		/* I - Size of line buffer */
+{
+  char		*ptr = line,		/* Pointer into line */
+		*end = line + linesize - 1;
+					/* End of line buffer */
+  int		ch;			/* Current character */
+  ssize_t	rbytes;			/* Bytes read */
+
+
+  if (!r->buffer)
+  {
+    if ((r->buffer = malloc(READ_SIZE)) == NULL)
+      return (0);
+
+    r->size = READ_SIZE;
+  }
+
+  for (;;)
+  {
+    if (r->pos >= r->len)
+    {
+      while ((rbytes = read(r->fd, r->buffer, r->size)) < 0 &&
+             (errno == EINTR || errno == EAGAIN));
+
+      if (rbytes <= 0)
+      {
+        *ptr = '\0';
+	return (ptr > line);
+      }
+
+      r->pos   = 0;
+      r->len   = (size_t)rbytes;
+      r->total += (uint64_t)rbytes;
+    }
+
+    if ((ch = r->buffer[r->pos ++]) == '\n')
+      break;
+    else if (ch != '\r' && ptr < end)
+      *ptr++ = (char)ch;
+  }
+
+ /*
+  * Trim trailing whitespace...
+  */
+
+  while (ptr > line && (ptr[-1] == ' ' || ptr[-1] == '\t'))
+    ptr --;
+
+  *ptr = '\0';
+
+  return (1);
+}
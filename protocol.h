@@ -0,0 +1,163 @@
+/*
+     File: protocol.h 
+ Abstract: Sample printer protocol definitions for sample CUPS printer driver.
+  Version: 4.0 
+  
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple 
+ Inc. ("Apple") in consideration of your agreement to the following 
+ terms, and your use, installation, modification or redistribution of 
+ this Apple software constitutes acceptance of these terms.  If you do 
+ not agree with these terms, please do not use, install, modify or 
+ redistribute this Apple software. 
+  
+ In consideration of your agreement to abide by the following terms, and 
+ subject to these terms, Apple grants you a personal, non-exclusive 
+ license, under Apple's copyrights in this original Apple software (the 
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple 
+ Software, with or without modifications, in source and/or binary forms; 
+ provided that if you redistribute the Apple Software in its entirety and 
+ without modifications, you must retain this notice and the following 
+ text and disclaimers in all such redistributions of the Apple Software. 
+ Neither the name, trademarks, service marks or logos of Apple Inc. may 
+ be used to endorse or promote products derived from the Apple Software 
+ without specific prior written permission from Apple.  Except as 
+ expressly stated in this notice, no other rights or licenses, express or 
+ implied, are granted by Apple herein, including but not limited to any 
+ patent rights that may be infringed by your derivative works or by other 
+ works in which the Apple Software may be incorporated. 
+  
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE 
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION 
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS 
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND 
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS. 
+  
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL 
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, 
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED 
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), 
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE 
+ POSSIBILITY OF SUCH DAMAGE. 
+  
+ Copyright (C) 2011 Apple Inc. All Rights Reserved. 
+  
+ */  
+
+#ifndef _SAMPLE_PROTOCOL_H_
+#  define _SAMPLE_PROTOCOL_H_
+
+/*
+ * Include necessary headers...
+ */
+
+#  include <stddef.h>
+#  include <stdint.h>
+
+
+/*
+ * Sample printer commands...
+ *
+ * The sample printer reads one command per line, some of which are followed
+ * by raster data.  The filters send them and sampletopdf, which stands in
+ * for the printer, reads them.
+ *
+ * COPIES applies to the pages that follow it in the document.  The printer
+ * prints each page that many times in a row or, when "collate" is non-zero,
+ * keeps the pages and prints the whole set again for each extra copy at the
+ * end of the document, so a page is only ever sent once.
+ *
+ * REPEATPAGE prints a page the printer has kept from an earlier job or
+ * page, as described in pagecache.h.
+ */
+
+typedef enum
+{
+  PROTOCOL_UNKNOWN,			/* Not a command */
+  PROTOCOL_AUTHOR,			/* AUTHOR name */
+  PROTOCOL_BAND,			/* BAND y lines bytes [encoding] */
+  PROTOCOL_CHANGEINK,			/* CHANGEINK [colors] */
+  PROTOCOL_CLEAN,			/* CLEAN [colors] */
+  PROTOCOL_COPIES,			/* COPIES copies [collate] */
+  PROTOCOL_DOCUMENT,			/* DOCUMENT */
+  PROTOCOL_ENDDOCUMENT,			/* ENDDOCUMENT */
+  PROTOCOL_ENDPAGE,			/* ENDPAGE */
+  PROTOCOL_HALFTONE,			/* HALFTONE bits */
+  PROTOCOL_LEVELS,			/* LEVELS */
+  PROTOCOL_LINE,			/* LINE bytes [encoding] */
+  PROTOCOL_PAGE,			/* PAGE x y width height */
+  PROTOCOL_RASTER,			/* RASTER width height depth */
+  PROTOCOL_REPEATPAGE,			/* REPEATPAGE key */
+  PROTOCOL_SKIP,			/* SKIP lines */
+  PROTOCOL_SPAN,			/* SPAN x bytes */
+  PROTOCOL_TITLE			/* TITLE title */
+} protocol_command_t;
+
+
+/*
+ * Command sink...
+ *
+ * A sink takes sample printer commands as function calls instead of text.
+ * The stream sink in output.c writes them to the printer, and
+ * ProtocolRead() reads a stream and calls a sink with what it finds, so a
+ * filter can either send its pages down the pipe or hand them straight to a
+ * page assembler in the same process.
+ *
+ * Lines are passed as pointers to the caller's buffers, which are only valid
+ * during the call.  A "y" of -1 means the next line on the page (LINE),
+ * otherwise it is the first line of a band (BAND).  Encoded bands have each
+ * line preceded by its 4-byte length, as in codec.h.  The functions return
+ * 1 on success and 0 on failure, and any of them may be NULL.
+ */
+
+typedef struct
+{
+  void	*data;				/* Sink data */
+  int	(*begin_document)(void *data, const char *author, const char *title);
+					/* DOCUMENT, AUTHOR, and TITLE */
+  int	(*set_copies)(void *data, unsigned copies, int collate);
+					/* COPIES */
+  int	(*begin_page)(void *data, unsigned x, unsigned y, unsigned width,
+		      unsigned height);	/* PAGE */
+  int	(*begin_raster)(void *data, unsigned width, unsigned height,
+		        unsigned depth);/* RASTER */
+  int	(*set_halftone)(void *data, unsigned bits);
+					/* HALFTONE */
+  int	(*put_lines)(void *data, int y, unsigned count,
+		     const unsigned char * const *lines, size_t bytes);
+					/* LINE or BAND with raw lines */
+  int	(*put_encoded)(void *data, int y, unsigned count, int codec,
+		       const unsigned char *buffer, size_t bytes);
+					/* LINE or BAND with encoded lines */
+  int	(*put_span)(void *data, unsigned x, const unsigned char *buffer,
+		    size_t bytes);	/* SPAN */
+  int	(*skip_lines)(void *data, unsigned count);
+					/* SKIP */
+  int	(*get_levels)(void *data);	/* LEVELS */
+  int	(*maintain)(void *data, protocol_command_t command,
+		    const char *colors);/* CHANGEINK and CLEAN */
+  int	(*end_page)(void *data);	/* ENDPAGE */
+  int	(*repeat_page)(void *data, const char *key);
+					/* REPEATPAGE */
+  int	(*end_document)(void *data);	/* ENDDOCUMENT */
+} protocol_sink_t;
+
+
+/*
+ * Self-test page, a 5x1" 72dpi RGB image...
+ */
+
+#  define PROTOCOL_SELFTEST_WIDTH	360
+#  define PROTOCOL_SELFTEST_HEIGHT	72
+
+
+/*
+ * Prototypes...
+ */
+
+extern protocol_command_t ProtocolCommand(const char *name);
+extern uint64_t		ProtocolRead(int fd, protocol_sink_t *sink);
+extern void		ProtocolSelfTestLine(unsigned char *data, int y);
+
+#endif /* !_SAMPLE_PROTOCOL_H_ */
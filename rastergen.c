@@ -0,0 +1,1088 @@
+/*
+     File: rastergen.c 
+ Abstract: Synthetic CUPS raster generator for sample CUPS printer driver.
+  Version: 4.0 
+  
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple 
+ Inc. ("Apple") in consideration of your agreement to the following 
+ terms, and your use, installation, modification or redistribution of 
+ this Apple software constitutes acceptance of these terms.  If you do 
+ not agree with these terms, please do not use, install, modify or 
+ redistribute this Apple software. 
+  
+ In consideration of your agreement to abide by the following terms, and 
+ subject to these terms, Apple grants you a personal, non-exclusive 
+ license, under Apple's copyrights in this original Apple software (the 
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple 
+ Software, with or without modifications, in source and/or binary forms; 
+ provided that if you redistribute the Apple Software in its entirety and 
+ without modifications, you must retain this notice and the following 
+ text and disclaimers in all such redistributions of the Apple Software. 
+ Neither the name, trademarks, service marks or logos of Apple Inc. may 
+ be used to endorse or promote products derived from the Apple Software 
+ without specific prior written permission from Apple.  Except as 
+ expressly stated in this notice, no other rights or licenses, express or 
+ implied, are granted by Apple herein, including but not limited to any 
+ patent rights that may be infringed by your derivative works or by other 
+ works in which the Apple Software may be incorporated. 
+  
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE 
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION 
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS 
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND 
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS. 
+  
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL 
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, 
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED 
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), 
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE 
+ POSSIBILITY OF SUCH DAMAGE. 
+  
+ Copyright (C) 2011 Apple Inc. All Rights Reserved. 
+  
+ */  
+
+/*
+ * Include necessary headers...
+ */
+
+#include <cups/raster.h>		/* CUPS raster header */
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+
+/*
+ * Content types...
+ */
+
+typedef enum
+{
+  CONTENT_BLANK,			/* White pages */
+  CONTENT_TEXT,				/* Lines of text-like glyphs */
+  CONTENT_PHOTO,			/* Smooth color with noise */
+  CONTENT_GRADIENT,			/* Linear ramps */
+  CONTENT_FORM,				/* The same ruled form on every page */
+  CONTENT_MIXED,			/* Each of the above in turn */
+  CONTENT_MAX
+} content_t;
+
+
+/*
+ * Generator state...
+ */
+
+typedef struct gen_s gen_t;
+
+typedef void (*gen_line_t)(gen_t *gen, unsigned char *line, unsigned y);
+
+struct gen_s
+{
+  unsigned	width,			/* Width in pixels */
+		height,			/* Height in pixels */
+		colors,			/* Samples per pixel */
+		dpi,			/* Resolution */
+		page;			/* Current page, starting at 0 */
+  unsigned	seed;			/* Random seed */
+  unsigned	state;			/* Random state for current line */
+};
+
+
+/*
+ * Raster writer for the streams libcups does not write: version 1, the
+ * other byte order, and run-length encoding with "clear to end of line"...
+ */
+
+typedef struct
+{
+  int		fd,			/* Output file */
+		version,		/* Raster version, 1 to 3 */
+		swapped,		/* Write in the other byte order? */
+		swap16;			/* Swap 16-bit samples on this page? */
+  unsigned char	clear;			/* Byte for "clear to end of line" */
+  size_t	bytes,			/* Bytes per line */
+		bpp;			/* Bytes per pixel for runs */
+  unsigned char	*line,			/* Line being repeated */
+		*buffer;		/* Swapped or encoded line */
+  unsigned	count;			/* Times the line repeats */
+} writer_t;
+
+
+/*
+ * Local globals...
+ */
+
+static const char * const content_names[CONTENT_MAX] =
+{					/* Content type names */
+  "blank",
+  "text",
+  "photo",
+  "gradient",
+  "form",
+  "mixed"
+};
+
+
+/*
+ * Local functions...
+ */
+
+static void	gen_blank(gen_t *gen, unsigned char *line, unsigned y);
+static void	gen_form(gen_t *gen, unsigned char *line, unsigned y);
+static void	gen_gradient(gen_t *gen, unsigned char *line, unsigned y);
+static void	gen_photo(gen_t *gen, unsigned char *line, unsigned y);
+static void	gen_text(gen_t *gen, unsigned char *line, unsigned y);
+static unsigned	hash3(unsigned a, unsigned b, unsigned c);
+static void	ink_pixels(gen_t *gen, unsigned char *line, unsigned x0,
+		           unsigned x1, const unsigned char *color);
+static int	page_size(const char *name, unsigned *width, unsigned *height);
+static unsigned	random_next(gen_t *gen);
+static void	text_row(gen_t *gen, unsigned char *line, unsigned x0,
+		         unsigned x1, unsigned row, unsigned rows,
+			 unsigned key);
+static void	usage(void);
+static int	write_all(int fd, const void *data, size_t bytes);
+static int	write_flush(writer_t *w);
+static int	write_header(writer_t *w, cups_page_header2_t *header);
+static int	write_line(writer_t *w, const unsigned char *line);
+
+
+/*
+ * Line generators for each content type...
+ */
+
+static const gen_line_t	gen_lines[CONTENT_MIXED] =
+{
+  gen_blank,
+  gen_text,
+  gen_photo,
+  gen_gradient,
+  gen_form
+};
+
+
+/*
+ * 'main()' - Write a synthetic CUPS raster stream.
+ *
+ * Usage:
+ *
+ *     rastergen [options] [filename]
+ *
+ * Options:
+ *
+ *     -b 8|16           Bits per color (default 8)
+ *     -c W|K|RGB        Color space (default RGB)
+ *     -f v1|v2|v3       Write this raster version ourselves, not with libcups
+ *     -m media          MediaType value (default none)
+ *     -n pages          Number of pages (default 1)
+ *     -r dpi            Resolution (default 300)
+ *     -s size           letter, legal, a4, 4x6, or WIDTHxHEIGHT in points
+ *     -S seed           Random seed (default 1)
+ *     -t content        blank, text, photo, gradient, form, or mixed
+ *     -v                Show the size of the stream when done
+ *     -x                Write the other byte order (implies -f v3)
+ *
+ * The stream is written to the named file or the standard output.  Streams
+ * written with -f or -x end each run-length encoded line with a "clear to
+ * end of line" code where the rest of the line is blank, and have noise in
+ * the low byte of 16-bit samples, so that they cover the parts of the format
+ * that libcups never writes.
+ */
+
+int					/* O - Exit status */
+main(int  argc,				/* I - Number of command-line args */
+     char *argv[])			/* I - Command-line arguments */
+{
+  int			i;		/* Looping var */
+  const char		*opt,		/* Current option */
+			*filename = NULL,
+					/* Output file */
+			*media = NULL;	/* MediaType */
+  unsigned		bits = 8,	/* Bits per color */
+			pages = 1,	/* Number of pages */
+			pwidth = 612,	/* Page width in points */
+			plength = 792,	/* Page length in points */
+			x, y;		/* Looping vars */
+  int			verbose = 0,	/* Show stream size? */
+			fd;		/* Output file */
+  cups_cspace_t		cspace = CUPS_CSPACE_RGB;
+					/* Color space */
+  content_t		content = CONTENT_TEXT,
+					/* Content type */
+			page_content;	/* Content for current page */
+  gen_t			gen;		/* Generator state */
+  cups_raster_t		*ras = NULL;	/* Raster stream */
+  writer_t		writer;		/* Our own raster stream */
+  uint32_t		sync;		/* Sync word for our own stream */
+  cups_page_header2_t	header;		/* Page header */
+  unsigned char		*line,		/* 8-bit line */
+			*pixels;	/* Line as written */
+  unsigned short	*pixels16;	/* 16-bit line */
+  size_t		samples;	/* Samples per line */
+  unsigned long long	total_bytes = 0,/* Bytes of raster data */
+			total_lines = 0;/* Lines of raster data */
+
+
+ /*
+  * Parse the command-line...
+  */
+
+  memset(&gen, 0, sizeof(gen));
+  memset(&writer, 0, sizeof(writer));
+  gen.dpi  = 300;
+  gen.seed = 1;
+
+  for (i = 1; i < argc; i ++)
+  {
+    if (argv[i][0] != '-' || !argv[i][1])
+    {
+      if (filename)
+        usage();
+
+      filename = argv[i];
+      continue;
+    }
+
+    for (opt = argv[i] + 1; *opt; opt ++)
+    {
+      if (*opt == 'v')
+      {
+        verbose = 1;
+	continue;
+      }
+      else if (*opt == 'x')
+      {
+        writer.swapped = 1;
+	continue;
+      }
+
+      if (++ i >= argc)
+        usage();
+
+      switch (*opt)
+      {
+        case 'b' :
+	    bits = (unsigned)atoi(argv[i]);
+	    if (bits != 8 && bits != 16)
+	      usage();
+	    break;
+
+        case 'c' :
+	    if (!strcasecmp(argv[i], "W"))
+	      cspace = CUPS_CSPACE_W;
+	    else if (!strcasecmp(argv[i], "K"))
+	      cspace = CUPS_CSPACE_K;
+	    else if (!strcasecmp(argv[i], "RGB"))
+	      cspace = CUPS_CSPACE_RGB;
+	    else
+	      usage();
+	    break;
+
+        case 'f' :
+	    if (!strcmp(argv[i], "v1"))
+	      writer.version = 1;
+	    else if (!strcmp(argv[i], "v2"))
+	      writer.version = 2;
+	    else if (!strcmp(argv[i], "v3"))
+	      writer.version = 3;
+	    else
+	      usage();
+	    break;
+
+        case 'm' :
+	    media = argv[i];
+	    break;
+
+        case 'n' :
+	    if ((pages = (unsigned)atoi(argv[i])) < 1)
+	      usage();
+	    break;
+
+        case 'r' :
+	    if ((gen.dpi = (unsigned)atoi(argv[i])) < 1 || gen.dpi > 4800)
+	      usage();
+	    break;
+
+        case 's' :
+	    if (!page_size(argv[i], &pwidth, &plength))
+	      usage();
+	    break;
+
+        case 'S' :
+	    gen.seed = (unsigned)strtoul(argv[i], NULL, 10);
+	    break;
+
+        case 't' :
+	    for (content = CONTENT_BLANK; content < CONTENT_MAX; content ++)
+	      if (!strcmp(argv[i], content_names[content]))
+	        break;
+
+	    if (content == CONTENT_MAX)
+	      usage();
+	    break;
+
+        default :
+	    usage();
+      }
+
+      break;
+    }
+  }
+
+ /*
+  * Set up the page header the way cupsRasterInterpretPPD() would...
+  */
+
+  memset(&header, 0, sizeof(header));
+
+  header.HWResolution[0]       = gen.dpi;
+  header.HWResolution[1]       = gen.dpi;
+  header.PageSize[0]           = pwidth;
+  header.PageSize[1]           = plength;
+  header.ImagingBoundingBox[2] = pwidth;
+  header.ImagingBoundingBox[3] = plength;
+  header.cupsPageSize[0]       = (float)pwidth;
+  header.cupsPageSize[1]       = (float)plength;
+  header.cupsImagingBBox[2]    = (float)pwidth;
+  header.cupsImagingBBox[3]    = (float)plength;
+  header.NumCopies             = 1;
+  header.cupsWidth             = pwidth * gen.dpi / 72;
+  header.cupsHeight            = plength * gen.dpi / 72;
+  header.cupsBitsPerColor      = bits;
+  header.cupsColorOrder        = CUPS_ORDER_CHUNKED;
+  header.cupsColorSpace        = cspace;
+  header.cupsNumColors         = cspace == CUPS_CSPACE_RGB ? 3 : 1;
+  header.cupsBitsPerPixel      = bits * header.cupsNumColors;
+  header.cupsBytesPerLine      = header.cupsWidth * header.cupsBitsPerPixel / 8;
+
+  if (media)
+    strncpy(header.MediaType, media, sizeof(header.MediaType) - 1);
+
+  gen.width  = header.cupsWidth;
+  gen.height = header.cupsHeight;
+  gen.colors = header.cupsNumColors;
+
+  samples = (size_t)gen.width * gen.colors;
+
+  if ((line = malloc(samples)) == NULL ||
+      (pixels16 = malloc(samples * sizeof(unsigned short))) == NULL)
+  {
+    fputs("rastergen: Unable to allocate memory for a line.\n", stderr);
+    return (1);
+  }
+
+  pixels = bits == 16 ? (unsigned char *)pixels16 : line;
+
+ /*
+  * Open the output stream...
+  */
+
+  if (!filename)
+    fd = 1;
+  else if ((fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+  {
+    fprintf(stderr, "rastergen: Unable to create \"%s\": %s\n", filename,
+            strerror(errno));
+    return (1);
+  }
+
+  if (writer.swapped && !writer.version)
+    writer.version = 3;
+
+  if (writer.version)
+  {
+    if (writer.version == 1)
+      sync = writer.swapped ? CUPS_RASTER_REVSYNCv1 : CUPS_RASTER_SYNCv1;
+    else if (writer.version == 2)
+      sync = writer.swapped ? CUPS_RASTER_REVSYNCv2 : CUPS_RASTER_SYNCv2;
+    else
+      sync = writer.swapped ? CUPS_RASTER_REVSYNC : CUPS_RASTER_SYNC;
+
+    writer.fd = fd;
+
+    if (!write_all(fd, &sync, sizeof(sync)))
+    {
+      fprintf(stderr, "rastergen: Unable to write raster data: %s\n",
+	      strerror(errno));
+      return (1);
+    }
+  }
+  else if ((ras = cupsRasterOpen(fd, CUPS_RASTER_WRITE)) == NULL)
+  {
+    fputs("rastergen: Unable to open raster stream.\n", stderr);
+    return (1);
+  }
+
+ /*
+  * Write the pages...
+  */
+
+  for (gen.page = 0; gen.page < pages; gen.page ++)
+  {
+    if (content == CONTENT_MIXED)
+      page_content = (content_t)(gen.page % CONTENT_MIXED);
+    else
+      page_content = content;
+
+    if (ras ? !cupsRasterWriteHeader2(ras, &header) :
+              !write_header(&writer, &header))
+    {
+      fputs("rastergen: Unable to write page header.\n", stderr);
+      return (1);
+    }
+
+    for (y = 0; y < gen.height; y ++)
+    {
+      gen.state = hash3(gen.seed, gen.page, y);
+
+      (*gen_lines[page_content])(&gen, line, y);
+
+      if (cspace == CUPS_CSPACE_K)
+      {
+        for (x = 0; x < samples; x ++)
+	  line[x] = (unsigned char)(255 - line[x]);
+      }
+
+      if (bits == 16)
+      {
+        for (x = 0; x < samples; x ++)
+	  pixels16[x] = (unsigned short)(line[x] * 257);
+
+       /*
+        * Our own streams get noise in the low bits of each sample between
+	* black and white, so that both bytes matter; it still rounds to the
+	* same 8-bit value...
+	*/
+
+        if (writer.version)
+	{
+	  for (x = 0; x < samples; x ++)
+	    if (line[x] > 0 && line[x] < 255)
+	      pixels16[x] -= (unsigned short)(hash3(gen.seed, y, x) & 127);
+	}
+      }
+
+      if (ras ? cupsRasterWritePixels(ras, pixels, header.cupsBytesPerLine) <
+                    header.cupsBytesPerLine :
+                !write_line(&writer, pixels))
+      {
+        fprintf(stderr, "rastergen: Unable to write raster data: %s\n",
+	        strerror(errno));
+	return (1);
+      }
+    }
+
+    total_lines += gen.height;
+    total_bytes += (unsigned long long)gen.height * header.cupsBytesPerLine;
+  }
+
+  if (ras)
+    cupsRasterClose(ras);
+  else if (!write_flush(&writer))
+  {
+    fprintf(stderr, "rastergen: Unable to write raster data: %s\n",
+	    strerror(errno));
+    return (1);
+  }
+
+  if (fd != 1)
+    close(fd);
+
+  if (verbose)
+    fprintf(stderr, "rastergen: %u pages, %llu lines, %llu bytes\n", pages,
+            total_lines, total_bytes);
+
+  free(line);
+  free(pixels16);
+  free(writer.line);
+  free(writer.buffer);
+
+  return (0);
+}
+
+
+/*
+ * 'gen_blank()' - Generate a white line.
+ */
+
+static void
+gen_blank(gen_t         *gen,		/* I - Generator */
+          unsigned char *line,		/* O - Line */
+	  unsigned      y)		/* I - Line number */
+{
+  (void)y;
+
+  memset(line, 255, (size_t)gen->width * gen->colors);
+}
+
+
+/*
+ * 'gen_form()' - Generate a line of a ruled form.
+ *
+ * The form has a shaded title bar, a grid of boxes with labels, and a
+ * border.  It does not depend on the page number, so every page is the
+ * same.
+ */
+
+static void
+gen_form(gen_t         *gen,		/* I - Generator */
+         unsigned char *line,		/* O - Line */
+	 unsigned      y)		/* I - Line number */
+{
+  static const unsigned char black[3] = { 0, 0, 0 },
+			shade[3] = { 208, 216, 232 };
+					/* Ink colors */
+  unsigned	margin = gen->dpi / 2,	/* Page margins */
+		rule = gen->dpi / 72 + 1,
+					/* Rule thickness */
+		title = margin + gen->dpi,
+					/* Bottom of title bar */
+		box = gen->dpi * 3 / 4,	/* Box height */
+		columns = 4,		/* Number of columns */
+		column,			/* Column width */
+		x,			/* Looping var */
+		row;			/* Row within box */
+
+
+  gen_blank(gen, line, y);
+
+  if (y < margin || y >= gen->height - margin)
+    return;
+
+  column = (gen->width - 2 * margin) / columns;
+
+  if (y < margin + rule || y >= gen->height - margin - rule ||
+      (y >= title && ((y - title) % box) < rule))
+  {
+   /*
+    * Horizontal rule...
+    */
+
+    ink_pixels(gen, line, margin, gen->width - margin, black);
+    return;
+  }
+
+  if (y < title)
+  {
+   /*
+    * Title bar...
+    */
+
+    ink_pixels(gen, line, margin, gen->width - margin, shade);
+    text_row(gen, line, margin + gen->dpi / 4, gen->width / 2, y - margin,
+             title - margin, 0);
+  }
+  else
+  {
+   /*
+    * Labels in the top of each box...
+    */
+
+    row = (y - title) % box;
+
+    if (row < box / 3)
+      for (x = 0; x < columns; x ++)
+        text_row(gen, line, margin + x * column + gen->dpi / 16,
+	         margin + x * column + column / 2, row, box / 3,
+		 (y - title) / box * columns + x + 1);
+  }
+
+ /*
+  * Vertical rules...
+  */
+
+  for (x = 0; x <= columns; x ++)
+  {
+    if (x == columns)
+      ink_pixels(gen, line, gen->width - margin - rule, gen->width - margin,
+                 black);
+    else if (y >= title || x == 0)
+      ink_pixels(gen, line, margin + x * column, margin + x * column + rule,
+                 black);
+  }
+}
+
+
+/*
+ * 'gen_gradient()' - Generate a line of linear ramps.
+ */
+
+static void
+gen_gradient(gen_t         *gen,	/* I - Generator */
+             unsigned char *line,	/* O - Line */
+	     unsigned      y)		/* I - Line number */
+{
+  unsigned	x,			/* Looping var */
+		vy = y * 255 / gen->height;
+					/* Vertical ramp */
+
+
+  for (x = 0; x < gen->width; x ++)
+  {
+    unsigned vx = x * 255 / gen->width;	/* Horizontal ramp */
+
+    if (gen->colors == 1)
+    {
+      *line++ = (unsigned char)((vx + vy) / 2);
+    }
+    else
+    {
+      *line++ = (unsigned char)vx;
+      *line++ = (unsigned char)vy;
+      *line++ = (unsigned char)(255 - vx);
+    }
+  }
+}
+
+
+/*
+ * 'gen_photo()' - Generate a line of smooth color with noise.
+ *
+ * Slowly varying waves stand in for the subject and random noise for the
+ * grain, so that lines neither repeat nor compress well.
+ */
+
+static void
+gen_photo(gen_t         *gen,		/* I - Generator */
+          unsigned char *line,		/* O - Line */
+	  unsigned      y)		/* I - Line number */
+{
+  unsigned	x, c;			/* Looping vars */
+  double	fx = 6.2832 * 3.0 / gen->width,
+		fy = 6.2832 * 2.0 / gen->height;
+					/* Wave frequencies */
+  int		v;			/* Sample value */
+
+
+  for (x = 0; x < gen->width; x ++)
+    for (c = 0; c < gen->colors; c ++)
+    {
+      v = 128 + (int)(90.0 * sin(x * fx * (c + 1) + gen->page + c) *
+                             cos(y * fy * (c + 2) + c)) +
+          (int)(random_next(gen) & 31) - 16;
+
+      *line++ = (unsigned char)(v < 0 ? 0 : v > 255 ? 255 : v);
+    }
+}
+
+
+/*
+ * 'gen_text()' - Generate a line of text-like glyphs.
+ *
+ * Text is set at 12 points on 14 point lines with 1 inch margins.  Lines are
+ * ragged on the right and every few lines a paragraph break is left blank.
+ */
+
+static void
+gen_text(gen_t         *gen,		/* I - Generator */
+         unsigned char *line,		/* O - Line */
+	 unsigned      y)		/* I - Line number */
+{
+  unsigned	margin = gen->dpi,	/* Page margins */
+		pitch = gen->dpi * 14 / 72,
+					/* Line pitch */
+		tline,			/* Text line number */
+		right;			/* Right end of text line */
+
+
+  gen_blank(gen, line, y);
+
+  if (y < margin || y >= gen->height - margin || gen->width <= 2 * margin ||
+      pitch == 0)
+    return;
+
+  tline = (y - margin) / pitch;
+
+  if (hash3(gen->seed, gen->page, tline) % 8 == 0)
+    return;
+
+  right = gen->width - margin -
+          hash3(gen->page, tline, gen->seed) % ((gen->width - 2 * margin) / 4 + 1);
+
+  text_row(gen, line, margin, right, (y - margin) % pitch, pitch,
+           hash3(gen->seed, gen->page, tline));
+}
+
+
+/*
+ * 'hash3()' - Hash three numbers together.
+ */
+
+static unsigned				/* O - Hash */
+hash3(unsigned a,			/* I - First number */
+      unsigned b,			/* I - Second number */
+      unsigned c)			/* I - Third number */
+{
+  unsigned h = a * 0x9e3779b1u ^ b * 0x85ebca77u ^ c * 0xc2b2ae3du;
+					/* Hash */
+
+
+  h ^= h >> 15;
+  h *= 0x2c1b3c6du;
+  h ^= h >> 12;
+  h *= 0x297a2d39u;
+  h ^= h >> 15;
+
+  return (h);
+}
+
+
+/*
+ * 'ink_pixels()' - Fill a run of pixels with a color.
+ */
+
+static void
+ink_pixels(gen_t               *gen,	/* I - Generator */
+           unsigned char       *line,	/* O - Line */
+	   unsigned            x0,	/* I - First pixel */
+	   unsigned            x1,	/* I - Pixel after last */
+	   const unsigned char *color)	/* I - RGB color */
+{
+  unsigned	x;			/* Looping var */
+
+
+  if (x1 > gen->width)
+    x1 = gen->width;
+
+  for (x = x0; x < x1; x ++)
+  {
+    if (gen->colors == 1)
+      line[x] = (unsigned char)((color[0] * 30 + color[1] * 59 + color[2] * 11) / 100);
+    else
+      memcpy(line + 3 * x, color, 3);
+  }
+}
+
+
+/*
+ * 'page_size()' - Get a page size in points.
+ */
+
+static int				/* O - 1 on success, 0 on failure */
+page_size(const char *name,		/* I - Size name or WIDTHxHEIGHT */
+          unsigned   *width,		/* O - Width in points */
+	  unsigned   *height)		/* O - Height in points */
+{
+  if (!strcasecmp(name, "letter"))
+  {
+    *width  = 612;
+    *height = 792;
+  }
+  else if (!strcasecmp(name, "legal"))
+  {
+    *width  = 612;
+    *height = 1008;
+  }
+  else if (!strcasecmp(name, "a4"))
+  {
+    *width  = 595;
+    *height = 842;
+  }
+  else if (!strcasecmp(name, "4x6"))
+  {
+    *width  = 288;
+    *height = 432;
+  }
+  else if (sscanf(name, "%ux%u", width, height) != 2)
+    return (0);
+
+  return (*width > 0 && *height > 0 && *width <= 14400 && *height <= 14400);
+}
+
+
+/*
+ * 'random_next()' - Get the next random number for the current line.
+ */
+
+static unsigned				/* O - Random number */
+random_next(gen_t *gen)			/* I - Generator */
+{
+  gen->state ^= gen->state << 13;
+  gen->state ^= gen->state >> 17;
+  gen->state ^= gen->state << 5;
+
+  return (gen->state);
+}
+
+
+/*
+ * 'text_row()' - Draw one row of a line of glyphs.
+ *
+ * Each glyph is a 5x7 grid of dots chosen by hashing "key" with the glyph
+ * number, scaled to fill the top 3/4 of "rows" lines.  One glyph in six is
+ * a space.  Color pages get an occasional blue line, like a link.
+ */
+
+static void
+text_row(gen_t         *gen,		/* I - Generator */
+         unsigned char *line,		/* O - Line */
+	 unsigned      x0,		/* I - Left edge */
+	 unsigned      x1,		/* I - Right edge */
+	 unsigned      row,		/* I - Row within text line */
+	 unsigned      rows,		/* I - Rows in text line */
+	 unsigned      key)		/* I - Text line key */
+{
+  static const unsigned char black[3] = { 0, 0, 0 },
+			blue[3] = { 16, 48, 192 };
+					/* Ink colors */
+  const unsigned char	*color = (key % 23) == 0 ? blue : black;
+					/* Ink color */
+  unsigned		cell = rows / 2,/* Glyph cell width */
+			height = rows * 3 / 4,
+					/* Glyph height */
+			gy,		/* Glyph row */
+			gx,		/* Glyph column */
+			glyph,		/* Glyph number */
+			bits,		/* Dots for glyph */
+			x;		/* Current position */
+
+
+  if (cell < 6 || row >= height)
+    return;
+
+  gy = row * 7 / height;
+
+  for (glyph = 0, x = x0; x + cell <= x1; glyph ++, x += cell)
+  {
+    bits = hash3(key, glyph, 0x5eed);
+
+    if (bits % 6 == 0)
+      continue;
+
+    for (gx = 0; gx < 5; gx ++)
+      if (bits & (1 << (gy * 4 + gx) % 31))
+        ink_pixels(gen, line, x + gx * (cell - 1) / 6, x + (gx + 1) * (cell - 1) / 6,
+	           color);
+  }
+}
+
+
+/*
+ * 'usage()' - Show program usage and exit.
+ */
+
+static void
+usage(void)
+{
+  fputs("Usage: rastergen [options] [filename]\n", stderr);
+  fputs("Options:\n", stderr);
+  fputs("  -b 8|16           Bits per color (default 8)\n", stderr);
+  fputs("  -c W|K|RGB        Color space (default RGB)\n", stderr);
+  fputs("  -f v1|v2|v3       Write this raster version ourselves\n", stderr);
+  fputs("  -m media          MediaType value\n", stderr);
+  fputs("  -n pages          Number of pages (default 1)\n", stderr);
+  fputs("  -r dpi            Resolution (default 300)\n", stderr);
+  fputs("  -s size           letter, legal, a4, 4x6, or WIDTHxHEIGHT in points\n", stderr);
+  fputs("  -S seed           Random seed (default 1)\n", stderr);
+  fputs("  -t content        blank, text, photo, gradient, form, or mixed\n", stderr);
+  fputs("  -v                Show the size of the stream when done\n", stderr);
+  fputs("  -x                Write the other byte order (implies -f v3)\n", stderr);
+
+  exit(1);
+}
+
+
+/*
+ * 'write_all()' - Write bytes to a file, retrying short writes.
+ */
+
+static int				/* O - 1 on success, 0 on error */
+write_all(int        fd,		/* I - Output file */
+          const void *data,		/* I - Bytes to write */
+          size_t     bytes)		/* I - Number of bytes */
+{
+  const char	*ptr = (const char *)data;
+					/* Pointer into data */
+  ssize_t	wbytes;			/* Bytes written */
+
+
+  while (bytes > 0)
+  {
+    if ((wbytes = write(fd, ptr, bytes)) < 0)
+    {
+      if (errno == EINTR || errno == EAGAIN)
+        continue;
+
+      return (0);
+    }
+
+    ptr   += wbytes;
+    bytes -= (size_t)wbytes;
+  }
+
+  return (1);
+}
+
+
+/*
+ * 'write_flush()' - Encode and write the line being repeated.
+ *
+ * Blank pixels at the end of the line are written as a "clear to end of
+ * line" code, and the rest as runs of up to 128 repeated or literal pixels
+ * the way libcups writes them.
+ */
+
+static int				/* O - 1 on success, 0 on error */
+write_flush(writer_t *w)		/* I - Raster writer */
+{
+  const unsigned char	*ptr,		/* Pointer into line */
+			*end;		/* End of pixels before clear */
+  unsigned char		*out;		/* Pointer into encoded line */
+  size_t		bpp = w->bpp,	/* Bytes per pixel */
+			count;		/* Pixels in run */
+
+
+  if (w->count == 0)
+    return (1);
+
+ /*
+  * Find the blank pixels at the end of the line...
+  */
+
+  for (end = w->line + w->bytes; end > w->line && end[-1] == w->clear; end --);
+
+  end = w->line + ((size_t)(end - w->line) + bpp - 1) / bpp * bpp;
+
+ /*
+  * Write the repeat count and runs...
+  */
+
+  out    = w->buffer;
+  *out++ = (unsigned char)(w->count - 1);
+
+  for (ptr = w->line; ptr < end; ptr += count * bpp)
+  {
+    if (ptr + bpp < end && !memcmp(ptr, ptr + bpp, bpp))
+    {
+      for (count = 2;
+           count < 128 && ptr + count * bpp < end &&
+	       !memcmp(ptr, ptr + count * bpp, bpp);
+	   count ++);
+
+      *out++ = (unsigned char)(count - 1);
+      memcpy(out, ptr, bpp);
+      out += bpp;
+    }
+    else
+    {
+      for (count = 1;
+           count < 128 && ptr + count * bpp < end &&
+	       (ptr + (count + 1) * bpp >= end ||
+	        memcmp(ptr + count * bpp, ptr + (count + 1) * bpp, bpp));
+	   count ++);
+
+      *out++ = (unsigned char)(257 - count);
+					/* 1 pixel comes out as 0, a repeat */
+      memcpy(out, ptr, count * bpp);
+      out += count * bpp;
+    }
+  }
+
+  if (end < w->line + w->bytes)
+    *out++ = 128;
+
+  w->count = 0;
+
+  return (write_all(w->fd, w->buffer, (size_t)(out - w->buffer)));
+}
+
+
+/*
+ * 'write_header()' - Write a page header.
+ */
+
+static int				/* O - 1 on success, 0 on error */
+write_header(writer_t            *w,	/* I - Raster writer */
+             cups_page_header2_t *header)
+					/* I - Page header */
+{
+  cups_page_header2_t	swapped;	/* Header in the other byte order */
+  unsigned		i,		/* Looping var */
+			*word;		/* Header word to swap */
+
+
+  if (!write_flush(w))
+    return (0);
+
+  free(w->line);
+  free(w->buffer);
+
+  w->bytes  = header->cupsBytesPerLine;
+  w->bpp    = (header->cupsBitsPerPixel + 7) / 8;
+  w->clear  = header->cupsColorSpace == CUPS_CSPACE_K ? 0x00 : 0xff;
+  w->swap16 = w->swapped && header->cupsBitsPerColor == 16;
+  w->line   = malloc(w->bytes);
+  w->buffer = malloc(2 * w->bytes + 2);
+
+  if (!w->line || !w->buffer)
+    return (0);
+
+  if (!w->swapped)
+    return (write_all(w->fd, header, sizeof(cups_page_header2_t)));
+
+ /*
+  * Swap the 81 integer and real values from AdvanceDistance through
+  * cupsReal...
+  */
+
+  swapped = *header;
+
+  for (i = 81, word = (unsigned *)&swapped.AdvanceDistance; i > 0;
+       i --, word ++)
+    *word = (*word >> 24) | ((*word >> 8) & 0xff00) |
+            ((*word & 0xff00) << 8) | (*word << 24);
+
+  return (write_all(w->fd, &swapped, sizeof(swapped)));
+}
+
+
+/*
+ * 'write_line()' - Write a line of pixels.
+ *
+ * Version 2 lines are held until a different line comes along or the
+ * repeat count is full.
+ */
+
+static int				/* O - 1 on success, 0 on error */
+write_line(writer_t            *w,	/* I - Raster writer */
+           const unsigned char *line)	/* I - Line of pixels */
+{
+  size_t	i;			/* Looping var */
+
+
+  if (w->swap16)
+  {
+    for (i = 0; i < w->bytes; i += 2)
+    {
+      w->buffer[i]     = line[i + 1];
+      w->buffer[i + 1] = line[i];
+    }
+
+    line = w->buffer;
+  }
+
+  if (w->version != 2)
+    return (write_all(w->fd, line, w->bytes));
+
+  if (w->count > 0 && w->count < 256 && !memcmp(w->line, line, w->bytes))
+  {
+    w->count ++;
+    return (1);
+  }
+
+  if (!write_flush(w))
+    return (0);
+
+  memcpy(w->line, line, w->bytes);
+  w->count = 1;
+
+  return (1);
+}
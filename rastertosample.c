@@ -50,15 +50,163 @@ page settings, and so forth.
  */  
 
 #include "sample.h"			/* Common sample driver header */
+#include "codec.h"			/* Raster data encoding definitions */
+#include "color.h"			/* Color separation definitions */
+#include "counters.h"			/* Performance counter definitions */
+#include "halftone.h"			/* Halftoning definitions */
+#include "input.h"			/* Raster input definitions */
+#include "kernels.h"			/* Raster kernel definitions */
+#include "metrics.h"			/* Shared job metrics definitions */
+#include "output.h"			/* Output stream definitions */
+#include "pagecache.h"			/* Printer page cache definitions */
+#ifdef HAVE_ASSEMBLER
+#  include "assembler.h"		/* Page assembler definitions */
+#endif /* HAVE_ASSEMBLER */
+#include "ring.h"			/* Ring buffer definitions */
+#include "trace.h"			/* Stage timing definitions */
 #include <cups/raster.h>		/* CUPS raster header */
 #include <signal.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+
+/*
+ * Constants...
+ */
+
+#define BAND_LINES	16		/* Default lines per band */
+#define BAND_MAX	256		/* Maximum lines per band */
+#define PIPELINE_SLOTS	4		/* Bands in flight per conversion thread */
+#define PIPELINE_MAX	16		/* Maximum number of conversion threads */
+#define ENCODING_AUTO	-1		/* Choose the encoding for each band */
+#define SPAN_OVERHEAD	16		/* Approximate length of a SPAN command */
+#define PROGRESS_INTERVAL 1.0		/* Seconds between progress messages */
+#define REPEAT_TIMEOUT	30.0		/* Seconds to wait for repeated pages to be read */
+#define STAGE_CONVERT	0		/* Counters for ConvertBand() */
+#define STAGE_HALFTONE	1		/* Counters for HalftoneBand() */
+#define STAGE_OUTPUT	2		/* Counters for OutputBand() */
+#define STAGE_MAX	3		/* Number of counted stages */
+
+
+/*
+ * Band data...
+ *
+ * Raster data is read, converted, and sent to the printer in bands of
+ * BandLines lines.
+ */
+
+typedef struct
+{
+  unsigned		y,		/* First line in band */
+			count;		/* Number of lines in band */
+  unsigned char		*input,		/* Buffer for raster data */
+			*output,	/* Converted data */
+			*packed;	/* Halftoned data */
+  const unsigned char	*data,		/* Raster data, in "input" or mapped */
+			**lines;	/* Converted lines */
+  unsigned char		*same;		/* Lines that repeat the line before */
+} band_t;
+
+
+/*
+ * Encoder data...
+ *
+ * The seed line is the last line sent to the printer, which the delta-row
+ * encoding compares against.  Bands are encoded into one of two buffers so
+ * that two encodings can be compared.
+ */
+
+typedef struct
+{
+  size_t		bytes;		/* Bytes in converted line */
+  unsigned char		*seed,		/* Previous line */
+			*buffers[2];	/* Encoded band data */
+  unsigned		skip;		/* White lines not yet sent */
+  unsigned long		raw_bytes,	/* Raster bytes since last page */
+			encoded_bytes;	/* Encoded bytes since last page */
+} encoder_t;
+
+
+/*
+ * Pipeline data...
+ *
+ * In pipelined mode the main thread reads bands of raster data, one or more
+ * conversion threads run the kernel on them, and a writer thread sends them
+ * to the printer.  Each conversion thread has its own "lane" of rings so
+ * that every ring has exactly one producer and one consumer:
+ *
+ *     main --todo--> converter --done--> writer --free--> main
+ *
+ * Bands are handed to the lanes round-robin and the writer reads the lanes
+ * in the same order, so lines are sent in page order.
+ */
+
+typedef struct pipeline_s pipeline_t;
+
+typedef struct
+{
+  pipeline_t		*pipeline;	/* Pipeline for this lane */
+  ring_t		todo,		/* Bands to convert */
+			done,		/* Bands to write */
+			free;		/* Bands to read */
+  band_t		bands[PIPELINE_SLOTS];
+					/* Bands in this lane */
+  pthread_t		thread;		/* Conversion thread */
+  int			started;	/* Was the thread started? */
+} lane_t;
+
+struct pipeline_s
+{
+  ppd_file_t		*ppd;		/* PPD file for printer */
+  cups_page_header2_t	*header;	/* Page header */
+  const kernel_t	*kernel;	/* Conversion kernel */
+  int			page;		/* Current page number */
+  volatile int		abort;		/* Set to 1 when a stage fails */
+  band_t		end;		/* End-of-page marker */
+  int			num_lanes;	/* Number of lanes */
+  lane_t		lanes[PIPELINE_MAX];
+					/* Lanes */
+};
 
 
 /*
  * Local globals...
  */
 
-static int	CancelJob = 0;		/* Set to 1 when we need to cancel the current job */
+static volatile int CancelJob = 0;	/* Set to 1 when we need to cancel the current job */
+static output_t	*Output = NULL;		/* Buffered output to the printer */
+static protocol_sink_t Printer;		/* Where printer commands go */
+static protocol_sink_t Sink;		/* Where page commands go */
+#ifdef HAVE_ASSEMBLER
+static assembler_t *Assembler = NULL;	/* Page assembler for fused filter */
+#else
+static pagecache_t *PageCache = NULL;	/* Printer's page cache or NULL */
+static output_t	*PageOutput = NULL;	/* Page being written to the cache */
+#endif /* HAVE_ASSEMBLER */
+static int	Threads = 0;		/* Number of conversion threads, 0 for none */
+static unsigned	BandLines = BAND_LINES;	/* Lines per band */
+static int	SendLines = 0;		/* Send LINE commands instead of BAND? */
+static int	Encoding = ENCODING_AUTO;
+					/* Raster data encoding */
+static encoder_t Encoder;		/* Raster data encoder */
+static int	SkipBlank = 0;		/* Don't print blank pages? */
+static int	PageSent = 0;		/* Was the current page started on the printer? */
+static unsigned	Copies = 1;		/* Copies the printer is making of each page */
+static int	Collate = 0;		/* Is the printer collating them? */
+static unsigned	Levels = 0;		/* LEVELS commands sent to the printer */
+static int	HalftoneMode = HALFTONE_NONE;
+					/* Halftoning mode */
+static unsigned	HalftoneBits = 1;	/* Bits per halftoned sample */
+static halftone_t *Halftone = NULL;	/* Halftoning data for current page */
+static color_t	*Color = NULL;		/* Color separation data, NULL for gray pages */
+static unsigned	Colors = 1;		/* Samples per pixel sent to the printer */
+static counter_stage_t Stages[STAGE_MAX] =
+{					/* Counters for each raster kernel */
+  COUNTER_STAGE("convert"),
+  COUNTER_STAGE("halftone"),
+  COUNTER_STAGE("output")
+};
 
 
 /*
@@ -66,11 +214,38 @@ static int	CancelJob = 0;		/* Set to 1 when we need to cancel the current job */
  */
 
 static int	Setup(ppd_file_t *ppd, job_data_t *job);
-static int	StartPage(ppd_file_t *ppd, job_data_t *job, cups_page_header2_t *header);
-static int	OutputLine(ppd_file_t *ppd, cups_page_header2_t *header, unsigned char *line);
+static int	StartPage(ppd_file_t *ppd, job_data_t *job, cups_page_header2_t *header, const kernel_t **kernel);
+static const char *FindProfile(ppd_file_t *ppd, cups_page_header2_t *header);
+static int	AllocBand(band_t *band, cups_page_header2_t *header);
+static void	FreeBand(band_t *band);
+static int	ReadBand(input_t *in, cups_page_header2_t *header, band_t *band, unsigned y);
+static void	ConvertBand(cups_page_header2_t *header, const kernel_t *kernel, band_t *band);
+static int	HalftoneBand(pipeline_t *pipeline, band_t *band);
+static int	AllocEncoder(cups_page_header2_t *header);
+static void	FreeEncoder(void);
+static codec_t	EncodeBand(const unsigned char **lines, unsigned count, int prefix, const unsigned char **data, size_t *length);
+static ssize_t	EncodeLines(codec_t codec, const unsigned char **lines, unsigned count, int prefix, unsigned char *buffer);
+static int	OutputBand(ppd_file_t *ppd, cups_page_header2_t *header, band_t *band);
+static int	SendBand(ppd_file_t *ppd, cups_page_header2_t *header, band_t *band);
+static int	OutputLine(ppd_file_t *ppd, cups_page_header2_t *header, const unsigned char *data, size_t first, size_t last);
+static int	OutputSpan(cups_page_header2_t *header, const unsigned char *data, size_t first, size_t last);
+static int	StartOutput(cups_page_header2_t *header);
+static void	ShowProgress(ppd_file_t *ppd, cups_page_header2_t *header, int page, band_t *band);
+static int	PipelinePage(ppd_file_t *ppd, input_t *in, cups_page_header2_t *header, const kernel_t *kernel, int page);
+static void	*PipelinePop(pipeline_t *pipeline, ring_t *ring);
+static int	PipelinePush(pipeline_t *pipeline, ring_t *ring, band_t *band);
+static void	*ConvertThread(void *data);
+static void	*WriteThread(void *data);
 static int	EndPage(ppd_file_t *ppd, job_data_t *job, cups_page_header2_t *header);
+#ifndef HAVE_ASSEMBLER
+static int	SendPage(int send);
+#endif /* !HAVE_ASSEMBLER */
+static void	UpdateMetrics(cups_page_header2_t *header, uint64_t nsecs);
 static int	Shutdown(ppd_file_t *ppd, job_data_t *job);
 static void	SignalHandler(int sig);
+#ifdef HAVE_ASSEMBLER
+static void	AssemblerReport(void *data, const char *status);
+#endif /* HAVE_ASSEMBLER */
 
 
 /*
@@ -85,10 +260,26 @@ main(int  argc,				/* I - Number of command-line args */
   job_data_t		job;		/* Job data */
   int			page = 0;	/* Current page number */
   int			fd;		/* File descriptor for raster data */
-  cups_raster_t		*ras;		/* Raster stream */
+  input_t		*in;		/* Raster stream */
   cups_page_header2_t	header;		/* Current page header */
   unsigned		y;		/* Current line */
-  unsigned char		*line;		/* Line buffer */
+  band_t		band;		/* Current band */
+  int			more;		/* More lines to read? */
+  const kernel_t	*kernel;	/* Conversion kernel for page */
+  uint64_t		page_start;	/* Start time of page */
+  const char		*threads,	/* SAMPLE_THREADS env var */
+			*lines,		/* SAMPLE_BAND_LINES env var */
+			*encoding,	/* SAMPLE_ENCODING env var */
+			*map,		/* SAMPLE_MMAP env var */
+			*decoder;	/* SAMPLE_DECODER env var */
+#ifndef HAVE_ASSEMBLER
+  const char		*splice,	/* SAMPLE_SPLICE env var */
+			*cache;		/* SAMPLE_PAGE_CACHE env var */
+  char			*units;		/* Units for cache size */
+  size_t		limit;		/* Size of page cache */
+  int			monitor;	/* Is the status monitor running? */
+#endif /* !HAVE_ASSEMBLER */
+  int			flags = 0;	/* Raster input flags */
 
 
  /*
@@ -98,12 +289,125 @@ main(int  argc,				/* I - Number of command-line args */
   if ((ppd = Initialize(argc, argv, &job)) == NULL)
     return (1);
 
+ /*
+  * Time each stage of the job if SAMPLE_TRACE is set...
+  */
+
+  TRACE_START("rastertosample", argv[1]);
+
+ /*
+  * Keep metrics for the queue and time each kernel for them.  Cycles,
+  * instructions, and misses are also counted if SAMPLE_COUNTERS is set...
+  */
+
+  MetricsStart(METRICS_FILTER);
+  CountersStart("rastertosample", argv[1], 1);
+
  /*
   * Register a signal handler...
   */
 
   signal(SIGTERM, SignalHandler);
 
+ /*
+  * Report status messages from the device as they come in.  The fused filter
+  * is its own device and gets its status with each LEVELS command...
+  */
+
+#ifndef HAVE_ASSEMBLER
+  if ((monitor = StartStatus()) == 0)
+    LogDebug("Unable to start status monitor thread.");
+#endif /* !HAVE_ASSEMBLER */
+
+ /*
+  * See if we should convert pages on separate threads...
+  */
+
+  if ((threads = getenv("SAMPLE_THREADS")) != NULL)
+  {
+    if ((Threads = atoi(threads)) < 0)
+      Threads = 0;
+    else if (Threads > PIPELINE_MAX)
+      Threads = PIPELINE_MAX;
+
+    LogDebug("Using %d conversion threads.", Threads);
+  }
+
+ /*
+  * See how many lines to send at a time, with 0 meaning to use the older
+  * single-line LINE commands...
+  */
+
+  if ((lines = getenv("SAMPLE_BAND_LINES")) != NULL)
+  {
+    if ((BandLines = (unsigned)atoi(lines)) == 0)
+    {
+      SendLines = 1;
+      BandLines = 1;
+    }
+    else if (BandLines > BAND_MAX)
+      BandLines = BAND_MAX;
+
+    LogDebug("Using %u lines per band.", BandLines);
+  }
+
+ /*
+  * See how to encode the raster data, with "auto" choosing the smallest
+  * encoding for each band.  The fused filter copies lines straight into the
+  * page buffer, so there is nothing to gain by compressing them unless
+  * asked...
+  */
+
+#ifdef HAVE_ASSEMBLER
+  Encoding = CODEC_RAW;
+#endif /* HAVE_ASSEMBLER */
+
+  if ((encoding = getenv("SAMPLE_ENCODING")) != NULL)
+  {
+    if (!strcmp(encoding, "auto"))
+      Encoding = ENCODING_AUTO;
+    else if ((Encoding = CodecValue(encoding)) < 0)
+    {
+      LogDebug("Unknown encoding \"%s\".", encoding);
+      Encoding = ENCODING_AUTO;
+    }
+
+    LogDebug("Using %s encoding.",
+             Encoding == ENCODING_AUTO ? "auto" : CodecName(Encoding));
+  }
+
+ /*
+  * Buffer everything we send to the printer...
+  */
+
+  if ((Output = OutputCreate(1, OUTPUT_SIZE, OUTPUT_INTERVAL)) == NULL)
+  {
+    LogMessage("ERROR", "Unable to allocate %u bytes!", (unsigned)OUTPUT_SIZE);
+    return (1);
+  }
+
+ /*
+  * Send printer commands down the pipe, or straight to the page assembler in
+  * the fused filter...
+  */
+
+#ifdef HAVE_ASSEMBLER
+  if ((Assembler = AssemblerCreate(getenv("PRINTER"), argv[1], argv[3],
+                                   0)) == NULL)
+  {
+    LogMessage("ERROR", "Unable to create page assembler - %s",
+               strerror(errno));
+    return (1);
+  }
+
+  AssemblerStatus(Assembler, AssemblerReport, NULL);
+  AssemblerSink(Assembler, &Sink);
+#else
+  OutputSink(Output, &Sink);
+#endif /* HAVE_ASSEMBLER */
+
+  Printer = Sink;
+
  /*
   * Prepare the print job.
   */
@@ -119,21 +423,76 @@ main(int  argc,				/* I - Number of command-line args */
   {
     if ((fd = open(argv[6], O_RDONLY)) == -1)
     {
-      LogMessage("ERROR", CFCopyLocalizedString(CFSTR("Unable to open raster file - %s"), NULL), strerror(errno));
+      LogMessage("ERROR", "Unable to open raster file - %s", strerror(errno));
       return (1);
     }
   }
   else
     fd = 0;
 
-  ras = cupsRasterOpen(fd, CUPS_RASTER_READ);
+ /*
+  * Spooled files are mapped so that uncompressed lines can be converted
+  * in place, unless SAMPLE_MMAP is 0.  The raster is decoded by the driver
+  * unless SAMPLE_DECODER is "cups"...
+  */
+
+  if ((map = getenv("SAMPLE_MMAP")) == NULL || atoi(map) != 0)
+    flags |= INPUT_MAP;
+
+  if ((decoder = getenv("SAMPLE_DECODER")) != NULL && !strcmp(decoder, "cups"))
+    flags |= INPUT_CUPS;
+
+  if ((in = InputCreate(fd, flags)) == NULL)
+  {
+    LogMessage("ERROR", "Unable to open raster stream - %s", strerror(errno));
+    return (1);
+  }
+
+#ifndef HAVE_ASSEMBLER
+ /*
+  * Lines passed through from a mapped file can be spliced from the file to
+  * the printer, unless SAMPLE_SPLICE is 0...
+  */
+
+  if (in->map &&
+      ((splice = getenv("SAMPLE_SPLICE")) == NULL || atoi(splice) != 0) &&
+      OutputSetSource(Output, in->fd, in->map, in->map_size))
+    LogDebug("Splicing raster data from the raster file.");
+
+ /*
+  * Pages the printer has printed before can be repeated from its page cache
+  * if SAMPLE_PAGE_CACHE gives the size of the cache, e.g. "256m".  Each page
+  * is then sent when it is done instead of as it is converted.  Repeated
+  * pages must stay in the cache until the printer has read them, and only
+  * the status monitor can tell us when that is...
+  */
+
+  if ((cache = getenv("SAMPLE_PAGE_CACHE")) != NULL && !monitor)
+    LogDebug("Not using the page cache without a status monitor.");
+  else if (cache)
+  {
+    limit = (size_t)strtoul(cache, &units, 10);
+
+    if (*units == 'k' || *units == 'K')
+      limit *= 1024;
+    else if (*units == 'm' || *units == 'M')
+      limit *= 1024 * 1024;
+    else if (*units == 'g' || *units == 'G')
+      limit *= 1024 * 1024 * 1024;
+
+    if ((PageCache = PageCacheCreate(getenv("PRINTER"), limit)) != NULL)
+      LogDebug("Using %lu byte page cache.", (unsigned long)limit);
+  }
+#endif /* !HAVE_ASSEMBLER */
 
  /*
   * Process pages as needed...
   */
 
-  while (cupsRasterReadHeader2(ras, &header))
+  while (InputReadHeader(in, &header))
   {
+    TRACE_SCOPE("page");
+
    /*
     * Check for canceled jobs...
     */
@@ -141,17 +500,13 @@ main(int  argc,				/* I - Number of command-line args */
     if (CancelJob)
       break;
 
+    page_start = MetricsNow();
+
    /*
-    * Allocate memory for the line...
+    * Log the line size for the page...
     */
 
-    fprintf(stderr, "DEBUG: cupsBytesPerLine=%u\n", header.cupsBytesPerLine);
-
-    if ((line = malloc(header.cupsBytesPerLine)) == NULL)
-    {
-      LogMessage("ERROR", CFCopyLocalizedString(CFSTR("Unable to allocate %u bytes!"), NULL), header.cupsBytesPerLine);
-      break;
-    }
+    LogDebug("cupsBytesPerLine=%u", header.cupsBytesPerLine);
 
    /*
     * Let the scheduler and user know we are printing a page...
@@ -160,76 +515,111 @@ main(int  argc,				/* I - Number of command-line args */
     page ++;
 
     fprintf(stderr, "PAGE: %d %d\n", page, header.NumCopies);
-    LogMessage("INFO", CFCopyLocalizedString(CFSTR("Starting page %d..."), NULL), page);
+    LogMessage("INFO", "Starting page %d...", page);
 
-    if (!StartPage(ppd, &job, &header))
+    if (!StartPage(ppd, &job, &header, &kernel))
       break;
 
    /*
-    * Print every line on the page...
+    * Print every line on the page.  The pipeline has its own bands...
     */
 
-    for (y = 0; y < header.cupsHeight; y ++)
+    if (Threads > 0)
+    {
+      if (!PipelinePage(ppd, in, &header, kernel, page))
+        break;
+    }
+    else
     {
      /*
-      * Check for canceled jobs...
+      * Allocate memory for a band of lines...
       */
 
-      if (CancelJob)
+      if (!AllocBand(&band, &header))
+      {
+	LogMessage("ERROR", "Unable to allocate %u bytes!", 2 * BandLines * header.cupsBytesPerLine);
 	break;
+      }
 
-     /*
-      * Show progress...
-      */
-
-      if ((y & 127) == 0)
+      for (y = 0; y < header.cupsHeight; y += band.count)
       {
-        LogMessage("INFO", CFCopyLocalizedString(CFSTR("Printing page %d, %.0f%% complete..."), NULL), page, 100.0 * y / header.cupsHeight);
+       /*
+	* Check for canceled jobs...
+	*/
 
-        puts("LEVELS");
-	fflush(stdout);
-      }
+	if (CancelJob)
+	  break;
 
-     /*
-      * Check for status messages from the device...
-      */
+       /*
+	* Read the band, convert it, and write it out...
+	*/
 
-      GetStatus(ppd, 0.0);
+	more = ReadBand(in, &header, &band, y);
 
-     /*
-      * Read the line and write it out...
-      */
+	if (band.count == 0)
+	  break;
 
-      if (cupsRasterReadPixels(ras, line, header.cupsBytesPerLine) > 0)
-      {
-        if (!OutputLine(ppd, &header, line))
+	ShowProgress(ppd, &header, page, &band);
+	ConvertBand(&header, kernel, &band);
+
+	if (!HalftoneBand(NULL, &band) || !SendBand(ppd, &header, &band) ||
+	    !more)
 	  break;
       }
-      else
-        break;
-    }
 
-   /*
-    * Release the line buffer...
-    */
+     /*
+      * Release the band buffers...
+      */
 
-    free(line);
+      FreeBand(&band);
+    }
 
    /*
     * Show progress and end the current page...
     */
 
-    LogMessage("INFO", CFCopyLocalizedString(CFSTR("Finished page %d..."), NULL), page);
+    LogMessage("INFO", "Finished page %d...", page);
 
     if (!EndPage(ppd, &job, &header))
       break;
+
+    UpdateMetrics(&header, MetricsNow() - page_start);
+    CountersReport(Stages, STAGE_MAX, page);
   }
 
  /*
-  * Check for status messages from the device...
+  * Send everything we have buffered and wait for the final status from the
+  * device...
+  */
+
+  OutputFlush(Output);
+
+#ifdef HAVE_ASSEMBLER
+  (Printer.get_levels)(Printer.data);
+#else
+ /*
+  * The printer has read every page repeated from the page cache once it
+  * answers a LEVELS command sent after them, so wait for that before the
+  * pages are unlocked.  A printer that is slow to answer or never does
+  * doesn't hold up the job; its pages are kept in the cache for a while
+  * instead...
   */
 
-  GetStatus(ppd, 1.0);
+  if (PageCache && PageCache->hits > 0)
+  {
+    Levels ++;
+
+    if (!(Printer.get_levels)(Printer.data) ||
+        !WaitStatus(Levels, REPEAT_TIMEOUT))
+    {
+      LogDebug("Printer has not read the repeated pages yet, keeping them "
+               "for %d seconds.", PAGECACHE_KEEP);
+      PageCacheKeep(PageCache);
+    }
+  }
+
+  StopStatus(1.0);
+#endif /* HAVE_ASSEMBLER */
 
  /*
   * End the job on the printer...
@@ -237,18 +627,52 @@ main(int  argc,				/* I - Number of command-line args */
 
   Shutdown(ppd, &job);
 
+#ifndef HAVE_ASSEMBLER
+ /*
+  * Report how well the page cache did and unlock the cached pages the job
+  * used...
+  */
+
+  if (PageCache)
+  {
+    if (PageOutput)
+      SendPage(0);
+
+    LogDebug("Repeated %u of %u pages from the page cache, saving %lu bytes.",
+             PageCache->hits, PageCache->hits + PageCache->misses,
+	     (unsigned long)PageCache->saved);
+
+    MetricsAdd(METRIC_CACHE_HITS, PageCache->hits);
+    MetricsAdd(METRIC_CACHE_MISSES, PageCache->misses);
+
+    PageCacheDelete(PageCache);
+  }
+#endif /* !HAVE_ASSEMBLER */
+
+  InputDelete(in);
+
+  CountersReport(Stages, STAGE_MAX, 0);
+
+#ifdef HAVE_ASSEMBLER
+  AssemblerDelete(Assembler);
+#endif /* HAVE_ASSEMBLER */
+
+  OutputDelete(Output);
+
+  MetricsFinish();
+
  /*
   * Show final status...
   */
 
   if (page == 0)
   {
-    LogMessage("ERROR", CFCopyLocalizedString(CFSTR("No pages found!"), NULL));
+    LogMessage("ERROR", "No pages found!");
     return (1);
   }
   else
   {
-    LogMessage("INFO", CFCopyLocalizedString(CFSTR("Ready to print."), NULL));
+    LogMessage("INFO", "Ready to print.");
     return (0);
   }
 }
@@ -262,15 +686,41 @@ static int				/* O - 1 on success, 0 on failure */
 Setup(ppd_file_t *ppd,			/* I - PPD file for printer */
       job_data_t *job)			/* I - Job data */
 {
+  ppd_choice_t	*choice;		/* Marked option choice */
+
+
  /*
-  * Send any job setup commands to the printer.
+  * See if we should skip blank pages...
   */
 
-  puts("DOCUMENT");
-  printf("AUTHOR %s\n", job->user);
-  printf("TITLE %s\n", job->title);
+  if ((choice = ppdFindMarkedChoice(ppd, "SkipBlankPages")) != NULL &&
+      !strcmp(choice->choice, "True"))
+    SkipBlank = 1;
 
-  return (1);
+ /*
+  * See if we should halftone the raster data...
+  */
+
+  if ((choice = ppdFindMarkedChoice(ppd, "Halftone")) != NULL &&
+      (HalftoneMode = HalftoneValue(choice->choice)) < 0)
+  {
+    LogDebug("Unknown halftoning mode \"%s\".", choice->choice);
+    HalftoneMode = HALFTONE_NONE;
+  }
+
+  if ((choice = ppdFindMarkedChoice(ppd, "HalftoneBits")) != NULL &&
+      !strcmp(choice->choice, "2"))
+    HalftoneBits = 2;
+
+  if (HalftoneMode != HALFTONE_NONE)
+    LogDebug("Using %s halftoning with %u bits per sample.",
+             HalftoneName((halftone_mode_t)HalftoneMode), HalftoneBits);
+
+ /*
+  * Send any job setup commands to the printer.
+  */
+
+  return ((Printer.begin_document)(Printer.data, job->user, job->title));
 }
 
 
@@ -282,140 +732,1282 @@ static int				/* O - 1 on success, 0 on failure */
 StartPage(
     ppd_file_t          *ppd,		/* I - PPD file for printer */
     job_data_t          *job,		/* I - Job data */
-    cups_page_header2_t *header)	/* I - Page header */
+    cups_page_header2_t *header,	/* I - Page header */
+    const kernel_t      **kernel)	/* O - Conversion kernel */
 {
+  TRACE_SCOPE("start page");
+
+
  /*
   * Validate the raster data...
   */
 
   if (header->cupsBitsPerColor != 8 && header->cupsBitsPerColor != 16)
   {
-    LogMessage("ERROR", CFCopyLocalizedString(CFSTR("Bad cupsBitsPerColor=%u!"), NULL), header->cupsBitsPerColor);
+    LogMessage("ERROR", "Bad cupsBitsPerColor=%u!", header->cupsBitsPerColor);
     return (0);
   }
   else if (header->cupsColorOrder != CUPS_ORDER_CHUNKED)
   {
-    LogMessage("ERROR", CFCopyLocalizedString(CFSTR("Bad cupsColorOrder=%u!"), NULL), header->cupsColorOrder);
+    LogMessage("ERROR", "Bad cupsColorOrder=%u!", header->cupsColorOrder);
     return (0);
   }
   else if (header->cupsColorSpace != CUPS_CSPACE_W &&
            header->cupsColorSpace != CUPS_CSPACE_RGB)
   {
-    LogMessage("ERROR", CFCopyLocalizedString(CFSTR("Bad cupsColorSpace=%u!"), NULL), header->cupsColorSpace);
+    LogMessage("ERROR", "Bad cupsColorSpace=%u!", header->cupsColorSpace);
+    return (0);
+  }
+  else if (header->cupsNumColors !=
+               (header->cupsColorSpace == CUPS_CSPACE_RGB ? 3 : 1) ||
+           header->cupsBitsPerPixel !=
+               header->cupsBitsPerColor * header->cupsNumColors)
+  {
+    LogMessage("ERROR", "Bad cupsNumColors=%u!", header->cupsNumColors);
+    return (0);
+  }
+  else if (header->cupsBytesPerLine <
+               (uint64_t)header->cupsWidth * header->cupsBitsPerPixel / 8)
+  {
+    LogMessage("ERROR", "Bad cupsBytesPerLine=%u!", header->cupsBytesPerLine);
     return (0);
   }
 
  /*
-  * Send any page setup commands to the printer.
+  * Choose the conversion kernel for this page once, so the line loop doesn't
+  * need to look at the page format again...
   */
 
-  printf("PAGE %u %u %u %u\n", header->Margins[0], header->Margins[1], header->PageSize[0], header->PageSize[1]);
-  printf("RASTER %u %u %u\n", header->cupsWidth, header->cupsHeight, header->cupsNumColors);
-
-  return (1);
-}
-
+  if ((*kernel = FindKernel(header)) == NULL)
+  {
+    LogMessage("ERROR", "Bad cupsBitsPerColor=%u!", header->cupsBitsPerColor);
+    return (0);
+  }
 
-/*
- * 'OutputLine()' - Output a single line of raster data.
- */
+  LogDebug("Using %s kernel.", (*kernel)->name);
 
-static int				/* O - 1 on success, 0 on failure */
-OutputLine(
-    ppd_file_t          *ppd,		/* I - PPD file for printer */
-    cups_page_header2_t *header,	/* I - Page header */
-    unsigned char       *line)		/* I - Raster data */
-{
  /*
-  * Send a line of raster data to the printer.
+  * RGB pages are separated into CMYK for the printer.  The separation only
+  * changes with the media and resolution, so it is kept between pages...
   */
 
-  if (header->cupsBitsPerColor == 8)
+  if (header->cupsColorSpace == CUPS_CSPACE_RGB)
   {
-   /*
-    * Send 8-bit data to the printer...
-    */
+    int media;				/* Media type */
+
+    if ((media = ColorMedia(header->MediaType)) < 0)
+    {
+      LogDebug("Unknown media type \"%s\", using Plain.", header->MediaType);
+      media = COLOR_PLAIN;
+    }
+
+    if (Color && (Color->media != (color_media_t)media ||
+                  Color->resolution != header->HWResolution[0]))
+    {
+      ColorDelete(Color);
+      Color = NULL;
+    }
 
-    printf("LINE %d\n", header->cupsBytesPerLine);
+    if (!Color &&
+        (Color = ColorNew(FindProfile(ppd, header), (color_media_t)media, header->HWResolution[0])) == NULL)
+    {
+      LogMessage("ERROR", "Unable to allocate %u bytes!", (unsigned)sizeof(color_t));
+      return (0);
+    }
 
-    return (fwrite(line, 1, header->cupsBytesPerLine, stdout) == header->cupsBytesPerLine);
+    Colors = 4;
   }
   else
-  {
-   /*
-    * Send 16-bit data to the printer.  Ordinarily you'd be dithering the
-    * print data, but here we just need to convert the 48-bit RGB data to
-    * 24-bits.
-    *
-    * This formula:
-    *
-    *     (*pixel + 129) / 257
-    *
-    * rounds the 16-bit pixel to the nearest 8-bit value ("+ 129") and
-    * converts from 16-bits to 8-bits (65535 / 255 = 257).
-    */
+    Colors = header->cupsNumColors;
 
-    unsigned short	*pixel;		/* Current pixel */
-    int			count;		/* Remaining count */
+ /*
+  * Set up halftoning, which starts over with every page...
+  */
 
-    printf("LINE %d\n", header->cupsBytesPerLine / 2);
+  HalftoneDelete(Halftone);
+  Halftone = NULL;
 
-    for (pixel = (unsigned short *)line, count = header->cupsBytesPerLine / 2;
-         count > 0;
-	 count --, pixel ++)
-      if (putchar((*pixel + 129) / 257) == EOF)
-        return (0);
+  if (HalftoneMode != HALFTONE_NONE &&
+      (Halftone = HalftoneNew((halftone_mode_t)HalftoneMode, HalftoneBits, header->cupsWidth, Colors)) == NULL)
+  {
+    LogMessage("ERROR", "Unable to allocate %u bytes!", header->cupsWidth * Colors);
+    return (0);
+  }
 
-    return (1);
+ /*
+  * Start every page with a white seed line...
+  */
+
+  if (!AllocEncoder(header))
+  {
+    LogMessage("ERROR", "Unable to allocate %u bytes!", 2 * BandLines * header->cupsBytesPerLine);
+    return (0);
   }
-}
 
+ /*
+  * The page setup commands are sent with the first line that isn't white,
+  * so that blank pages can be skipped...
+  */
 
-/*
- * 'EndPage()' - End the current page on the printer.
- */
+  PageSent = 0;
 
-static int
-EndPage(
-    ppd_file_t          *ppd,		/* I - PPD file for printer */
-    job_data_t          *job,		/* I - Job data */
-    cups_page_header2_t *header)	/* I - Page header */
-{
+#ifndef HAVE_ASSEMBLER
  /*
-  * Send end-of-page commands to the printer.
+  * With a page cache the page is written to a file so that it can be looked
+  * up when it is done; job commands still go straight to the printer...
   */
 
-  puts("ENDPAGE");
+  if (PageCache && PageCacheBegin(PageCache) >= 0)
+  {
+    if ((PageOutput = OutputCreate(PageCache->fd, OUTPUT_SIZE,
+                                   OUTPUT_INTERVAL)) != NULL)
+      OutputSink(PageOutput, &Sink);
+    else
+      PageCacheDone(PageCache);
+  }
+#endif /* !HAVE_ASSEMBLER */
 
   return (1);
 }
 
 
 /*
- * 'Shutdown()' - Finish the current job on the printer.
+ * 'FindProfile()' - Find the ICC profile for a page.
+ *
+ * cupsICCProfile attributes are qualified by "ColorModel.MediaType.Resolution"
+ * where an empty qualifier matches anything.
  */
 
-static int				/* O - 1 on success, 0 on failure */
-Shutdown(
-    ppd_file_t *ppd,			/* I - PPD file for printer */
-    job_data_t *job)			/* I - Job data */
+static const char *			/* O - Profile filename or NULL */
+FindProfile(
+    ppd_file_t          *ppd,		/* I - PPD file for printer */
+    cups_page_header2_t *header)	/* I - Page header */
 {
- /*
-  * Send end-of-job commands to the printer.
-  */
+  ppd_attr_t	*attr;			/* cupsICCProfile attribute */
+  ppd_choice_t	*choice;		/* ColorModel choice */
+  const char	*colormodel;		/* ColorModel name */
+  char		spec[PPD_MAX_NAME],	/* Attribute qualifiers */
+		*media,			/* MediaType qualifier */
+		*resolution,		/* Resolution qualifier */
+		dpi[64];		/* Page resolution */
 
-  puts("ENDDOCUMENT");
 
-  return (1);
-}
+  if ((choice = ppdFindMarkedChoice(ppd, "ColorModel")) != NULL)
+    colormodel = choice->choice;
+  else
+    colormodel = "RGB";
 
+  if (header->HWResolution[0] == header->HWResolution[1])
+    snprintf(dpi, sizeof(dpi), "%udpi", header->HWResolution[0]);
+  else
+    snprintf(dpi, sizeof(dpi), "%ux%udpi", header->HWResolution[0], header->HWResolution[1]);
 
-/*
- * 'SignalHandler()' - Catch SIGTERM and flag that we need to cancel the job.
- */
+  for (attr = ppdFindAttr(ppd, "cupsICCProfile", NULL);
+       attr;
+       attr = ppdFindNextAttr(ppd, "cupsICCProfile", NULL))
+  {
+    snprintf(spec, sizeof(spec), "%s", attr->spec);
 
-static void
-SignalHandler(int sig)			/* I - Signal number (unused) */
+    if ((media = strchr(spec, '.')) == NULL ||
+        (resolution = strchr(media + 1, '.')) == NULL)
+      continue;
+
+    *media++      = '\0';
+    *resolution++ = '\0';
+
+    if ((!spec[0] || !strcmp(spec, colormodel)) &&
+        (!media[0] || !strcmp(media, header->MediaType)) &&
+	(!resolution[0] || !strcmp(resolution, dpi)))
+    {
+      LogDebug("Using color profile \"%s\".", attr->value);
+      return (attr->value);
+    }
+  }
+
+  return (NULL);
+}
+
+
+/*
+ * 'AllocBand()' - Allocate memory for a band.
+ */
+
+static int				/* O - 1 on success, 0 on failure */
+AllocBand(band_t              *band,	/* I - Band */
+          cups_page_header2_t *header)	/* I - Page header */
+{
+  size_t	bytes = (size_t)BandLines * header->cupsBytesPerLine,
+					/* Bytes per band */
+		converted = (size_t)BandLines * header->cupsWidth * Colors;
+					/* Bytes per converted band */
+
+
+  memset(band, 0, sizeof(band_t));
+
+  if (converted < bytes)
+    converted = bytes;
+
+  if ((band->input = malloc(bytes)) == NULL ||
+      (band->output = malloc(converted)) == NULL ||
+      (band->lines = calloc(BandLines, sizeof(unsigned char *))) == NULL ||
+      (band->same = calloc(BandLines, 1)) == NULL ||
+      (Halftone && (band->packed = malloc(BandLines * Halftone->bytes)) == NULL))
+  {
+    FreeBand(band);
+    return (0);
+  }
+
+  return (1);
+}
+
+
+/*
+ * 'FreeBand()' - Free the memory used by a band.
+ */
+
+static void
+FreeBand(band_t *band)			/* I - Band */
+{
+  free(band->input);
+  free(band->output);
+  free(band->packed);
+  free(band->lines);
+  free(band->same);
+
+  memset(band, 0, sizeof(band_t));
+}
+
+
+/*
+ * 'ReadBand()' - Read up to BandLines lines of raster data.
+ */
+
+static int				/* O - 1 if all lines were read, 0 otherwise */
+ReadBand(input_t             *in,	/* I - Raster stream */
+         cups_page_header2_t *header,	/* I - Page header */
+         band_t              *band,	/* I - Band */
+         unsigned            y)		/* I - First line */
+{
+  unsigned	count;			/* Lines to read */
+  TRACE_SCOPE("read");
+
+
+  if ((count = header->cupsHeight - y) > BandLines)
+    count = BandLines;
+
+  band->y     = y;
+  band->count = InputReadLines(in, band->input, count, &band->data, band->same);
+
+  return (band->count == count);
+}
+
+
+/*
+ * 'ConvertBand()' - Run the conversion kernel on every line in a band.
+ *
+ * RGB pages are separated straight from the 8-bit or 16-bit raster data
+ * instead.  Lines that repeat the line before are not converted again.
+ */
+
+static void
+ConvertBand(cups_page_header2_t *header,/* I - Page header */
+            const kernel_t      *kernel,/* I - Conversion kernel */
+            band_t              *band)	/* I - Band */
+{
+  unsigned	i,			/* Looping var */
+		bpl = header->cupsBytesPerLine;
+					/* Bytes per line */
+  counter_sample_t sample;		/* Counter sample */
+  TRACE_SCOPE("convert");
+
+
+  CountersBegin(&sample);
+
+  if (Color)
+  {
+    for (i = 0; i < band->count; i ++)
+    {
+      if (band->same[i])
+      {
+        band->lines[i] = band->lines[i - 1];
+	continue;
+      }
+
+      ColorLine(Color, band->output + i * header->cupsWidth * 4, band->data + i * bpl, header->cupsWidth, header->cupsBitsPerColor);
+      band->lines[i] = band->output + i * header->cupsWidth * 4;
+    }
+  }
+  else
+  {
+    for (i = 0; i < band->count; i ++)
+      if (band->same[i])
+        band->lines[i] = band->lines[i - 1];
+      else
+        band->lines[i] = (*kernel->convert)(band->output + i * bpl, band->data + i * bpl, header->cupsWidth);
+  }
+
+  CountersEnd(Stages + STAGE_CONVERT, &sample);
+}
+
+
+/*
+ * 'HalftoneBand()' - Halftone the converted lines in a band.
+ *
+ * Error diffusion needs the previous band to be done first, so conversion
+ * threads wait their turn here.  "pipeline" is NULL when bands are converted
+ * on the main thread.
+ */
+
+static int				/* O - 1 on success, 0 if canceled */
+HalftoneBand(pipeline_t *pipeline,	/* I - Pipeline or NULL */
+             band_t     *band)		/* I - Band */
+{
+  unsigned	i,			/* Looping var */
+		spins = 0;		/* Number of times we waited */
+  counter_sample_t sample;		/* Counter sample */
+
+
+  if (!Halftone)
+    return (1);
+
+  if (!HalftoneReady(Halftone, band->y))
+  {
+    TRACE_SCOPE("wait");
+
+    while (!HalftoneReady(Halftone, band->y))
+    {
+      if (CancelJob || (pipeline && pipeline->abort))
+	return (0);
+
+      if (spins ++ < 64)
+	sched_yield();
+      else
+	usleep(100);
+    }
+  }
+
+  TRACE_SCOPE("halftone");
+
+  CountersBegin(&sample);
+  HalftoneLines(Halftone, band->packed, band->lines, band->y, band->count);
+  CountersEnd(Stages + STAGE_HALFTONE, &sample);
+
+  for (i = 0; i < band->count; i ++)
+    band->lines[i] = band->packed + i * Halftone->bytes;
+
+  return (1);
+}
+
+
+/*
+ * 'AllocEncoder()' - Allocate memory for the raster data encoder.
+ */
+
+static int				/* O - 1 on success, 0 on failure */
+AllocEncoder(
+    cups_page_header2_t *header)	/* I - Page header */
+{
+  size_t	bytes;			/* Bytes per encoded band */
+
+
+  FreeEncoder();
+
+  if (Halftone)
+    Encoder.bytes = Halftone->bytes;
+  else
+    Encoder.bytes = header->cupsWidth * Colors;
+
+  bytes = (size_t)BandLines * (Encoder.bytes + 4);
+
+  if ((Encoder.seed = malloc(Encoder.bytes)) == NULL ||
+      (Encoder.buffers[0] = malloc(bytes)) == NULL ||
+      (Encoder.buffers[1] = malloc(bytes)) == NULL)
+  {
+    FreeEncoder();
+    return (0);
+  }
+
+  memset(Encoder.seed, 255, Encoder.bytes);
+
+  return (1);
+}
+
+
+/*
+ * 'FreeEncoder()' - Free the memory used by the raster data encoder.
+ */
+
+static void
+FreeEncoder(void)
+{
+  free(Encoder.seed);
+  free(Encoder.buffers[0]);
+  free(Encoder.buffers[1]);
+
+  memset(&Encoder, 0, sizeof(Encoder));
+}
+
+
+/*
+ * 'EncodeBand()' - Encode lines of converted raster data.
+ *
+ * With automatic encoding, delta-row data is used right away when it is less
+ * than 1/16th of the raw data, which is the common case of white or repeated
+ * lines.  Otherwise PackBits is also tried and the smallest of the raw,
+ * delta-row, and PackBits data is used.  The last line becomes the seed line
+ * for the next call.
+ */
+
+static codec_t				/* O - Encoding used */
+EncodeBand(
+    const unsigned char **lines,	/* I - Converted lines */
+    unsigned            count,		/* I - Number of lines */
+    int                 prefix,		/* I - Prefix each line with its length? */
+    const unsigned char **data,		/* O - Encoded data or NULL for raw */
+    size_t              *length)	/* O - Length of encoded data */
+{
+  codec_t	codec = CODEC_RAW;	/* Encoding used */
+  size_t	raw = count * Encoder.bytes;
+					/* Length of raw data */
+  ssize_t	delta,			/* Length of delta-row data */
+		packbits;		/* Length of PackBits data */
+
+
+  *data   = NULL;
+  *length = raw;
+
+  if (Encoding == CODEC_DELTA || Encoding == ENCODING_AUTO)
+  {
+    if ((delta = EncodeLines(CODEC_DELTA, lines, count, prefix, Encoder.buffers[0])) >= 0 &&
+        (size_t)delta < *length)
+    {
+      codec   = CODEC_DELTA;
+      *data   = Encoder.buffers[0];
+      *length = (size_t)delta;
+    }
+  }
+
+  if ((Encoding == CODEC_PACKBITS ||
+       (Encoding == ENCODING_AUTO && *length > raw / 16)) &&
+      (packbits = EncodeLines(CODEC_PACKBITS, lines, count, prefix, Encoder.buffers[1])) >= 0 &&
+      (size_t)packbits < *length)
+  {
+    codec   = CODEC_PACKBITS;
+    *data   = Encoder.buffers[1];
+    *length = (size_t)packbits;
+  }
+
+  memcpy(Encoder.seed, lines[count - 1], Encoder.bytes);
+
+  return (codec);
+}
+
+
+/*
+ * 'EncodeLines()' - Encode lines of converted raster data using the given
+ *                   encoding.
+ *
+ * Lines that don't get smaller fail the whole encoding, so the encoded data
+ * is never larger than the raw data plus the length prefixes.
+ */
+
+static ssize_t				/* O - Length of encoded data or -1 */
+EncodeLines(
+    codec_t             codec,		/* I - Encoding */
+    const unsigned char **lines,	/* I - Converted lines */
+    unsigned            count,		/* I - Number of lines */
+    int                 prefix,		/* I - Prefix each line with its length? */
+    unsigned char       *buffer)	/* I - Encoding buffer */
+{
+  unsigned		i;		/* Looping var */
+  unsigned char		*bufptr;	/* Current position in buffer */
+  const unsigned char	*seed;		/* Seed line */
+  ssize_t		bytes;		/* Length of encoded line */
+
+
+  for (i = 0, bufptr = buffer, seed = Encoder.seed; i < count; seed = lines[i], i ++)
+  {
+    if (prefix)
+      bufptr += 4;
+
+    if (codec == CODEC_DELTA)
+      bytes = DeltaRowEncode(bufptr, Encoder.bytes, lines[i], seed, Encoder.bytes);
+    else
+      bytes = PackBitsEncode(bufptr, Encoder.bytes, lines[i], Encoder.bytes);
+
+    if (bytes < 0)
+      return (-1);
+
+    if (prefix)
+    {
+      bufptr[-4] = (unsigned char)(bytes >> 24);
+      bufptr[-3] = (unsigned char)(bytes >> 16);
+      bufptr[-2] = (unsigned char)(bytes >> 8);
+      bufptr[-1] = (unsigned char)bytes;
+    }
+
+    bufptr += bytes;
+  }
+
+  return (bufptr - buffer);
+}
+
+
+/*
+ * 'OutputBand()' - Output a band of converted raster data.
+ *
+ * White lines are counted and sent as a single "SKIP lines" command before
+ * the next line with ink.  Runs of lines with ink are sent with a single
+ * "BAND y lines bytes [encoding]" command, as "SPAN x0 bytes" commands with
+ * just the non-white pixels when that is smaller than the raw data, or as
+ * separate LINE commands when SAMPLE_BAND_LINES is 0.
+ */
+
+static int				/* O - 1 on success, 0 on failure */
+OutputBand(
+    ppd_file_t          *ppd,		/* I - PPD file for printer */
+    cups_page_header2_t *header,	/* I - Page header */
+    band_t              *band)		/* I - Band */
+{
+  unsigned		i, j, k,	/* Looping vars */
+			count,		/* Number of lines in run */
+			unit = Colors,
+					/* Bytes per whole pixel(s) */
+			bytes = (unsigned)Encoder.bytes;
+					/* Bytes in converted line */
+  size_t		first[BAND_MAX],/* First non-white byte in each line */
+			last[BAND_MAX],	/* Byte after last non-white byte */
+			spans;		/* Length of run sent as SPAN commands */
+  codec_t		codec;		/* Encoding */
+  const unsigned char	*data;		/* Encoded data */
+  size_t		length;		/* Length of encoded data */
+  TRACE_SCOPE("output");
+
+
+ /*
+  * Find the non-white pixels on each line.  Halftoned spans start on a byte
+  * that holds the start of a pixel, which is every 8 pixels...
+  */
+
+  if (Halftone)
+    unit *= Halftone->bits;
+
+  for (i = 0; i < band->count; i ++)
+  {
+    if (ScanLine(band->lines[i], bytes, first + i, last + i))
+    {
+      first[i] -= first[i] % unit;
+      last[i]  += (unit - last[i] % unit) % unit;
+
+      if (last[i] > bytes)
+        last[i] = bytes;
+    }
+  }
+
+ /*
+  * Then send each run of white lines or lines with ink...
+  */
+
+  for (i = 0; i < band->count; i = j)
+  {
+    if (last[i] == 0)
+    {
+      Encoder.skip ++;
+      Encoder.raw_bytes += bytes;
+
+      j = i + 1;
+      continue;
+    }
+
+    for (j = i + 1; j < band->count && last[j] > 0; j ++);
+
+    count = j - i;
+
+    if (!StartOutput(header))
+      return (0);
+
+    if (SendLines)
+    {
+      for (k = i; k < j; k ++)
+        if (!OutputLine(ppd, header, band->lines[k], first[k], last[k]))
+	  return (0);
+
+      continue;
+    }
+
+    Encoder.raw_bytes += count * bytes;
+
+    if ((codec = EncodeBand(band->lines + i, count, 1, &data, &length)) != CODEC_RAW)
+    {
+      Encoder.encoded_bytes += length;
+
+      if (!(Sink.put_encoded)(Sink.data, (int)(band->y + i), count, codec, data, length))
+        return (0);
+
+      continue;
+    }
+
+    for (k = i, spans = 0; k < j; k ++)
+      spans += last[k] - first[k] + SPAN_OVERHEAD;
+
+    if (spans < length)
+    {
+      for (k = i; k < j; k ++)
+        if (!OutputSpan(header, band->lines[k], first[k], last[k]))
+	  return (0);
+
+      continue;
+    }
+
+    Encoder.encoded_bytes += length;
+
+    if (!(Sink.put_lines)(Sink.data, (int)(band->y + i), count, (const unsigned char * const *)band->lines + i, bytes))
+      return (0);
+  }
+
+  return (1);
+}
+
+
+/*
+ * 'SendBand()' - Output a band and count what it took.
+ */
+
+static int				/* O - 1 on success, 0 on failure */
+SendBand(
+    ppd_file_t          *ppd,		/* I - PPD file for printer */
+    cups_page_header2_t *header,	/* I - Page header */
+    band_t              *band)		/* I - Band */
+{
+  int			status;		/* Status of output */
+  counter_sample_t	sample;		/* Counter sample */
+
+
+  CountersBegin(&sample);
+  status = OutputBand(ppd, header, band);
+  CountersEnd(Stages + STAGE_OUTPUT, &sample);
+
+  return (status);
+}
+
+
+/*
+ * 'OutputLine()' - Output a single line of raster data.
+ */
+
+static int				/* O - 1 on success, 0 on failure */
+OutputLine(
+    ppd_file_t          *ppd,		/* I - PPD file for printer */
+    cups_page_header2_t *header,	/* I - Page header */
+    const unsigned char *data,		/* I - Converted data */
+    size_t              first,		/* I - First non-white byte */
+    size_t              last)		/* I - Byte after last non-white byte */
+{
+  codec_t		codec;		/* Encoding */
+  const unsigned char	*encoded;	/* Encoded data */
+  size_t		length;		/* Length of encoded data */
+
+
+  Encoder.raw_bytes += Encoder.bytes;
+
+ /*
+  * Send a line of raster data to the printer, using whichever of the
+  * encoded data and the non-white pixels is smaller.
+  */
+
+  codec = EncodeBand(&data, 1, 0, &encoded, &length);
+
+  if ((last - first + SPAN_OVERHEAD) < length)
+    return (OutputSpan(header, data, first, last));
+
+  Encoder.encoded_bytes += length;
+
+  if (codec != CODEC_RAW)
+    return ((Sink.put_encoded)(Sink.data, -1, 1, codec, encoded, length));
+
+  return ((Sink.put_lines)(Sink.data, -1, 1, &data, length));
+}
+
+
+/*
+ * 'OutputSpan()' - Output the non-white pixels of a line.
+ *
+ * The rest of the line is white.
+ */
+
+static int				/* O - 1 on success, 0 on failure */
+OutputSpan(
+    cups_page_header2_t *header,	/* I - Page header */
+    const unsigned char *data,		/* I - Converted data */
+    size_t              first,		/* I - First non-white byte */
+    size_t              last)		/* I - Byte after last non-white byte */
+{
+  unsigned	bits = Halftone ? Halftone->bits : 8;
+					/* Bits per sample */
+
+
+  Encoder.encoded_bytes += last - first;
+
+  return ((Sink.put_span)(Sink.data, (unsigned)(first * 8 / (Colors * bits)), data + first, last - first));
+}
+
+
+/*
+ * 'StartOutput()' - Send the page setup commands and any white lines before
+ *                   the next line with ink.
+ */
+
+static int				/* O - 1 on success, 0 on failure */
+StartOutput(
+    cups_page_header2_t *header)	/* I - Page header */
+{
+  unsigned	copies;			/* Copies of page */
+
+
+  if (!PageSent)
+  {
+   /*
+    * The printer makes the copies, so each page is converted and sent only
+    * once...
+    */
+
+    copies = header->NumCopies > 1 ? header->NumCopies : 1;
+
+    if (copies != Copies || (copies > 1 && (header->Collate != 0) != Collate))
+    {
+      if (!(Printer.set_copies)(Printer.data, copies, header->Collate != 0))
+        return (0);
+
+      Copies  = copies;
+      Collate = header->Collate != 0;
+    }
+
+    if (!(Sink.begin_page)(Sink.data, header->Margins[0], header->Margins[1], header->PageSize[0], header->PageSize[1]) ||
+        !(Sink.begin_raster)(Sink.data, header->cupsWidth, header->cupsHeight, Colors))
+      return (0);
+
+    if (Halftone && !(Sink.set_halftone)(Sink.data, Halftone->bits))
+      return (0);
+
+    PageSent = 1;
+  }
+
+  if (Encoder.skip > 0)
+  {
+    if (!(Sink.skip_lines)(Sink.data, Encoder.skip))
+      return (0);
+
+   /*
+    * The printer starts over with a white seed line after white lines...
+    */
+
+    memset(Encoder.seed, 255, Encoder.bytes);
+    Encoder.skip = 0;
+  }
+
+  return (1);
+}
+
+
+/*
+ * 'ShowProgress()' - Show progress and ask the device for its ink levels.
+ *
+ * Replies are reported by the status monitor thread.
+ */
+
+static void
+ShowProgress(
+    ppd_file_t          *ppd,		/* I - PPD file for printer */
+    cups_page_header2_t *header,	/* I - Page header */
+    int                 page,		/* I - Current page number */
+    band_t              *band)		/* I - Current band */
+{
+  struct timeval	curtime;	/* Current time */
+  double		now;		/* Current time in seconds */
+  static double		last = 0.0;	/* Time of last progress message */
+
+
+ /*
+  * Show progress at the start of each page and then every
+  * PROGRESS_INTERVAL seconds...
+  */
+
+  gettimeofday(&curtime, NULL);
+
+  now = curtime.tv_sec + 0.000001 * curtime.tv_usec;
+
+  if (band->y == 0 || (now - last) >= PROGRESS_INTERVAL)
+  {
+    last = now;
+
+    LogMessage("INFO", "Printing page %d, %.0f%% complete...", page, 100.0 * band->y / header->cupsHeight);
+
+    (Printer.get_levels)(Printer.data);
+    Levels ++;
+  }
+}
+
+
+/*
+ * 'PipelinePage()' - Read, convert, and write a page on separate threads.
+ *
+ * The calling thread reads the raster data.
+ */
+
+static int				/* O - 1 on success, 0 on failure */
+PipelinePage(
+    ppd_file_t          *ppd,		/* I - PPD file for printer */
+    input_t             *in,		/* I - Raster stream */
+    cups_page_header2_t *header,	/* I - Page header */
+    const kernel_t      *kernel,	/* I - Conversion kernel */
+    int                 page)		/* I - Current page number */
+{
+  pipeline_t	*pipeline;		/* Pipeline */
+  lane_t	*lane;			/* Current lane */
+  band_t	*band;			/* Current band */
+  pthread_t	writer;			/* Writer thread */
+  int		status = 0;		/* Return status */
+  int		i, j;			/* Looping vars */
+  unsigned	y,			/* Current line */
+		k;			/* Current band number */
+  int		more;			/* More lines to read? */
+
+
+ /*
+  * Set up the lanes...
+  */
+
+  if ((pipeline = calloc(1, sizeof(pipeline_t))) == NULL)
+    return (0);
+
+  pipeline->ppd       = ppd;
+  pipeline->header    = header;
+  pipeline->kernel    = kernel;
+  pipeline->page      = page;
+  pipeline->num_lanes = Threads;
+
+  for (i = 0, lane = pipeline->lanes; i < pipeline->num_lanes; i ++, lane ++)
+  {
+    lane->pipeline = pipeline;
+
+    if (!RingInit(&lane->todo, PIPELINE_SLOTS + 1) ||
+        !RingInit(&lane->done, PIPELINE_SLOTS + 1) ||
+        !RingInit(&lane->free, PIPELINE_SLOTS))
+      goto cleanup;
+
+    for (j = 0, band = lane->bands; j < PIPELINE_SLOTS; j ++, band ++)
+    {
+      if (!AllocBand(band, header))
+      {
+	LogMessage("ERROR", "Unable to allocate %u bytes!", 2 * BandLines * header->cupsBytesPerLine);
+	goto cleanup;
+      }
+
+      RingPush(&lane->free, band);
+    }
+  }
+
+ /*
+  * Start the threads...
+  */
+
+  for (i = 0, lane = pipeline->lanes; i < pipeline->num_lanes; i ++, lane ++)
+  {
+    if (pthread_create(&lane->thread, NULL, ConvertThread, lane))
+    {
+      LogDebug("Unable to start conversion thread: %s", strerror(errno));
+      pipeline->abort = 1;
+      goto cleanup;
+    }
+
+    lane->started = 1;
+  }
+
+  if (pthread_create(&writer, NULL, WriteThread, pipeline))
+  {
+    LogDebug("Unable to start writer thread: %s", strerror(errno));
+    pipeline->abort = 1;
+    goto cleanup;
+  }
+
+ /*
+  * Read bands and hand them to the lanes...
+  */
+
+  for (y = 0, k = 0; y < header->cupsHeight; y += band->count, k ++)
+  {
+    lane = pipeline->lanes + k % pipeline->num_lanes;
+
+    if ((band = PipelinePop(pipeline, &lane->free)) == NULL)
+      break;
+
+    more = ReadBand(in, header, band, y);
+
+    if (band->count > 0 && !PipelinePush(pipeline, &lane->todo, band))
+      break;
+
+    if (!more)
+      break;
+  }
+
+ /*
+  * Tell every lane that the page is done and wait for the writer...
+  */
+
+  for (i = 0, lane = pipeline->lanes; i < pipeline->num_lanes; i ++, lane ++)
+    PipelinePush(pipeline, &lane->todo, &pipeline->end);
+
+  pthread_join(writer, NULL);
+
+  status = !pipeline->abort;
+
+ /*
+  * Stop the conversion threads and free memory...
+  */
+
+  cleanup:
+
+  if (!status)
+    pipeline->abort = 1;
+
+  for (i = 0, lane = pipeline->lanes; i < pipeline->num_lanes; i ++, lane ++)
+  {
+    if (lane->started)
+      pthread_join(lane->thread, NULL);
+
+    for (j = 0, band = lane->bands; j < PIPELINE_SLOTS; j ++, band ++)
+      FreeBand(band);
+
+    RingDelete(&lane->todo);
+    RingDelete(&lane->done);
+    RingDelete(&lane->free);
+  }
+
+  free(pipeline);
+
+  return (status);
+}
+
+
+/*
+ * 'PipelinePop()' - Wait for a band from a ring.
+ */
+
+static void *				/* O - Band or NULL if canceled */
+PipelinePop(pipeline_t *pipeline,	/* I - Pipeline */
+            ring_t     *ring)		/* I - Ring */
+{
+  void		*band;			/* Band */
+  unsigned	spins = 0;		/* Number of times we waited */
+
+
+  if ((band = RingPop(ring)) == NULL)
+  {
+    TRACE_SCOPE("wait");
+
+    while ((band = RingPop(ring)) == NULL)
+    {
+      if (CancelJob || pipeline->abort)
+	return (NULL);
+
+      if (spins ++ < 64)
+	sched_yield();
+      else
+	usleep(100);
+    }
+  }
+
+  return (band);
+}
+
+
+/*
+ * 'PipelinePush()' - Wait for room and add a band to a ring.
+ */
+
+static int				/* O - 1 on success, 0 if canceled */
+PipelinePush(pipeline_t *pipeline,	/* I - Pipeline */
+             ring_t     *ring,		/* I - Ring */
+             band_t     *band)		/* I - Band */
+{
+  unsigned	spins = 0;		/* Number of times we waited */
+
+
+  if (!RingPush(ring, band))
+  {
+    TRACE_SCOPE("wait");
+
+    while (!RingPush(ring, band))
+    {
+      if (CancelJob || pipeline->abort)
+	return (0);
+
+      if (spins ++ < 64)
+	sched_yield();
+      else
+	usleep(100);
+    }
+  }
+
+  return (1);
+}
+
+
+/*
+ * 'ConvertThread()' - Convert bands for one lane.
+ */
+
+static void *				/* O - Thread exit status (unused) */
+ConvertThread(void *data)		/* I - Lane */
+{
+  lane_t	*lane = (lane_t *)data;	/* Lane */
+  pipeline_t	*pipeline = lane->pipeline;
+					/* Pipeline */
+  band_t	*band;			/* Current band */
+
+
+  TRACE_THREAD("convert");
+
+  while ((band = PipelinePop(pipeline, &lane->todo)) != NULL)
+  {
+    if (band != &pipeline->end)
+    {
+      ConvertBand(pipeline->header, pipeline->kernel, band);
+
+      if (!HalftoneBand(pipeline, band))
+        break;
+    }
+
+    if (!PipelinePush(pipeline, &lane->done, band) || band == &pipeline->end)
+      break;
+  }
+
+  return (NULL);
+}
+
+
+/*
+ * 'WriteThread()' - Write converted bands to the printer in page order.
+ */
+
+static void *				/* O - Thread exit status (unused) */
+WriteThread(void *data)			/* I - Pipeline */
+{
+  pipeline_t	*pipeline = (pipeline_t *)data;
+					/* Pipeline */
+  lane_t	*lane;			/* Current lane */
+  band_t	*band;			/* Current band */
+  unsigned	k;			/* Current band number */
+
+
+  TRACE_THREAD("write");
+
+  for (k = 0;; k ++)
+  {
+    lane = pipeline->lanes + k % pipeline->num_lanes;
+
+    if ((band = PipelinePop(pipeline, &lane->done)) == NULL ||
+        band == &pipeline->end)
+      break;
+
+    ShowProgress(pipeline->ppd, pipeline->header, pipeline->page, band);
+
+    if (!SendBand(pipeline->ppd, pipeline->header, band))
+    {
+      pipeline->abort = 1;
+      return (NULL);
+    }
+
+    PipelinePush(pipeline, &lane->free, band);
+  }
+
+  return (NULL);
+}
+
+
+/*
+ * 'EndPage()' - End the current page on the printer.
+ */
+
+static int
+EndPage(
+    ppd_file_t          *ppd,		/* I - PPD file for printer */
+    job_data_t          *job,		/* I - Job data */
+    cups_page_header2_t *header)	/* I - Page header */
+{
+ /*
+  * Lines at the bottom of the page are white already.  If every line was
+  * white, skip the page or send the page setup commands now...
+  */
+
+  Encoder.skip = 0;
+
+  if (!PageSent && SkipBlank)
+  {
+    LogDebug("Skipping blank page.");
+#ifndef HAVE_ASSEMBLER
+    if (PageOutput)
+      SendPage(0);
+#endif /* !HAVE_ASSEMBLER */
+    FreeEncoder();
+    HalftoneDelete(Halftone);
+    Halftone = NULL;
+    return (1);
+  }
+
+  if (!StartOutput(header))
+    return (0);
+
+ /*
+  * Send end-of-page commands to the printer and report how much it took
+  * to send the page.
+  */
+
+  (Sink.end_page)(Sink.data);
+
+#ifndef HAVE_ASSEMBLER
+  if (PageOutput && !SendPage(1))
+    return (0);
+#endif /* !HAVE_ASSEMBLER */
+
+  if (!OutputFlush(Output))
+    return (0);
+
+  LogDebug("Sent %lu bytes in %lu writes.", Output->bytes, Output->writes);
+
+  if (Output->spliced > 0)
+    LogDebug("Spliced %lu bytes from the raster file.", Output->spliced);
+
+  LogDebug("Encoded %lu bytes of raster data as %lu bytes.",
+           Encoder.raw_bytes, Encoder.encoded_bytes);
+
+  MetricsAdd(METRIC_BYTES_OUT, Output->bytes);
+  MetricsAdd(METRIC_RAW_BYTES, Encoder.raw_bytes);
+  MetricsAdd(METRIC_ENCODED_BYTES, Encoder.encoded_bytes);
+
+  OutputResetStats(Output);
+  FreeEncoder();
+  HalftoneDelete(Halftone);
+  Halftone = NULL;
+
+  return (1);
+}
+
+
+#ifndef HAVE_ASSEMBLER
+/*
+ * 'SendPage()' - Send a page from the page cache file.
+ *
+ * The printer gets "REPEATPAGE <key>" if it has the page already and the
+ * page itself otherwise.  Skipped pages are just thrown away.
+ */
+
+static int				/* O - 1 on success, 0 on failure */
+SendPage(int send)			/* I - 1 to send the page, 0 to skip it */
+{
+  char	key[PAGECACHE_KEY];		/* Key for page */
+  int	status;				/* Status of output */
+  TRACE_SCOPE("page cache");
+
+
+ /*
+  * Finish the page file and send page commands to the printer again...
+  */
+
+  status     = OutputFlush(PageOutput);
+  OutputDelete(PageOutput);
+  PageOutput = NULL;
+  Sink       = Printer;
+
+  if (!status)
+    LogMessage("ERROR", "Unable to write cached page - %s", strerror(errno));
+  else if (send)
+  {
+    switch (PageCacheEnd(PageCache, key, sizeof(key)))
+    {
+      case 1 :
+          LogDebug("Repeating cached page %s.", key);
+          status = (Printer.repeat_page)(Printer.data, key);
+	  break;
+
+      case 0 :
+          status = OutputWrite(Output, PageCache->data, PageCache->bytes);
+	  break;
+
+      default :
+          LogMessage("ERROR", "Unable to read cached page - %s",
+	             strerror(errno));
+          status = 0;
+	  break;
+    }
+  }
+
+  PageCacheDone(PageCache);
+
+  return (status);
+}
+#endif /* !HAVE_ASSEMBLER */
+
+
+/*
+ * 'Shutdown()' - Finish the current job on the printer.
+ */
+
+static int				/* O - 1 on success, 0 on failure */
+Shutdown(
+    ppd_file_t *ppd,			/* I - PPD file for printer */
+    job_data_t *job)			/* I - Job data */
+{
+  int	status;				/* Status of output */
+
+
+ /*
+  * Send end-of-job commands to the printer.
+  */
+
+  (Printer.end_document)(Printer.data);
+
+  ColorDelete(Color);
+  Color = NULL;
+
+  status = OutputFlush(Output);
+
+  MetricsAdd(METRIC_BYTES_OUT, Output->bytes);
+
+  return (status);
+}
+
+
+/*
+ * 'UpdateMetrics()' - Add a finished page to the job metrics.
+ *
+ * The kernel times come from the page totals of the stages, so this must be
+ * called before CountersReport() resets them.
+ */
+
+static void
+UpdateMetrics(
+    cups_page_header2_t *header,	/* I - Page header */
+    uint64_t            nsecs)		/* I - Time for page in nanoseconds */
+{
+  MetricsAdd(METRIC_PAGES, 1);
+  MetricsAdd(METRIC_LINES, header->cupsHeight);
+  MetricsAdd(METRIC_BYTES_IN, (uint64_t)header->cupsBytesPerLine * header->cupsHeight);
+
+  MetricsTime(METRIC_TIME_PAGE, nsecs);
+  MetricsTime(METRIC_TIME_CONVERT, Stages[STAGE_CONVERT].page.nsecs);
+  if (Stages[STAGE_HALFTONE].page.calls)
+    MetricsTime(METRIC_TIME_HALFTONE, Stages[STAGE_HALFTONE].page.nsecs);
+  MetricsTime(METRIC_TIME_OUTPUT, Stages[STAGE_OUTPUT].page.nsecs);
+}
+
+
+/*
+ * 'SignalHandler()' - Catch SIGTERM and flag that we need to cancel the job.
+ */
+
+static void
+SignalHandler(int sig)			/* I - Signal number (unused) */
 {
  /*
   * Tell the main loop to cancel the job.
@@ -423,3 +2015,23 @@ SignalHandler(int sig)			/* I - Signal number (unused) */
 
   CancelJob = 1;
 }
+
+
+#ifdef HAVE_ASSEMBLER
+/*
+ * 'AssemblerReport()' - Report status from the page assembler.
+ */
+
+static void
+AssemblerReport(void       *data,	/* I - Callback data (unused) */
+                const char *status)	/* I - Status */
+{
+  char	buffer[1024];			/* Copy of status for parsing */
+
+
+  (void)data;
+
+  snprintf(buffer, sizeof(buffer), "%s", status);
+  ParseStatus(buffer);
+}
+#endif /* HAVE_ASSEMBLER */
@@ -0,0 +1,162 @@
+/*
+     File: ring.c 
+ Abstract: Lock-free single-producer/single-consumer ring buffer for sample CUPS printer driver.
+  Version: 4.0 
+  
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple 
+ Inc. ("Apple") in consideration of your agreement to the following 
+ terms, and your use, installation, modification or redistribution of 
+ this Apple software constitutes acceptance of these terms.  If you do 
+ not agree with these terms, please do not use, install, modify or 
+ redistribute this Apple software. 
+  
+ In consideration of your agreement to abide by the following terms, and 
+ subject to these terms, Apple grants you a personal, non-exclusive 
+ license, under Apple's copyrights in this original Apple software (the 
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple 
+ Software, with or without modifications, in source and/or binary forms; 
+ provided that if you redistribute the Apple Software in its entirety and 
+ without modifications, you must retain this notice and the following 
+ text and disclaimers in all such redistributions of the Apple Software. 
+ Neither the name, trademarks, service marks or logos of Apple Inc. may 
+ be used to endorse or promote products derived from the Apple Software 
+ without specific prior written permission from Apple.  Except as 
+ expressly stated in this notice, no other rights or licenses, express or 
+ implied, are granted by Apple herein, including but not limited to any 
+ patent rights that may be infringed by your derivative works or by other 
+ works in which the Apple Software may be incorporated. 
+  
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE 
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION 
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS 
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND 
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS. 
+  
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL 
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, 
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED 
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), 
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE 
+ POSSIBILITY OF SUCH DAMAGE. 
+  
+ Copyright (C) 2011 Apple Inc. All Rights Reserved. 
+  
+ */  
+
+#include "ring.h"			/* Ring buffer definitions */
+#include <stdlib.h>
+
+
+/*
+ * Memory ordering...
+ *
+ * The producer publishes an item by storing the new head with release
+ * semantics, and the consumer reads the head with acquire semantics before
+ * reading the item (and the same for the tail in the other direction).
+ */
+
+#if defined(__ATOMIC_ACQUIRE)
+#  define ring_load(p)		__atomic_load_n(p, __ATOMIC_ACQUIRE)
+#  define ring_store(p,v)	__atomic_store_n(p, v, __ATOMIC_RELEASE)
+#else
+#  define ring_load(p)		ring_load_sync(p)
+#  define ring_store(p,v)	(__sync_synchronize(), *(volatile unsigned *)(p) = (v))
+
+static inline unsigned
+ring_load_sync(unsigned *p)
+{
+  unsigned v = *(volatile unsigned *)p;
+
+  __sync_synchronize();
+
+  return (v);
+}
+#endif /* __ATOMIC_ACQUIRE */
+
+
+/*
+ * 'RingDelete()' - Free the memory used by a ring.
+ */
+
+void
+RingDelete(ring_t *ring)		/* I - Ring */
+{
+  free(ring->items);
+  ring->items = NULL;
+}
+
+
+/*
+ * 'RingInit()' - Initialize a ring.
+ *
+ * The size is rounded up to a power of 2.
+ */
+
+int					/* O - 1 on success, 0 on failure */
+RingInit(ring_t   *ring,		/* I - Ring */
+         unsigned size)			/* I - Minimum number of items */
+{
+  unsigned	count;			/* Actual number of items */
+
+
+  for (count = 2; count < size; count <<= 1);
+
+  if ((ring->items = calloc(count, sizeof(void *))) == NULL)
+    return (0);
+
+  ring->mask = count - 1;
+  ring->head = 0;
+  ring->tail = 0;
+
+  return (1);
+}
+
+
+/*
+ * 'RingPop()' - Remove the oldest item from a ring.
+ *
+ * Only the consumer thread may call this function.
+ */
+
+void *					/* O - Item or NULL if empty */
+RingPop(ring_t *ring)			/* I - Ring */
+{
+  unsigned	tail = ring->tail;	/* Next item to pop */
+  void		*item;			/* Item */
+
+
+  if (tail == ring_load(&ring->head))
+    return (NULL);
+
+  item = ring->items[tail & ring->mask];
+
+  ring_store(&ring->tail, tail + 1);
+
+  return (item);
+}
+
+
+/*
+ * 'RingPush()' - Add an item to a ring.
+ *
+ * Only the producer thread may call this function.
+ */
+
+int					/* O - 1 on success, 0 if full */
+RingPush(ring_t *ring,			/* I - Ring */
+         void   *item)			/* I - Item */
+{
+  unsigned	head = ring->head;	/* Next item to push */
+
+
+  if ((head - ring_load(&ring->tail)) > ring->mask)
+    return (0);
+
+  ring->items[head & ring->mask] = item;
+
+  ring_store(&ring->head, head + 1);
+
+  return (1);
+}
@@ -0,0 +1,84 @@
+/*
+     File: ring.h 
+ Abstract: Lock-free ring buffer definitions for sample CUPS printer driver.
+  Version: 4.0 
+  
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple 
+ Inc. ("Apple") in consideration of your agreement to the following 
+ terms, and your use, installation, modification or redistribution of 
+ this Apple software constitutes acceptance of these terms.  If you do 
+ not agree with these terms, please do not use, install, modify or 
+ redistribute this Apple software. 
+  
+ In consideration of your agreement to abide by the following terms, and 
+ subject to these terms, Apple grants you a personal, non-exclusive 
+ license, under Apple's copyrights in this original Apple software (the 
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple 
+ Software, with or without modifications, in source and/or binary forms; 
+ provided that if you redistribute the Apple Software in its entirety and 
+ without modifications, you must retain this notice and the following 
+ text and disclaimers in all such redistributions of the Apple Software. 
+ Neither the name, trademarks, service marks or logos of Apple Inc. may 
+ be used to endorse or promote products derived from the Apple Software 
+ without specific prior written permission from Apple.  Except as 
+ expressly stated in this notice, no other rights or licenses, express or 
+ implied, are granted by Apple herein, including but not limited to any 
+ patent rights that may be infringed by your derivative works or by other 
+ works in which the Apple Software may be incorporated. 
+  
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE 
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION 
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS 
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND 
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS. 
+  
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL 
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, 
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED 
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), 
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE 
+ POSSIBILITY OF SUCH DAMAGE. 
+  
+ Copyright (C) 2011 Apple Inc. All Rights Reserved. 
+  
+ */  
+
+#ifndef _SAMPLE_RING_H_
+#  define _SAMPLE_RING_H_
+
+/*
+ * Ring buffer data...
+ *
+ * A ring is a bounded single-producer/single-consumer queue of pointers.
+ * Exactly one thread may call RingPush() and exactly one thread may call
+ * RingPop() on a given ring; no locks are used.  The head and tail indices
+ * are kept on separate cache lines so the two threads don't contend for
+ * the same line.
+ */
+
+#  define RING_CACHE_LINE	64	/* Assumed cache line size */
+
+typedef struct
+{
+  void		**items;		/* Queued items */
+  unsigned	mask;			/* Size of items array - 1 */
+  char		pad0[RING_CACHE_LINE];	/* Keep head on its own line */
+  unsigned	head;			/* Next item to push (producer) */
+  char		pad1[RING_CACHE_LINE];	/* Keep tail on its own line */
+  unsigned	tail;			/* Next item to pop (consumer) */
+  char		pad2[RING_CACHE_LINE];	/* Keep neighbors off the line */
+} ring_t;
+
+
+/*
+ * Prototypes...
+ */
+
+extern void	RingDelete(ring_t *ring);
+extern int	RingInit(ring_t *ring, unsigned size);
+extern void	*RingPop(ring_t *ring);
+extern int	RingPush(ring_t *ring, void *item);
+
+#endif /* !_SAMPLE_RING_H_ */
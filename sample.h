@@ -52,7 +52,6 @@
 #include <errno.h>
 #include <unistd.h>
 #include <fcntl.h>
-#include <CoreFoundation/CoreFoundation.h>
 
 
 /*
@@ -75,5 +74,18 @@ typedef struct
 
 extern int		GetStatus(ppd_file_t *ppd, double timeout);
 extern ppd_file_t	*Initialize(int argc, char *argv[], job_data_t *job);
-extern void		LogMessage(const char *prefix, CFStringRef format, ...);
-extern void		SetLocale(void);
+extern void		LogDebug(const char *format, ...)
+#ifdef __GNUC__
+			__attribute__((format(printf, 1, 2)))
+#endif /* __GNUC__ */
+			;
+extern void		LogMessage(const char *prefix, const char *message, ...)
+#ifdef __GNUC__
+			__attribute__((format(printf, 2, 3)))
+#endif /* __GNUC__ */
+			;
+extern int		ParseStatus(char *buffer);
+extern void		SetLocale(const char *program);
+extern int		StartStatus(void);
+extern void		StopStatus(double timeout);
+extern int		WaitStatus(unsigned requests, double timeout);
@@ -0,0 +1,717 @@
+/*
+     File: sampledevice.c 
+ Abstract: Device simulator for sample CUPS printer driver.
+  Version: 4.0 
+  
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple 
+ Inc. ("Apple") in consideration of your agreement to the following 
+ terms, and your use, installation, modification or redistribution of 
+ this Apple software constitutes acceptance of these terms.  If you do 
+ not agree with these terms, please do not use, install, modify or 
+ redistribute this Apple software. 
+  
+ In consideration of your agreement to abide by the following terms, and 
+ subject to these terms, Apple grants you a personal, non-exclusive 
+ license, under Apple's copyrights in this original Apple software (the 
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple 
+ Software, with or without modifications, in source and/or binary forms; 
+ provided that if you redistribute the Apple Software in its entirety and 
+ without modifications, you must retain this notice and the following 
+ text and disclaimers in all such redistributions of the Apple Software. 
+ Neither the name, trademarks, service marks or logos of Apple Inc. may 
+ be used to endorse or promote products derived from the Apple Software 
+ without specific prior written permission from Apple.  Except as 
+ expressly stated in this notice, no other rights or licenses, express or 
+ implied, are granted by Apple herein, including but not limited to any 
+ patent rights that may be infringed by your derivative works or by other 
+ works in which the Apple Software may be incorporated. 
+  
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE 
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION 
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS 
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND 
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS. 
+  
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL 
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, 
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED 
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), 
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE 
+ POSSIBILITY OF SUCH DAMAGE. 
+  
+ Copyright (C) 2011 Apple Inc. All Rights Reserved. 
+  
+ */  
+
+/*
+ * Include necessary headers...
+ */
+
+#include "protocol.h"			/* Sample printer protocol definitions */
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+
+/*
+ * Constants...
+ */
+
+#define MAX_REPLIES	64		/* Maximum pending status replies */
+#define MAX_BUFFER	1048576		/* Maximum device buffer */
+
+
+/*
+ * Local types...
+ */
+
+typedef struct
+{
+  int		fd;			/* File to read from */
+  unsigned char	*buffer;		/* Device buffer */
+  size_t	size,			/* Size of buffer */
+		pos,			/* Position in buffer */
+		len;			/* Bytes in buffer */
+  uint64_t	total;			/* Total bytes read */
+} stream_t;
+
+
+/*
+ * Local globals...
+ */
+
+static double		rate = 0.0,	/* Bytes per second or 0 for unlimited */
+			latency = 0.0,	/* Seconds per command */
+			status_delay = 0.0,
+					/* Seconds before status replies */
+			jitter = 0.0,	/* Largest random extra delay in seconds */
+			refill = 2.0;	/* Seconds to load paper */
+static size_t		buffer_size = 65536;
+					/* Size of device buffer */
+static int		low_page = 0,	/* Page where paper gets low */
+			out_page = 0;	/* Page where paper runs out */
+static unsigned short	seed[3] = { 1, 2, 3 };
+					/* Random number seed for jitter */
+static uint64_t		device_time = 0;/* Time when device is idle */
+static const char	*condition = "OK";
+					/* Current paper condition */
+static uint64_t		replies[MAX_REPLIES];
+					/* Due times of pending replies */
+static int		num_replies = 0,/* Number of pending replies */
+			status_done = 0;/* Stop the status thread? */
+static pthread_mutex_t	status_mutex = PTHREAD_MUTEX_INITIALIZER;
+					/* Mutex for replies */
+static pthread_cond_t	status_cond = PTHREAD_COND_INITIALIZER;
+					/* Condition for replies */
+
+
+/*
+ * Local functions...
+ */
+
+static void	device_delay(double secs);
+static uint64_t	device_now(void);
+static int	fill_buffer(stream_t *stream);
+static int	get_line(stream_t *stream, char *line, size_t linesize);
+static void	load_settings(const char *settings);
+static double	random_jitter(void);
+static void	send_status(const char *status);
+static void	set_condition(const char *status);
+static size_t	skip_data(stream_t *stream, size_t bytes);
+static void	*status_thread(void *data);
+
+
+/*
+ * 'main()' - Consume the sample printer protocol like a slow printer.
+ *
+ * Usage:
+ *
+ *     sampledevice job user title copies options [filename]
+ *
+ * sampledevice stands in for sampletopdf, and so for the printer, where
+ * CoreGraphics and real hardware are not available.  Nothing is printed;
+ * instead the device is simulated using the settings in the SAMPLE_DEVICE
+ * environment variable, a list of name=value pairs separated by spaces or
+ * commas:
+ *
+ *     rate=N[k|m]  Bytes per second the device accepts (default unlimited)
+ *     latency=MS   Milliseconds to process each command (default 0)
+ *     status=MS    Milliseconds before answering LEVELS (default 0)
+ *     jitter=MS    Largest random delay added to the latency and status
+ *     buffer=N[k]  Size of the device buffer in bytes (default 64k)
+ *     lp=PAGE      Report low paper from this page on
+ *     op=PAGE      Run out of paper at the start of this page
+ *     refill=MS    Milliseconds until paper is loaded again (default 2000)
+ *     seed=N       Random number seed for the jitter
+ *
+ * The device reads no more than its buffer at a time and takes the time the
+ * data needs at the given rate, so a slow device applies backpressure to
+ * the filter through the pipe.  Status replies are sent on the back-channel
+ * by a separate thread, so they are late but don't stop the data.  Paper
+ * conditions are also sent on the back-channel when they change, and the
+ * device stops reading while out of paper.
+ *
+ * For example, to see how the filter copes with a 2MB/s printer that takes
+ * a quarter second to report its status:
+ *
+ *     SAMPLE_DEVICE="rate=2m status=250" jobbench -B sampledevice corpus
+ */
+
+int					/* O - Exit status */
+main(int  argc,				/* I - Number of command-line args */
+     char *argv[])			/* I - Command-line arguments */
+{
+  stream_t	stream;			/* Print data */
+  char		line[1024],		/* Command line */
+		*value;			/* Value after command */
+  protocol_command_t command;		/* Command */
+  size_t	bytes;			/* Bytes of data after command */
+  unsigned	band_y,			/* First line in band */
+		band_lines;		/* Number of lines in band */
+  int		pages = 0,		/* Pages started */
+		commands = 0;		/* Commands read */
+  pthread_t	thread;			/* Status reply thread */
+  uint64_t	start;			/* Start of job */
+  double	elapsed;		/* Seconds for job */
+
+
+  if (argc < 6 || argc > 7)
+  {
+    fputs("Usage: sampledevice job user title copies options [filename]\n",
+          stderr);
+    return (1);
+  }
+
+  load_settings(getenv("SAMPLE_DEVICE"));
+
+  signal(SIGPIPE, SIG_IGN);
+
+ /*
+  * Open the print file...
+  */
+
+  memset(&stream, 0, sizeof(stream));
+
+  if (argc == 6)
+    stream.fd = 0;
+  else if ((stream.fd = open(argv[6], O_RDONLY)) < 0)
+  {
+    fprintf(stderr, "ERROR: Unable to open print file - %s\n",
+            strerror(errno));
+    return (1);
+  }
+
+  stream.size = buffer_size;
+
+  if ((stream.buffer = malloc(stream.size)) == NULL)
+  {
+    perror("ERROR: Unable to allocate device buffer");
+    return (1);
+  }
+
+  fprintf(stderr, "DEBUG: Simulating device with rate=%.0f latency=%g "
+                  "status=%g jitter=%g buffer=%u lp=%d op=%d refill=%g\n",
+	  rate, 1000.0 * latency, 1000.0 * status_delay, 1000.0 * jitter,
+	  (unsigned)buffer_size, low_page, out_page, 1000.0 * refill);
+
+  pthread_create(&thread, NULL, status_thread, NULL);
+
+ /*
+  * Read commands until end-of-file, skipping any raster data...
+  */
+
+  start = device_now();
+
+  while (get_line(&stream, line, sizeof(line)))
+  {
+    if (!line[0] || line[0] == '#')
+      continue;
+
+    if ((value = strchr(line, ' ')) != NULL)
+      *value++ = '\0';
+
+    command = ProtocolCommand(line);
+    bytes   = 0;
+
+    commands ++;
+
+    switch (command)
+    {
+      case PROTOCOL_LINE :
+          if (value)
+	    bytes = (size_t)strtoul(value, NULL, 10);
+          break;
+
+      case PROTOCOL_BAND :
+          if (value && sscanf(value, "%u%u%zu", &band_y, &band_lines,
+	                      &bytes) != 3)
+	    bytes = 0;
+          break;
+
+      case PROTOCOL_SPAN :
+          if (value && sscanf(value, "%u%zu", &band_y, &bytes) != 2)
+	    bytes = 0;
+          break;
+
+      case PROTOCOL_REPEATPAGE :
+      case PROTOCOL_PAGE :
+          pages ++;
+
+          if (pages == low_page)
+	    set_condition("LP");
+
+          if (pages == out_page)
+	  {
+	   /*
+	    * Out of paper, so stop taking data until paper is loaded...
+	    */
+
+            fprintf(stderr, "DEBUG: Out of paper on page %d.\n", pages);
+
+	    set_condition("OP");
+	    device_delay(refill);
+	    set_condition(low_page && pages >= low_page ? "LP" : "OK");
+	  }
+          break;
+
+      case PROTOCOL_ENDPAGE :
+          fputs("DEBUG: Ending page...\n", stderr);
+          break;
+
+      case PROTOCOL_LEVELS :
+         /*
+	  * Queue a reply for the status thread...
+	  */
+
+          pthread_mutex_lock(&status_mutex);
+
+	  if (num_replies < MAX_REPLIES)
+	  {
+	    replies[num_replies ++] = device_now() +
+	                              (uint64_t)((status_delay + random_jitter()) *
+				                 1000000000.0);
+	    pthread_cond_signal(&status_cond);
+	  }
+
+	  pthread_mutex_unlock(&status_mutex);
+          break;
+
+      default :
+          break;
+    }
+
+    if (bytes > 0)
+      skip_data(&stream, bytes);
+
+   /*
+    * Take the time to process the command...
+    */
+
+    if (latency > 0.0)
+      device_delay(latency + random_jitter());
+  }
+
+  device_delay(0.0);
+
+  elapsed = (device_now() - start) / 1000000000.0;
+
+ /*
+  * Send any late replies before finishing...
+  */
+
+  pthread_mutex_lock(&status_mutex);
+  status_done = 1;
+  pthread_cond_signal(&status_cond);
+  pthread_mutex_unlock(&status_mutex);
+
+  pthread_join(thread, NULL);
+
+  fprintf(stderr, "DEBUG: Read %llu bytes, %d commands, and %d pages in "
+                  "%.3f seconds (%.1f KB/s).\n",
+	  (unsigned long long)stream.total, commands, pages, elapsed,
+	  elapsed > 0.0 ? stream.total / elapsed / 1024.0 : 0.0);
+
+  if (stream.fd)
+    close(stream.fd);
+
+  free(stream.buffer);
+
+  return (0);
+}
+
+
+/*
+ * 'device_delay()' - Keep the device busy for a time.
+ *
+ * Delays accumulate on the device clock and are only slept once they add up
+ * to a millisecond, so a short latency on thousands of LINE commands costs
+ * what it should rather than the granularity of the system timer.
+ */
+
+static void
+device_delay(double secs)		/* I - Seconds */
+{
+  uint64_t		now = device_now();
+					/* Current time */
+  struct timespec	delay;		/* Time to sleep */
+
+
+  if (device_time < now)
+    device_time = now;
+
+  device_time += (uint64_t)(secs * 1000000000.0);
+
+  if (device_time > now + (secs > 0.0 ? 1000000 : 0))
+  {
+    delay.tv_sec  = (time_t)((device_time - now) / 1000000000);
+    delay.tv_nsec = (long)((device_time - now) % 1000000000);
+
+    while (nanosleep(&delay, &delay) && errno == EINTR);
+  }
+}
+
+
+/*
+ * 'device_now()' - Get a monotonic time in nanoseconds.
+ */
+
+static uint64_t				/* O - Time in nanoseconds */
+device_now(void)
+{
+#ifdef CLOCK_MONOTONIC
+  struct timespec	curtime;	/* Current time */
+
+
+  clock_gettime(CLOCK_MONOTONIC, &curtime);
+
+  return ((uint64_t)curtime.tv_sec * 1000000000 + (uint64_t)curtime.tv_nsec);
+
+#else
+  struct timeval	curtime;	/* Current time */
+
+
+  gettimeofday(&curtime, NULL);
+
+  return ((uint64_t)curtime.tv_sec * 1000000000 + (uint64_t)curtime.tv_usec * 1000);
+#endif /* CLOCK_MONOTONIC */
+}
+
+
+/*
+ * 'fill_buffer()' - Read more data into the device buffer.
+ *
+ * The device only reads what its buffer has room for and takes the time
+ * the data needs at the device's rate, so the filter blocks on a full pipe
+ * just as it would with a slow printer.
+ */
+
+static int				/* O - 1 on success, 0 on end-of-file */
+fill_buffer(stream_t *stream)		/* I - Print data */
+{
+  ssize_t	bytes;			/* Bytes read */
+
+
+  if (rate > 0.0)
+    device_delay(0.0);
+
+  while ((bytes = read(stream->fd, stream->buffer, stream->size)) < 0 &&
+         (errno == EINTR || errno == EAGAIN));
+
+  if (bytes <= 0)
+    return (0);
+
+  stream->pos   = 0;
+  stream->len   = (size_t)bytes;
+  stream->total += (uint64_t)bytes;
+
+  if (rate > 0.0)
+    device_time += (uint64_t)(bytes / rate * 1000000000.0);
+
+  return (1);
+}
+
+
+/*
+ * 'get_line() - Read a command line from the device buffer.
+ */
+
+static int				/* O - 1 on success, 0 on end-of-file */
+get_line(stream_t *stream,		/* I - Print data */
+         char     *line,		/* O - Line */
+	 size_t   linesize)		/* I - Size of line buffer */
+{
+  char		*ptr = line,		/* Pointer into line */
+		*end = line + linesize - 1;
+					/* End of line buffer */
+  int		ch;			/* Current character */
+
+
+  for (;;)
+  {
+    if (stream->pos >= stream->len && !fill_buffer(stream))
+    {
+      *ptr = '\0';
+      return (ptr > line);
+    }
+
+    ch = stream->buffer[stream->pos ++];
+
+    if (ch == '\n')
+      break;
+    else if (ch != '\r' && ptr < end)
+      *ptr++ = (char)ch;
+  }
+
+  *ptr = '\0';
+
+  return (1);
+}
+
+
+/*
+ * 'load_settings()' - Load the device settings.
+ */
+
+static void
+load_settings(const char *settings)	/* I - Settings or NULL */
+{
+  char		name[64];		/* Setting name */
+  double	number;			/* Setting value */
+  char		*ptr;			/* Pointer into value */
+  int		len;			/* Length of name */
+
+
+  if (!settings)
+    return;
+
+  while (*settings)
+  {
+    if (*settings == ' ' || *settings == ',')
+    {
+      settings ++;
+      continue;
+    }
+
+    for (len = 0; *settings && *settings != '=' && *settings != ' ' &&
+                  *settings != ','; settings ++)
+      if (len < (int)sizeof(name) - 1)
+        name[len ++] = *settings;
+
+    name[len] = '\0';
+
+    if (*settings != '=')
+    {
+      fprintf(stderr, "DEBUG: Ignoring device setting \"%s\".\n", name);
+      continue;
+    }
+
+    number = strtod(settings + 1, &ptr);
+
+    if (*ptr == 'k' || *ptr == 'K')
+    {
+      number *= 1024.0;
+      ptr ++;
+    }
+    else if (*ptr == 'm' || *ptr == 'M')
+    {
+      number *= 1048576.0;
+      ptr ++;
+    }
+
+    settings = ptr;
+
+    if (number < 0.0)
+      number = 0.0;
+
+    if (!strcmp(name, "rate"))
+      rate = number;
+    else if (!strcmp(name, "latency"))
+      latency = number / 1000.0;
+    else if (!strcmp(name, "status"))
+      status_delay = number / 1000.0;
+    else if (!strcmp(name, "jitter"))
+      jitter = number / 1000.0;
+    else if (!strcmp(name, "refill"))
+      refill = number / 1000.0;
+    else if (!strcmp(name, "buffer"))
+    {
+      if (number < 1024.0)
+        buffer_size = 1024;
+      else if (number > MAX_BUFFER)
+        buffer_size = MAX_BUFFER;
+      else
+        buffer_size = (size_t)number;
+    }
+    else if (!strcmp(name, "lp"))
+      low_page = (int)number;
+    else if (!strcmp(name, "op"))
+      out_page = (int)number;
+    else if (!strcmp(name, "seed"))
+    {
+      seed[0] = (unsigned short)number;
+      seed[1] = (unsigned short)((unsigned)number >> 16);
+    }
+    else
+      fprintf(stderr, "DEBUG: Ignoring device setting \"%s\".\n", name);
+  }
+}
+
+
+/*
+ * 'random_jitter()' - Get a random extra delay.
+ */
+
+static double				/* O - Seconds */
+random_jitter(void)
+{
+  return (jitter > 0.0 ? jitter * erand48(seed) : 0.0);
+}
+
+
+/*
+ * 'send_status()' - Send status on the back-channel.
+ */
+
+static void
+send_status(const char *status)		/* I - Status lines */
+{
+  size_t	bytes = strlen(status);	/* Bytes to write */
+  ssize_t	written;		/* Bytes written */
+
+
+  while (bytes > 0)
+  {
+    if ((written = write(3, status, bytes)) < 0)
+    {
+      if (errno == EINTR || errno == EAGAIN)
+        continue;
+
+      return;
+    }
+
+    status += written;
+    bytes  -= (size_t)written;
+  }
+}
+
+
+/*
+ * 'set_condition()' - Change the paper condition and report it.
+ */
+
+static void
+set_condition(const char *status)	/* I - "OK", "LP", or "OP" */
+{
+  char	buffer[8];			/* Status line */
+
+
+  pthread_mutex_lock(&status_mutex);
+
+  if (strcmp(condition, status))
+  {
+    condition = status;
+
+    snprintf(buffer, sizeof(buffer), "%s\n", status);
+    send_status(buffer);
+  }
+
+  pthread_mutex_unlock(&status_mutex);
+}
+
+
+/*
+ * 'skip_data()' - Skip the raster data after a command.
+ */
+
+static size_t				/* O - Bytes skipped */
+skip_data(stream_t *stream,		/* I - Print data */
+          size_t   bytes)		/* I - Bytes to skip */
+{
+  size_t	total = 0,		/* Bytes skipped */
+		count;			/* Bytes in buffer */
+
+
+  while (total < bytes)
+  {
+    if (stream->pos >= stream->len && !fill_buffer(stream))
+      break;
+
+    if ((count = stream->len - stream->pos) > bytes - total)
+      count = bytes - total;
+
+    stream->pos += count;
+    total       += count;
+  }
+
+  return (total);
+}
+
+
+/*
+ * 'status_thread()' - Send status replies when they are due.
+ */
+
+static void *				/* O - Thread exit status (unused) */
+status_thread(void *data)		/* I - Thread data (unused) */
+{
+  uint64_t		now;		/* Current time */
+  char			buffer[64];	/* Status reply */
+  struct timespec	delay;		/* Time to sleep */
+
+
+  (void)data;
+
+  pthread_mutex_lock(&status_mutex);
+
+  for (;;)
+  {
+    if (num_replies == 0)
+    {
+      if (status_done)
+        break;
+
+      pthread_cond_wait(&status_cond, &status_mutex);
+      continue;
+    }
+
+    if ((now = device_now()) < replies[0])
+    {
+     /*
+      * Wait for the oldest reply to be due...
+      */
+
+      pthread_mutex_unlock(&status_mutex);
+
+      delay.tv_sec  = (time_t)((replies[0] - now) / 1000000000);
+      delay.tv_nsec = (long)((replies[0] - now) % 1000000000);
+
+      nanosleep(&delay, NULL);
+
+      pthread_mutex_lock(&status_mutex);
+      continue;
+    }
+
+   /*
+    * The ink is virtual, so the levels are always full...
+    */
+
+    snprintf(buffer, sizeof(buffer), "IL100,100,100,100\n%s\n", condition);
+    send_status(buffer);
+
+    memmove(replies, replies + 1, (size_t)(-- num_replies) * sizeof(uint64_t));
+  }
+
+  pthread_mutex_unlock(&status_mutex);
+
+  return (NULL);
+}
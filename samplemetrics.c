@@ -0,0 +1,375 @@
+/*
+     File: samplemetrics.c 
+ Abstract: Shared job metrics exporter for sample CUPS printer driver.
+  Version: 4.0 
+  
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple 
+ Inc. ("Apple") in consideration of your agreement to the following 
+ terms, and your use, installation, modification or redistribution of 
+ this Apple software constitutes acceptance of these terms.  If you do 
+ not agree with these terms, please do not use, install, modify or 
+ redistribute this Apple software. 
+  
+ In consideration of your agreement to abide by the following terms, and 
+ subject to these terms, Apple grants you a personal, non-exclusive 
+ license, under Apple's copyrights in this original Apple software (the 
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple 
+ Software, with or without modifications, in source and/or binary forms; 
+ provided that if you redistribute the Apple Software in its entirety and 
+ without modifications, you must retain this notice and the following 
+ text and disclaimers in all such redistributions of the Apple Software. 
+ Neither the name, trademarks, service marks or logos of Apple Inc. may 
+ be used to endorse or promote products derived from the Apple Software 
+ without specific prior written permission from Apple.  Except as 
+ expressly stated in this notice, no other rights or licenses, express or 
+ implied, are granted by Apple herein, including but not limited to any 
+ patent rights that may be infringed by your derivative works or by other 
+ works in which the Apple Software may be incorporated. 
+  
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE 
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION 
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS 
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND 
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS. 
+  
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL 
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, 
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED 
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), 
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE 
+ POSSIBILITY OF SUCH DAMAGE. 
+  
+ Copyright (C) 2011 Apple Inc. All Rights Reserved. 
+  
+ */  
+
+/*
+ * Include necessary headers...
+ */
+
+#include "metrics.h"			/* Shared job metrics definitions */
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+
+/*
+ * Constants...
+ */
+
+#define MAX_FILES	256		/* Maximum number of metrics files */
+
+
+/*
+ * Local globals...
+ */
+
+static const char * const counter_help[METRIC_MAX] =
+{					/* Help text for counters */
+  "Jobs processed.",
+  "Pages processed.",
+  "Raster lines processed.",
+  "Bytes read.",
+  "Bytes written.",
+  "Raster bytes before encoding.",
+  "Raster bytes after encoding.",
+  "Back-channel status round-trips.",
+  "Pages repeated from the printer's page cache.",
+  "Pages the printer's page cache did not have."
+};
+static metrics_file_t	*files[MAX_FILES];
+					/* Metrics files */
+static int		num_files = 0;	/* Number of metrics files */
+
+
+/*
+ * Local functions...
+ */
+
+static void	load_dir(const char *dirname);
+static void	load_file(const char *filename);
+static void	print_labels(const metrics_file_t *file, const char *extra);
+static void	print_string(const char *s);
+
+
+/*
+ * 'main()' - Show the shared job metrics in the Prometheus text format.
+ *
+ * Usage:
+ *
+ *     samplemetrics [directory or file ...]
+ *
+ * With no arguments, the directory named by SAMPLE_METRICS or
+ * /Library/Caches is used.
+ */
+
+int					/* O - Exit status */
+main(int  argc,				/* I - Number of command-line args */
+     char *argv[])			/* I - Command-line arguments */
+{
+  int			i, j, k;	/* Looping vars */
+  const char		*dir;		/* Metrics directory */
+  struct stat		info;		/* File information */
+  metrics_file_t	*file;		/* Current file */
+  const metrics_histogram_t *times;	/* Current histogram */
+  uint64_t		total;		/* Cumulative bucket count */
+  char			extra[256];	/* Extra labels */
+
+
+ /*
+  * Load the metrics files...
+  */
+
+  if (argc == 1)
+  {
+    if ((dir = getenv("SAMPLE_METRICS")) == NULL)
+      dir = "/Library/Caches";
+
+    load_dir(dir);
+  }
+  else
+  {
+    for (i = 1; i < argc; i ++)
+    {
+      if (argv[i][0] == '-')
+      {
+        fputs("Usage: samplemetrics [directory or file ...]\n", stderr);
+	return (1);
+      }
+      else if (!stat(argv[i], &info) && S_ISDIR(info.st_mode))
+        load_dir(argv[i]);
+      else
+        load_file(argv[i]);
+    }
+  }
+
+ /*
+  * Show the counters...
+  */
+
+  for (i = 0; i < METRIC_MAX; i ++)
+  {
+    printf("# HELP sample_%s_total %s\n", MetricNames[i], counter_help[i]);
+    printf("# TYPE sample_%s_total counter\n", MetricNames[i]);
+
+    for (j = 0; j < num_files; j ++)
+    {
+      printf("sample_%s_total", MetricNames[i]);
+      print_labels(files[j], NULL);
+      printf(" %llu\n", (unsigned long long)files[j]->counters[i]);
+    }
+  }
+
+  puts("# HELP sample_compression_ratio Raster bytes before encoding divided by bytes after.");
+  puts("# TYPE sample_compression_ratio gauge");
+
+  for (j = 0; j < num_files; j ++)
+  {
+    file = files[j];
+
+    if (!file->counters[METRIC_ENCODED_BYTES])
+      continue;
+
+    fputs("sample_compression_ratio", stdout);
+    print_labels(file, NULL);
+    printf(" %.4f\n", (double)file->counters[METRIC_RAW_BYTES] /
+                      (double)file->counters[METRIC_ENCODED_BYTES]);
+  }
+
+  puts("# HELP sample_peak_rss_bytes Largest resident set of any job.");
+  puts("# TYPE sample_peak_rss_bytes gauge");
+
+  for (j = 0; j < num_files; j ++)
+  {
+    fputs("sample_peak_rss_bytes", stdout);
+    print_labels(files[j], NULL);
+    printf(" %llu\n", (unsigned long long)files[j]->peak_rss);
+  }
+
+ /*
+  * Show the stage times as histograms.  Prometheus buckets are cumulative,
+  * while ours count only the times that fall in each one...
+  */
+
+  puts("# HELP sample_stage_seconds Time spent in each stage.");
+  puts("# TYPE sample_stage_seconds histogram");
+
+  for (j = 0; j < num_files; j ++)
+  {
+    file = files[j];
+
+    for (i = 0; i < METRIC_TIME_MAX; i ++)
+    {
+      times = file->times + i;
+
+      if (!times->count)
+        continue;
+
+      for (k = 0, total = 0; k <= METRICS_BUCKETS; k ++)
+      {
+        total += times->buckets[k];
+
+        if (k < METRICS_BUCKETS)
+	  snprintf(extra, sizeof(extra), "stage=\"%s\",le=\"%g\"",
+	           MetricTimeNames[i],
+		   (double)((uint64_t)METRICS_BUCKET_NSECS << k) / 1000000000.0);
+        else
+	  snprintf(extra, sizeof(extra), "stage=\"%s\",le=\"+Inf\"",
+	           MetricTimeNames[i]);
+
+        fputs("sample_stage_seconds_bucket", stdout);
+	print_labels(file, extra);
+	printf(" %llu\n", (unsigned long long)total);
+      }
+
+      snprintf(extra, sizeof(extra), "stage=\"%s\"", MetricTimeNames[i]);
+
+      fputs("sample_stage_seconds_sum", stdout);
+      print_labels(file, extra);
+      printf(" %.9f\n", times->nsecs / 1000000000.0);
+
+      fputs("sample_stage_seconds_count", stdout);
+      print_labels(file, extra);
+      printf(" %llu\n", (unsigned long long)times->count);
+    }
+  }
+
+  return (0);
+}
+
+
+/*
+ * 'load_dir()' - Load the metrics files in a directory.
+ */
+
+static void
+load_dir(const char *dirname)		/* I - Directory */
+{
+  DIR		*dir;			/* Directory */
+  struct dirent	*dent;			/* Directory entry */
+  size_t	length;			/* Length of name */
+  char		filename[1024];		/* Metrics filename */
+
+
+  if ((dir = opendir(dirname)) == NULL)
+  {
+    fprintf(stderr, "samplemetrics: Unable to open \"%s\": %s\n", dirname,
+            strerror(errno));
+    return;
+  }
+
+  while ((dent = readdir(dir)) != NULL)
+  {
+    if ((length = strlen(dent->d_name)) < 9 ||
+        strcmp(dent->d_name + length - 8, ".metrics"))
+      continue;
+
+    snprintf(filename, sizeof(filename), "%s/%s", dirname, dent->d_name);
+    load_file(filename);
+  }
+
+  closedir(dir);
+}
+
+
+/*
+ * 'load_file()' - Load a metrics file.
+ *
+ * Jobs may be adding to the file while it is read, so the values are only
+ * a snapshot and can be a job apart from each other.
+ */
+
+static void
+load_file(const char *filename)		/* I - Metrics file */
+{
+  int			fd;		/* File */
+  metrics_file_t	*file;		/* Metrics */
+
+
+  if (num_files >= MAX_FILES)
+    return;
+
+  if ((fd = open(filename, O_RDONLY)) < 0)
+  {
+    fprintf(stderr, "samplemetrics: Unable to open \"%s\": %s\n", filename,
+            strerror(errno));
+    return;
+  }
+
+  if ((file = malloc(sizeof(metrics_file_t))) == NULL)
+  {
+    close(fd);
+    return;
+  }
+
+  if (read(fd, file, sizeof(metrics_file_t)) != sizeof(metrics_file_t) ||
+      file->magic != METRICS_MAGIC || file->size != sizeof(metrics_file_t))
+  {
+    fprintf(stderr, "samplemetrics: \"%s\" is not a metrics file.\n",
+            filename);
+    free(file);
+  }
+  else
+  {
+    file->queue[sizeof(file->queue) - 1]     = '\0';
+    file->program[sizeof(file->program) - 1] = '\0';
+
+    files[num_files ++] = file;
+  }
+
+  close(fd);
+}
+
+
+/*
+ * 'print_labels()' - Print the labels for a file.
+ */
+
+static void
+print_labels(
+    const metrics_file_t *file,		/* I - Metrics file */
+    const char           *extra)	/* I - Extra labels or NULL */
+{
+  fputs("{queue=", stdout);
+  print_string(file->queue);
+  fputs(",program=", stdout);
+  print_string(file->program);
+
+  if (extra)
+    printf(",%s", extra);
+
+  putchar('}');
+}
+
+
+/*
+ * 'print_string()' - Print a quoted label value.
+ */
+
+static void
+print_string(const char *s)		/* I - String */
+{
+  putchar('\"');
+
+  for (; *s; s ++)
+  {
+    if (*s == '\\' || *s == '\"')
+    {
+      putchar('\\');
+      putchar(*s);
+    }
+    else if (*s == '\n')
+      fputs("\\n", stdout);
+    else
+      putchar(*s);
+  }
+
+  putchar('\"');
+}
@@ -0,0 +1,963 @@
+/*
+     File: stressbench.c 
+ Abstract: Multi-queue stress harness for sample CUPS printer driver.
+  Version: 4.0 
+  
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple 
+ Inc. ("Apple") in consideration of your agreement to the following 
+ terms, and your use, installation, modification or redistribution of 
+ this Apple software constitutes acceptance of these terms.  If you do 
+ not agree with these terms, please do not use, install, modify or 
+ redistribute this Apple software. 
+  
+ In consideration of your agreement to abide by the following terms, and 
+ subject to these terms, Apple grants you a personal, non-exclusive 
+ license, under Apple's copyrights in this original Apple software (the 
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple 
+ Software, with or without modifications, in source and/or binary forms; 
+ provided that if you redistribute the Apple Software in its entirety and 
+ without modifications, you must retain this notice and the following 
+ text and disclaimers in all such redistributions of the Apple Software. 
+ Neither the name, trademarks, service marks or logos of Apple Inc. may 
+ be used to endorse or promote products derived from the Apple Software 
+ without specific prior written permission from Apple.  Except as 
+ expressly stated in this notice, no other rights or licenses, express or 
+ implied, are granted by Apple herein, including but not limited to any 
+ patent rights that may be infringed by your derivative works or by other 
+ works in which the Apple Software may be incorporated. 
+  
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE 
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION 
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS 
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND 
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS. 
+  
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL 
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, 
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED 
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), 
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE 
+ POSSIBILITY OF SUCH DAMAGE. 
+  
+ Copyright (C) 2011 Apple Inc. All Rights Reserved. 
+  
+ */  
+
+/*
+ * Include necessary headers...
+ */
+
+#include "metrics.h"			/* MetricsNow() */
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+
+/*
+ * Constants...
+ */
+
+#define MAX_DOCS	256		/* Maximum documents in corpus */
+#define MAX_JOBS	4096		/* Maximum jobs per level */
+#define MAX_LEVELS	32		/* Maximum concurrency levels */
+#define MAX_QUEUES	64		/* Maximum printer queues */
+#define MAX_THREADS	256		/* Maximum concurrent jobs */
+
+#define INK_SEED	1000000000	/* Starting ink level for each channel */
+#define INK_RESET	1000000		/* Full level used by a reset cache file */
+
+
+/*
+ * Local types...
+ */
+
+typedef struct
+{
+  char		name[256];		/* Queue name */
+  char		**envp;			/* Environment for programs */
+  int		active;			/* Jobs running on queue */
+  long		busy_samples,		/* Samples with jobs running */
+		locked_samples,		/* Samples with the ink file locked */
+		contended_samples;	/* Locked samples with other jobs waiting */
+} queue_t;
+
+typedef struct
+{
+  int		doc,			/* Document index */
+		queue,			/* Queue index */
+		status;			/* 0 if every process succeeded */
+  uint64_t	start,			/* Start time */
+		end;			/* End time */
+} run_t;
+
+
+/*
+ * Local globals...
+ */
+
+static const char	*backend = NULL;/* Backend program */
+static const char	*bindir = ".";	/* Directory with programs */
+static char		*docs[MAX_DOCS];/* Documents to print */
+static int		num_docs = 0;	/* Number of documents */
+static int64_t		doc_ink[MAX_DOCS];
+					/* Ink used by each document alone */
+static queue_t		queues[MAX_QUEUES + 1];
+					/* Queues, plus one for solo runs */
+static int		num_queues = 4;	/* Number of queues */
+static run_t		runs[MAX_JOBS];	/* Jobs in current level */
+static int		num_runs = 0,	/* Number of jobs in current level */
+			next_run = 0;	/* Next job to start */
+static int		sampling = 0;	/* Sample the ink file locks? */
+static pthread_mutex_t	stress_mutex = PTHREAD_MUTEX_INITIALIZER;
+					/* Mutex for queues and runs */
+static int		verbose = 0;	/* Show program messages? */
+
+
+/*
+ * Local functions...
+ */
+
+static void	add_doc(const char *path);
+static void	clean_queue(queue_t *queue, int seed);
+static int	compare_doubles(const void *a, const void *b);
+static int	compare_strings(const void *a, const void *b);
+static int64_t	ink_used(queue_t *queue, int *reset);
+static void	load_corpus(const char *path);
+static char	**make_env(const char *printer);
+static int	run_job(int doc, int queue, int jobid, run_t *run);
+static void	*run_worker(void *data);
+static void	*sample_locks(void *data);
+static pid_t	start_program(const char *program, const char *filename,
+		              char **envp, int jobid, int infd, int outfd,
+			      int bcfd, int errfd);
+static void	usage(void);
+
+
+/*
+ * 'main()' - Run print jobs on several queues at once and measure how the
+ *            driver scales.
+ *
+ * Usage:
+ *
+ *     stressbench [options] corpus ...
+ *
+ * Each corpus is a directory of documents or a single document, using the
+ * same extensions as jobbench (.ras, .cmd, and .smp).  For each concurrency
+ * level, that many jobs run at once on a pool of queues, and the harness
+ * reports the throughput, the latency percentiles, and three measures of
+ * how the jobs on a queue get in each other's way:
+ *
+ *     overlap   Jobs that ran while another job on the same queue was
+ *               running, i.e. whose ink level read-modify-write raced
+ *     contend   Share of samples on a busy queue where the ink file held a
+ *               POSIX record lock while another job on the queue was running
+ *     lost      Ink updates lost, in jobs, found by comparing the final ink
+ *               levels with the ink each document uses when printed alone
+ *
+ * Queues whose ink file was reset to full by a torn read are counted in the
+ * "resets" column and left out of the lost updates.
+ */
+
+int					/* O - Exit status */
+main(int  argc,				/* I - Number of command-line args */
+     char *argv[])			/* I - Command-line arguments */
+{
+  int		i, j;			/* Looping vars */
+  char		*levelstr = "1,2,4,8,16",
+					/* Concurrency levels */
+		*ptr;			/* Pointer into levels */
+  int		levels[MAX_LEVELS],	/* Concurrency levels */
+		num_levels = 0,		/* Number of levels */
+		jobs_per_level = 0;	/* Jobs per level or 0 for automatic */
+  const char	*prefix = "stress";	/* Queue name prefix */
+  char		name[256];		/* Queue name */
+  pthread_t	workers[MAX_THREADS],	/* Job threads */
+		sampler;		/* Lock sampling thread */
+  run_t		solo;			/* Solo run */
+  int		reset,			/* Was the ink file reset? */
+		resets,			/* Number of reset queues */
+		failed,			/* Number of failed jobs */
+		overlapped;		/* Number of overlapped jobs */
+  int64_t	expected[MAX_QUEUES],	/* Ink each queue should have used */
+		expected_total,		/* Ink all jobs should have used */
+		used,			/* Ink a queue did use */
+		lost;			/* Ink whose update was lost */
+  long		busy,			/* Busy samples */
+		contended;		/* Contended samples */
+  uint64_t	start,			/* Start of level */
+		end;			/* End of level */
+  double	elapsed,		/* Seconds for level */
+		rate,			/* Jobs per second */
+		base_rate = 0.0,	/* Jobs per second at first level */
+		latency[MAX_JOBS];	/* Latency of each job */
+  int		status = 0;		/* Exit status */
+
+
+  for (i = 1; i < argc; i ++)
+  {
+    if (!strcmp(argv[i], "-B") && i + 1 < argc)
+      backend = argv[++ i];
+    else if (!strcmp(argv[i], "-b") && i + 1 < argc)
+      bindir = argv[++ i];
+    else if (!strcmp(argv[i], "-c") && i + 1 < argc)
+      levelstr = argv[++ i];
+    else if (!strcmp(argv[i], "-j") && i + 1 < argc)
+    {
+      if ((jobs_per_level = atoi(argv[++ i])) < 1 || jobs_per_level > MAX_JOBS)
+        usage();
+    }
+    else if (!strcmp(argv[i], "-p") && i + 1 < argc)
+      prefix = argv[++ i];
+    else if (!strcmp(argv[i], "-q") && i + 1 < argc)
+    {
+      if ((num_queues = atoi(argv[++ i])) < 1 || num_queues > MAX_QUEUES)
+        usage();
+    }
+    else if (!strcmp(argv[i], "-v"))
+      verbose = 1;
+    else if (argv[i][0] == '-')
+      usage();
+    else
+      load_corpus(argv[i]);
+  }
+
+  if (num_docs == 0)
+    usage();
+
+  for (ptr = levelstr; *ptr && num_levels < MAX_LEVELS;)
+  {
+    if ((levels[num_levels] = (int)strtol(ptr, &ptr, 10)) < 1 ||
+        levels[num_levels] > MAX_THREADS)
+      usage();
+
+    num_levels ++;
+
+    if (*ptr == ',')
+      ptr ++;
+    else if (*ptr)
+      usage();
+  }
+
+  if (strchr(prefix, '/'))
+  {
+    fputs("stressbench: Bad printer name.\n", stderr);
+    return (1);
+  }
+
+  if (!backend)
+  {
+    static char	path[1024];		/* Default backend */
+
+    snprintf(path, sizeof(path), "%s/sampletopdf", bindir);
+    backend = path;
+  }
+
+  for (i = 0; i <= num_queues; i ++)
+  {
+    if (i < num_queues)
+      snprintf(name, sizeof(name), "%s-%d", prefix, i + 1);
+    else
+      snprintf(name, sizeof(name), "%s-solo", prefix);
+
+    snprintf(queues[i].name, sizeof(queues[i].name), "%s", name);
+    queues[i].envp = make_env(name);
+  }
+
+  signal(SIGPIPE, SIG_IGN);
+
+ /*
+  * Print each document alone to see how much ink it uses...
+  */
+
+  for (i = 0; i < num_docs; i ++)
+  {
+    clean_queue(queues + num_queues, 1);
+
+    if (run_job(i, num_queues, i + 1, &solo))
+    {
+      fprintf(stderr, "stressbench: Unable to print \"%s\".\n", docs[i]);
+      return (1);
+    }
+
+    doc_ink[i] = ink_used(queues + num_queues, &reset);
+
+    if (verbose)
+      fprintf(stderr, "stressbench: %s uses %lld ink in %.1fms.\n", docs[i],
+              (long long)doc_ink[i], (solo.end - solo.start) / 1000000.0);
+  }
+
+  clean_queue(queues + num_queues, 0);
+
+ /*
+  * Run each level...
+  */
+
+  printf("%d documents, %d queues\n", num_docs, num_queues);
+  printf("%5s %5s %8s %7s %9s %9s %9s %9s %8s %8s %6s %6s\n", "conc", "jobs",
+         "jobs/s", "scale", "p50", "p95", "p99", "max", "overlap", "contend",
+	 "lost", "resets");
+
+  for (i = 0; i < num_levels; i ++)
+  {
+    for (j = 0; j < num_queues; j ++)
+    {
+      clean_queue(queues + j, 1);
+
+      queues[j].busy_samples      = 0;
+      queues[j].locked_samples    = 0;
+      queues[j].contended_samples = 0;
+    }
+
+    num_runs = jobs_per_level ? jobs_per_level : 4 * levels[i];
+    next_run = 0;
+
+    if (num_runs > MAX_JOBS)
+      num_runs = MAX_JOBS;
+
+    for (j = 0; j < num_runs; j ++)
+    {
+      runs[j].doc   = j % num_docs;
+      runs[j].queue = j % num_queues;
+    }
+
+    sampling = 1;
+    pthread_create(&sampler, NULL, sample_locks, NULL);
+
+    start = MetricsNow();
+
+    for (j = 0; j < levels[i]; j ++)
+      pthread_create(workers + j, NULL, run_worker, NULL);
+
+    for (j = 0; j < levels[i]; j ++)
+      pthread_join(workers[j], NULL);
+
+    end = MetricsNow();
+
+    sampling = 0;
+    pthread_join(sampler, NULL);
+
+   /*
+    * Collect the results...
+    */
+
+    memset(expected, 0, sizeof(expected));
+
+    for (j = 0, failed = 0, overlapped = 0; j < num_runs; j ++)
+    {
+      int	k;			/* Looping var */
+
+
+      latency[j] = (runs[j].end - runs[j].start) / 1000000000.0;
+
+      if (runs[j].status)
+        failed ++;
+      else
+        expected[runs[j].queue] += doc_ink[runs[j].doc];
+
+      for (k = 0; k < num_runs; k ++)
+        if (k != j && runs[k].queue == runs[j].queue &&
+	    runs[k].start < runs[j].end && runs[j].start < runs[k].end)
+	{
+	  overlapped ++;
+	  break;
+	}
+    }
+
+    for (j = 0, expected_total = 0, lost = 0, resets = 0, busy = 0,
+             contended = 0; j < num_queues; j ++)
+    {
+      expected_total += expected[j];
+      busy           += queues[j].busy_samples;
+      contended      += queues[j].contended_samples;
+
+      used = ink_used(queues + j, &reset);
+
+      if (reset)
+        resets ++;
+      else if (used < expected[j])
+        lost += expected[j] - used;
+    }
+
+    qsort(latency, num_runs, sizeof(double), compare_doubles);
+
+    elapsed = (end - start) / 1000000000.0;
+    rate    = num_runs / elapsed;
+
+    if (i == 0)
+      base_rate = rate / levels[i];
+
+    printf("%5d %5d %8.2f %6.2fx %7.1fms %7.1fms %7.1fms %7.1fms %7.1f%% "
+           "%7.1f%% %6.1f %6d%s\n", levels[i], num_runs, rate,
+	   rate / base_rate, 1000.0 * latency[num_runs / 2],
+	   1000.0 * latency[(num_runs * 95) / 100],
+	   1000.0 * latency[(num_runs * 99) / 100],
+	   1000.0 * latency[num_runs - 1], 100.0 * overlapped / num_runs,
+	   busy ? 100.0 * contended / busy : 0.0,
+	   expected_total ? (double)lost * num_runs / expected_total : 0.0,
+	   resets, failed ? "  FAILED" : "");
+    fflush(stdout);
+
+    if (failed)
+      status = 1;
+  }
+
+  for (j = 0; j < num_queues; j ++)
+    clean_queue(queues + j, 0);
+
+  return (status);
+}
+
+
+/*
+ * 'add_doc()' - Add a document to the corpus.
+ */
+
+static void
+add_doc(const char *path)		/* I - Document file */
+{
+  if (num_docs >= MAX_DOCS)
+  {
+    fprintf(stderr, "stressbench: Too many documents, ignoring \"%s\".\n",
+            path);
+    return;
+  }
+
+  docs[num_docs ++] = strdup(path);
+}
+
+
+/*
+ * 'clean_queue()' - Remove a queue's output files and seed its ink levels.
+ *
+ * The ink levels start high enough that no job runs out of ink, so the ink
+ * used by a level is simply the seed minus the final levels.
+ */
+
+static void
+clean_queue(queue_t *queue,		/* I - Queue */
+            int     seed)		/* I - Seed the ink levels? */
+{
+  char		dirname[1024],		/* Output directory */
+		filename[1024];		/* Output file */
+  DIR		*dir;			/* Directory */
+  struct dirent	*dent;			/* Directory entry */
+  FILE		*fp;			/* Ink file */
+
+
+  snprintf(dirname, sizeof(dirname), "/Library/Caches/%s", queue->name);
+
+  if ((dir = opendir(dirname)) != NULL)
+  {
+    while ((dent = readdir(dir)) != NULL)
+    {
+      if (dent->d_name[0] == '.')
+        continue;
+
+      if (snprintf(filename, sizeof(filename), "%s/%s", dirname,
+                   dent->d_name) < (int)sizeof(filename))
+        unlink(filename);
+    }
+
+    closedir(dir);
+  }
+
+  snprintf(filename, sizeof(filename), "/Library/Caches/%s.cmyk", queue->name);
+
+  if (!seed)
+  {
+    unlink(filename);
+    rmdir(dirname);
+  }
+  else if ((fp = fopen(filename, "w")) != NULL)
+  {
+    fprintf(fp, "%d %d %d %d\n", INK_SEED, INK_SEED, INK_SEED, INK_SEED);
+    fclose(fp);
+  }
+  else
+  {
+    fprintf(stderr, "stressbench: Unable to create \"%s\": %s\n", filename,
+            strerror(errno));
+    exit(1);
+  }
+}
+
+
+/*
+ * 'compare_doubles()' - Compare two times.
+ */
+
+static int				/* O - Result of comparison */
+compare_doubles(const void *a,		/* I - First time */
+                const void *b)		/* I - Second time */
+{
+  double	da = *((const double *)a),
+		db = *((const double *)b);
+
+
+  return (da < db ? -1 : da > db);
+}
+
+
+/*
+ * 'compare_strings()' - Compare two filenames.
+ */
+
+static int				/* O - Result of comparison */
+compare_strings(const void *a,		/* I - First filename */
+                const void *b)		/* I - Second filename */
+{
+  return (strcmp(*((char * const *)a), *((char * const *)b)));
+}
+
+
+/*
+ * 'ink_used()' - Get the ink a queue used since it was seeded.
+ */
+
+static int64_t				/* O - Ink used, all channels */
+ink_used(queue_t *queue,		/* I - Queue */
+         int     *reset)		/* O - 1 if the levels were reset */
+{
+  char		filename[1024];		/* Ink file */
+  FILE		*fp;			/* Ink file */
+  int		cmyk[4],		/* Ink levels */
+		i;			/* Looping var */
+  int64_t	used = 0;		/* Ink used */
+
+
+  *reset = 0;
+
+  snprintf(filename, sizeof(filename), "/Library/Caches/%s.cmyk", queue->name);
+
+  if ((fp = fopen(filename, "r")) == NULL)
+  {
+    *reset = 1;
+    return (0);
+  }
+
+  if (fscanf(fp, "%d%d%d%d", cmyk + 0, cmyk + 1, cmyk + 2, cmyk + 3) != 4)
+    *reset = 1;
+
+  fclose(fp);
+
+  for (i = 0; i < 4 && !*reset; i ++)
+  {
+    if (cmyk[i] <= INK_RESET)
+      *reset = 1;
+    else
+      used += INK_SEED - cmyk[i];
+  }
+
+  return (*reset ? 0 : used);
+}
+
+
+/*
+ * 'load_corpus()' - Add the documents in a corpus directory or file.
+ */
+
+static void
+load_corpus(const char *path)		/* I - Directory or file */
+{
+  DIR		*dir;			/* Directory */
+  struct dirent	*dent;			/* Directory entry */
+  struct stat	info;			/* File information */
+  char		filename[1024];		/* Document filename */
+  char		*names[MAX_DOCS];	/* Entries in directory */
+  int		i,			/* Looping var */
+		count = 0;		/* Number of entries */
+
+
+  if (stat(path, &info))
+  {
+    fprintf(stderr, "stressbench: Unable to open \"%s\": %s\n", path,
+            strerror(errno));
+    return;
+  }
+
+  if (!S_ISDIR(info.st_mode))
+  {
+    add_doc(path);
+    return;
+  }
+
+  if ((dir = opendir(path)) == NULL)
+  {
+    fprintf(stderr, "stressbench: Unable to open \"%s\": %s\n", path,
+            strerror(errno));
+    return;
+  }
+
+  while ((dent = readdir(dir)) != NULL && count < MAX_DOCS)
+    if (dent->d_name[0] != '.')
+      names[count ++] = strdup(dent->d_name);
+
+  closedir(dir);
+
+  qsort(names, count, sizeof(char *), compare_strings);
+
+  for (i = 0; i < count; i ++)
+  {
+    snprintf(filename, sizeof(filename), "%s/%s", path, names[i]);
+
+    if (!stat(filename, &info) && S_ISREG(info.st_mode))
+      add_doc(filename);
+
+    free(names[i]);
+  }
+}
+
+
+/*
+ * 'make_env()' - Make the environment for a queue's programs.
+ *
+ * The environment is built before any threads start because the children
+ * of a threaded process can't safely call setenv() before exec.
+ */
+
+static char **				/* O - Environment */
+make_env(const char *printer)		/* I - Printer queue name */
+{
+  extern char	**environ;		/* Current environment */
+  char		**envp,			/* New environment */
+		**ptr,			/* Pointer into environment */
+		buffer[PATH_MAX + 5],	/* Variable */
+		ppd[PATH_MAX];		/* PPD file */
+  int		count;			/* Number of variables */
+
+
+  for (count = 0; environ[count]; count ++);
+
+  if ((envp = calloc(count + 3, sizeof(char *))) == NULL)
+  {
+    perror("stressbench: Unable to allocate memory");
+    exit(1);
+  }
+
+  for (ptr = envp, count = 0; environ[count]; count ++)
+    if (strncmp(environ[count], "PRINTER=", 8))
+      *ptr++ = environ[count];
+
+  snprintf(buffer, sizeof(buffer), "PRINTER=%s", printer);
+  *ptr++ = strdup(buffer);
+
+  if (!getenv("PPD") && realpath("sample.ppd", ppd))
+  {
+    snprintf(buffer, sizeof(buffer), "PPD=%s", ppd);
+    *ptr++ = strdup(buffer);
+  }
+
+  return (envp);
+}
+
+
+/*
+ * 'run_job()' - Run one job, connecting the filter and backend directly.
+ */
+
+static int				/* O - 0 on success, 1 on failure */
+run_job(int   doc,			/* I - Document index */
+        int   queue,			/* I - Queue index */
+	int   jobid,			/* I - Job ID */
+	run_t *run)			/* O - Start, end, and status */
+{
+  int		data[2],		/* Pipe to backend */
+		backch[2],		/* Back-channel */
+		errfd,			/* Program messages */
+		infd,			/* Backend input */
+		wstatus;		/* Exit status */
+  const char	*ext;			/* Document extension */
+  char		program[1024];		/* Filter */
+  pid_t		backend_pid,		/* Backend */
+		filter_pid = -1;	/* Filter or -1 */
+  queue_t	*q = queues + queue;	/* Queue */
+
+
+  run->status = 0;
+
+  errfd = open(verbose ? "/dev/stderr" : "/dev/null", O_WRONLY);
+
+  data[0] = data[1] = -1;
+
+  if (pipe(backch))
+  {
+    perror("stressbench: Unable to create pipes");
+    exit(1);
+  }
+
+  pthread_mutex_lock(&stress_mutex);
+  q->active ++;
+  pthread_mutex_unlock(&stress_mutex);
+
+  run->start = MetricsNow();
+
+ /*
+  * Recorded streams go straight to the backend, everything else through the
+  * filter...
+  */
+
+  if ((ext = strrchr(docs[doc], '.')) != NULL && !strcmp(ext, ".smp"))
+  {
+    if ((infd = open(docs[doc], O_RDONLY)) < 0)
+    {
+      fprintf(stderr, "stressbench: Unable to open \"%s\": %s\n", docs[doc],
+	      strerror(errno));
+      exit(1);
+    }
+  }
+  else
+  {
+    if (pipe(data))
+    {
+      perror("stressbench: Unable to create pipes");
+      exit(1);
+    }
+
+    if (ext && !strcmp(ext, ".cmd"))
+      snprintf(program, sizeof(program), "%s/commandtosample", bindir);
+    else
+      snprintf(program, sizeof(program), "%s/rastertosample", bindir);
+
+    filter_pid = start_program(program, docs[doc], q->envp, jobid, -1,
+                               data[1], backch[0], errfd);
+    infd       = data[0];
+
+    close(data[1]);
+  }
+
+  backend_pid = start_program(backend, NULL, q->envp, jobid, infd, errfd,
+                              backch[1], errfd);
+
+  close(infd);
+  close(backch[0]);
+  close(backch[1]);
+  close(errfd);
+
+ /*
+  * Wait for both to finish...
+  */
+
+  if (data[0] >= 0)
+  {
+    if (filter_pid < 0)
+      run->status = 1;
+    else
+    {
+      while (waitpid(filter_pid, &wstatus, 0) < 0 && errno == EINTR);
+
+      if (!WIFEXITED(wstatus) || WEXITSTATUS(wstatus))
+	run->status = 1;
+    }
+  }
+
+  if (backend_pid > 0)
+  {
+    while (waitpid(backend_pid, &wstatus, 0) < 0 && errno == EINTR);
+
+    if (!WIFEXITED(wstatus) || WEXITSTATUS(wstatus))
+      run->status = 1;
+  }
+  else
+    run->status = 1;
+
+  run->end = MetricsNow();
+
+  pthread_mutex_lock(&stress_mutex);
+  q->active --;
+  pthread_mutex_unlock(&stress_mutex);
+
+  if (run->status)
+    fprintf(stderr, "stressbench: Job %d (\"%s\" on %s) failed.\n", jobid,
+            docs[doc], q->name);
+
+  return (run->status);
+}
+
+
+/*
+ * 'run_worker()' - Run jobs from the current level until none are left.
+ */
+
+static void *				/* O - Thread exit status (unused) */
+run_worker(void *data)			/* I - Thread data (unused) */
+{
+  int	i;				/* Job to run */
+
+
+  (void)data;
+
+  for (;;)
+  {
+    pthread_mutex_lock(&stress_mutex);
+    i = next_run ++;
+    pthread_mutex_unlock(&stress_mutex);
+
+    if (i >= num_runs)
+      break;
+
+    run_job(runs[i].doc, runs[i].queue, i + 1, runs + i);
+  }
+
+  return (NULL);
+}
+
+
+/*
+ * 'sample_locks()' - Sample the ink file locks every millisecond.
+ *
+ * A queue is busy while it has jobs running.  For each busy queue, the ink
+ * file is tested for a POSIX record lock, and a lock seen while another job
+ * is running on the queue counts as contended, since that job either waits
+ * for the lock or will soon.
+ */
+
+static void *				/* O - Thread exit status (unused) */
+sample_locks(void *data)		/* I - Thread data (unused) */
+{
+  int			i,		/* Looping var */
+			fd,		/* Ink file */
+			active;		/* Jobs running on queue */
+  char			filename[1024];	/* Ink file */
+  struct flock		lock;		/* Lock test */
+  struct timespec	delay;		/* Time between samples */
+
+
+  (void)data;
+
+  delay.tv_sec  = 0;
+  delay.tv_nsec = 1000000;
+
+  while (sampling)
+  {
+    for (i = 0; i < num_queues; i ++)
+    {
+      pthread_mutex_lock(&stress_mutex);
+      active = queues[i].active;
+      pthread_mutex_unlock(&stress_mutex);
+
+      if (!active)
+        continue;
+
+      queues[i].busy_samples ++;
+
+      if (snprintf(filename, sizeof(filename), "/Library/Caches/%s.cmyk",
+                   queues[i].name) >= (int)sizeof(filename) ||
+          (fd = open(filename, O_RDONLY)) < 0)
+        continue;
+
+      memset(&lock, 0, sizeof(lock));
+      lock.l_type   = F_WRLCK;
+      lock.l_whence = SEEK_SET;
+
+      if (!fcntl(fd, F_GETLK, &lock) && lock.l_type != F_UNLCK)
+      {
+        queues[i].locked_samples ++;
+
+	if (active > 1)
+	  queues[i].contended_samples ++;
+      }
+
+      close(fd);
+    }
+
+    nanosleep(&delay, NULL);
+  }
+
+  return (NULL);
+}
+
+
+/*
+ * 'start_program()' - Start a filter or backend the way cupsd does.
+ *
+ * Only async-signal-safe functions are used in the child since other threads
+ * may be holding locks when it is forked.
+ */
+
+static pid_t				/* O - Process ID or -1 on error */
+start_program(const char *program,	/* I - Program to run */
+              const char *filename,	/* I - File to print or NULL */
+	      char       **envp,	/* I - Environment */
+	      int        jobid,		/* I - Job ID */
+              int        infd,		/* I - Standard input or -1 */
+	      int        outfd,		/* I - Standard output */
+	      int        bcfd,		/* I - Back-channel */
+	      int        errfd)		/* I - Standard error */
+{
+  pid_t		pid;			/* Process ID */
+  int		fd;			/* Looping var */
+  char		job[32],		/* Job ID string */
+		*args[8];		/* Arguments */
+
+
+  snprintf(job, sizeof(job), "%d", jobid);
+
+  args[0] = (char *)program;
+  args[1] = job;
+  args[2] = "stressbench";
+  args[3] = "stressbench";
+  args[4] = "1";
+  args[5] = "";
+  args[6] = (char *)filename;
+  args[7] = NULL;
+
+  if ((pid = fork()) < 0)
+  {
+    perror("stressbench: Unable to fork");
+    return (-1);
+  }
+  else if (pid > 0)
+    return (pid);
+
+ /*
+  * Child comes here...
+  */
+
+  if (infd < 0)
+    infd = open("/dev/null", O_RDONLY);
+
+  dup2(infd, 0);
+  dup2(outfd, 1);
+  dup2(errfd, 2);
+  dup2(bcfd, 3);
+
+  for (fd = 4; fd < 1024; fd ++)
+    close(fd);
+
+  execve(program, args, envp);
+
+  _exit(127);
+}
+
+
+/*
+ * 'usage()' - Show program usage and exit.
+ */
+
+static void
+usage(void)
+{
+  fputs("Usage: stressbench [options] corpus ...\n", stderr);
+  fputs("Options:\n", stderr);
+  fputs("  -B backend        Backend to use (default sampletopdf in bindir)\n", stderr);
+  fputs("  -b bindir         Directory with the filters (default .)\n", stderr);
+  fputs("  -c n,n,...        Concurrent jobs for each level (default 1,2,4,8,16)\n", stderr);
+  fputs("  -j jobs           Jobs per level (default 4 times concurrency)\n", stderr);
+  fputs("  -p prefix         Printer queue name prefix (default stress)\n", stderr);
+  fputs("  -q queues         Number of queues (default 4)\n", stderr);
+  fputs("  -v                Show filter and backend messages\n", stderr);
+
+  exit(1);
+}
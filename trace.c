@@ -0,0 +1,299 @@
+/*
+     File: trace.c 
+ Abstract: Stage timing for sample CUPS printer driver.
+  Version: 4.0 
+  
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple 
+ Inc. ("Apple") in consideration of your agreement to the following 
+ terms, and your use, installation, modification or redistribution of 
+ this Apple software constitutes acceptance of these terms.  If you do 
+ not agree with these terms, please do not use, install, modify or 
+ redistribute this Apple software. 
+  
+ In consideration of your agreement to abide by the following terms, and 
+ subject to these terms, Apple grants you a personal, non-exclusive 
+ license, under Apple's copyrights in this original Apple software (the 
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple 
+ Software, with or without modifications, in source and/or binary forms; 
+ provided that if you redistribute the Apple Software in its entirety and 
+ without modifications, you must retain this notice and the following 
+ text and disclaimers in all such redistributions of the Apple Software. 
+ Neither the name, trademarks, service marks or logos of Apple Inc. may 
+ be used to endorse or promote products derived from the Apple Software 
+ without specific prior written permission from Apple.  Except as 
+ expressly stated in this notice, no other rights or licenses, express or 
+ implied, are granted by Apple herein, including but not limited to any 
+ patent rights that may be infringed by your derivative works or by other 
+ works in which the Apple Software may be incorporated. 
+  
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE 
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION 
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS 
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND 
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS. 
+  
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL 
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, 
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED 
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), 
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE 
+ POSSIBILITY OF SUCH DAMAGE. 
+  
+ Copyright (C) 2011 Apple Inc. All Rights Reserved. 
+  
+ */  
+
+#include "trace.h"			/* Stage timing definitions */
+
+#ifdef ENABLE_TRACE
+#  include <stdio.h>
+#  include <stdlib.h>
+#  include <string.h>
+#  include <unistd.h>
+#  include <stdint.h>
+#  include <pthread.h>
+#  include <sys/time.h>
+
+
+/*
+ * Local globals...
+ */
+
+static pthread_mutex_t	trace_mutex = PTHREAD_MUTEX_INITIALIZER;
+					/* Lock for trace file */
+static FILE		*trace_fp = NULL;
+					/* Trace file */
+static int		trace_pid = 0;	/* Process ID */
+static pthread_key_t	trace_key;	/* Thread ID key */
+static int		trace_threads = 0;
+					/* Number of thread IDs handed out */
+
+
+/*
+ * Local functions...
+ */
+
+static long long	get_time(void);
+static int		get_thread(void);
+static void		trace_stop(void);
+static void		write_string(const char *s);
+
+
+/*
+ * 'TraceBegin()' - Start timing a stage.
+ */
+
+trace_scope_t				/* O - Scope for TraceEnd() */
+TraceBegin(const char *name,		/* I - Stage name */
+           const char *arg)		/* I - Detail for this event or NULL */
+{
+  trace_scope_t	scope;			/* Scope */
+
+
+  scope.name  = trace_fp ? name : NULL;
+  scope.arg   = arg;
+  scope.start = scope.name ? get_time() : 0;
+
+  return (scope);
+}
+
+
+/*
+ * 'TraceEnd()' - Finish timing a stage and write a complete event.
+ */
+
+void
+TraceEnd(trace_scope_t *scope)		/* I - Scope from TraceBegin() */
+{
+  long long	end;			/* End time */
+  int		tid;			/* Thread ID */
+
+
+  if (!scope->name)
+    return;
+
+  end = get_time();
+  tid = get_thread();
+
+  pthread_mutex_lock(&trace_mutex);
+
+  if (trace_fp)
+  {
+    fputs(",\n{\"name\":", trace_fp);
+    write_string(scope->name);
+    fprintf(trace_fp, ",\"ph\":\"X\",\"ts\":%lld,\"dur\":%lld,\"pid\":%d,\"tid\":%d",
+            scope->start, end - scope->start, trace_pid, tid);
+
+    if (scope->arg)
+    {
+      fputs(",\"args\":{\"detail\":", trace_fp);
+      write_string(scope->arg);
+      putc('}', trace_fp);
+    }
+
+    putc('}', trace_fp);
+  }
+
+  pthread_mutex_unlock(&trace_mutex);
+}
+
+
+/*
+ * 'TraceStart()' - Start writing a trace file if SAMPLE_TRACE is set.
+ *
+ * The file is finished when the process exits.
+ */
+
+int					/* O - 1 if tracing, 0 otherwise */
+TraceStart(const char *program,		/* I - Program name */
+           const char *job)		/* I - Job ID */
+{
+  const char	*dir;			/* Trace directory */
+  char		filename[1024];		/* Trace filename */
+
+
+  if ((dir = getenv("SAMPLE_TRACE")) == NULL || trace_fp)
+    return (trace_fp != NULL);
+
+  trace_pid = (int)getpid();
+
+  snprintf(filename, sizeof(filename), "%s/%s-%s-%d.json", dir, job, program,
+           trace_pid);
+
+  if (pthread_key_create(&trace_key, NULL) ||
+      (trace_fp = fopen(filename, "w")) == NULL)
+  {
+    fprintf(stderr, "DEBUG: Unable to create trace file \"%s\".\n", filename);
+    return (0);
+  }
+
+  setvbuf(trace_fp, NULL, _IOFBF, 65536);
+
+ /*
+  * Use the JSON array format, which doesn't need the closing bracket if the
+  * process dies.  Events after the first start with a comma...
+  */
+
+  fprintf(trace_fp, "[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":0,\"args\":{\"name\":", trace_pid);
+  write_string(program);
+  fputs("}}", trace_fp);
+
+  TraceThread("main");
+
+  atexit(trace_stop);
+
+  return (1);
+}
+
+
+/*
+ * 'TraceThread()' - Name the current thread in the trace.
+ */
+
+void
+TraceThread(const char *name)		/* I - Thread name */
+{
+  int	tid;				/* Thread ID */
+
+
+  if (!trace_fp)
+    return;
+
+  tid = get_thread();
+
+  pthread_mutex_lock(&trace_mutex);
+
+  if (trace_fp)
+  {
+    fprintf(trace_fp, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":", trace_pid, tid);
+    write_string(name);
+    fputs("}}", trace_fp);
+  }
+
+  pthread_mutex_unlock(&trace_mutex);
+}
+
+
+/*
+ * 'get_time()' - Get the current time in microseconds.
+ *
+ * The wall clock is used so that events from different processes line up.
+ */
+
+static long long			/* O - Time in microseconds */
+get_time(void)
+{
+  struct timeval	curtime;	/* Current time */
+
+
+  gettimeofday(&curtime, NULL);
+
+  return ((long long)curtime.tv_sec * 1000000 + curtime.tv_usec);
+}
+
+
+/*
+ * 'get_thread()' - Get a small ID number for the current thread.
+ */
+
+static int				/* O - Thread ID */
+get_thread(void)
+{
+  int	tid;				/* Thread ID */
+
+
+  if ((tid = (int)(intptr_t)pthread_getspecific(trace_key)) == 0)
+  {
+    tid = __sync_add_and_fetch(&trace_threads, 1);
+    pthread_setspecific(trace_key, (void *)(intptr_t)tid);
+  }
+
+  return (tid);
+}
+
+
+/*
+ * 'trace_stop()' - Finish the trace file.
+ */
+
+static void
+trace_stop(void)
+{
+  pthread_mutex_lock(&trace_mutex);
+
+  if (trace_fp)
+  {
+    fputs("\n]\n", trace_fp);
+    fclose(trace_fp);
+    trace_fp = NULL;
+  }
+
+  pthread_mutex_unlock(&trace_mutex);
+}
+
+
+/*
+ * 'write_string()' - Write a quoted JSON string.
+ */
+
+static void
+write_string(const char *s)		/* I - String */
+{
+  putc('\"', trace_fp);
+
+  for (; *s; s ++)
+  {
+    if (*s == '\"' || *s == '\\')
+      putc('\\', trace_fp);
+
+    if ((*s & 255) < ' ')
+      putc(' ', trace_fp);
+    else
+      putc(*s, trace_fp);
+  }
+
+  putc('\"', trace_fp);
+}
+#endif /* ENABLE_TRACE */
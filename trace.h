@@ -0,0 +1,92 @@
+/*
+     File: trace.h 
+ Abstract: Stage timing definitions for sample CUPS printer driver.
+  Version: 4.0 
+  
+ Disclaimer: IMPORTANT:  This Apple software is supplied to you by Apple 
+ Inc. ("Apple") in consideration of your agreement to the following 
+ terms, and your use, installation, modification or redistribution of 
+ this Apple software constitutes acceptance of these terms.  If you do 
+ not agree with these terms, please do not use, install, modify or 
+ redistribute this Apple software. 
+  
+ In consideration of your agreement to abide by the following terms, and 
+ subject to these terms, Apple grants you a personal, non-exclusive 
+ license, under Apple's copyrights in this original Apple software (the 
+ "Apple Software"), to use, reproduce, modify and redistribute the Apple 
+ Software, with or without modifications, in source and/or binary forms; 
+ provided that if you redistribute the Apple Software in its entirety and 
+ without modifications, you must retain this notice and the following 
+ text and disclaimers in all such redistributions of the Apple Software. 
+ Neither the name, trademarks, service marks or logos of Apple Inc. may 
+ be used to endorse or promote products derived from the Apple Software 
+ without specific prior written permission from Apple.  Except as 
+ expressly stated in this notice, no other rights or licenses, express or 
+ implied, are granted by Apple herein, including but not limited to any 
+ patent rights that may be infringed by your derivative works or by other 
+ works in which the Apple Software may be incorporated. 
+  
+ The Apple Software is provided by Apple on an "AS IS" basis.  APPLE 
+ MAKES NO WARRANTIES, EXPRESS OR IMPLIED, INCLUDING WITHOUT LIMITATION 
+ THE IMPLIED WARRANTIES OF NON-INFRINGEMENT, MERCHANTABILITY AND FITNESS 
+ FOR A PARTICULAR PURPOSE, REGARDING THE APPLE SOFTWARE OR ITS USE AND 
+ OPERATION ALONE OR IN COMBINATION WITH YOUR PRODUCTS. 
+  
+ IN NO EVENT SHALL APPLE BE LIABLE FOR ANY SPECIAL, INDIRECT, INCIDENTAL 
+ OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ INTERRUPTION) ARISING IN ANY WAY OUT OF THE USE, REPRODUCTION, 
+ MODIFICATION AND/OR DISTRIBUTION OF THE APPLE SOFTWARE, HOWEVER CAUSED 
+ AND WHETHER UNDER THEORY OF CONTRACT, TORT (INCLUDING NEGLIGENCE), 
+ STRICT LIABILITY OR OTHERWISE, EVEN IF APPLE HAS BEEN ADVISED OF THE 
+ POSSIBILITY OF SUCH DAMAGE. 
+  
+ Copyright (C) 2011 Apple Inc. All Rights Reserved. 
+  
+ */  
+
+#ifndef _SAMPLE_TRACE_H_
+#  define _SAMPLE_TRACE_H_
+
+/*
+ * Stage timing...
+ *
+ * TRACE_SCOPE() times the rest of the enclosing block.  When the driver is
+ * built with ENABLE_TRACE and the SAMPLE_TRACE environment variable names a
+ * directory, each process writes its timings to a Chrome trace-event file,
+ * "<job>-<program>-<pid>.json", in that directory.  The files use the same
+ * clock and different process IDs, so the filter and backend for a job can
+ * be loaded together in chrome://tracing or Perfetto.
+ *
+ * Without ENABLE_TRACE the macros compile to nothing.
+ */
+
+#  ifdef ENABLE_TRACE
+typedef struct
+{
+  const char	*name;			/* Stage name or NULL if not tracing */
+  const char	*arg;			/* Detail for this event or NULL */
+  long long	start;			/* Start time in microseconds */
+} trace_scope_t;
+
+#    define TRACE_CONCAT(a,b)		a ## b
+#    define TRACE_VAR(line)		TRACE_CONCAT(trace_scope_, line)
+#    define TRACE_SCOPE(name)		TRACE_SCOPE_ARG(name, NULL)
+#    define TRACE_SCOPE_ARG(name,arg)	trace_scope_t TRACE_VAR(__LINE__) \
+					  __attribute__((cleanup(TraceEnd))) = \
+					  TraceBegin(name, arg)
+#    define TRACE_START(program,job)	TraceStart(program, job)
+#    define TRACE_THREAD(name)		TraceThread(name)
+
+extern trace_scope_t	TraceBegin(const char *name, const char *arg);
+extern void		TraceEnd(trace_scope_t *scope);
+extern int		TraceStart(const char *program, const char *job);
+extern void		TraceThread(const char *name);
+#  else
+#    define TRACE_SCOPE(name)
+#    define TRACE_SCOPE_ARG(name,arg)
+#    define TRACE_START(program,job)
+#    define TRACE_THREAD(name)
+#  endif /* ENABLE_TRACE */
+
+#endif /* !_SAMPLE_TRACE_H_ */